@@ -0,0 +1,1550 @@
+/* bench_loader.c -- host benchmark for the .so loading phases
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+#include <kubridge.h>
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../loader/so_util.h"
+#include "../loader/prelink.h"
+#include "../loader/intrinsics.h"
+#include "../loader/deps.h"
+#include "../loader/snapshot.h"
+#include "../loader/tls.h"
+#include "../loader/probes.h"
+#include "../loader/workers.h"
+#include "bench_util.h"
+#include "synth_elf.h"
+
+#define DEFAULT_DYNLIB_SIZE 575
+#define MAX_HOOKS 160 // about what patch_game installs
+#define ARENA_BLOB 256
+#define DEFAULT_IO_RATE 20 // MB/s, about what a memory card sustains
+#define ARENA_FILL (3 * 0x10000 / ARENA_BLOB) // enough to outgrow the patch arena twice
+#define RECLAIM_NAMES 2000 // exports looked up again once reclaimed, per module
+#define TLS_THREADS 4
+#define TLS_CALLS 4000000 // accesses timed per way to reach a variable
+#define TRACE_LEFT 1000 // calls left by longjmp, more than the shadow stack holds
+#define PROBE_CALLS 1000000 // probed calls timed, entry and exit
+
+enum {
+	PHASE_LOAD_WHOLE,
+	PHASE_LOAD,
+	PHASE_RELOCATE,
+	PHASE_RESOLVE,
+	PHASE_LINK,
+	PHASE_PRELINK,
+	PHASE_WARM_LINK,
+	PHASE_STATIC,
+	PHASE_STATIC_LINK,
+	PHASE_LAZY_LINK,
+	PHASE_LAZY_BIND,
+	PHASE_HOOK,
+	PHASE_HOOK_BATCH,
+	PHASE_TRACED_LINK,
+	PHASE_ARENA,
+	PHASE_INTRINSICS,
+	PHASE_HIT_SYMTAB,
+	PHASE_MISS_SYMTAB,
+	PHASE_HIT_GNU,
+	PHASE_MISS_GNU,
+	PHASE_HIT_SYSV,
+	PHASE_MISS_SYSV,
+	PHASE_HIT_SCAN,
+	PHASE_MISS_SCAN,
+	PHASE_LIST_SYMTAB,
+	PHASE_BATCH_SYMTAB,
+	PHASE_LIST_SCAN,
+	PHASE_BATCH_SCAN,
+	PHASE_NUM
+};
+
+enum {
+	MODE_SPLIT,
+	MODE_LINK,
+	MODE_PRELINKED,
+	MODE_STATIC,
+	MODE_LAZY,
+	MODE_NUM
+};
+
+static const char *phase_names[PHASE_NUM] = { "load whole", "load", "relocate", "resolve", "link", "prelink", "link warm", "static", "link static", "link lazy", "bind lazy", "hook", "hook batch", "link trace", "arena grow", "intrinsics",
+	"hit symtab", "miss symtab", "hit gnu", "miss gnu", "hit sysv", "miss sysv", "hit scan", "miss scan",
+	"list symtab", "batch symtab", "list scan", "batch scan" };
+
+static so_module mods[MAX_FIXTURES];
+static bench_phase phases[MAX_FIXTURES][PHASE_NUM];
+static so_link_stats link_stats[MAX_FIXTURES];
+static so_link_stats lazy_stats[MAX_FIXTURES];
+static uint32_t image_sum[MODE_NUM][MAX_FIXTURES];
+static uint32_t loaded_sum[2][MAX_FIXTURES];
+static uint32_t hooked_sum[2][MAX_FIXTURES];
+static int traced_bad[MAX_FIXTURES];
+static int arena_bad[MAX_FIXTURES];
+static int batch_bad[MAX_FIXTURES];
+static int intrinsics_bad[MAX_FIXTURES];
+static so_arena_stats arena_stats[MAX_FIXTURES];
+static char cache_path[MAX_FIXTURES][512];
+static prelink_table static_table[MAX_FIXTURES]; // what bindgen would emit, built in memory
+static bench_phase threaded[MAX_FIXTURES][MAX_WORKERS + 1];
+static char threaded_names[MAX_WORKERS + 1][16];
+static uint32_t threaded_sum[MAX_WORKERS + 1][MAX_FIXTURES];
+static const int pack_flags[3] = { SYNTH_PACK_APS2, SYNTH_PACK_RELR, SYNTH_PACK_APS2 | SYNTH_PACK_RELR };
+static bench_phase packed[MAX_FIXTURES][3][2] = {
+	[0 ... MAX_FIXTURES - 1] = {
+		{ { .name = "load aps2" }, { .name = "link aps2" } },
+		{ { .name = "load relr" }, { .name = "link relr" } },
+		{ { .name = "load packed" }, { .name = "link packed" } },
+	}
+};
+static uint32_t packed_sum[3][MAX_FIXTURES];
+static uint32_t packed_split_sum[MAX_FIXTURES];
+static uint32_t plain_slots_sum[MAX_FIXTURES];
+static size_t reloc_bytes[4][MAX_FIXTURES];
+static bench_phase boot[6] = { { .name = "boot serial" }, { .name = "boot piped" }, { .name = "boot graph" }, { .name = "boot save" }, { .name = "boot snapshot" },
+	{ .name = "reclaim" } };
+static int graph_bad = 0;
+static int snapshot_bad = 0;
+static int reclaim_bad = 0;
+static int init_bad = 0;
+static int init_order[4], init_calls;
+static so_reclaim_stats reclaim_stats[MAX_FIXTURES];
+static int tls_bad = 0;
+static double tls_ns[4];
+static uintptr_t tls_first[TLS_THREADS];
+static pthread_barrier_t tls_barrier;
+static __thread uint32_t tls_native;
+static int probes_bad = 0;
+static double probes_ns;
+static int graph_dynlib_size;
+static snapshot graph_snapshot;
+static char graph_dir[512];
+static uint32_t boot_sum[2][MAX_FIXTURES];
+static uint64_t boot_hidden_us;
+
+static void usage(const char *argv0) {
+	printf("usage: %s [-n iterations] [-j threads] [-r rate] [module.so ...]\n", argv0);
+	printf("Modules are loaded in the given order, dependencies first (e.g. libc++_shared.so libHumanResourceMachine.so).\n");
+	printf("Without modules, a synthetic pair shaped like the game's is generated and used.\n");
+	printf("so_link is also timed with 1 to threads workers (default %d).\n", MAX_WORKERS / 2);
+	printf("The boot sequence is timed with file reads throttled to rate MB/s (default %d, 0 for none).\n", DEFAULT_IO_RATE);
+}
+
+static void load_all(bench_fixtures *f) {
+	for (int m = 0; m < f->num; m++) {
+		if (so_file_load(&mods[m], f->path[m], f->load_addr[m]) < 0) {
+			fprintf(stderr, "Error could not load %s.\n", f->path[m]);
+			exit(1);
+		}
+	}
+}
+
+static void unload_all(bench_fixtures *f) {
+	for (int m = f->num - 1; m >= 0; m--)
+		so_unload(&mods[m]);
+}
+
+static uint32_t checksum(uint32_t sum, uintptr_t base, size_t size) {
+	uint32_t *words = (uint32_t *)base;
+	for (size_t j = 0; j < size / 4; j++)
+		sum = (sum << 5 | sum >> 27) ^ words[j];
+	return sum;
+}
+
+static uint32_t data_checksum(so_module *mod) {
+	uint32_t sum = 0;
+	for (int i = 0; i < mod->n_data; i++)
+		sum = checksum(sum, mod->data_base[i], mod->data_size[i]);
+	return sum;
+}
+
+// The data segments minus .dynamic, which differs with how relocations are encoded
+static uint32_t slots_checksum(so_module *mod) {
+	uintptr_t dyn_start = (uintptr_t)mod->dynamic, dyn_end = dyn_start + mod->num_dynamic * sizeof(Elf32_Dyn);
+	uint32_t sum = 0;
+	for (int i = 0; i < mod->n_data; i++) {
+		uintptr_t start = mod->data_base[i], end = start + mod->data_size[i];
+		if (dyn_start >= start && dyn_end <= end) {
+			sum = checksum(sum, start, dyn_start - start);
+			sum = checksum(sum, dyn_end, end - dyn_end);
+		} else {
+			sum = checksum(sum, start, end - start);
+		}
+	}
+	return sum;
+}
+
+static uint32_t image_checksum(so_module *mod) {
+	// The block loader rebases the program headers before copying them along
+	// with .text, the streaming one keeps them as they are in the file
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)mod->text_base;
+	size_t skip = 0;
+	if (memcmp(ehdr->e_ident, ELFMAG, SELFMAG) == 0)
+		skip = ALIGN_MEM(ehdr->e_phoff + ehdr->e_phnum * sizeof(Elf32_Phdr), 4);
+	return checksum(data_checksum(mod), mod->text_base + skip, mod->text_size - skip);
+}
+
+// Reading the whole file into a block first, as the loader used to
+static void run_load_whole(bench_fixtures *f) {
+	bench_mark mark;
+
+	for (int m = 0; m < f->num; m++) {
+		shim_reset_peaks();
+		bench_begin(&mark);
+		if (so_file_load_whole(&mods[m], f->path[m], f->load_addr[m]) < 0) {
+			fprintf(stderr, "Error could not load %s.\n", f->path[m]);
+			exit(1);
+		}
+		bench_end(&mark, &phases[m][PHASE_LOAD_WHOLE]);
+		loaded_sum[0][m] = image_checksum(&mods[m]);
+	}
+
+	unload_all(f);
+}
+
+// Looks up exported names and the module's own imports (which it cannot
+// provide, as when so_resolve_link probes it) through the loader-wide
+// symbol table and then each table the module has
+static void run_lookups(so_module *mod, bench_phase *phases) {
+	uint32_t *gnu_hash = mod->gnu_hash, *hash = mod->hash;
+	int interned = mod->interned;
+	int num_exports = 0;
+	for (int i = 1; i < mod->num_dynsym; i++)
+		if (mod->dynsym[i].st_shndx != SHN_UNDEF)
+			num_exports++;
+	int stride = num_exports > 2000 ? num_exports / 2000 : 1;
+	bench_mark mark;
+
+	for (int table = 0; table < 4; table++) {
+		mod->interned = table == 0 ? interned : 0;
+		mod->gnu_hash = table <= 1 ? gnu_hash : NULL;
+		mod->hash = table <= 2 ? hash : NULL;
+		if ((table == 0 && !interned) || (table == 1 && !gnu_hash) || (table == 2 && !hash))
+			continue;
+
+		bench_begin(&mark);
+		for (int i = 1, n = 0; i < mod->num_dynsym; i++) {
+			Elf32_Sym *sym = &mod->dynsym[i];
+			if (sym->st_shndx == SHN_UNDEF || n++ % stride)
+				continue;
+			if (!so_symbol(mod, mod->dynstr + sym->st_name)) {
+				fprintf(stderr, "Error lookup of %s failed.\n", mod->dynstr + sym->st_name);
+				exit(1);
+			}
+		}
+		bench_end(&mark, &phases[PHASE_HIT_SYMTAB + table * 2]);
+
+		bench_begin(&mark);
+		for (int i = 1; i < mod->num_dynsym; i++) {
+			Elf32_Sym *sym = &mod->dynsym[i];
+			if (sym->st_shndx != SHN_UNDEF)
+				continue;
+			if (so_symbol(mod, mod->dynstr + sym->st_name)) {
+				fprintf(stderr, "Error lookup of %s should have failed.\n", mod->dynstr + sym->st_name);
+				exit(1);
+			}
+		}
+		bench_end(&mark, &phases[PHASE_MISS_SYMTAB + table * 2]);
+	}
+
+	mod->interned = interned;
+	mod->gnu_hash = gnu_hash;
+	mod->hash = hash;
+}
+
+// Resolves a patch_game sized list of names (a few of them missing) one
+// so_symbol call at a time and through so_symbols_lookup, with the symbol
+// table and with the plain .dynsym scan that batching replaces
+static void run_batch_lookups(so_module *mod, bench_phase *phases, int *bad) {
+	const char *names[MAX_HOOKS];
+	uintptr_t single[MAX_HOOKS], batch[MAX_HOOKS];
+	uint32_t *gnu_hash = mod->gnu_hash, *hash = mod->hash;
+	int interned = mod->interned;
+	int num_exports = 0, num = 0;
+	bench_mark mark;
+
+	for (int i = 1; i < mod->num_dynsym; i++)
+		if (mod->dynsym[i].st_shndx != SHN_UNDEF)
+			num_exports++;
+	int num_hits = MAX_HOOKS - MAX_HOOKS / 16;
+	int stride = num_exports > num_hits ? num_exports / num_hits : 1;
+	for (int i = 1, n = 0; i < mod->num_dynsym && num < num_hits; i++) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx != SHN_UNDEF && n++ % stride == 0)
+			names[num++] = mod->dynstr + sym->st_name;
+	}
+	for (int i = 1; i < mod->num_dynsym && num < MAX_HOOKS; i++)
+		if (mod->dynsym[i].st_shndx == SHN_UNDEF)
+			names[num++] = mod->dynstr + mod->dynsym[i].st_name;
+
+	for (int scan = 0; scan < 2; scan++) {
+		mod->interned = scan ? 0 : interned;
+		mod->gnu_hash = scan ? NULL : gnu_hash;
+		mod->hash = scan ? NULL : hash;
+
+		bench_begin(&mark);
+		for (int i = 0; i < num; i++)
+			single[i] = so_symbol(mod, names[i]);
+		bench_end(&mark, &phases[scan ? PHASE_LIST_SCAN : PHASE_LIST_SYMTAB]);
+
+		bench_begin(&mark);
+		so_symbols_lookup(mod, names, batch, num);
+		bench_end(&mark, &phases[scan ? PHASE_BATCH_SCAN : PHASE_BATCH_SYMTAB]);
+
+		for (int i = 0; i < num; i++)
+			if (single[i] != batch[i])
+				(*bad)++;
+	}
+
+	mod->interned = interned;
+	mod->gnu_hash = gnu_hash;
+	mod->hash = hash;
+}
+
+// Hooks functions of the module one call at a time followed by a full .text
+// flush, as patch_game used to, or through a single transaction
+static void run_hooks(so_module *mod, int batched, bench_phase *phase) {
+	uintptr_t addrs[MAX_HOOKS];
+	int num = 0;
+	bench_mark mark;
+
+	// Exports far enough apart for their patches not to overlap
+	uintptr_t last = 0;
+	for (int i = 1; i < mod->num_dynsym && num < MAX_HOOKS; i++) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx == SHN_UNDEF || ELF32_ST_TYPE(sym->st_info) != STT_FUNC)
+			continue;
+		uintptr_t addr = mod->text_base + sym->st_value;
+		if (addr >= last + 0x10) {
+			addrs[num++] = addr;
+			last = addr;
+		}
+	}
+
+	bench_begin(&mark);
+	if (batched) {
+		so_hook_batch hooks;
+		hook_begin(&hooks);
+		for (int i = 0; i < num; i++)
+			hook_queue(&hooks, addrs[i], (uintptr_t)&run_hooks, NULL);
+		if (hook_commit(&hooks) != num) {
+			fprintf(stderr, "Error could not commit %d hooks.\n", num);
+			exit(1);
+		}
+	} else {
+		for (int i = 0; i < num; i++)
+			hook_addr(addrs[i], (uintptr_t)&run_hooks);
+		so_flush_caches(mod);
+	}
+	bench_end(&mark, phase);
+}
+
+// Fills the arenas past the patch block and the cave with code blobs, half of
+// them required near .text, then branches to a target beyond B range
+static void run_arena(so_module *mod, bench_phase *phase, int *bad) {
+	uint32_t blob[ARENA_BLOB / 4];
+	uintptr_t addrs[ARENA_FILL];
+	bench_mark mark;
+
+	bench_begin(&mark);
+	for (int i = 0; i < ARENA_FILL; i++) {
+		for (int j = 0; j < ARENA_BLOB / 4; j++)
+			blob[j] = i * 0x10000 + j;
+		addrs[i] = so_arena_write(mod, (i & 1) ? mod->text_base : 0, blob, sizeof(blob));
+	}
+	uintptr_t far = mod->text_base + 0x4000000;
+	uintptr_t veneer = so_arena_branch(mod, mod->text_base, far);
+	bench_end(&mark, phase);
+
+	for (int i = 0; i < ARENA_FILL; i++) {
+		uint32_t *words = (uint32_t *)addrs[i];
+		if (!words || words[0] != i * 0x10000 || words[ARENA_BLOB / 4 - 1] != i * 0x10000 + ARENA_BLOB / 4 - 1)
+			(*bad)++;
+	}
+	if (!veneer || veneer == far || ((uint32_t *)veneer)[1] != (uint32_t)far)
+		(*bad)++;
+}
+
+static size_t plain_strlen(const char *s) {
+	size_t len = 0;
+	while (s[len])
+		len++;
+	return len;
+}
+
+static float plain_sinf(float x) {
+	return (float)sin(x);
+}
+
+// Substitutes three exports of the module: one by name, one by a signature
+// planted in it under a name it does not have, and one whose signature
+// differs from the expected one, which has to be left alone
+static void run_intrinsics(so_module *mod, bench_phase *phase, int *bad) {
+	static const uint32_t planted = 0x12345678;
+	uintptr_t addrs[3];
+	const char *names[3];
+	int num = 0;
+	bench_mark mark;
+
+	// The last exports, far enough apart for their patches not to overlap
+	uintptr_t last = 0;
+	for (int i = mod->num_dynsym - 1; i > 0 && num < 3; i--) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx == SHN_UNDEF || ELF32_ST_TYPE(sym->st_info) != STT_FUNC)
+			continue;
+		uintptr_t addr = mod->text_base + sym->st_value;
+		if (!last || addr + 0x10 <= last) {
+			names[num] = mod->dynstr + sym->st_name;
+			addrs[num++] = addr;
+			last = addr;
+		}
+	}
+	if (num < 3)
+		return;
+	kuKernelCpuUnrestrictedMemcpy((void *)addrs[1], &planted, sizeof(planted));
+
+	intrinsic table[] = {
+		{ names[0], INTRINSIC_STRLEN, (uintptr_t)&plain_strlen, NULL },
+		{ "not_exported", INTRINSIC_STRLEN, (uintptr_t)&plain_strlen, "78 ?? 34 12" },
+		{ names[2], INTRINSIC_STRLEN, (uintptr_t)&plain_strlen, "78 56 34 12" },
+		{ names[1], INTRINSIC_STRLEN, (uintptr_t)&plain_strlen, NULL }, // not enabled
+	};
+	intrinsic_result results[4];
+	char enable[256];
+	snprintf(enable, sizeof(enable), "%s not_exported %s", names[0], names[2]);
+
+	bench_begin(&mark);
+	int res = intrinsics_apply(mod, table, 4, enable, 0, results);
+	bench_end(&mark, phase);
+
+	if (res != 2 || results[0].addr != addrs[0] || results[0].by_signature ||
+		results[1].addr != addrs[1] || !results[1].by_signature ||
+		results[2].addr || !results[2].rejected || results[3].addr)
+		(*bad)++;
+}
+
+static void run_iteration(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size, int mode) {
+	bench_mark mark;
+
+	for (int m = 0; m < f->num; m++) {
+		shim_reset_peaks();
+		bench_begin(&mark);
+		if (so_file_load(&mods[m], f->path[m], f->load_addr[m]) < 0) {
+			fprintf(stderr, "Error could not load %s.\n", f->path[m]);
+			exit(1);
+		}
+		bench_end(&mark, &phases[m][PHASE_LOAD]);
+		loaded_sum[1][m] = image_checksum(&mods[m]);
+
+		switch (mode) {
+		case MODE_SPLIT:
+			bench_begin(&mark);
+			so_relocate(&mods[m]);
+			bench_end(&mark, &phases[m][PHASE_RELOCATE]);
+
+			bench_begin(&mark);
+			so_resolve(&mods[m], dynlib, dynlib_size, 0);
+			bench_end(&mark, &phases[m][PHASE_RESOLVE]);
+			break;
+		case MODE_LINK:
+			bench_begin(&mark);
+			so_link(&mods[m], dynlib, dynlib_size, 0);
+			bench_end(&mark, &phases[m][PHASE_LINK]);
+			link_stats[m] = mods[m].link_stats;
+			so_prelink_save(&mods[m], cache_path[m], dynlib, dynlib_size);
+			so_prelink_table_free(&static_table[m]);
+			so_prelink_table_build(&mods[m], dynlib, dynlib_size, &static_table[m]);
+			break;
+		case MODE_PRELINKED:
+			bench_begin(&mark);
+			if (so_prelink_load(&mods[m], cache_path[m], dynlib, dynlib_size) < 0) {
+				fprintf(stderr, "Error could not load the prelink cache of %s.\n", f->label[m]);
+				exit(1);
+			}
+			bench_end(&mark, &phases[m][PHASE_PRELINK]);
+
+			bench_begin(&mark);
+			so_link(&mods[m], dynlib, dynlib_size, 0);
+			bench_end(&mark, &phases[m][PHASE_WARM_LINK]);
+			break;
+		case MODE_STATIC:
+			bench_begin(&mark);
+			if (so_prelink_table_apply(&mods[m], &static_table[m], dynlib, dynlib_size) < 0) {
+				fprintf(stderr, "Error the static bindings of %s were rejected.\n", f->label[m]);
+				exit(1);
+			}
+			bench_end(&mark, &phases[m][PHASE_STATIC]);
+
+			bench_begin(&mark);
+			so_link(&mods[m], dynlib, dynlib_size, 0);
+			bench_end(&mark, &phases[m][PHASE_STATIC_LINK]);
+			break;
+		case MODE_LAZY:
+			bench_begin(&mark);
+			so_link_lazy(&mods[m], dynlib, dynlib_size, 0);
+			bench_end(&mark, &phases[m][PHASE_LAZY_LINK]);
+
+			// As if every deferred function got called once
+			bench_begin(&mark);
+			for (int i = 0; i < mods[m].num_relplt; i++) {
+				uintptr_t slot = mods[m].text_base + mods[m].relplt[i].r_offset;
+				if (*(Elf32_Addr *)slot == mods[m].lazy_stub)
+					so_lazy_bind(&mods[m], slot);
+			}
+			bench_end(&mark, &phases[m][PHASE_LAZY_BIND]);
+			lazy_stats[m] = mods[m].link_stats;
+			break;
+		}
+		image_sum[mode][m] = data_checksum(&mods[m]);
+		if (mode == MODE_SPLIT)
+			plain_slots_sum[m] = slots_checksum(&mods[m]);
+
+		if (mode == MODE_LINK) {
+			run_lookups(&mods[m], phases[m]);
+			run_batch_lookups(&mods[m], phases[m], &batch_bad[m]);
+		}
+		if (mode == MODE_LINK || mode == MODE_PRELINKED) {
+			int batched = mode == MODE_PRELINKED;
+			run_hooks(&mods[m], batched, &phases[m][batched ? PHASE_HOOK_BATCH : PHASE_HOOK]);
+			hooked_sum[batched][m] = image_checksum(&mods[m]);
+		}
+		if (mode == MODE_LINK) {
+			run_arena(&mods[m], &phases[m][PHASE_ARENA], &arena_bad[m]);
+			arena_stats[m] = mods[m].arena_stats;
+			run_intrinsics(&mods[m], &phases[m][PHASE_INTRINSICS], &intrinsics_bad[m]);
+		}
+	}
+
+	unload_all(f);
+}
+
+// The fused pass again, with the relocations split across worker threads
+static void run_threaded(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size, int threads) {
+	bench_mark mark;
+
+	for (int m = 0; m < f->num; m++) {
+		if (so_file_load(&mods[m], f->path[m], f->load_addr[m]) < 0) {
+			fprintf(stderr, "Error could not load %s.\n", f->path[m]);
+			exit(1);
+		}
+		mods[m].link_threads = threads;
+
+		bench_begin(&mark);
+		so_link(&mods[m], dynlib, dynlib_size, 0);
+		bench_end(&mark, &threaded[m][threads]);
+		threaded_sum[threads][m] = data_checksum(&mods[m]);
+	}
+
+	unload_all(f);
+}
+
+// The fused pass with default_dynlib imports bound through timing thunks,
+// every such slot must point at the thunk of its entry
+static void run_traced(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size) {
+	bench_mark mark;
+
+	so_trace_imports(SO_TRACE_TIME);
+	for (int m = 0; m < f->num; m++) {
+		if (so_file_load(&mods[m], f->path[m], f->load_addr[m]) < 0) {
+			fprintf(stderr, "Error could not load %s.\n", f->path[m]);
+			exit(1);
+		}
+
+		bench_begin(&mark);
+		so_link(&mods[m], dynlib, dynlib_size, 0);
+		bench_end(&mark, &phases[m][PHASE_TRACED_LINK]);
+
+		so_module *mod = &mods[m];
+		for (int i = 0; i < mod->num_reldyn + mod->num_relplt; i++) {
+			Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
+			so_binding *b = NULL;
+			for (int j = 0; j < mod->num_bindings && !b; j++)
+				if (mod->bindings[j].sym == ELF32_R_SYM(rel->r_info))
+					b = &mod->bindings[j];
+			if (!b || b->kind != SO_BIND_DYNLIB || ELF32_R_TYPE(rel->r_info) == R_ARM_ABS32)
+				continue;
+			uintptr_t thunk = so_dynlib_target(dynlib, dynlib_size, b->index);
+			so_trace_import *imp = so_trace_get(dynlib, dynlib_size, b->index);
+			if (*(Elf32_Addr *)(mod->text_base + rel->r_offset) != thunk ||
+				(imp ? imp->thunk != thunk || imp->site.target != dynlib[b->index].func ||
+					((uint32_t *)thunk)[SO_SHADOW_THUNK_SITE / 4] != (uint32_t)(uintptr_t)&imp->site : thunk != dynlib[b->index].func))
+				traced_bad[m]++;
+		}
+	}
+
+	// Imports that never return are bound directly
+	static so_default_dynlib direct[] = { { "strlen", 0x1000 }, { "longjmp", 0x2000 } }; // one traced, one not
+	so_dynlib_prepare(direct, sizeof(direct));
+	if (so_dynlib_target(direct, sizeof(direct), 0) == 0x1000 || so_dynlib_target(direct, sizeof(direct), 1) != 0x2000)
+		traced_bad[f->num - 1]++;
+
+	// Calls left without returning must not pile up, nor be taken for the
+	// caller of one they tail called
+	so_shadow_site *site = &so_trace_get(direct, sizeof(direct), 0)->site;
+	uint32_t calls = site->calls;
+	for (int i = 0; i < TRACE_LEFT; i++)
+		so_shadow_enter(site, 0x100 + i, 0x8000, 0x10);
+	so_shadow_enter(site, 0x20, 0x7000, 0x30);
+	so_shadow_enter(site, 0x30, 0x7000, 0x40); // tail called
+	so_shadow_enter(site, 0x50, 0x6000, 0x60); // left by longjmp
+	if (so_shadow_leave(0x7000) != 0x30 || so_shadow_leave(0x7000) != 0x20 ||
+		so_shadow_leave(0x8000) != 0x100 + TRACE_LEFT - 1 || site->calls != calls + TRACE_LEFT + 3)
+		traced_bad[f->num - 1]++;
+	so_trace_imports(SO_TRACE_OFF);
+
+	unload_all(f);
+}
+
+// The boot sequence of main: each module is loaded and linked before the next
+// one, or read on the background loader while the previous ones are linked
+static void run_boot(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size, int pipelined) {
+	bench_mark mark;
+
+	bench_begin(&mark);
+	if (pipelined) {
+		for (int m = 0; m < f->num; m++)
+			so_load_queue(&mods[m], f->path[m], f->load_addr[m]);
+		so_load_start();
+	}
+	for (int m = 0; m < f->num; m++) {
+		int res = pipelined ? so_load_wait(&mods[m]) : so_file_load(&mods[m], f->path[m], f->load_addr[m]);
+		if (res < 0) {
+			fprintf(stderr, "Error could not load %s.\n", f->path[m]);
+			exit(1);
+		}
+		so_link(&mods[m], dynlib, dynlib_size, 0);
+	}
+	bench_end(&mark, &boot[pipelined]);
+
+	for (int m = 0; m < f->num; m++) {
+		boot_sum[pipelined][m] = data_checksum(&mods[m]);
+		if (pipelined)
+			boot_hidden_us += mods[m].load_us - (mods[m].wait_us < mods[m].load_us ? mods[m].wait_us : mods[m].load_us);
+	}
+
+	unload_all(f);
+}
+
+static void init_first(void) { init_order[init_calls++] = 0; }
+static void init_slow(void) { init_order[init_calls++] = 1; usleep(2000); }
+static void init_third(void) { init_order[init_calls++] = 2; }
+static void init_last(void) { init_order[init_calls++] = 3; }
+
+// Constructors standing in for the root's: the second and the last one are
+// deferred by name and must run after the others, still in their order, and
+// each one gets timed. Exports inside the module are found back by address.
+static void check_inits(so_module *mod) {
+	static int (*inits[4])(void) = { (void *)init_first, (void *)init_slow, (void *)init_third, (void *)init_last };
+	static const int expected[4] = { 0, 2, 1, 3 };
+	char deferred[128], name[64];
+
+	for (int i = 1; i < mod->num_dynsym; i++) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx == SHN_UNDEF || ELF32_ST_TYPE(sym->st_info) != STT_FUNC)
+			continue;
+		uintptr_t addr = mod->text_base + (sym->st_value & ~1) + 2, offset;
+		const char *found = so_function_at(mod, addr, &offset);
+		if (!found || (so_symbol(mod, found) & ~1) != addr - offset)
+			init_bad++;
+		break;
+	}
+	if (so_function_at(mod, mod->text_base - 4, NULL))
+		init_bad++;
+
+	int (**init_array)(void) = mod->init_array;
+	int num_init_array = mod->num_init_array;
+	mod->init_array = inits;
+	mod->num_init_array = 4;
+	init_calls = 0;
+
+	so_init_name(mod, 1, deferred, sizeof(deferred));
+	so_init_name(mod, 3, name, sizeof(name));
+	snprintf(deferred + strlen(deferred), sizeof(deferred) - strlen(deferred), " %s", name);
+	if (so_initialize_defer(mod, deferred) != 2 || init_calls != 2 || mod->init_stats[1].state != SO_INIT_DEFERRED)
+		init_bad++;
+	so_initialize_deferred(mod);
+	for (int i = 0; i < 4; i++)
+		if (init_calls != 4 || init_order[i] != expected[i] || mod->init_stats[i].state != SO_INIT_DONE || mod->init_stats[i].deferred != (i & 1))
+			init_bad++;
+	if (mod->init_stats[1].time_us < 2000)
+		init_bad++;
+
+	mod->init_array = init_array;
+	mod->num_init_array = num_init_array;
+}
+
+static int link_graph_module(so_module *mod, const char *name, void *arg) {
+	so_default_dynlib *dynlib = arg;
+	return so_link(mod, dynlib, graph_dynlib_size, 0);
+}
+
+// Linked, then kept in the snapshot as the loader does before patching
+static int save_graph_module(so_module *mod, const char *name, void *arg) {
+	char path[1024];
+	if (link_graph_module(mod, name, arg) < 0)
+		return -1;
+	snprintf(path, sizeof(path), "%s/%s", graph_dir, name);
+	return snapshot_add(&graph_snapshot, mod, name, path);
+}
+
+// Directory of the root module (the last fixture) in dir, returns its name
+static const char *graph_root(bench_fixtures *f, char *dir, size_t size) {
+	snprintf(dir, size, "%s", f->path[f->num - 1]);
+	char *slash = strrchr(dir, '/');
+	if (!slash) {
+		snprintf(dir, size, ".");
+		return f->path[f->num - 1];
+	}
+	*slash = 0;
+	return f->path[f->num - 1] + (slash - dir) + 1;
+}
+
+// The last module as the root, its DT_NEEDED entries found next to it, read
+// two at a time and linked in dependency order: they must bind like the
+// fixtures loaded in order do, without overlapping
+static void run_graph(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size) {
+	static deps_graph graph;
+	so_module root;
+	char dir[512];
+	bench_mark mark;
+
+	const char *name = graph_root(f, dir, sizeof(dir));
+	graph_dynlib_size = dynlib_size;
+
+	bench_begin(&mark);
+	if (deps_scan(&graph, dir, name, &root, f->load_addr[f->num - 1]) < 0 || deps_start(&graph) < 0) {
+		fprintf(stderr, "Error could not scan the dependencies of %s.\n", f->path[f->num - 1]);
+		exit(1);
+	}
+	int failed = deps_link(&graph, link_graph_module, dynlib);
+	if (failed >= 0) {
+		fprintf(stderr, "Error could not load %s.\n", graph.nodes[failed].path);
+		exit(1);
+	}
+	deps_initialize(&graph, NULL);
+	bench_end(&mark, &boot[2]);
+
+	// Every fixture is in the graph, in the order they were given, and binds the same
+	if (graph.num != f->num || graph.order[graph.num - 1] != 0)
+		graph_bad++;
+	for (int k = 0; k < graph.num && graph.num == f->num; k++) {
+		deps_node *node = &graph.nodes[graph.order[k]];
+		so_link_stats *st = &node->mod->link_stats;
+		if (strcmp(node->path + strlen(node->path) - strlen(f->label[k]), f->label[k]) != 0 ||
+			st->from_link != link_stats[k].from_link || st->unresolved != link_stats[k].unresolved)
+			graph_bad++;
+		for (int o = 0; o < graph.num; o++) {
+			deps_node *other = &graph.nodes[o];
+			if (other != node && node->load_addr <= other->load_addr && node->load_addr + node->span > other->mod->patch_base)
+				graph_bad++;
+		}
+	}
+	check_inits(&root);
+
+	deps_unload(&graph);
+
+	// A DT_NEEDED name that does not fit must fail the scan, cut it would look like a missing module
+	char needed[SO_NAME_MAX + 8], path[1024];
+	memset(needed, 'x', sizeof(needed) - 1);
+	needed[sizeof(needed) - 1] = 0;
+	synth_params longer = {
+		.soname = "libsynth_long.so",
+		.needed = { needed },
+		.num_needed = 1,
+		.export_fmt = "long_func_%d",
+		.num_exports = 4,
+		.text_size = 4096,
+		.hash_style = SYNTH_HASH_SYSV,
+	};
+	snprintf(path, sizeof(path), "%s/%s", dir, longer.soname);
+	if (synth_elf_write(&longer, path) < 0 || deps_scan(&graph, dir, longer.soname, &root, f->load_addr[f->num - 1]) >= 0)
+		graph_bad++;
+	remove(path);
+}
+
+// The graph booted once more writing a snapshot, then mapped back from it: the
+// modules must come back registered in the same order with the same images,
+// and a damaged or stale snapshot must leave nothing behind
+static void run_snapshot(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size) {
+	static deps_graph graph;
+	uint32_t sums[DEPS_MAX];
+	so_link_stats stats[DEPS_MAX];
+	char path[1024], export[SO_NAME_MAX] = "";
+	uintptr_t export_addr = 0;
+	so_module root;
+	bench_mark mark;
+
+	const char *name = graph_root(f, graph_dir, sizeof(graph_dir));
+	snprintf(path, sizeof(path), "%s/boot.snapshot", graph_dir);
+	graph_dynlib_size = dynlib_size;
+	uint64_t blocks_before = shim.memblock_live;
+
+	bench_begin(&mark);
+	if (deps_scan(&graph, graph_dir, name, &root, f->load_addr[f->num - 1]) < 0 || deps_start(&graph) < 0 ||
+		snapshot_begin(&graph_snapshot, path, graph.num, dynlib, dynlib_size) < 0) {
+		fprintf(stderr, "Error could not start a snapshot of %s.\n", f->path[f->num - 1]);
+		exit(1);
+	}
+	int failed = deps_link(&graph, save_graph_module, dynlib);
+	if (failed >= 0) {
+		fprintf(stderr, "Error could not load %s.\n", graph.nodes[failed].path);
+		exit(1);
+	}
+	deps_initialize(&graph, NULL);
+	if (snapshot_add_init(&graph_snapshot) < 0 || snapshot_end(&graph_snapshot) < 0)
+		snapshot_bad++;
+	bench_end(&mark, &boot[3]);
+
+	for (int k = 0; k < graph.num; k++) {
+		sums[k] = image_checksum(graph.nodes[graph.order[k]].mod);
+		stats[k] = graph.nodes[graph.order[k]].mod->link_stats;
+	}
+	for (int i = 1; i < root.num_dynsym && !export[0]; i++) {
+		if (root.dynsym[i].st_shndx != SHN_UNDEF && root.dynstr[root.dynsym[i].st_name]) {
+			snprintf(export, sizeof(export), "%s", root.dynstr + root.dynsym[i].st_name);
+			export_addr = so_symbol(&root, export);
+		}
+	}
+	deps_unload(&graph);
+
+	bench_begin(&mark);
+	if (deps_scan(&graph, graph_dir, name, &root, f->load_addr[f->num - 1]) < 0) {
+		fprintf(stderr, "Error could not scan the dependencies of %s.\n", f->path[f->num - 1]);
+		exit(1);
+	}
+	int res = snapshot_restore(path, &graph, dynlib, dynlib_size);
+	bench_end(&mark, &boot[4]);
+
+	if (res != 1)
+		snapshot_bad++;
+	for (int k = 0; k < graph.num && res >= 0; k++) {
+		so_module *mod = graph.nodes[graph.order[k]].mod;
+		if (so_module_at(k) != mod || image_checksum(mod) != sums[k] ||
+			mod->link_stats.from_link != stats[k].from_link || mod->link_stats.from_dynlib != stats[k].from_dynlib)
+			snapshot_bad++;
+	}
+	if (res >= 0 && (!export_addr || so_symbol(&root, export) != export_addr))
+		snapshot_bad++;
+	deps_unload(&graph);
+
+	// Imports bound against another table, or against the same names at other
+	// addresses as a rebuilt loader has them, then a flipped byte in the data
+	deps_scan(&graph, graph_dir, name, &root, f->load_addr[f->num - 1]);
+	if (snapshot_restore(path, &graph, dynlib, dynlib_size - sizeof(so_default_dynlib)) >= 0)
+		snapshot_bad++;
+	so_default_dynlib *moved = malloc(dynlib_size);
+	memcpy(moved, dynlib, dynlib_size);
+	moved[dynlib_size / sizeof(so_default_dynlib) - 1].func += 4;
+	if (snapshot_restore(path, &graph, moved, dynlib_size) >= 0) {
+		snapshot_bad++;
+		deps_unload(&graph);
+		deps_scan(&graph, graph_dir, name, &root, f->load_addr[f->num - 1]);
+	}
+	free(moved);
+	FILE *file = fopen(path, "r+b");
+	if (file) {
+		fseek(file, -1, SEEK_END);
+		int c = fgetc(file);
+		fseek(file, -1, SEEK_END);
+		fputc(c ^ 0xff, file);
+		fclose(file);
+	}
+	if (snapshot_restore(path, &graph, dynlib, dynlib_size) >= 0)
+		snapshot_bad++;
+	if (so_module_at(0) || shim.memblock_live != blocks_before)
+		snapshot_bad++;
+	for (int n = 1; n < graph.num; n++)
+		free(graph.nodes[n].mod);
+
+	unlink(path);
+}
+
+static int lazy_graph_module(so_module *mod, const char *name, void *arg) {
+	so_default_dynlib *dynlib = arg;
+	return so_link_lazy(mod, dynlib, graph_dynlib_size, 0);
+}
+
+// The graph booted with lazy binding, then reclaimed keeping a single name in
+// the symbol index: every export must still be found where it was, the deferred
+// imports must bind where they would have before, and arena space must come
+// out of the relocation tables before any extra block gets added
+static void run_reclaim(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size) {
+	static deps_graph graph;
+	static const char *names[DEPS_MAX][RECLAIM_NAMES];
+	static uintptr_t addrs[DEPS_MAX][RECLAIM_NAMES], found[RECLAIM_NAMES];
+	uint32_t blob[ARENA_BLOB / 4];
+	int num[DEPS_MAX], tables[DEPS_MAX];
+	so_module root;
+	char dir[512];
+	bench_mark mark;
+
+	const char *name = graph_root(f, dir, sizeof(dir));
+	graph_dynlib_size = dynlib_size;
+	uint64_t blocks_before = shim.memblock_live;
+
+	if (deps_scan(&graph, dir, name, &root, f->load_addr[f->num - 1]) < 0 || deps_start(&graph) < 0 ||
+		deps_link(&graph, lazy_graph_module, dynlib) >= 0) {
+		fprintf(stderr, "Error could not load the dependencies of %s.\n", f->path[f->num - 1]);
+		exit(1);
+	}
+	deps_initialize(&graph, NULL);
+
+	// Where the exports are and where the deferred imports would bind now
+	uintptr_t *targets[DEPS_MAX];
+	for (int k = 0; k < graph.num; k++) {
+		so_module *mod = graph.nodes[graph.order[k]].mod;
+		int exports = 0;
+		for (int i = 1; i < mod->num_dynsym; i++)
+			if (mod->dynsym[i].st_shndx != SHN_UNDEF)
+				exports++;
+		int stride = exports > RECLAIM_NAMES ? exports / RECLAIM_NAMES + 1 : 1;
+		num[k] = 0;
+		for (int i = 1, n = 0; i < mod->num_dynsym && num[k] < RECLAIM_NAMES; i++) {
+			if (mod->dynsym[i].st_shndx == SHN_UNDEF || n++ % stride)
+				continue;
+			names[k][num[k]] = mod->dynstr + mod->dynsym[i].st_name;
+			addrs[k][num[k]] = so_symbol(mod, names[k][num[k]]);
+			num[k]++;
+		}
+
+		uintptr_t reldyn = mod->reldyn_unpacked ? 0 : (uintptr_t)mod->reldyn;
+		tables[k] = (reldyn >= mod->text_base && reldyn < mod->text_base + mod->text_size && mod->num_reldyn > 16) ||
+			((uintptr_t)mod->relr >= mod->text_base && (uintptr_t)mod->relr < mod->text_base + mod->text_size && mod->num_relr > 16);
+
+		targets[k] = calloc(mod->num_relplt + 1, sizeof(uintptr_t));
+		for (int i = 0; i < mod->num_relplt; i++) {
+			const char *import = mod->dynstr + mod->dynsym[ELF32_R_SYM(mod->relplt[i].r_info)].st_name;
+			int index = so_dynlib_lookup(dynlib, dynlib_size, import);
+			targets[k][i] = index >= 0 ? dynlib[index].func : so_resolve_link(mod, import);
+		}
+	}
+
+	// Lazy binds run on game threads with no lock, nothing past linking may rewrite the dependencies they walk
+	static so_module *needed[DEPS_MAX][MAX_NEEDED];
+	int num_needed[DEPS_MAX];
+	for (int k = 0; k < graph.num; k++) {
+		so_module *mod = graph.nodes[graph.order[k]].mod;
+		num_needed[k] = mod->num_needed;
+		memcpy(needed[k], mod->needed, sizeof(mod->needed));
+	}
+
+	uint64_t heap_before = shim.heap_live;
+	bench_begin(&mark);
+	size_t total = so_reclaim(names[graph.num - 1], 1);
+	bench_end(&mark, &boot[5]);
+
+	// The arenas handed out count against the heap given back
+	size_t heap = heap_before - shim.heap_live + graph.num * 2 * sizeof(so_arena);
+	for (int k = 0; k < graph.num; k++)
+		total -= graph.nodes[graph.order[k]].mod->reclaim_stats.arena;
+	if (!total || heap < total)
+		reclaim_bad++;
+
+	for (int k = 0; k < graph.num; k++) {
+		so_module *mod = graph.nodes[graph.order[k]].mod;
+		if (!mod->reclaimed || mod->interned || mod->bindings || mod->reldyn || mod->relr)
+			reclaim_bad++;
+		so_symbols_lookup(mod, names[k], found, num[k]);
+		for (int i = 0; i < num[k]; i++)
+			if (so_symbol(mod, names[k][i]) != addrs[k][i] || found[i] != addrs[k][i])
+				reclaim_bad++;
+
+		for (int i = 0; i < mod->num_relplt; i++) {
+			uintptr_t slot = mod->text_base + mod->relplt[i].r_offset;
+			if (*(Elf32_Addr *)slot == mod->lazy_stub && so_lazy_bind(mod, slot) != targets[k][i])
+				reclaim_bad++;
+		}
+		if (mod->link_stats.lazy_bound != mod->link_stats.lazy ||
+			mod->num_needed != num_needed[k] || memcmp(mod->needed, needed[k], sizeof(mod->needed)))
+			reclaim_bad++;
+		free(targets[k]);
+
+		// Past the patch arena and the cave, the relocation tables come next
+		size_t room = mod->patch_size + mod->cave_size;
+		int landed = 0;
+		for (size_t i = 0; i <= room / ARENA_BLOB && mod->reclaim_stats.arena >= ARENA_BLOB && !landed; i++) {
+			for (int j = 0; j < ARENA_BLOB / 4; j++)
+				blob[j] = i * 0x10000 + j;
+			uintptr_t addr = so_arena_write(mod, 0, blob, sizeof(blob));
+			if (!addr || memcmp((void *)addr, blob, sizeof(blob)) != 0)
+				break;
+			landed = addr >= mod->text_base && addr < mod->text_base + mod->text_size;
+		}
+		if ((tables[k] && !mod->reclaim_stats.arena) || (mod->reclaim_stats.arena >= ARENA_BLOB && (!landed || mod->arena_stats.extra_blocks)))
+			reclaim_bad++;
+		reclaim_stats[k] = mod->reclaim_stats;
+	}
+
+	deps_unload(&graph);
+	if (shim.memblock_live != blocks_before)
+		reclaim_bad++;
+}
+
+// Walks the DTPMOD32/DTPOFF32 pairs of every module as the calling thread sees
+// them: each must name the module defining the variable and its offset there,
+// and the TPOFF32 word after it must lead to the same place. A fresh thread
+// finds the initial values, then leaves its own behind for the second pass.
+static int check_tls(bench_fixtures *f, uint32_t seed, int pass) {
+	int bad = 0, first = 1;
+	for (int m = 0; m < f->num; m++) {
+		so_module *mod = &mods[m];
+		for (int i = 0; i < mod->num_reldyn; i++) {
+			Elf32_Rel *rel = &mod->reldyn[i];
+			if (ELF32_R_TYPE(rel->r_info) != R_ARM_TLS_DTPMOD32)
+				continue;
+
+			so_tls_index *ti = (so_tls_index *)(mod->text_base + rel->r_offset);
+			Elf32_Sym *sym = &mod->dynsym[ELF32_R_SYM(rel->r_info)];
+			so_module *def = ELF32_R_SYM(rel->r_info) == 0 || sym->st_shndx != SHN_UNDEF ? mod : NULL;
+			for (int k = 0; k < f->num && !def; k++)
+				if (k != m && so_symbol(&mods[k], mod->dynstr + sym->st_name))
+					def = &mods[k];
+			if (!def || !def->tls_id || ti->module != def->tls_id) {
+				bad++;
+				continue;
+			}
+			if (def != mod && so_symbol(def, mod->dynstr + sym->st_name) != def->text_base + ti->offset)
+				bad++;
+
+			uint32_t *addr = so_tls_get_addr(ti);
+			if (first && pass == 0)
+				tls_first[seed % TLS_THREADS] = (uintptr_t)addr;
+			first = 0;
+			if (i + 2 < mod->num_reldyn && ELF32_R_TYPE(mod->reldyn[i + 2].r_info) == R_ARM_TLS_TPOFF32 &&
+				so_tls_thread_pointer() + ((uint32_t *)ti)[2] != (uintptr_t)addr)
+				bad++;
+
+			uint32_t mine = seed * 0x10000 + def->tls_id * 0x100 + ti->offset;
+			if (pass == 0) {
+				if (*addr != *(uint32_t *)(def->tls_image + ti->offset) && *addr != mine)
+					bad++;
+				*addr = mine;
+			} else if (*addr != mine) {
+				bad++;
+			}
+		}
+	}
+	return bad;
+}
+
+typedef struct {
+	bench_fixtures *f;
+	uint32_t seed;
+	int bad;
+} tls_worker;
+
+static void *tls_thread(void *arg) {
+	tls_worker *w = (tls_worker *)arg;
+	w->bad = check_tls(w->f, w->seed, 0);
+	pthread_barrier_wait(&tls_barrier);
+	w->bad += check_tls(w->f, w->seed, 1);
+	return NULL;
+}
+
+// The synthetic modules linked, their variables checked from a few threads at
+// once, then from this one as the modules come back under ids handed out
+// again. Last the cost of reaching a variable: __tls_get_addr, the thread
+// pointer (__aeabi_read_tp), a pthread key and the host's own __thread.
+static void run_tls(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size) {
+	pthread_t threads[TLS_THREADS];
+	tls_worker workers[TLS_THREADS];
+	pthread_key_t key;
+
+	load_all(f);
+	for (int m = 0; m < f->num; m++)
+		so_link(&mods[m], dynlib, dynlib_size, 0);
+
+	uint64_t heap_before = shim.heap_live;
+	pthread_barrier_init(&tls_barrier, NULL, TLS_THREADS);
+	for (int t = 0; t < TLS_THREADS; t++) {
+		workers[t].f = f;
+		workers[t].seed = t + 1;
+		pthread_create(&threads[t], NULL, tls_thread, &workers[t]);
+	}
+	for (int t = 0; t < TLS_THREADS; t++) {
+		pthread_join(threads[t], NULL);
+		tls_bad += workers[t].bad;
+		for (int u = 0; u < t; u++)
+			if (tls_first[u] == tls_first[t])
+				tls_bad++;
+	}
+	pthread_barrier_destroy(&tls_barrier);
+	// The blocks went along with their threads
+	if (shim.heap_live != heap_before)
+		tls_bad++;
+
+	tls_bad += check_tls(f, TLS_THREADS + 1, 0);
+	unload_all(f);
+	load_all(f);
+	for (int m = 0; m < f->num; m++)
+		so_link(&mods[m], dynlib, dynlib_size, 0);
+	tls_bad += check_tls(f, TLS_THREADS + 2, 0);
+	tls_bad += check_tls(f, TLS_THREADS + 2, 1);
+
+	so_tls_index *ti = NULL;
+	so_module *game = &mods[f->num - 1];
+	for (int i = 0; i < game->num_reldyn && !ti; i++)
+		if (ELF32_R_TYPE(game->reldyn[i].r_info) == R_ARM_TLS_DTPMOD32 && i + 2 < game->num_reldyn &&
+			ELF32_R_TYPE(game->reldyn[i + 2].r_info) == R_ARM_TLS_TPOFF32)
+			ti = (so_tls_index *)(game->text_base + game->reldyn[i].r_offset);
+	if (!ti) {
+		if (f->num > 0 && mods[0].tls_memsz)
+			tls_bad++;
+		unload_all(f);
+		return;
+	}
+
+	uint32_t tpoff = ((uint32_t *)ti)[2];
+	pthread_key_create(&key, NULL);
+	pthread_setspecific(key, so_tls_get_addr(ti));
+	volatile uint32_t sink = 0;
+	uint64_t start[5];
+	start[0] = sceKernelGetProcessTimeWide();
+	for (int i = 0; i < TLS_CALLS; i++)
+		sink += *(volatile uint32_t *)so_tls_get_addr(ti);
+	start[1] = sceKernelGetProcessTimeWide();
+	for (int i = 0; i < TLS_CALLS; i++)
+		sink += *(volatile uint32_t *)(so_tls_thread_pointer() + tpoff);
+	start[2] = sceKernelGetProcessTimeWide();
+	for (int i = 0; i < TLS_CALLS; i++)
+		sink += *(volatile uint32_t *)pthread_getspecific(key);
+	start[3] = sceKernelGetProcessTimeWide();
+	for (int i = 0; i < TLS_CALLS; i++)
+		sink += *(volatile uint32_t *)&tls_native;
+	start[4] = sceKernelGetProcessTimeWide();
+	for (int k = 0; k < 4; k++)
+		tls_ns[k] += (start[k + 1] - start[k]) * 1000.0 / TLS_CALLS;
+	pthread_key_delete(key);
+
+	unload_all(f);
+}
+
+// Probes on the last exports of the game, one of them starting with an
+// instruction no trampoline can move, so that its code must be put back. The
+// thunks only run on the Vita, here their hooks and literals are checked and
+// so_shadow_enter and so_shadow_leave are called as they would: a probe made
+// once around two calls of another, one of them left by longjmp, then the
+// cost of a probed call.
+static void run_probes(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size, const char *dir) {
+	static const uint32_t unmovable = 0xf57ff05f; // DMB SY
+	uintptr_t addrs[4];
+	const char *names[4];
+	uint8_t image[4][12];
+	char list[512], path[512];
+	int num = 0;
+
+	load_all(f);
+	so_module *game = &mods[f->num - 1];
+	so_link(game, dynlib, dynlib_size, 0);
+	uintptr_t last = 0;
+	for (int i = game->num_dynsym - 1; i > 0 && num < 4; i--) {
+		Elf32_Sym *sym = &game->dynsym[i];
+		if (sym->st_shndx == SHN_UNDEF || ELF32_ST_TYPE(sym->st_info) != STT_FUNC)
+			continue;
+		uintptr_t addr = game->text_base + sym->st_value;
+		if (!last || addr + 0x10 <= last) {
+			names[num] = game->dynstr + sym->st_name;
+			addrs[num++] = addr;
+			last = addr;
+		}
+	}
+	if (num < 4) {
+		unload_all(f);
+		return;
+	}
+	kuKernelCpuUnrestrictedMemcpy((void *)addrs[2], &unmovable, sizeof(unmovable));
+	for (int i = 0; i < 4; i++)
+		memcpy(image[i], (void *)addrs[i], sizeof(image[i]));
+
+	snprintf(list, sizeof(list), "# timed\n%s %s\nnot_exported %s %s\n  %s# last\n", names[0], names[1], names[2], names[0], names[3]);
+	int installed = probes_install(game, list);
+	int n;
+	const probe *p = probes_list(&n);
+	if (installed != 3 || n != 3 || strcmp(p[0].name, names[0]) || strcmp(p[1].name, names[1]) || strcmp(p[2].name, names[3])) {
+		probes_bad++;
+		probes_clear();
+		unload_all(f);
+		return;
+	}
+	if (memcmp((void *)addrs[2], image[2], sizeof(image[2])))
+		probes_bad++;
+	for (int i = 0; i < n; i++) {
+		uint32_t *patch = (uint32_t *)p[i].addr, *thunk = (uint32_t *)p[i].thunk;
+		if (!p[i].hook.trampoline || patch[0] != 0xe51ff004 || patch[1] != (uint32_t)p[i].thunk ||
+			memcmp(p[i].orig, image[i < 2 ? i : 3], sizeof(p[i].orig)) ||
+			p[i].site.target != p[i].hook.trampoline ||
+			thunk[SO_SHADOW_THUNK_SITE / 4] != (uint32_t)(uintptr_t)&p[i].site ||
+			thunk[SO_SHADOW_THUNK_SITE / 4 + 1] != (uint32_t)(uintptr_t)&so_shadow_enter ||
+			thunk[SO_SHADOW_THUNK_SITE / 4 + 2] != (uint32_t)(uintptr_t)&so_shadow_leave)
+			probes_bad++;
+	}
+
+	probe *outer = (probe *)&p[0], *inner = (probe *)&p[1];
+	if (so_shadow_enter(&outer->site, 0x1000, 0x8000, 0x10) != outer->hook.trampoline)
+		probes_bad++;
+	for (int i = 0; i < 3; i++) {
+		if (so_shadow_enter(&inner->site, 0x2000 + i, 0x7000, 0x20) != inner->hook.trampoline)
+			probes_bad++;
+		usleep(2000);
+		if (i < 2 && so_shadow_leave(0x7000) != 0x2000 + i) // the last one is left
+			probes_bad++;
+	}
+	usleep(1000);
+	if (so_shadow_leave(0x8000) != 0x1000)
+		probes_bad++;
+	if (outer->site.calls != 1 || outer->returns != 1 || outer->nested || outer->depth_max != 1 || outer->min_us != outer->max_us ||
+		outer->time_us < inner->time_us + 3000 || outer->self_us != outer->time_us - inner->time_us ||
+		inner->site.calls != 3 || inner->returns != 2 || inner->nested != 2 || inner->depth_max != 2 || inner->min_us < 2000 ||
+		inner->min_us > inner->max_us || inner->self_us != inner->time_us || p[2].site.calls)
+		probes_bad++;
+
+	snprintf(path, sizeof(path), "%s/probes_report.txt", dir);
+	char line[512] = "";
+	FILE *report;
+	if (probes_report(path) != 2 || !(report = fopen(path, "r")))
+		probes_bad++;
+	else {
+		// The header, then the outer probe first
+		if (!fgets(line, sizeof(line), report) || !fgets(line, sizeof(line), report) || !strstr(line, names[0]))
+			probes_bad++;
+		fclose(report);
+		unlink(path);
+	}
+
+	uint64_t start = sceKernelGetProcessTimeWide();
+	for (int i = 0; i < PROBE_CALLS; i++) {
+		so_shadow_enter(&inner->site, i, 0x8000, 0x10);
+		so_shadow_leave(0x8000);
+	}
+	probes_ns += (sceKernelGetProcessTimeWide() - start) * 1000.0 / PROBE_CALLS;
+
+	probes_clear();
+	unload_all(f);
+}
+
+// Bytes taken by .rel.dyn and .relr.dyn in the file
+static size_t reloc_table_size(const char *path) {
+	Elf32_Ehdr ehdr;
+	size_t total = 0;
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return 0;
+
+	if (fread(&ehdr, sizeof(ehdr), 1, f) == 1) {
+		Elf32_Shdr *shdr = malloc(ehdr.e_shnum * sizeof(Elf32_Shdr));
+		fseek(f, ehdr.e_shoff, SEEK_SET);
+		if (shdr && fread(shdr, sizeof(Elf32_Shdr), ehdr.e_shnum, f) == ehdr.e_shnum) {
+			for (int i = 0; i < ehdr.e_shnum; i++) {
+				if (shdr[i].sh_type == SHT_REL || shdr[i].sh_type == SHT_ANDROID_REL || shdr[i].sh_type == SHT_RELR)
+					total += shdr[i].sh_size;
+			}
+		}
+		free(shdr);
+	}
+	fclose(f);
+
+	return total;
+}
+
+// The synthetic pair again with packed relocations, decoding APS2 happens in
+// so_file_load and RELR is applied straight from the bitmaps
+static void run_packed(bench_fixtures *f, so_default_dynlib *dynlib, int dynlib_size, int variant) {
+	bench_mark mark;
+
+	for (int m = 0; m < f->num; m++) {
+		bench_begin(&mark);
+		if (so_file_load(&mods[m], f->path[m], f->load_addr[m]) < 0) {
+			fprintf(stderr, "Error could not load %s.\n", f->path[m]);
+			exit(1);
+		}
+		bench_end(&mark, &packed[m][variant][0]);
+
+		bench_begin(&mark);
+		so_link(&mods[m], dynlib, dynlib_size, 0);
+		bench_end(&mark, &packed[m][variant][1]);
+		packed_sum[variant][m] = slots_checksum(&mods[m]);
+		reloc_bytes[1 + variant][m] = reloc_table_size(f->path[m]);
+	}
+	unload_all(f);
+
+	// Both tables through the split passes too
+	if (pack_flags[variant] == (SYNTH_PACK_APS2 | SYNTH_PACK_RELR)) {
+		load_all(f);
+		for (int m = 0; m < f->num; m++) {
+			so_relocate(&mods[m]);
+			so_resolve(&mods[m], dynlib, dynlib_size, 0);
+			packed_split_sum[m] = slots_checksum(&mods[m]);
+		}
+		unload_all(f);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int iterations = 10;
+	int max_threads = MAX_WORKERS / 2;
+	int io_rate = DEFAULT_IO_RATE;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "n:j:r:h")) != -1) {
+		switch (opt) {
+		case 'n':
+			iterations = atoi(optarg);
+			break;
+		case 'j':
+			max_threads = atoi(optarg);
+			if (max_threads < 1)
+				max_threads = 1;
+			if (max_threads > MAX_WORKERS)
+				max_threads = MAX_WORKERS;
+			break;
+		case 'r':
+			io_rate = atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	bench_fixtures fixtures;
+	char tmpdir[] = "/tmp/hrm_bench_XXXXXX";
+	int synthetic = optind >= argc;
+	if (!mkdtemp(tmpdir)) {
+		fprintf(stderr, "Error could not create a temporary directory.\n");
+		return 1;
+	}
+	if (synthetic) {
+		if (bench_fixtures_synthetic(&fixtures, tmpdir) < 0) {
+			fprintf(stderr, "Error could not generate synthetic fixtures.\n");
+			return 1;
+		}
+	} else {
+		bench_fixtures_files(&fixtures, argc - optind, &argv[optind]);
+	}
+
+	// Warm-up pass, also used to collect the imports for the stand-in default_dynlib
+	load_all(&fixtures);
+	int dynlib_size;
+	so_default_dynlib *dynlib = bench_dynlib_build(mods, fixtures.num, DEFAULT_DYNLIB_SIZE, &dynlib_size);
+	unload_all(&fixtures);
+
+	for (int m = 0; m < fixtures.num; m++)
+		for (int p = 0; p < PHASE_NUM; p++)
+			phases[m][p].name = phase_names[p];
+	for (int t = 1; t <= max_threads; t++) {
+		snprintf(threaded_names[t], sizeof(threaded_names[t]), "link x%d", t);
+		for (int m = 0; m < fixtures.num; m++)
+			threaded[m][t].name = threaded_names[t];
+	}
+
+	// Split relocate + resolve, then the fused pass, then the fused pass replaying
+	// the bindings it saved: all of them must produce the same image
+	for (int m = 0; m < fixtures.num; m++)
+		snprintf(cache_path[m], sizeof(cache_path[m]), "%s/%d.prelink", tmpdir, m);
+	for (int i = 0; i < iterations; i++)
+		run_load_whole(&fixtures);
+	for (int mode = 0; mode < MODE_NUM; mode++)
+		for (int i = 0; i < iterations; i++)
+			run_iteration(&fixtures, dynlib, dynlib_size, mode);
+	for (int t = 1; t <= max_threads; t++)
+		for (int i = 0; i < iterations; i++)
+			run_threaded(&fixtures, dynlib, dynlib_size, t);
+	for (int i = 0; i < iterations; i++)
+		run_traced(&fixtures, dynlib, dynlib_size);
+	if (synthetic) {
+		for (int m = 0; m < fixtures.num; m++)
+			reloc_bytes[0][m] = reloc_table_size(fixtures.path[m]);
+		for (int v = 0; v < 3; v++) {
+			bench_fixtures packed_fixtures;
+			if (bench_fixtures_packed(&packed_fixtures, tmpdir, pack_flags[v]) < 0) {
+				fprintf(stderr, "Error could not generate packed fixtures.\n");
+				return 1;
+			}
+			for (int i = 0; i < iterations; i++)
+				run_packed(&packed_fixtures, dynlib, dynlib_size, v);
+			for (int m = 0; m < packed_fixtures.num; m++)
+				unlink(packed_fixtures.path[m]);
+			bench_fixtures_free(&packed_fixtures);
+		}
+	}
+	shim_io_rate = io_rate > 0 ? (uint64_t)io_rate << 20 : 0;
+	for (int i = 0; i < iterations; i++) {
+		run_boot(&fixtures, dynlib, dynlib_size, 0);
+		run_boot(&fixtures, dynlib, dynlib_size, 1);
+		run_graph(&fixtures, dynlib, dynlib_size);
+		run_snapshot(&fixtures, dynlib, dynlib_size);
+		run_reclaim(&fixtures, dynlib, dynlib_size);
+	}
+	shim_io_rate = 0;
+	for (int i = 0; i < iterations; i++)
+		run_tls(&fixtures, dynlib, dynlib_size);
+	for (int i = 0; synthetic && i < iterations; i++)
+		run_probes(&fixtures, dynlib, dynlib_size, tmpdir);
+
+	printf("%s fixtures, %d iterations, %d default_dynlib entries (averages per iteration)\n",
+		synthetic ? "synthetic" : "file", iterations, dynlib_size / (int)sizeof(so_default_dynlib));
+	bench_print_header();
+	for (int m = 0; m < fixtures.num; m++) {
+		for (int p = 0; p < PHASE_NUM; p++)
+			if (phases[m][p].runs)
+				bench_print_phase(fixtures.label[m], &phases[m][p]);
+		for (int t = 1; t <= max_threads; t++)
+			bench_print_phase(fixtures.label[m], &threaded[m][t]);
+		for (int v = 0; synthetic && v < 3; v++)
+			for (int p = 0; p < 2; p++)
+				bench_print_phase(fixtures.label[m], &packed[m][v][p]);
+		for (int p = PHASE_LOAD_WHOLE; p <= PHASE_LOAD; p++)
+			printf("%-28s %-11s %10s peak blocks %.1f KB, peak heap %.1f KB\n", fixtures.label[m], phase_names[p], "",
+				phases[m][p].delta.memblock_peak / 1024.0, phases[m][p].delta.heap_peak / 1024.0);
+	}
+	for (int b = 0; b < 6; b++)
+		bench_print_phase("all modules", &boot[b]);
+	for (int m = 0; m < fixtures.num; m++)
+		printf("%-28s %-11s %10s %.1f KB of heap freed, %.1f KB of relocation tables made arena space\n", fixtures.label[m], boot[5].name, "",
+			reclaim_stats[m].heap / 1024.0, reclaim_stats[m].arena / 1024.0);
+	printf("%-28s %-11s %10s %llu us of file reads overlapped linking, %.1f%% faster (reads at %d MB/s)\n", "all modules", boot[1].name, "",
+		(unsigned long long)(boot_hidden_us / iterations),
+		boot[0].time_us ? 100.0 * ((double)boot[0].time_us - boot[1].time_us) / boot[0].time_us : 0.0, io_rate);
+
+	int mismatch = 0;
+	if (graph_bad) {
+		printf("all modules: MISMATCH in %d checks of the dependency graph load\n", graph_bad);
+		mismatch = 1;
+	}
+	if (snapshot_bad) {
+		printf("all modules: MISMATCH in %d checks of the boot snapshot\n", snapshot_bad);
+		mismatch = 1;
+	}
+	if (init_bad) {
+		printf("all modules: MISMATCH in %d checks of the deferred constructors\n", init_bad);
+		mismatch = 1;
+	}
+	if (reclaim_bad) {
+		printf("all modules: MISMATCH in %d checks of the reclaimed modules\n", reclaim_bad);
+		mismatch = 1;
+	}
+	printf("tls: %.1f ns per __tls_get_addr, %.1f ns through the thread pointer, %.1f ns per pthread_getspecific, %.1f ns per __thread\n",
+		tls_ns[0] / iterations, tls_ns[1] / iterations, tls_ns[2] / iterations, tls_ns[3] / iterations);
+	if (tls_bad) {
+		printf("all modules: MISMATCH in %d checks of the TLS variables\n", tls_bad);
+		mismatch = 1;
+	}
+	if (synthetic)
+		printf("probes: %.1f ns per probed call, entry and exit\n", probes_ns / iterations);
+	if (probes_bad) {
+		printf("all modules: MISMATCH in %d checks of the probes\n", probes_bad);
+		mismatch = 1;
+	}
+
+	// The side by side benchmark the loader runs at boot, on host routines:
+	// sinf against cosf has to be told apart
+	static const intrinsic pairs[] = {
+		{ "strlen", INTRINSIC_STRLEN, (uintptr_t)&plain_strlen, NULL },
+		{ "sinf", INTRINSIC_F_F, (uintptr_t)&plain_sinf, NULL },
+		{ "sinf", INTRINSIC_F_F, (uintptr_t)&cosf, NULL },
+	};
+	for (int i = 0; i < 3; i++) {
+		intrinsic_result r;
+		uintptr_t orig = i ? (uintptr_t)&sinf : (uintptr_t)&strlen;
+		intrinsics_bench(&pairs[i], orig, 100000, &r);
+		printf("intrinsic %s: %.1f ns per call, %.1f ns replaced, %d of 256 results differ\n", pairs[i].name,
+			r.orig_us * 1000.0 / r.calls, r.repl_us * 1000.0 / r.calls, r.disagreements);
+		if ((i < 2) != (r.disagreements == 0)) {
+			printf("intrinsic %s: MISMATCH in the results compared\n", pairs[i].name);
+			mismatch = 1;
+		}
+	}
+
+	for (int m = 0; m < fixtures.num; m++) {
+		so_link_stats *st = &link_stats[m];
+		printf("%s: %d relative, %d abs32, %d glob_dat, %d jump_slot, %d tls (%d imports: %d dynlib, %d linked, %d unresolved)\n",
+			fixtures.label[m], st->relative, st->abs32, st->glob_dat, st->jump_slot, st->tls,
+			st->imports, st->from_dynlib, st->from_link, st->unresolved);
+		printf("%s: %d of %d lazy slots bound\n", fixtures.label[m], lazy_stats[m].lazy_bound, lazy_stats[m].lazy);
+		if (lazy_stats[m].lazy_bound != lazy_stats[m].lazy) {
+			printf("%s: MISMATCH between lazy slots and slots bound\n", fixtures.label[m]);
+			mismatch = 1;
+		}
+		so_arena_stats *as = &arena_stats[m];
+		printf("%s: %d arena allocations, %d extra blocks (%u KB), %d veneers, %d failed\n", fixtures.label[m],
+			as->allocs, as->extra_blocks, (unsigned)(as->extra_size / 1024), as->veneers, as->failures);
+		if (intrinsics_bad[m]) {
+			printf("%s: MISMATCH in %d intrinsics substitutions\n", fixtures.label[m], intrinsics_bad[m]);
+			mismatch = 1;
+		}
+		if (batch_bad[m]) {
+			printf("%s: MISMATCH between single and batched lookups of %d names\n", fixtures.label[m], batch_bad[m]);
+			mismatch = 1;
+		}
+		if (arena_bad[m] || as->failures) {
+			printf("%s: MISMATCH in %d arena blobs\n", fixtures.label[m], arena_bad[m]);
+			mismatch = 1;
+		}
+		if (traced_bad[m]) {
+			printf("%s: MISMATCH in %d traced import slots\n", fixtures.label[m], traced_bad[m]);
+			mismatch = 1;
+		}
+		if (hooked_sum[0][m] != hooked_sum[1][m]) {
+			printf("%s: MISMATCH between hook and hook batch images\n", fixtures.label[m]);
+			mismatch = 1;
+		}
+		if (synthetic) {
+			printf("%s: relocation tables %.1f KB plain, %.1f KB aps2, %.1f KB relr, %.1f KB both\n", fixtures.label[m],
+				reloc_bytes[0][m] / 1024.0, reloc_bytes[1][m] / 1024.0, reloc_bytes[2][m] / 1024.0, reloc_bytes[3][m] / 1024.0);
+			for (int v = 0; v < 3; v++) {
+				if (packed_sum[v][m] != plain_slots_sum[m]) {
+					printf("%s: MISMATCH between relocate+resolve and %s images\n", fixtures.label[m], packed[m][v][1].name);
+					mismatch = 1;
+				}
+			}
+			if (packed_split_sum[m] != plain_slots_sum[m]) {
+				printf("%s: MISMATCH between relocate+resolve on plain and packed tables\n", fixtures.label[m]);
+				mismatch = 1;
+			}
+		}
+		if (boot_sum[0][m] != image_sum[MODE_SPLIT][m] || boot_sum[1][m] != image_sum[MODE_SPLIT][m]) {
+			printf("%s: MISMATCH between relocate+resolve and boot images\n", fixtures.label[m]);
+			mismatch = 1;
+		}
+		if (loaded_sum[0][m] != loaded_sum[1][m]) {
+			printf("%s: MISMATCH between whole file and streamed images\n", fixtures.label[m]);
+			mismatch = 1;
+		}
+		for (int t = 1; t <= max_threads; t++) {
+			if (image_sum[MODE_SPLIT][m] != threaded_sum[t][m]) {
+				printf("%s: MISMATCH between relocate+resolve and %s images\n", fixtures.label[m], threaded_names[t]);
+				mismatch = 1;
+			}
+		}
+		for (int mode = MODE_LINK; mode < MODE_NUM; mode++) {
+			if (image_sum[MODE_SPLIT][m] != image_sum[mode][m]) {
+				static const int mode_phase[MODE_NUM] = { PHASE_RESOLVE, PHASE_LINK, PHASE_WARM_LINK, PHASE_STATIC_LINK, PHASE_LAZY_BIND };
+				printf("%s: MISMATCH between relocate+resolve and %s images\n", fixtures.label[m], phase_names[mode_phase[mode]]);
+				mismatch = 1;
+			}
+		}
+	}
+
+	bench_dynlib_free(dynlib, dynlib_size);
+	for (int m = 0; m < fixtures.num; m++) {
+		if (synthetic)
+			unlink(fixtures.path[m]);
+		unlink(cache_path[m]);
+		so_prelink_table_free(&static_table[m]);
+	}
+	rmdir(tmpdir);
+	bench_fixtures_free(&fixtures);
+
+	return mismatch;
+}
@@ -0,0 +1,240 @@
+/* bench_util.c -- shared helpers for the host loader benchmarks
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../loader/config.h"
+#include "bench_util.h"
+#include "synth_elf.h"
+
+#define MODULE_SPACING 0x3000000
+
+void bench_begin(bench_mark *m) {
+	m->start = shim;
+	m->start_us = shim_time_us();
+}
+
+void bench_end(bench_mark *m, bench_phase *phase) {
+	uint64_t end_us = shim_time_us();
+	phase->runs++;
+	phase->time_us += end_us - m->start_us;
+
+	#define DELTA(f) phase->delta.f += shim.f - m->start.f
+	DELTA(memblock_allocs);
+	DELTA(memblock_bytes);
+	DELTA(heap_allocs);
+	DELTA(heap_bytes);
+	DELTA(kmemcpy_calls);
+	DELTA(kmemcpy_bytes);
+	DELTA(flush_calls);
+	DELTA(flush_bytes);
+	DELTA(io_reads);
+	DELTA(io_bytes);
+	#undef DELTA
+
+	if (shim.memblock_peak > phase->delta.memblock_peak)
+		phase->delta.memblock_peak = shim.memblock_peak;
+	if (shim.heap_peak > phase->delta.heap_peak)
+		phase->delta.heap_peak = shim.heap_peak;
+}
+
+void bench_print_header(void) {
+	printf("%-28s %-11s %10s %7s %9s %7s %9s %7s %9s %9s %9s\n",
+		"module", "phase", "time(us)", "blocks", "block KB", "mallocs", "heap KB", "kcopies", "kcopy KB", "flush KB", "io KB");
+}
+
+void bench_print_phase(const char *module, const bench_phase *phase) {
+	uint64_t n = phase->runs ? phase->runs : 1;
+	printf("%-28s %-11s %10.1f %7.1f %9.1f %7.1f %9.1f %7.1f %9.1f %9.1f %9.1f\n",
+		module, phase->name,
+		(double)phase->time_us / n,
+		(double)phase->delta.memblock_allocs / n,
+		(double)phase->delta.memblock_bytes / n / 1024.0,
+		(double)phase->delta.heap_allocs / n,
+		(double)phase->delta.heap_bytes / n / 1024.0,
+		(double)phase->delta.kmemcpy_calls / n,
+		(double)phase->delta.kmemcpy_bytes / n / 1024.0,
+		(double)phase->delta.flush_bytes / n / 1024.0,
+		(double)phase->delta.io_bytes / n / 1024.0);
+}
+
+static void fixture_add(bench_fixtures *f, const char *path, const char *label) {
+	f->path[f->num] = strdup(path);
+	f->label[f->num] = strdup(label);
+	f->num++;
+}
+
+static void fixture_place(bench_fixtures *f) {
+	// Same layout as main(): the last module sits at LOAD_ADDRESS, its dependencies above it
+	for (int i = 0; i < f->num; i++)
+		f->load_addr[i] = LOAD_ADDRESS + (f->num - 1 - i) * MODULE_SPACING;
+}
+
+static void fixture_path(char *path, size_t size, const char *tmpdir, const char *soname, int pack) {
+	if (pack)
+		snprintf(path, size, "%s/%s%s%s", tmpdir, (pack & SYNTH_PACK_APS2) ? "aps2_" : "", (pack & SYNTH_PACK_RELR) ? "relr_" : "", soname);
+	else
+		snprintf(path, size, "%s/%s", tmpdir, soname);
+}
+
+int bench_fixtures_synthetic(bench_fixtures *f, const char *tmpdir) {
+	return bench_fixtures_packed(f, tmpdir, 0);
+}
+
+int bench_fixtures_packed(bench_fixtures *f, const char *tmpdir, int pack) {
+	char path[512];
+	memset(f, 0, sizeof(*f));
+
+	// Roughly shaped like libc++_shared.so: lots of exports, few imports
+	synth_params dep = {
+		.soname = "libsynth_dep.so",
+		.export_fmt = "_ZNSt6__ndk1dep%dEv",
+		.num_exports = 4000,
+		.import_fmt = "dep_import_%d",
+		.num_imports = 150,
+		.tls_fmt = "_ZN6__ndk1tls%dE",
+		.num_tls = 8,
+		.num_relative = 6000,
+		.num_abs32 = 400,
+		.num_glob_dat = 100,
+		.text_size = 512 * 1024,
+		.hash_style = SYNTH_HASH_SYSV | SYNTH_HASH_GNU,
+		.pack = pack,
+	};
+	fixture_path(path, sizeof(path), tmpdir, dep.soname, pack);
+	if (synth_elf_write(&dep, path) < 0)
+		return -1;
+	fixture_add(f, path, dep.soname);
+
+	// Roughly shaped like libHumanResourceMachine.so: imports from both the loader and the dependency
+	synth_params game = {
+		.soname = "libsynth_game.so",
+		// Like the game, mostly system libraries the loader stands in for
+		.needed = { "liblog.so", "libandroid.so", "libEGL.so", "libGLESv2.so", "libOpenSLES.so",
+			"libsynth_dep.so", "libm.so", "libdl.so", "libc.so" },
+		.num_needed = 9,
+		.export_fmt = "game_func_%d",
+		.num_exports = 12000,
+		.import_fmt = "game_import_%d",
+		.num_imports = 450,
+		.link_fmt = "_ZNSt6__ndk1dep%dEv",
+		.num_links = 1500,
+		.tls_fmt = "game_tls_%d",
+		.num_tls = 4,
+		.tls_link_fmt = "_ZN6__ndk1tls%dE",
+		.num_tls_links = 8,
+		.num_relative = 40000,
+		.num_abs32 = 2000,
+		.num_glob_dat = 300,
+		.text_size = 4 * 1024 * 1024,
+		.hash_style = SYNTH_HASH_SYSV | SYNTH_HASH_GNU,
+		.pack = pack,
+	};
+	fixture_path(path, sizeof(path), tmpdir, game.soname, pack);
+	if (synth_elf_write(&game, path) < 0)
+		return -1;
+	fixture_add(f, path, game.soname);
+
+	fixture_place(f);
+	return 0;
+}
+
+void bench_fixtures_files(bench_fixtures *f, int argc, char **argv) {
+	memset(f, 0, sizeof(*f));
+	for (int i = 0; i < argc && f->num < MAX_FIXTURES; i++) {
+		const char *label = strrchr(argv[i], '/');
+		fixture_add(f, argv[i], label ? label + 1 : argv[i]);
+	}
+	fixture_place(f);
+}
+
+void bench_fixtures_free(bench_fixtures *f) {
+	for (int i = 0; i < f->num; i++) {
+		free(f->path[i]);
+		free(f->label[i]);
+	}
+	f->num = 0;
+}
+
+static int name_cmp(const void *a, const void *b) {
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+so_default_dynlib *bench_dynlib_build(so_module *mods, int num, int min_size, int *size_bytes) {
+	int count = 0, cap = 1024;
+	char **names = malloc(cap * sizeof(char *));
+
+	for (int m = 0; m < num; m++) {
+		for (int i = 1; i < mods[m].num_dynsym; i++) {
+			Elf32_Sym *sym = &mods[m].dynsym[i];
+			if (sym->st_shndx != SHN_UNDEF || sym->st_name == 0)
+				continue;
+			const char *name = mods[m].dynstr + sym->st_name;
+
+			int provided = 0;
+			for (int o = 0; o < num && !provided; o++)
+				if (o != m && so_symbol(&mods[o], name))
+					provided = 1;
+			if (provided)
+				continue;
+
+			if (count == cap) {
+				cap *= 2;
+				names = realloc(names, cap * sizeof(char *));
+			}
+			names[count++] = strdup(name);
+		}
+	}
+
+	// Drop duplicates between modules
+	qsort(names, count, sizeof(char *), name_cmp);
+	int uniq = 0;
+	for (int i = 0; i < count; i++) {
+		if (uniq && strcmp(names[uniq - 1], names[i]) == 0)
+			free(names[i]);
+		else
+			names[uniq++] = names[i];
+	}
+
+	int total = uniq < min_size ? min_size : uniq;
+	so_default_dynlib *dynlib = calloc(total, sizeof(so_default_dynlib));
+	char pad[32];
+	for (int i = 0; i < total; i++) {
+		if (i < uniq) {
+			dynlib[i].symbol = names[i];
+		} else {
+			snprintf(pad, sizeof(pad), "unused_import_%d", i);
+			dynlib[i].symbol = strdup(pad);
+		}
+		dynlib[i].func = 0x81000000 + i * 4;
+	}
+	free(names);
+
+	// Deterministic shuffle so that the table order has nothing to do with the relocation order
+	uint32_t seed = 0x12345678;
+	for (int i = total - 1; i > 0; i--) {
+		seed = seed * 1103515245 + 12345;
+		int j = (seed >> 8) % (i + 1);
+		so_default_dynlib tmp = dynlib[i];
+		dynlib[i] = dynlib[j];
+		dynlib[j] = tmp;
+	}
+
+	*size_bytes = total * sizeof(so_default_dynlib);
+	return dynlib;
+}
+
+void bench_dynlib_free(so_default_dynlib *dynlib, int size_bytes) {
+	for (int i = 0; i < size_bytes / (int)sizeof(so_default_dynlib); i++)
+		free(dynlib[i].symbol);
+	free(dynlib);
+}
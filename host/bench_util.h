@@ -0,0 +1,49 @@
+#ifndef __BENCH_UTIL_H__
+#define __BENCH_UTIL_H__
+
+#include <vitasdk.h>
+#include <stdint.h>
+
+#include "../loader/so_util.h"
+#include "shim.h"
+
+#define MAX_FIXTURES 8
+
+typedef struct {
+  const char *name;
+  uint64_t runs;
+  uint64_t time_us;
+  shim_stats delta;
+} bench_phase;
+
+typedef struct {
+  shim_stats start;
+  uint64_t start_us;
+} bench_mark;
+
+void bench_begin(bench_mark *m);
+void bench_end(bench_mark *m, bench_phase *phase);
+void bench_print_header(void);
+void bench_print_phase(const char *module, const bench_phase *phase);
+
+// Fixture set: synthetic modules are generated into a temporary directory,
+// real ones are used straight from the paths given on the command line
+typedef struct {
+  int num;
+  char *path[MAX_FIXTURES];
+  char *label[MAX_FIXTURES];
+  uintptr_t load_addr[MAX_FIXTURES];
+} bench_fixtures;
+
+int bench_fixtures_synthetic(bench_fixtures *f, const char *tmpdir);
+// The same pair with its relocations packed (SYNTH_PACK_* flags)
+int bench_fixtures_packed(bench_fixtures *f, const char *tmpdir, int pack);
+void bench_fixtures_files(bench_fixtures *f, int argc, char **argv);
+void bench_fixtures_free(bench_fixtures *f);
+
+// Builds a stand-in for default_dynlib out of the imports of the given
+// modules that none of them exports, padded to the size of the real table
+so_default_dynlib *bench_dynlib_build(so_module *mods, int num, int min_size, int *size_bytes);
+void bench_dynlib_free(so_default_dynlib *dynlib, int size_bytes);
+
+#endif
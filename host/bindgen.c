@@ -0,0 +1,203 @@
+/* bindgen.c -- generates static_bindings.c for a fixed set of modules
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../loader/so_util.h"
+#include "../loader/prelink.h"
+#include "bench_util.h"
+
+#define MAX_DYNLIB 4096
+
+static so_module mods[MAX_FIXTURES];
+
+static void usage(const char *argv0) {
+	printf("usage: %s [-t main.c] [-o static_bindings.c] module.so ...\n", argv0);
+	printf("Links the modules (dependencies first) against the default_dynlib table of main.c (default loader/main.c)\n");
+	printf("and writes their bindings as C, to be built into the loader in place of loader/static_bindings.c.\n");
+}
+
+// Entry names of default_dynlib in main.c, in table order: the loader checks
+// the result against the table it was built with, so a plain scan is enough
+static int parse_dynlib(const char *path, so_default_dynlib *table, int max) {
+	char line[1024];
+	int num = 0, inside = 0;
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return -1;
+
+	while (fgets(line, sizeof(line), f)) {
+		if (!inside) {
+			inside = strstr(line, "so_default_dynlib default_dynlib[]") != NULL;
+			continue;
+		}
+		if (strncmp(line, "};", 2) == 0)
+			break;
+
+		char *p = line;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (strncmp(p, "{ \"", 3) != 0 || num == max)
+			continue;
+		p += 3;
+		char *end = strchr(p, '"');
+		if (!end)
+			continue;
+		*end = 0;
+		table[num].symbol = strdup(p);
+		table[num].func = 0x1000 + num * 4; // only the index matters
+		num++;
+	}
+	fclose(f);
+
+	return inside ? num : -1;
+}
+
+static void print_hash(FILE *out, const uint8_t *hash) {
+	fprintf(out, "{ ");
+	for (int i = 0; i < SO_HASH_SIZE; i++)
+		fprintf(out, "0x%02x%s", hash[i], i < SO_HASH_SIZE - 1 ? ", " : " }");
+}
+
+static const char *binding_kind(int kind) {
+	switch (kind) {
+	case SO_BIND_DYNLIB:
+		return "SO_BIND_DYNLIB";
+	case SO_BIND_LINK:
+		return "SO_BIND_LINK";
+	default:
+		return "SO_BIND_NONE";
+	}
+}
+
+static void emit(FILE *out, prelink_table *tables, int num) {
+	fprintf(out, "/* static_bindings.c -- import bindings resolved offline\n");
+	fprintf(out, " *\n * Generated by host/bindgen, do not edit.\n */\n\n");
+	fprintf(out, "#include <vitasdk.h>\n\n#include \"prelink.h\"\n");
+
+	for (int t = 0; t < num; t++) {
+		prelink_table *table = &tables[t];
+		so_module *mod = &mods[t];
+
+		fprintf(out, "\n// %s\n", table->soname);
+		if (table->num_providers) {
+			fprintf(out, "static const prelink_provider providers_%d[] = {\n", t);
+			for (int i = 0; i < table->num_providers; i++) {
+				fprintf(out, "\t{ \"%s\", ", table->providers[i].soname);
+				print_hash(out, table->providers[i].hash);
+				fprintf(out, " },\n");
+			}
+			fprintf(out, "};\n");
+		}
+
+		fprintf(out, "static const so_binding bindings_%d[] = {\n", t);
+		for (int i = 0; i < table->num_bindings; i++) {
+			const so_binding *b = &table->bindings[i];
+			const char *name = mod->dynstr + mod->dynsym[b->sym].st_name;
+			fprintf(out, "\t{ %u, %s, %u, 0, %u }, // %s\n", b->sym, binding_kind(b->kind), b->provider, b->index, name);
+		}
+		fprintf(out, "};\n");
+	}
+
+	fprintf(out, "\nconst prelink_table static_bindings[] = {\n");
+	for (int t = 0; t < num; t++) {
+		prelink_table *table = &tables[t];
+		fprintf(out, "\t{\n\t\t\"%s\",\n\t\t", table->soname);
+		print_hash(out, table->module_hash);
+		fprintf(out, ",\n\t\t");
+		print_hash(out, table->dynlib_hash);
+		fprintf(out, ",\n\t\t%u, ", table->num_dynsym);
+		if (table->num_providers)
+			fprintf(out, "providers_%d, %u, ", t, table->num_providers);
+		else
+			fprintf(out, "NULL, 0, ");
+		fprintf(out, "bindings_%d, %u\n\t},\n", t, table->num_bindings);
+	}
+	fprintf(out, "};\nconst int num_static_bindings = %d;\n", num);
+}
+
+int main(int argc, char *argv[]) {
+	const char *main_path = "loader/main.c";
+	const char *out_path = NULL;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "t:o:h")) != -1) {
+		switch (opt) {
+		case 't':
+			main_path = optarg;
+			break;
+		case 'o':
+			out_path = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	static so_default_dynlib dynlib[MAX_DYNLIB];
+	int num_dynlib = parse_dynlib(main_path, dynlib, MAX_DYNLIB);
+	if (num_dynlib <= 0) {
+		fprintf(stderr, "Error could not find default_dynlib in %s.\n", main_path);
+		return 1;
+	}
+	int dynlib_size = num_dynlib * sizeof(so_default_dynlib);
+	so_dynlib_prepare(dynlib, dynlib_size);
+
+	bench_fixtures fixtures;
+	bench_fixtures_files(&fixtures, argc - optind, &argv[optind]);
+
+	// Same order and flags as link_module, so that the bindings are the ones the loader would find
+	prelink_table tables[MAX_FIXTURES];
+	for (int m = 0; m < fixtures.num; m++) {
+		if (so_file_load(&mods[m], fixtures.path[m], fixtures.load_addr[m]) < 0) {
+			fprintf(stderr, "Error could not load %s.\n", fixtures.path[m]);
+			return 1;
+		}
+		if (!mods[m].soname) {
+			fprintf(stderr, "Error %s has no DT_SONAME.\n", fixtures.path[m]);
+			return 1;
+		}
+		if (so_link(&mods[m], dynlib, dynlib_size, 0) < 0 ||
+			so_prelink_table_build(&mods[m], dynlib, dynlib_size, &tables[m]) < 0) {
+			fprintf(stderr, "Error could not link %s.\n", fixtures.path[m]);
+			return 1;
+		}
+		so_link_stats *st = &mods[m].link_stats;
+		fprintf(stderr, "%s: %d bindings (%d dynlib, %d linked, %d unresolved imports)\n",
+			mods[m].soname, tables[m].num_bindings, st->from_dynlib, st->from_link, st->unresolved);
+	}
+
+	FILE *out = out_path ? fopen(out_path, "w") : stdout;
+	if (!out) {
+		fprintf(stderr, "Error could not write %s.\n", out_path);
+		return 1;
+	}
+	emit(out, tables, fixtures.num);
+	if (out != stdout)
+		fclose(out);
+
+	for (int m = fixtures.num - 1; m >= 0; m--) {
+		so_prelink_table_free(&tables[m]);
+		so_unload(&mods[m]);
+	}
+	bench_fixtures_free(&fixtures);
+	for (int i = 0; i < num_dynlib; i++)
+		free(dynlib[i].symbol);
+
+	return 0;
+}
@@ -0,0 +1,43 @@
+/* kubridge.h -- host stand-in for the kubridge calls used by the loader
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#ifndef __HOST_KUBRIDGE_H__
+#define __HOST_KUBRIDGE_H__
+
+#include <vitasdk.h>
+
+typedef struct SceKernelAllocMemBlockKernelOpt {
+	SceSize size;
+	SceUInt32 field_4;
+	SceUInt32 attr;
+	SceUInt32 field_C;
+	SceUInt32 paddr;
+	SceSize alignment;
+	SceUInt32 extraLow;
+	SceUInt32 extraHigh;
+	SceUInt32 mirror_blockid;
+	SceUID pid;
+	SceUInt32 field_28;
+	SceUInt32 field_2C;
+	SceUInt32 field_30;
+	SceUInt32 field_34;
+	SceUInt32 field_38;
+	SceUInt32 field_3C;
+	SceUInt32 field_40;
+	SceUInt32 field_44;
+	SceUInt32 field_48;
+	SceUInt32 field_4C;
+	SceUInt32 field_50;
+	SceUInt32 field_54;
+} SceKernelAllocMemBlockKernelOpt;
+
+SceUID kuKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, SceKernelAllocMemBlockKernelOpt *opt);
+void kuKernelFlushCaches(const void *ptr, SceSize len);
+int kuKernelCpuUnrestrictedMemcpy(void *dst, const void *src, SceSize len);
+
+#endif
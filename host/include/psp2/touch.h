@@ -0,0 +1,28 @@
+/* touch.h -- host stand-in for the touch types referenced by main.h
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#ifndef __HOST_PSP2_TOUCH_H__
+#define __HOST_PSP2_TOUCH_H__
+
+#include <vitasdk.h>
+
+typedef struct SceTouchPanelInfo {
+	int16_t minAaX;
+	int16_t minAaY;
+	int16_t maxAaX;
+	int16_t maxAaY;
+	int16_t minDispX;
+	int16_t minDispY;
+	int16_t maxDispX;
+	int16_t maxDispY;
+	uint8_t minForce;
+	uint8_t maxForce;
+	uint8_t reserved[30];
+} SceTouchPanelInfo;
+
+#endif
@@ -0,0 +1,70 @@
+/* vitasdk.h -- host stand-in for the subset of the Vita SDK used by the loader
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#ifndef __HOST_VITASDK_H__
+#define __HOST_VITASDK_H__
+
+#include <sys/cdefs.h>
+#include <stdint.h>
+#include <stddef.h>
+
+typedef int32_t SceUID;
+typedef int32_t SceInt32;
+typedef uint32_t SceUInt32;
+typedef uint32_t SceSize;
+typedef int64_t SceOff;
+typedef uint64_t SceUInt64;
+typedef int SceMode;
+
+typedef struct {
+  unsigned short year, month, day, hour, minute, second;
+  unsigned int microsecond;
+} SceDateTime;
+
+typedef struct {
+  SceMode st_mode;
+  unsigned int st_attr;
+  SceOff st_size;
+  SceDateTime st_ctime;
+  SceDateTime st_atime;
+  SceDateTime st_mtime;
+} SceIoStat;
+
+#define SCE_KERNEL_MEMBLOCK_TYPE_USER_RW 0x0C20D060
+
+#define SCE_O_RDONLY 0x0001
+#define SCE_O_WRONLY 0x0002
+#define SCE_O_RDWR   (SCE_O_RDONLY | SCE_O_WRONLY)
+#define SCE_O_APPEND 0x0100
+#define SCE_O_CREAT  0x0200
+#define SCE_O_TRUNC  0x0400
+
+#define SCE_SEEK_SET 0
+#define SCE_SEEK_CUR 1
+#define SCE_SEEK_END 2
+
+SceUID sceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt);
+int sceKernelGetMemBlockBase(SceUID uid, void *base);
+int sceKernelFreeMemBlock(SceUID uid);
+SceUInt64 sceKernelGetProcessTimeWide(void);
+SceUID sceKernelGetThreadId(void);
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode);
+int sceIoClose(SceUID fd);
+int sceIoRead(SceUID fd, void *data, SceSize size);
+int sceIoWrite(SceUID fd, const void *data, SceSize size);
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence);
+int sceIoPread(SceUID fd, void *data, SceSize size, SceOff offset);
+int sceIoRemove(const char *file);
+int sceIoGetstat(const char *file, SceIoStat *out);
+
+void *sceClibMemcpy(void *dst, const void *src, SceSize len);
+void *sceClibMemmove(void *dst, const void *src, SceSize len);
+void *sceClibMemset(void *dst, int ch, SceSize len);
+
+#endif
@@ -0,0 +1,170 @@
+/* prof_report.c -- host replay of profiler sample files
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../loader/so_util.h"
+#include "../loader/profiler.h"
+#include "bench_util.h"
+
+static so_module mods[MAX_FIXTURES];
+
+static void usage(const char *argv0) {
+	printf("usage: %s [-g samples] [-o dir] samples.prof [module.so ...]\n", argv0);
+	printf("Loads the modules the samples were taken with and writes profile_flat.txt and profile_calls.txt to dir (default .).\n");
+	printf("With -g, samples.prof is first filled with random samples over the exported functions.\n");
+	printf("Without modules, a synthetic pair shaped like the game's is generated and used.\n");
+}
+
+// Random PCs inside functions, with the LR in another one as if it had called
+// them. The functions picked go in placed, callee then caller for each sample
+static int generate(prof_index *index, const char *path, int num, int *placed) {
+	prof_sample *samples = malloc(num * sizeof(prof_sample));
+	if (!samples || !index->num_symbols) {
+		free(samples);
+		return -1;
+	}
+
+	srand(1);
+	for (int i = 0; i < num; i++) {
+		// Skew towards the first functions so that the profile has a head
+		prof_symbol *callee = &index->symbols[(rand() % index->num_symbols) * (rand() % 4 == 0) % index->num_symbols];
+		prof_symbol *caller = &index->symbols[rand() % index->num_symbols];
+		samples[i].pc = callee->start + (rand() % (callee->end - callee->start) & ~1);
+		samples[i].lr = caller->start + (rand() % (caller->end - caller->start) & ~1);
+		placed[i * 2] = callee - index->symbols;
+		placed[i * 2 + 1] = caller - index->symbols;
+	}
+
+	int res = prof_samples_save(path, samples, num);
+	free(samples);
+	return res;
+}
+
+// Symbolizing must land in the function the address was placed in, or one
+// sharing its start (an alias)
+static int symbolized_in(prof_index *index, uintptr_t addr, int placed) {
+	int found = prof_symbolize(index, addr);
+	return found >= 0 && index->symbols[found].start == index->symbols[placed].start && addr < index->symbols[found].end;
+}
+
+static void print_head(const char *path, int lines) {
+	char line[512];
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return;
+	printf("%s:\n", path);
+	while (lines-- > 0 && fgets(line, sizeof(line), f))
+		printf("  %s", line);
+	fclose(f);
+}
+
+int main(int argc, char *argv[]) {
+	const char *out_dir = ".";
+	int generated = 0;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "g:o:h")) != -1) {
+		switch (opt) {
+		case 'g':
+			generated = atoi(optarg);
+			break;
+		case 'o':
+			out_dir = optarg;
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+
+	const char *samples_path = argv[optind++];
+	bench_fixtures fixtures;
+	char tmpdir[] = "/tmp/hrm_prof_XXXXXX";
+	int synthetic = optind >= argc;
+	if (synthetic) {
+		if (!mkdtemp(tmpdir) || bench_fixtures_synthetic(&fixtures, tmpdir) < 0) {
+			fprintf(stderr, "Error could not generate synthetic fixtures.\n");
+			return 1;
+		}
+	} else {
+		bench_fixtures_files(&fixtures, argc - optind, &argv[optind]);
+	}
+
+	for (int m = 0; m < fixtures.num; m++) {
+		if (so_file_load(&mods[m], fixtures.path[m], fixtures.load_addr[m]) < 0) {
+			fprintf(stderr, "Error could not load %s.\n", fixtures.path[m]);
+			return 1;
+		}
+	}
+
+	prof_index index;
+	if (prof_index_build(&index) < 0) {
+		fprintf(stderr, "Error could not index the module symbols.\n");
+		return 1;
+	}
+	int *placed = generated ? malloc(generated * 2 * sizeof(int)) : NULL;
+	if (generated && (!placed || generate(&index, samples_path, generated, placed) < 0)) {
+		fprintf(stderr, "Error could not write %s.\n", samples_path);
+		return 1;
+	}
+
+	int num;
+	prof_sample *samples = prof_samples_load(samples_path, &num);
+	if (!samples) {
+		fprintf(stderr, "Error could not read %s.\n", samples_path);
+		return 1;
+	}
+
+	// Generated samples come back where they were placed, in the functions they were placed in
+	int bad = 0;
+	if (generated) {
+		if (num != generated)
+			bad++;
+		for (int i = 0; i < num && num == generated; i++)
+			if (!symbolized_in(&index, samples[i].pc, placed[i * 2]) || !symbolized_in(&index, samples[i].lr, placed[i * 2 + 1]))
+				bad++;
+		if (bad)
+			printf("MISMATCH in %d of %d samples between the functions placed in and the ones symbolized\n", bad, generated);
+		free(placed);
+	}
+
+	char flat_path[512], graph_path[512];
+	snprintf(flat_path, sizeof(flat_path), "%s/profile_flat.txt", out_dir);
+	snprintf(graph_path, sizeof(graph_path), "%s/profile_calls.txt", out_dir);
+	uint64_t start = shim_time_us();
+	if (prof_report(&index, samples, num, flat_path, graph_path) < 0) {
+		fprintf(stderr, "Error could not write the profile to %s.\n", out_dir);
+		return 1;
+	}
+	printf("%d samples over %d functions, reported in %llu us\n", num, index.num_symbols, (unsigned long long)(shim_time_us() - start));
+	print_head(flat_path, 8);
+	print_head(graph_path, 8);
+
+	free(samples);
+	prof_index_free(&index);
+	for (int m = fixtures.num - 1; m >= 0; m--)
+		so_unload(&mods[m]);
+	if (synthetic) {
+		for (int m = 0; m < fixtures.num; m++)
+			unlink(fixtures.path[m]);
+		rmdir(tmpdir);
+	}
+	bench_fixtures_free(&fixtures);
+
+	return bad ? 1 : 0;
+}
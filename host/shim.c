@@ -0,0 +1,311 @@
+/* shim.c -- host stand-ins for the Vita kernel services used by the loader
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+#include <kubridge.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "shim.h"
+
+// <sys/stat.h> maps these onto struct timespec members, SceIoStat has its own
+#undef st_atime
+#undef st_mtime
+#undef st_ctime
+
+#define MAX_MEMBLOCKS 256
+
+typedef struct {
+	void *base;
+	size_t size;
+} memblock;
+
+shim_stats shim;
+uint64_t shim_io_rate = 0;
+
+static memblock blocks[MAX_MEMBLOCKS];
+static pthread_mutex_t shim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void shim_reset_stats(void) {
+	uint64_t live = shim.memblock_live, heap_live = shim.heap_live;
+	memset(&shim, 0, sizeof(shim));
+	shim.memblock_live = shim.memblock_peak = live;
+	shim.heap_live = shim.heap_peak = heap_live;
+}
+
+void shim_reset_peaks(void) {
+	shim.memblock_peak = shim.memblock_live;
+	shim.heap_peak = shim.heap_live;
+}
+
+uint64_t shim_time_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static SceUID memblock_alloc(void *addr, size_t size) {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+	// Module blocks must land at the requested address, which is kept below 4 GB
+	// so that 32 bit relocation targets still fit in a GOT slot
+	if (addr)
+		flags |= MAP_FIXED_NOREPLACE;
+	else
+		flags |= MAP_32BIT;
+
+	void *base = mmap(addr, size, PROT_READ | PROT_WRITE | PROT_EXEC, flags, -1, 0);
+	if (base == MAP_FAILED)
+		return -1;
+	if (addr && base != addr) {
+		munmap(base, size);
+		return -1;
+	}
+
+	pthread_mutex_lock(&shim_lock);
+	for (int i = 0; i < MAX_MEMBLOCKS; i++) {
+		if (!blocks[i].base) {
+			blocks[i].base = base;
+			blocks[i].size = size;
+			shim.memblock_allocs++;
+			shim.memblock_bytes += size;
+			shim.memblock_live += size;
+			if (shim.memblock_live > shim.memblock_peak)
+				shim.memblock_peak = shim.memblock_live;
+			pthread_mutex_unlock(&shim_lock);
+			return i + 1;
+		}
+	}
+	pthread_mutex_unlock(&shim_lock);
+
+	munmap(base, size);
+	return -1;
+}
+
+SceUID sceKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, void *opt) {
+	return memblock_alloc(NULL, size);
+}
+
+SceUID kuKernelAllocMemBlock(const char *name, SceUInt32 type, SceSize size, SceKernelAllocMemBlockKernelOpt *opt) {
+	void *addr = NULL;
+	if (opt && (opt->attr & 0x1))
+		addr = (void *)(uintptr_t)opt->field_C;
+	return memblock_alloc(addr, size);
+}
+
+int sceKernelGetMemBlockBase(SceUID uid, void *base) {
+	if (uid <= 0 || uid > MAX_MEMBLOCKS || !blocks[uid - 1].base)
+		return -1;
+	*(void **)base = blocks[uid - 1].base;
+	return 0;
+}
+
+int sceKernelFreeMemBlock(SceUID uid) {
+	if (uid <= 0 || uid > MAX_MEMBLOCKS || !blocks[uid - 1].base)
+		return -1;
+
+	pthread_mutex_lock(&shim_lock);
+	munmap(blocks[uid - 1].base, blocks[uid - 1].size);
+	shim.memblock_live -= blocks[uid - 1].size;
+	blocks[uid - 1].base = NULL;
+	blocks[uid - 1].size = 0;
+	pthread_mutex_unlock(&shim_lock);
+
+	return 0;
+}
+
+SceUInt64 sceKernelGetProcessTimeWide(void) {
+	return shim_time_us();
+}
+
+SceUID sceKernelGetThreadId(void) {
+	return (SceUID)syscall(SYS_gettid);
+}
+
+int kuKernelCpuUnrestrictedMemcpy(void *dst, const void *src, SceSize len) {
+	__atomic_add_fetch(&shim.kmemcpy_calls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&shim.kmemcpy_bytes, len, __ATOMIC_RELAXED);
+	memcpy(dst, src, len);
+	return 0;
+}
+
+void kuKernelFlushCaches(const void *ptr, SceSize len) {
+	__atomic_add_fetch(&shim.flush_calls, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&shim.flush_bytes, len, __ATOMIC_RELAXED);
+}
+
+SceUID sceIoOpen(const char *file, int flags, SceMode mode) {
+	int oflags = 0;
+	if ((flags & SCE_O_RDWR) == SCE_O_RDWR)
+		oflags |= O_RDWR;
+	else if (flags & SCE_O_WRONLY)
+		oflags |= O_WRONLY;
+	else
+		oflags |= O_RDONLY;
+	if (flags & SCE_O_APPEND)
+		oflags |= O_APPEND;
+	if (flags & SCE_O_CREAT)
+		oflags |= O_CREAT;
+	if (flags & SCE_O_TRUNC)
+		oflags |= O_TRUNC;
+
+	int fd = open(file, oflags, mode);
+	return fd < 0 ? -errno : fd;
+}
+
+int sceIoClose(SceUID fd) {
+	return close(fd);
+}
+
+static void io_throttle(ssize_t len) {
+	if (shim_io_rate)
+		usleep(len * 1000000 / shim_io_rate);
+}
+
+int sceIoRead(SceUID fd, void *data, SceSize size) {
+	ssize_t r = read(fd, data, size);
+	if (r > 0) {
+		__atomic_add_fetch(&shim.io_reads, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&shim.io_bytes, r, __ATOMIC_RELAXED);
+		io_throttle(r);
+	}
+	return r < 0 ? -errno : (int)r;
+}
+
+int sceIoPread(SceUID fd, void *data, SceSize size, SceOff offset) {
+	ssize_t r = pread(fd, data, size, offset);
+	if (r > 0) {
+		__atomic_add_fetch(&shim.io_reads, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&shim.io_bytes, r, __ATOMIC_RELAXED);
+		io_throttle(r);
+	}
+	return r < 0 ? -errno : (int)r;
+}
+
+int sceIoWrite(SceUID fd, const void *data, SceSize size) {
+	ssize_t r = write(fd, data, size);
+	return r < 0 ? -errno : (int)r;
+}
+
+SceOff sceIoLseek(SceUID fd, SceOff offset, int whence) {
+	return lseek(fd, offset, whence);
+}
+
+int sceIoRemove(const char *file) {
+	return unlink(file) < 0 ? -errno : 0;
+}
+
+int sceIoGetstat(const char *file, SceIoStat *out) {
+	struct stat st;
+	if (stat(file, &st) < 0)
+		return -errno;
+
+	struct tm tm;
+	gmtime_r(&st.st_mtim.tv_sec, &tm);
+	memset(out, 0, sizeof(*out));
+	out->st_mode = st.st_mode;
+	out->st_size = st.st_size;
+	out->st_mtime.year = tm.tm_year + 1900;
+	out->st_mtime.month = tm.tm_mon + 1;
+	out->st_mtime.day = tm.tm_mday;
+	out->st_mtime.hour = tm.tm_hour;
+	out->st_mtime.minute = tm.tm_min;
+	out->st_mtime.second = tm.tm_sec;
+	out->st_mtime.microsecond = st.st_mtim.tv_nsec / 1000;
+	return 0;
+}
+
+void *sceClibMemcpy(void *dst, const void *src, SceSize len) {
+	return memcpy(dst, src, len);
+}
+
+void *sceClibMemmove(void *dst, const void *src, SceSize len) {
+	return memmove(dst, src, len);
+}
+
+void *sceClibMemset(void *dst, int ch, SceSize len) {
+	return memset(dst, ch, len);
+}
+
+// Heap accounting for the code linked with --wrap=malloc & co.
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+void __real_free(void *ptr);
+
+static void heap_account(void *ptr, int64_t delta) {
+	if (!ptr)
+		return;
+	if (delta > 0) {
+		__atomic_add_fetch(&shim.heap_allocs, 1, __ATOMIC_RELAXED);
+		__atomic_add_fetch(&shim.heap_bytes, delta, __ATOMIC_RELAXED);
+	}
+	uint64_t live = __atomic_add_fetch(&shim.heap_live, delta, __ATOMIC_RELAXED);
+	if (live > shim.heap_peak)
+		shim.heap_peak = live;
+}
+
+void *__wrap_malloc(size_t size) {
+	void *ptr = __real_malloc(size);
+	heap_account(ptr, malloc_usable_size(ptr));
+	return ptr;
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+	void *ptr = __real_calloc(nmemb, size);
+	heap_account(ptr, malloc_usable_size(ptr));
+	return ptr;
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+	size_t old = ptr ? malloc_usable_size(ptr) : 0;
+	void *res = __real_realloc(ptr, size);
+	if (res) {
+		__atomic_sub_fetch(&shim.heap_live, old, __ATOMIC_RELAXED);
+		heap_account(res, malloc_usable_size(res));
+	}
+	return res;
+}
+
+void __wrap_free(void *ptr) {
+	if (ptr)
+		__atomic_sub_fetch(&shim.heap_live, malloc_usable_size(ptr), __ATOMIC_RELAXED);
+	__real_free(ptr);
+}
+
+// Loader-side services normally provided by main.c and dialog.c
+int debugPrintf(char *text, ...) {
+	return 0;
+}
+
+int ret0(void) {
+	return 0;
+}
+
+void fatal_error(const char *fmt, ...) {
+	va_list list;
+	va_start(list, fmt);
+	vfprintf(stderr, fmt, list);
+	va_end(list);
+	exit(1);
+}
+
+void warning(const char *msg) {
+	fprintf(stderr, "%s\n", msg);
+}
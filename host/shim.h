@@ -0,0 +1,41 @@
+#ifndef __SHIM_H__
+#define __SHIM_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef struct {
+  // Memory blocks (kuKernelAllocMemBlock / sceKernelAllocMemBlock)
+  uint64_t memblock_allocs;
+  uint64_t memblock_bytes;
+  uint64_t memblock_live;
+  uint64_t memblock_peak;
+
+  // Heap traffic coming from the loader (malloc/calloc/realloc)
+  uint64_t heap_allocs;
+  uint64_t heap_bytes;
+  uint64_t heap_live;
+  uint64_t heap_peak;
+
+  // Kernel-side copies and cache maintenance
+  uint64_t kmemcpy_calls;
+  uint64_t kmemcpy_bytes;
+  uint64_t flush_calls;
+  uint64_t flush_bytes;
+
+  // File I/O
+  uint64_t io_reads;
+  uint64_t io_bytes;
+} shim_stats;
+
+extern shim_stats shim;
+// Simulated storage speed in bytes per second for sceIoRead/sceIoPread,
+// 0 reads at page cache speed
+extern uint64_t shim_io_rate;
+
+void shim_reset_stats(void);
+// Restarts peak tracking from the current live amounts
+void shim_reset_peaks(void);
+uint64_t shim_time_us(void);
+
+#endif
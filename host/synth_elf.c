@@ -0,0 +1,612 @@
+/* synth_elf.c -- synthetic ARM ELF32 shared objects for the host benchmarks
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../loader/elf.h"
+#include "synth_elf.h"
+
+#define ALIGN(x, a) (((x) + ((a) - 1)) & ~((a) - 1))
+#define PAGE 0x1000
+#define APS2_MAX_SIZE(n) (16 + (n) * 24) // every number at its longest, groups of one
+
+enum {
+	SEC_NULL,
+	SEC_DYNSYM,
+	SEC_DYNSTR,
+	SEC_HASH,
+	SEC_GNU_HASH,
+	SEC_RELDYN,
+	SEC_RELPLT,
+	SEC_TEXT,
+	SEC_DYNAMIC,
+	SEC_GOT,
+	SEC_DATA,
+	SEC_TDATA,
+	SEC_RELR,
+	SEC_SHSTRTAB,
+	SEC_NUM
+};
+
+static const char *sec_names[SEC_NUM] = {
+	"", ".dynsym", ".dynstr", ".hash", ".gnu.hash", ".rel.dyn", ".rel.plt",
+	".text", ".dynamic", ".got", ".data", ".tdata", ".relr.dyn", ".shstrtab"
+};
+
+typedef struct {
+	char *data;
+	size_t size, cap;
+} strtab;
+
+static uint32_t strtab_add(strtab *t, const char *s) {
+	size_t len = strlen(s) + 1;
+	if (t->size + len > t->cap) {
+		t->cap = (t->size + len) * 2;
+		t->data = realloc(t->data, t->cap);
+	}
+	memcpy(t->data + t->size, s, len);
+	t->size += len;
+	return t->size - len;
+}
+
+static uint32_t elf_hash(const char *name) {
+	uint32_t h = 0, g;
+	while (*name) {
+		h = (h << 4) + (uint8_t)*name++;
+		if ((g = (h & 0xf0000000)) != 0)
+			h ^= g >> 24;
+		h &= 0x0fffffff;
+	}
+	return h;
+}
+
+static uint32_t gnu_hash(const char *name) {
+	uint32_t h = 5381;
+	while (*name)
+		h = (h << 5) + h + (uint8_t)*name++;
+	return h;
+}
+
+typedef struct {
+	uint8_t *data;
+	size_t size;
+} bytebuf;
+
+static void put_sleb128(bytebuf *b, int32_t value) {
+	for (;;) {
+		uint8_t byte = value & 0x7f;
+		value >>= 7;
+		if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40))) {
+			b->data[b->size++] = byte;
+			return;
+		}
+		b->data[b->size++] = byte | 0x80;
+	}
+}
+
+// Relocations from i on that share r_info and the step between their offsets
+static int aps2_run(const Elf32_Rel *rels, int num, int i) {
+	int run = 1;
+	if (i + 1 < num) {
+		uint32_t step = rels[i + 1].r_offset - rels[i].r_offset;
+		while (i + run < num && rels[i + run].r_info == rels[i].r_info && rels[i + run].r_offset - rels[i + run - 1].r_offset == step)
+			run++;
+	}
+	return run;
+}
+
+// Runs of relocations sharing r_info and the step between offsets become one
+// group, whatever is left in between goes into groups that spell out both
+static void pack_aps2(bytebuf *b, const Elf32_Rel *rels, int num) {
+	b->data = malloc(APS2_MAX_SIZE(num));
+	memcpy(b->data, "APS2", 4);
+	b->size = 4;
+	put_sleb128(b, num);
+	put_sleb128(b, 0);
+
+	uint32_t offset = 0;
+	for (int i = 0; i < num; ) {
+		int run = aps2_run(rels, num, i);
+		if (run >= 3) {
+			// The first one gets there on its own delta, the others share the step
+			put_sleb128(b, 1);
+			put_sleb128(b, 1); // GROUPED_BY_INFO
+			put_sleb128(b, rels[i].r_info);
+			put_sleb128(b, rels[i].r_offset - offset);
+			put_sleb128(b, run - 1);
+			put_sleb128(b, 3); // GROUPED_BY_INFO | GROUPED_BY_OFFSET_DELTA
+			put_sleb128(b, rels[i + 1].r_offset - rels[i].r_offset);
+			put_sleb128(b, rels[i].r_info);
+			offset = rels[i + run - 1].r_offset;
+			i += run;
+			continue;
+		}
+
+		int loose = 1;
+		while (i + loose < num && aps2_run(rels, num, i + loose) < 3)
+			loose++;
+		put_sleb128(b, loose);
+		put_sleb128(b, 0);
+		for (int j = i; j < i + loose; j++) {
+			put_sleb128(b, rels[j].r_offset - offset);
+			put_sleb128(b, rels[j].r_info);
+			offset = rels[j].r_offset;
+		}
+		i += loose;
+	}
+}
+
+// Offsets must be sorted and word aligned
+static void pack_relr(bytebuf *b, const uint32_t *offsets, int num) {
+	uint32_t *words = malloc((num + 1) * sizeof(uint32_t));
+	int n = 0;
+
+	for (int i = 0; i < num; ) {
+		uint32_t where = offsets[i++];
+		words[n++] = where;
+		where += 4;
+		for (;;) {
+			uint32_t bitmap = 0;
+			while (i < num && offsets[i] - where < 31 * 4) {
+				bitmap |= 1u << ((offsets[i] - where) / 4);
+				i++;
+			}
+			if (!bitmap)
+				break;
+			words[n++] = bitmap << 1 | 1;
+			where += 31 * 4;
+		}
+	}
+
+	b->data = (uint8_t *)words;
+	b->size = n * sizeof(uint32_t);
+}
+
+// .rel.dyn in its plain form: RELATIVE words first, then ABS32 and TLS ones in
+// .data and the GLOB_DAT slots after the JUMP_SLOT ones in .got. Only the
+// imports with a JUMP_SLOT are referenced by the others, TLS ones aside.
+static int synth_reldyn(const synth_params *p, const Elf32_Shdr *sh, const int *perm, int num_undef, int num_relplt, Elf32_Rel *reldyn) {
+	int num_defined = p->num_exports + p->num_tls;
+	int r = 0;
+	num_undef = num_relplt;
+	for (int i = 0; i < p->num_relative; i++) {
+		reldyn[r].r_offset = sh[SEC_DATA].sh_addr + i * 4;
+		reldyn[r++].r_info = ELF32_R_INFO(0, R_ARM_RELATIVE);
+	}
+	for (int i = 0; i < p->num_abs32; i++) {
+		int s;
+		if (num_undef && (i & 1 || !p->num_exports))
+			s = 1 + num_defined + (i / 2) % num_undef;
+		else
+			s = 1 + (i / 2) % (p->num_exports ? p->num_exports : 1);
+		reldyn[r].r_offset = sh[SEC_DATA].sh_addr + (p->num_relative + i) * 4;
+		reldyn[r++].r_info = ELF32_R_INFO(perm[s], R_ARM_ABS32);
+	}
+	for (int i = 0; i < p->num_glob_dat; i++) {
+		int s = num_undef ? 1 + num_defined + i % num_undef : 1;
+		reldyn[r].r_offset = sh[SEC_GOT].sh_addr + (3 + num_relplt + i) * 4;
+		reldyn[r++].r_info = ELF32_R_INFO(perm[s], R_ARM_GLOB_DAT);
+	}
+
+	uint32_t tls_at = sh[SEC_DATA].sh_addr + (p->num_relative + p->num_abs32) * 4;
+	for (int i = 0; i < p->num_tls + p->num_tls_links; i++) {
+		int s = i < p->num_tls ? 1 + p->num_exports + i : 1 + num_defined + num_relplt + i - p->num_tls;
+		static const int types[3] = { R_ARM_TLS_DTPMOD32, R_ARM_TLS_DTPOFF32, R_ARM_TLS_TPOFF32 };
+		for (int k = 0; k < 3; k++) {
+			reldyn[r].r_offset = tls_at + (3 * i + k) * 4;
+			reldyn[r++].r_info = ELF32_R_INFO(perm[s], types[k]);
+		}
+	}
+	if (p->num_tls) {
+		reldyn[r].r_offset = tls_at + 3 * (p->num_tls + p->num_tls_links) * 4;
+		reldyn[r++].r_info = ELF32_R_INFO(0, R_ARM_TLS_DTPMOD32);
+	}
+	return r;
+}
+
+void *synth_elf_build(const synth_params *p, size_t *size) {
+	char name[256];
+	int num_defined = p->num_exports + p->num_tls;
+	int num_relplt = p->num_imports + p->num_links;
+	int num_undef = num_relplt + p->num_tls_links;
+	int num_syms = 1 + num_defined + num_undef;
+	int num_tls_words = 3 * (p->num_tls + p->num_tls_links) + (p->num_tls ? 2 : 0);
+	int num_reldyn = p->num_relative + p->num_abs32 + p->num_glob_dat + 3 * (p->num_tls + p->num_tls_links) + (p->num_tls ? 1 : 0);
+	int num_phdr = p->num_tls ? 4 : 3;
+	int num_dynamic = p->num_needed + 20;
+
+	// String tables
+	strtab dynstr = {0}, shstr = {0};
+	strtab_add(&dynstr, "");
+	uint32_t *sym_name = calloc(num_syms, sizeof(uint32_t));
+	for (int i = 0; i < p->num_exports; i++) {
+		snprintf(name, sizeof(name), p->export_fmt, i);
+		sym_name[1 + i] = strtab_add(&dynstr, name);
+	}
+	for (int i = 0; i < p->num_tls; i++) {
+		snprintf(name, sizeof(name), p->tls_fmt, i);
+		sym_name[1 + p->num_exports + i] = strtab_add(&dynstr, name);
+	}
+	for (int i = 0; i < p->num_imports; i++) {
+		snprintf(name, sizeof(name), p->import_fmt, i);
+		sym_name[1 + num_defined + i] = strtab_add(&dynstr, name);
+	}
+	for (int i = 0; i < p->num_links; i++) {
+		snprintf(name, sizeof(name), p->link_fmt, i);
+		sym_name[1 + num_defined + p->num_imports + i] = strtab_add(&dynstr, name);
+	}
+	for (int i = 0; i < p->num_tls_links; i++) {
+		snprintf(name, sizeof(name), p->tls_link_fmt, i);
+		sym_name[1 + num_defined + num_relplt + i] = strtab_add(&dynstr, name);
+	}
+	uint32_t soname = strtab_add(&dynstr, p->soname);
+	uint32_t needed[SYNTH_MAX_NEEDED];
+	for (int i = 0; i < p->num_needed; i++)
+		needed[i] = strtab_add(&dynstr, p->needed[i]);
+
+	// Symbols are generated exports first, with a GNU hash table they are
+	// written out imports first and the exports grouped by bucket instead
+	int *perm = malloc(num_syms * sizeof(int));
+	int symoffset = 1 + num_undef;
+	int gnu_nbucket = num_defined / 4 + 1;
+	int bloom_size = 1;
+	while (bloom_size * 32 < num_defined * 8)
+		bloom_size <<= 1;
+	uint32_t *sym_hash = calloc(num_syms, sizeof(uint32_t));
+	for (int i = 0; i < num_syms; i++)
+		perm[i] = i;
+	if (p->hash_style & SYNTH_HASH_GNU) {
+		int *start = calloc(gnu_nbucket + 1, sizeof(int));
+		for (int i = 1; i <= num_defined; i++) {
+			sym_hash[i] = gnu_hash(dynstr.data + sym_name[i]);
+			start[sym_hash[i] % gnu_nbucket + 1]++;
+		}
+		for (int b = 0; b < gnu_nbucket; b++)
+			start[b + 1] += start[b];
+		for (int i = 1; i <= num_defined; i++)
+			perm[i] = symoffset + start[sym_hash[i] % gnu_nbucket]++;
+		for (int i = 0; i < num_undef; i++)
+			perm[1 + num_defined + i] = 1 + i;
+		free(start);
+	}
+
+	uint32_t sh_name[SEC_NUM];
+	for (int i = 0; i < SEC_NUM; i++) {
+		int absent = (i == SEC_HASH && !(p->hash_style & SYNTH_HASH_SYSV)) ||
+			(i == SEC_GNU_HASH && !(p->hash_style & SYNTH_HASH_GNU)) ||
+			(i == SEC_RELR && !(p->pack & SYNTH_PACK_RELR)) ||
+			(i == SEC_TDATA && !p->num_tls);
+		sh_name[i] = strtab_add(&shstr, absent ? "" : sec_names[i]);
+	}
+
+	int nbucket = num_syms / 2 + 1;
+	size_t hash_size = (p->hash_style & SYNTH_HASH_SYSV) ? (2 + nbucket + num_syms) * sizeof(uint32_t) : 0;
+	size_t gnu_hash_size = (p->hash_style & SYNTH_HASH_GNU) ? (4 + bloom_size + gnu_nbucket + num_syms - symoffset) * sizeof(uint32_t) : 0;
+
+	// Layout: the RX segment starts at offset 0 and maps 1:1, the RW one begins on a fresh page
+	Elf32_Shdr sh[SEC_NUM];
+	memset(sh, 0, sizeof(sh));
+	size_t off = sizeof(Elf32_Ehdr) + num_phdr * sizeof(Elf32_Phdr);
+	#define PLACE(sec, sz, align) do { \
+		off = ALIGN(off, align); \
+		sh[sec].sh_offset = sh[sec].sh_addr = off; \
+		sh[sec].sh_size = (sz); \
+		sh[sec].sh_addralign = align; \
+		off += (sz); \
+	} while (0)
+	PLACE(SEC_DYNSYM, num_syms * sizeof(Elf32_Sym), 4);
+	PLACE(SEC_DYNSTR, dynstr.size, 1);
+	PLACE(SEC_HASH, hash_size, 4);
+	PLACE(SEC_GNU_HASH, gnu_hash_size, 4);
+	PLACE(SEC_RELPLT, num_relplt * sizeof(Elf32_Rel), 4);
+	PLACE(SEC_TEXT, ALIGN(p->text_size ? p->text_size : 4, 4), 16);
+	size_t tables = off;
+
+	// .rel.dyn and .relr.dyn close the RX segment in the room plain .rel.dyn
+	// takes, so that the RW segment lands at the same place whatever the packing
+	off = ALIGN(tables + num_reldyn * sizeof(Elf32_Rel), PAGE);
+	size_t rw_start = off;
+	PLACE(SEC_DYNAMIC, num_dynamic * sizeof(Elf32_Dyn), 4);
+	PLACE(SEC_GOT, (3 + num_relplt + p->num_glob_dat) * sizeof(uint32_t), 4);
+	PLACE(SEC_DATA, (p->num_relative + p->num_abs32 + num_tls_words) * sizeof(uint32_t), 4);
+	if (p->num_tls)
+		PLACE(SEC_TDATA, p->num_tls * sizeof(uint32_t), 8);
+	size_t rw_end = off;
+
+	Elf32_Rel *rels = calloc(num_reldyn + 1, sizeof(Elf32_Rel));
+	int num_rels = synth_reldyn(p, sh, perm, num_undef, num_relplt, rels);
+	bytebuf aps2 = {0}, relr = {0};
+	off = tables;
+	if (p->pack & SYNTH_PACK_RELR) {
+		uint32_t *offsets = malloc((p->num_relative + 1) * sizeof(uint32_t));
+		for (int i = 0; i < p->num_relative; i++)
+			offsets[i] = rels[i].r_offset;
+		pack_relr(&relr, offsets, p->num_relative);
+		free(offsets);
+		PLACE(SEC_RELR, relr.size, 4);
+		// Only the symbolic ones stay in .rel.dyn
+		memmove(rels, rels + p->num_relative, (num_rels - p->num_relative) * sizeof(Elf32_Rel));
+		num_rels -= p->num_relative;
+	}
+	if (p->pack & SYNTH_PACK_APS2) {
+		pack_aps2(&aps2, rels, num_rels);
+		PLACE(SEC_RELDYN, aps2.size, 4);
+	} else {
+		PLACE(SEC_RELDYN, num_rels * sizeof(Elf32_Rel), 4);
+	}
+	size_t rx_end = off;
+	if (rx_end > rw_start) {
+		// Only APS2 with hardly any runs could get there
+		free(rels);
+		free(aps2.data);
+		free(relr.data);
+		free(perm);
+		free(sym_hash);
+		free(sym_name);
+		free(dynstr.data);
+		free(shstr.data);
+		return NULL;
+	}
+	off = rw_end;
+
+	sh[SEC_SHSTRTAB].sh_offset = off;
+	sh[SEC_SHSTRTAB].sh_size = shstr.size;
+	sh[SEC_SHSTRTAB].sh_addralign = 1;
+	off = ALIGN(off + shstr.size, 4);
+	size_t shoff = off;
+	off += sizeof(sh);
+	#undef PLACE
+
+	char *buf = calloc(1, off);
+
+	// Headers
+	Elf32_Ehdr *ehdr = (Elf32_Ehdr *)buf;
+	memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+	ehdr->e_ident[EI_CLASS] = ELFCLASS32;
+	ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+	ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+	ehdr->e_type = ET_DYN;
+	ehdr->e_machine = EM_ARM;
+	ehdr->e_version = EV_CURRENT;
+	ehdr->e_phoff = sizeof(Elf32_Ehdr);
+	ehdr->e_shoff = shoff;
+	ehdr->e_ehsize = sizeof(Elf32_Ehdr);
+	ehdr->e_phentsize = sizeof(Elf32_Phdr);
+	ehdr->e_phnum = num_phdr;
+	ehdr->e_shentsize = sizeof(Elf32_Shdr);
+	ehdr->e_shnum = SEC_NUM;
+	ehdr->e_shstrndx = SEC_SHSTRTAB;
+
+	Elf32_Phdr *phdr = (Elf32_Phdr *)(buf + ehdr->e_phoff);
+	phdr[0].p_type = PT_LOAD;
+	phdr[0].p_flags = PF_R | PF_X;
+	phdr[0].p_filesz = phdr[0].p_memsz = rx_end;
+	phdr[0].p_align = PAGE;
+	phdr[1].p_type = PT_LOAD;
+	phdr[1].p_flags = PF_R | PF_W;
+	phdr[1].p_offset = phdr[1].p_vaddr = phdr[1].p_paddr = rw_start;
+	phdr[1].p_filesz = rw_end - rw_start;
+	phdr[1].p_memsz = rw_end - rw_start + 0x100; // some .bss
+	phdr[1].p_align = PAGE;
+	phdr[2].p_type = PT_DYNAMIC;
+	phdr[2].p_flags = PF_R | PF_W;
+	phdr[2].p_offset = phdr[2].p_vaddr = phdr[2].p_paddr = sh[SEC_DYNAMIC].sh_offset;
+	phdr[2].p_filesz = phdr[2].p_memsz = sh[SEC_DYNAMIC].sh_size;
+	phdr[2].p_align = 4;
+	if (p->num_tls) {
+		phdr[3].p_type = PT_TLS;
+		phdr[3].p_flags = PF_R;
+		phdr[3].p_offset = phdr[3].p_vaddr = phdr[3].p_paddr = sh[SEC_TDATA].sh_offset;
+		phdr[3].p_filesz = sh[SEC_TDATA].sh_size;
+		phdr[3].p_memsz = sh[SEC_TDATA].sh_size + 0x20; // some .tbss
+		phdr[3].p_align = 8;
+	}
+
+	// Symbols
+	Elf32_Sym *sym = (Elf32_Sym *)(buf + sh[SEC_DYNSYM].sh_offset);
+	for (int i = 1; i < num_syms; i++) {
+		Elf32_Sym *s = &sym[perm[i]];
+		s->st_name = sym_name[i];
+		s->st_info = ELF32_ST_INFO(STB_GLOBAL, STT_FUNC);
+		if (i <= p->num_exports) {
+			s->st_shndx = SEC_TEXT;
+			s->st_value = sh[SEC_TEXT].sh_addr + ((i - 1) * 4) % sh[SEC_TEXT].sh_size;
+			s->st_size = 4;
+		} else if (i <= num_defined) {
+			// TLS symbols are offsets in the module's block
+			s->st_info = ELF32_ST_INFO(STB_GLOBAL, STT_TLS);
+			s->st_shndx = SEC_TDATA;
+			s->st_value = (i - 1 - p->num_exports) * 4;
+			s->st_size = 4;
+		} else {
+			if (i > num_defined + num_relplt)
+				s->st_info = ELF32_ST_INFO(STB_GLOBAL, STT_TLS);
+			s->st_shndx = SHN_UNDEF;
+		}
+	}
+	memcpy(buf + sh[SEC_DYNSTR].sh_offset, dynstr.data, dynstr.size);
+
+	if (p->hash_style & SYNTH_HASH_SYSV) {
+		uint32_t *hash = (uint32_t *)(buf + sh[SEC_HASH].sh_offset);
+		uint32_t *bucket = &hash[2], *chain = &hash[2 + nbucket];
+		hash[0] = nbucket;
+		hash[1] = num_syms;
+		for (int i = num_syms - 1; i > 0; i--) {
+			uint32_t h = elf_hash(dynstr.data + sym[i].st_name) % nbucket;
+			chain[i] = bucket[h];
+			bucket[h] = i;
+		}
+	}
+
+	if (p->hash_style & SYNTH_HASH_GNU) {
+		uint32_t *hash = (uint32_t *)(buf + sh[SEC_GNU_HASH].sh_offset);
+		uint32_t *bloom = &hash[4], *bucket = &bloom[bloom_size], *chain = &bucket[gnu_nbucket];
+		hash[0] = gnu_nbucket;
+		hash[1] = symoffset;
+		hash[2] = bloom_size;
+		hash[3] = 5;
+		for (int i = symoffset; i < num_syms; i++) {
+			uint32_t h = gnu_hash(dynstr.data + sym[i].st_name);
+			bloom[(h / 32) & (bloom_size - 1)] |= (1u << (h % 32)) | (1u << ((h >> 5) % 32));
+			if (!bucket[h % gnu_nbucket])
+				bucket[h % gnu_nbucket] = i;
+			// The last symbol of each bucket has the low bit set
+			chain[i - symoffset] = h & ~1;
+			if (i == num_syms - 1 || gnu_hash(dynstr.data + sym[i + 1].st_name) % gnu_nbucket != h % gnu_nbucket)
+				chain[i - symoffset] |= 1;
+		}
+	}
+
+	// Code: just "bx lr" everywhere
+	uint32_t *text = (uint32_t *)(buf + sh[SEC_TEXT].sh_offset);
+	for (size_t i = 0; i < sh[SEC_TEXT].sh_size / 4; i++)
+		text[i] = 0xe12fff1e;
+
+	// Relocations
+	Elf32_Rel *relplt = (Elf32_Rel *)(buf + sh[SEC_RELPLT].sh_offset);
+	uint32_t *got = (uint32_t *)(buf + sh[SEC_GOT].sh_offset);
+	uint32_t *data = (uint32_t *)(buf + sh[SEC_DATA].sh_offset);
+	for (int i = 0; i < p->num_relative; i++)
+		data[i] = sh[SEC_TEXT].sh_addr + (i * 4) % sh[SEC_TEXT].sh_size;
+	if (p->pack & SYNTH_PACK_APS2)
+		memcpy(buf + sh[SEC_RELDYN].sh_offset, aps2.data, aps2.size);
+	else
+		memcpy(buf + sh[SEC_RELDYN].sh_offset, rels, num_rels * sizeof(Elf32_Rel));
+	if (p->pack & SYNTH_PACK_RELR)
+		memcpy(buf + sh[SEC_RELR].sh_offset, relr.data, relr.size);
+	for (int i = 0; i < num_relplt; i++) {
+		got[3 + i] = sh[SEC_TEXT].sh_addr;
+		relplt[i].r_offset = sh[SEC_GOT].sh_addr + (3 + i) * 4;
+		relplt[i].r_info = ELF32_R_INFO(perm[1 + num_defined + i], R_ARM_JUMP_SLOT);
+	}
+	uint32_t *tdata = (uint32_t *)(buf + sh[SEC_TDATA].sh_offset);
+	for (int i = 0; i < p->num_tls; i++)
+		tdata[i] = (i + 1) * 0x01010101;
+
+	// Dynamic section
+	Elf32_Dyn *dyn = (Elf32_Dyn *)(buf + sh[SEC_DYNAMIC].sh_offset);
+	int d = 0;
+	#define DYN(tag, val) do { dyn[d].d_tag = (tag); dyn[d++].d_un.d_val = (val); } while (0)
+	for (int i = 0; i < p->num_needed; i++)
+		DYN(DT_NEEDED, needed[i]);
+	DYN(DT_SONAME, soname);
+	if (p->hash_style & SYNTH_HASH_SYSV)
+		DYN(DT_HASH, sh[SEC_HASH].sh_addr);
+	if (p->hash_style & SYNTH_HASH_GNU)
+		DYN(DT_GNU_HASH, sh[SEC_GNU_HASH].sh_addr);
+	DYN(DT_STRTAB, sh[SEC_DYNSTR].sh_addr);
+	DYN(DT_SYMTAB, sh[SEC_DYNSYM].sh_addr);
+	DYN(DT_STRSZ, dynstr.size);
+	DYN(DT_SYMENT, sizeof(Elf32_Sym));
+	if (p->pack & SYNTH_PACK_APS2) {
+		DYN(DT_ANDROID_REL, sh[SEC_RELDYN].sh_addr);
+		DYN(DT_ANDROID_RELSZ, sh[SEC_RELDYN].sh_size);
+	} else {
+		DYN(DT_REL, sh[SEC_RELDYN].sh_addr);
+		DYN(DT_RELSZ, sh[SEC_RELDYN].sh_size);
+		DYN(DT_RELENT, sizeof(Elf32_Rel));
+	}
+	if (p->pack & SYNTH_PACK_RELR) {
+		DYN(DT_RELR, sh[SEC_RELR].sh_addr);
+		DYN(DT_RELRSZ, sh[SEC_RELR].sh_size);
+		DYN(DT_RELRENT, sizeof(uint32_t));
+	}
+	DYN(DT_JMPREL, sh[SEC_RELPLT].sh_addr);
+	DYN(DT_PLTRELSZ, sh[SEC_RELPLT].sh_size);
+	DYN(DT_PLTREL, DT_REL);
+	DYN(DT_PLTGOT, sh[SEC_GOT].sh_addr);
+	DYN(DT_NULL, 0);
+	#undef DYN
+
+	// Section headers
+	sh[SEC_DYNSYM].sh_type = SHT_DYNSYM;
+	sh[SEC_DYNSYM].sh_flags = SHF_ALLOC;
+	sh[SEC_DYNSYM].sh_link = SEC_DYNSTR;
+	sh[SEC_DYNSYM].sh_info = 1;
+	sh[SEC_DYNSYM].sh_entsize = sizeof(Elf32_Sym);
+	sh[SEC_DYNSTR].sh_type = SHT_STRTAB;
+	sh[SEC_DYNSTR].sh_flags = SHF_ALLOC;
+	if (p->hash_style & SYNTH_HASH_SYSV) {
+		sh[SEC_HASH].sh_type = SHT_HASH;
+		sh[SEC_HASH].sh_flags = SHF_ALLOC;
+		sh[SEC_HASH].sh_link = SEC_DYNSYM;
+		sh[SEC_HASH].sh_entsize = 4;
+	}
+	if (p->hash_style & SYNTH_HASH_GNU) {
+		sh[SEC_GNU_HASH].sh_type = SHT_GNU_HASH;
+		sh[SEC_GNU_HASH].sh_flags = SHF_ALLOC;
+		sh[SEC_GNU_HASH].sh_link = SEC_DYNSYM;
+	}
+	sh[SEC_RELDYN].sh_type = (p->pack & SYNTH_PACK_APS2) ? SHT_ANDROID_REL : SHT_REL;
+	sh[SEC_RELDYN].sh_flags = SHF_ALLOC;
+	sh[SEC_RELDYN].sh_link = SEC_DYNSYM;
+	sh[SEC_RELDYN].sh_entsize = (p->pack & SYNTH_PACK_APS2) ? 1 : sizeof(Elf32_Rel);
+	if (p->pack & SYNTH_PACK_RELR) {
+		sh[SEC_RELR].sh_type = SHT_RELR;
+		sh[SEC_RELR].sh_flags = SHF_ALLOC;
+		sh[SEC_RELR].sh_entsize = sizeof(uint32_t);
+	}
+	sh[SEC_RELPLT].sh_type = SHT_REL;
+	sh[SEC_RELPLT].sh_flags = SHF_ALLOC | SHF_INFO_LINK;
+	sh[SEC_RELPLT].sh_link = SEC_DYNSYM;
+	sh[SEC_RELPLT].sh_info = SEC_GOT;
+	sh[SEC_RELPLT].sh_entsize = sizeof(Elf32_Rel);
+	sh[SEC_TEXT].sh_type = SHT_PROGBITS;
+	sh[SEC_TEXT].sh_flags = SHF_ALLOC | SHF_EXECINSTR;
+	sh[SEC_DYNAMIC].sh_type = SHT_DYNAMIC;
+	sh[SEC_DYNAMIC].sh_flags = SHF_ALLOC | SHF_WRITE;
+	sh[SEC_DYNAMIC].sh_link = SEC_DYNSTR;
+	sh[SEC_DYNAMIC].sh_entsize = sizeof(Elf32_Dyn);
+	sh[SEC_GOT].sh_type = SHT_PROGBITS;
+	sh[SEC_GOT].sh_flags = SHF_ALLOC | SHF_WRITE;
+	sh[SEC_DATA].sh_type = SHT_PROGBITS;
+	sh[SEC_DATA].sh_flags = SHF_ALLOC | SHF_WRITE;
+	if (p->num_tls) {
+		sh[SEC_TDATA].sh_type = SHT_PROGBITS;
+		sh[SEC_TDATA].sh_flags = SHF_ALLOC | SHF_WRITE | SHF_TLS;
+	}
+	sh[SEC_SHSTRTAB].sh_type = SHT_STRTAB;
+	for (int i = 0; i < SEC_NUM; i++)
+		sh[i].sh_name = sh_name[i];
+	memcpy(buf + sh[SEC_SHSTRTAB].sh_offset, shstr.data, shstr.size);
+	memcpy(buf + shoff, sh, sizeof(sh));
+
+	free(rels);
+	free(aps2.data);
+	free(relr.data);
+	free(perm);
+	free(sym_hash);
+	free(sym_name);
+	free(dynstr.data);
+	free(shstr.data);
+
+	*size = off;
+	return buf;
+}
+
+int synth_elf_write(const synth_params *p, const char *path) {
+	size_t size;
+	void *buf = synth_elf_build(p, &size);
+	if (!buf)
+		return -1;
+
+	FILE *f = fopen(path, "wb");
+	if (!f) {
+		free(buf);
+		return -1;
+	}
+	size_t written = fwrite(buf, 1, size, f);
+	fclose(f);
+	free(buf);
+
+	return written == size ? 0 : -1;
+}
@@ -0,0 +1,51 @@
+#ifndef __SYNTH_ELF_H__
+#define __SYNTH_ELF_H__
+
+#include <stddef.h>
+
+#define SYNTH_MAX_NEEDED 10
+
+// Hash tables to emit, without any the loader has to scan .dynsym
+#define SYNTH_HASH_SYSV 1
+#define SYNTH_HASH_GNU 2
+
+// Relocation encodings: .rel.dyn as an APS2 stream, relative relocations as RELR
+#define SYNTH_PACK_APS2 1
+#define SYNTH_PACK_RELR 2
+
+typedef struct {
+  const char *soname;
+  const char *needed[SYNTH_MAX_NEEDED];
+  int num_needed;
+
+  // Defined symbols are named export_fmt % i, undefined ones import_fmt % i
+  // followed by link_fmt % i (the ones meant to come from a DT_NEEDED module)
+  const char *export_fmt;
+  int num_exports;
+  const char *import_fmt;
+  int num_imports;
+  const char *link_fmt;
+  int num_links;
+
+  // TLS variables, one word each in .tdata: tls_fmt % i are defined after the
+  // exports, tls_link_fmt % i come from a DT_NEEDED module after the other
+  // imports. Each is reached through a DTPMOD32/DTPOFF32 pair and a TPOFF32
+  // word in .data, one more pair with no symbol stands for the module's own block.
+  const char *tls_fmt;
+  int num_tls;
+  const char *tls_link_fmt;
+  int num_tls_links;
+
+  int num_relative;  // R_ARM_RELATIVE words in .data
+  int num_abs32;     // R_ARM_ABS32 words, alternating between exports and imports
+  int num_glob_dat;  // R_ARM_GLOB_DAT slots in .got, cycling over the imports
+  size_t text_size;
+  int hash_style;    // SYNTH_HASH_* flags
+  int pack;          // SYNTH_PACK_* flags, 0 for plain .rel.dyn
+} synth_params;
+
+// Builds an ARM ELF32 shared object in memory, returns a malloc'd buffer
+void *synth_elf_build(const synth_params *p, size_t *size);
+int synth_elf_write(const synth_params *p, const char *path);
+
+#endif
@@ -5,10 +5,64 @@
 
 #define LOAD_ADDRESS 0x98000000
 
+// Bind imported functions on their first call rather than at boot: an import
+// nothing provides stops the game the first time it is called, not at boot
+//#define LAZY_BINDING
+
+// Threads relocations are written with, the Vita has 3 cores available to apps
+#define LINK_THREADS 3
+
+// Sample where the game thread runs and write a profile to DATA_PATH on exit
+//#define PROFILER
+#define PROFILER_INTERVAL_US 1000
+
+// Bind default_dynlib imports through thunks counting their calls (SO_TRACE_CALLS)
+// or also timing them (SO_TRACE_TIME), ranked in DATA_PATH/imports.txt on exit
+//#define TRACE_IMPORTS SO_TRACE_TIME
+
+// Time every call of the game functions named in DATA_PATH/probes.txt (mangled,
+// one per line, # starts a comment) or, without that file, in PROBES: calls,
+// min/avg/max, time spent outside the other probes and nesting are ranked in
+// DATA_PATH/probes_report.txt on exit. No C++ exception may be thrown through
+// a probed function, the unwinder cannot walk past its thunk
+//#define PROBES "SomeExport OtherExport"
+
+// Route the routines the game carries its own copy of to native ones (intrinsics
+// in main.c): a space separated list of their names, or "all". The entries have
+// no signature there, so a name is taken on trust: only list the ones that
+// INTRINSICS_BENCH found to agree for this game
+//#define INTRINSICS "strlen strcmp strncmp strchr strrchr strstr memcmp memchr"
+// Time each of them against the game's own with that many calls at boot,
+// compared in DATA_PATH/intrinsics.txt
+//#define INTRINSICS_BENCH 100000
+
+// Keep the modules as linked in DATA_PATH/boot.snapshot and map them back on the
+// next boots rather than linking them again, until the game files or the loader change
+//#define SNAPSHOT
+// Also keep their data as their constructors leave it, and skip these on the next
+// boots: only taken if the constructors made no heap allocation and no thread,
+// pthread key, file, SDL or GL object through the imports main.c watches.
+// Experimental: state made by imports that are not watched, by syscalls the game
+// makes itself or in the static data of the loader is not seen, and the atexit
+// destructors they register do not run on a restored boot
+//#define SNAPSHOT_INIT
+
+// Constructors to run once the others are done, as the startup report names them
+// (or by the symbol alone, for every one named after it): only ones that nothing
+// at boot depends on. They run on a thread of their own, or with DEFER_INIT_FRAME
+// on the game thread once its first frame is presented
+//#define DEFER_INIT "SomeExport+0x1c4 OtherExport"
+//#define DEFER_INIT_FRAME
+
+// Once booted, free the symbol table, bindings and relocations that only linking
+// needed and reuse the relocation tables of the modules as room for hooks
+#define RECLAIM
+
 #define MEMORY_NEWLIB_MB 256
 #define MEMORY_VITAGL_THRESHOLD_MB 256
 
 #define DATA_PATH "ux0:data/hrm"
+#define SNAPSHOT_FILE DATA_PATH "/boot.snapshot"
 #define TROPHIES_FILE "ux0:data/goo/trophies.chk"
 
 #define SCREEN_W 960
@@ -0,0 +1,169 @@
+/* deps.c -- loads a module along with the modules it needs
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "deps.h"
+
+static int deps_find(deps_graph *graph, const char *name) {
+	for (int i = 0; i < graph->num; i++)
+		if (strcmp(graph->nodes[i].name, name) == 0)
+			return i;
+	return -1;
+}
+
+static int deps_add(deps_graph *graph, const char *dir, const char *name, so_module *mod) {
+	deps_node *node = &graph->nodes[graph->num];
+	memset(node, 0, sizeof(deps_node));
+	snprintf(node->name, sizeof(node->name), "%s", name);
+	if (snprintf(node->path, sizeof(node->path), "%s/%s", dir, name) >= sizeof(node->path)) {
+		printf("%s/%s: path too long\n", dir, name);
+		return -1;
+	}
+	node->mod = mod ? mod : calloc(1, sizeof(so_module));
+	if (!node->mod)
+		return -1;
+
+	return graph->num++;
+}
+
+// Depth first, each module after the ones it needs; a module that turns up
+// again while its own dependencies are being visited closes a cycle and is skipped
+static void deps_visit(deps_graph *graph, int i, int *state, int *num) {
+	if (state[i])
+		return;
+	state[i] = 1;
+	for (int n = 0; n < graph->nodes[i].num_needed; n++)
+		deps_visit(graph, graph->nodes[i].needed[n], state, num);
+	graph->order[(*num)++] = i;
+}
+
+int deps_scan(deps_graph *graph, const char *dir, const char *root, so_module *root_mod, uintptr_t load_addr) {
+	char needed[MAX_NEEDED][SO_NAME_MAX];
+	SceIoStat st;
+
+	memset(graph, 0, sizeof(deps_graph));
+	if (deps_add(graph, dir, root, root_mod) < 0)
+		return -1;
+
+	for (int i = 0; i < graph->num; i++) {
+		deps_node *node = &graph->nodes[i];
+		int num = so_file_needed(node->path, needed, MAX_NEEDED, &node->span);
+		if (num < 0)
+			return -1;
+
+		for (int n = 0; n < num; n++) {
+			int dep = deps_find(graph, needed[n]);
+			if (dep < 0) {
+				char path[sizeof(node->path)];
+				if (snprintf(path, sizeof(path), "%s/%s", dir, needed[n]) >= sizeof(path)) {
+					printf("%s: path too long for %s\n", node->name, needed[n]);
+					return -1;
+				}
+				if (sceIoGetstat(path, &st) < 0) {
+					graph->missing++;
+					continue;
+				}
+				if (graph->num == DEPS_MAX) {
+					printf("%s: too many modules, ignoring %s\n", node->name, needed[n]);
+					continue;
+				}
+				if ((dep = deps_add(graph, dir, needed[n], NULL)) < 0)
+					return -1;
+			}
+			if (dep != i)
+				node->needed[node->num_needed++] = dep;
+		}
+	}
+
+	// The root where it always was, what it needs above it
+	uintptr_t addr = load_addr;
+	for (int i = 0; i < graph->num; i++) {
+		graph->nodes[i].load_addr = addr;
+		addr = ALIGN_MEM(addr + graph->nodes[i].span + DEPS_GAP, DEPS_GAP);
+	}
+
+	int state[DEPS_MAX] = { 0 };
+	int num = 0;
+	deps_visit(graph, 0, state, &num);
+
+	return graph->num;
+}
+
+int deps_start(deps_graph *graph) {
+	for (int k = 0; k < graph->num; k++) {
+		deps_node *node = &graph->nodes[graph->order[k]];
+		if (so_load_queue(node->mod, node->path, node->load_addr) < 0)
+			return -1;
+	}
+	so_load_start();
+
+	return 0;
+}
+
+int deps_link(deps_graph *graph, deps_link_fn link, void *arg) {
+	for (int k = 0; k < graph->num; k++) {
+		deps_node *node = &graph->nodes[graph->order[k]];
+		if (so_load_wait(node->mod) < 0)
+			return graph->order[k];
+
+		uint64_t start = sceKernelGetProcessTimeWide();
+		if (link(node->mod, node->name, arg) < 0)
+			return graph->order[k];
+		so_flush_caches(node->mod);
+		node->link_us = sceKernelGetProcessTimeWide() - start;
+	}
+
+	return -1;
+}
+
+int deps_initialize(deps_graph *graph, const char *deferred) {
+	int num = 0;
+	for (int k = 0; k < graph->num; k++) {
+		deps_node *node = &graph->nodes[graph->order[k]];
+		uint64_t start = sceKernelGetProcessTimeWide();
+		num += so_initialize_defer(node->mod, deferred);
+		node->init_us = sceKernelGetProcessTimeWide() - start;
+	}
+	return num;
+}
+
+void deps_initialize_deferred(deps_graph *graph) {
+	for (int k = 0; k < graph->num; k++)
+		so_initialize_deferred(graph->nodes[graph->order[k]].mod);
+}
+
+void deps_report(deps_graph *graph) {
+	uint64_t read_us = 0, wait_us = 0;
+	for (int k = 0; k < graph->num; k++) {
+		deps_node *node = &graph->nodes[graph->order[k]];
+		printf("%s at 0x%08X: read %llu us (waited %llu us), link %llu us, init %llu us\n", node->name, (unsigned)node->load_addr,
+			(unsigned long long)node->mod->load_us, (unsigned long long)node->mod->wait_us, (unsigned long long)node->link_us, (unsigned long long)node->init_us);
+		so_init_report(node->mod, DEPS_INIT_REPORT);
+		read_us += node->mod->load_us;
+		wait_us += node->mod->wait_us;
+	}
+
+	int64_t hidden = (int64_t)read_us - (int64_t)wait_us;
+	printf("%d modules, %d DT_NEEDED entries left to default_dynlib: file reads took %llu us, %lld us of it overlapped other work\n",
+		graph->num, graph->missing, (unsigned long long)read_us, (long long)(hidden > 0 ? hidden : 0));
+}
+
+void deps_unload(deps_graph *graph) {
+	for (int k = graph->num - 1; k >= 0; k--) {
+		deps_node *node = &graph->nodes[graph->order[k]];
+		so_unload(node->mod);
+		if (graph->order[k] != 0)
+			free(node->mod);
+	}
+	graph->num = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef __DEPS_H__
+#define __DEPS_H__
+
+#include "so_util.h"
+
+#define DEPS_MAX 16
+#define DEPS_GAP 0x100000 // between modules, room for the patch arena and extra arenas below each one
+#define DEPS_INIT_REPORT 5 // slowest constructors reported per module
+
+typedef struct {
+  so_module *mod;
+  char name[SO_NAME_MAX]; // file name, as found in the DT_NEEDED entry
+  char path[256];
+  uintptr_t load_addr;
+  size_t span;
+  int needed[MAX_NEEDED]; // nodes this module depends on
+  int num_needed;
+  uint64_t link_us, init_us; // init_us leaves the deferred constructors out
+} deps_node;
+
+typedef struct {
+  deps_node nodes[DEPS_MAX]; // the root module first
+  int num;
+  int order[DEPS_MAX];       // every module after the ones it needs, the root last
+  int missing;               // DT_NEEDED entries with no file in the directory, left to default_dynlib
+} deps_graph;
+
+// Called once a module is loaded and its dependencies are linked, to bind it
+typedef int (*deps_link_fn)(so_module *mod, const char *name, void *arg);
+
+// Walks the DT_NEEDED entries of root in dir, breadth first, and places the
+// modules found one above the other from load_addr. root_mod receives the
+// root module, the others are allocated.
+int deps_scan(deps_graph *graph, const char *dir, const char *root, so_module *root_mod, uintptr_t load_addr);
+// Hands the modules to the background loaders, in dependency order
+int deps_start(deps_graph *graph);
+// Links each module as soon as it and everything it needs are in, returns
+// the node that failed or -1
+int deps_link(deps_graph *graph, deps_link_fn link, void *arg);
+// Runs the constructors of every module in dependency order, but the ones named
+// in deferred (see so_initialize_defer), returns how many were left
+int deps_initialize(deps_graph *graph, const char *deferred);
+// Runs the constructors left, module after module in the same order
+void deps_initialize_deferred(deps_graph *graph);
+void deps_report(deps_graph *graph);
+void deps_unload(deps_graph *graph);
+
+#endif
@@ -0,0 +1,320 @@
+/* intrinsics.c -- substitution of routines the game carries its own copy of
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intrinsics.h"
+
+#define MAX_INTRINSICS 128
+#define MAX_SIGNATURE 64
+#define BENCH_INPUTS 256
+#define BENCH_STR_SIZE 256
+
+typedef size_t (*strlen_fn)(const char *);
+typedef int (*strcmp_fn)(const char *, const char *);
+typedef int (*strncmp_fn)(const void *, const void *, size_t);
+typedef char *(*strchr_fn)(const char *, int);
+typedef char *(*strstr_fn)(const char *, const char *);
+typedef void *(*memchr_fn)(const void *, int, size_t);
+typedef float (*f_f_fn)(float);
+typedef float (*f_ff_fn)(float, float);
+
+typedef struct {
+	uint8_t bytes[MAX_SIGNATURE];
+	uint8_t mask[MAX_SIGNATURE];
+	int len;
+} signature;
+
+static int is_enabled(const char *enable, const char *name) {
+	size_t len = strlen(name);
+	if (!enable)
+		return 0;
+	if (strcmp(enable, "all") == 0)
+		return 1;
+
+	for (const char *p = enable; *p; ) {
+		while (*p == ' ')
+			p++;
+		const char *end = p;
+		while (*end && *end != ' ')
+			end++;
+		if (end - p == len && strncmp(p, name, len) == 0)
+			return 1;
+		p = end;
+	}
+	return 0;
+}
+
+static int parse_signature(const char *str, signature *sig) {
+	sig->len = 0;
+	while (*str) {
+		if (*str == ' ') {
+			str++;
+			continue;
+		}
+		if (sig->len == MAX_SIGNATURE || !str[1])
+			return -1;
+		if (str[0] == '?' && str[1] == '?') {
+			sig->bytes[sig->len] = 0;
+			sig->mask[sig->len++] = 0;
+		} else {
+			char hex[3] = { str[0], str[1], 0 };
+			char *end;
+			sig->bytes[sig->len] = strtoul(hex, &end, 16);
+			sig->mask[sig->len++] = 0xff;
+			if (*end)
+				return -1;
+		}
+		str += 2;
+	}
+	return sig->len ? 0 : -1;
+}
+
+// Thumb functions have bit 0 of their address set, the code starts right under it
+static int match_signature(so_module *mod, Elf32_Sym *sym, const signature *sig) {
+	if (sym->st_size && sym->st_size < sig->len)
+		return 0;
+	const uint8_t *code = (const uint8_t *)(mod->text_base + (sym->st_value & ~1));
+	if ((uintptr_t)code + sig->len > mod->text_base + mod->text_size)
+		return 0;
+
+	for (int i = 0; i < sig->len; i++)
+		if ((code[i] & sig->mask[i]) != sig->bytes[i])
+			return 0;
+	return 1;
+}
+
+static Elf32_Sym *find_symbol(so_module *mod, uintptr_t addr) {
+	for (int i = 1; i < mod->num_dynsym; i++) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx != SHN_UNDEF && mod->text_base + sym->st_value == addr)
+			return sym;
+	}
+	return NULL;
+}
+
+// Deterministic inputs: strings of 0 to 255 characters, each paired with one
+// that differs in its last character, and floats spread over ]0, 10[
+static char bench_str[BENCH_INPUTS][BENCH_STR_SIZE];
+static char bench_other[BENCH_INPUTS][BENCH_STR_SIZE];
+static char bench_needle[BENCH_INPUTS][8];
+static float bench_x[BENCH_INPUTS], bench_y[BENCH_INPUTS];
+
+static void bench_inputs(void) {
+	static int ready = 0;
+	if (ready)
+		return;
+
+	uint32_t seed = 0x2545f491;
+	for (int i = 0; i < BENCH_INPUTS; i++) {
+		int len = i % BENCH_STR_SIZE;
+		for (int j = 0; j < len; j++) {
+			seed = seed * 1103515245 + 12345;
+			bench_str[i][j] = 'a' + (seed >> 16) % 26;
+		}
+		bench_str[i][len] = 0;
+		memcpy(bench_other[i], bench_str[i], len + 1);
+		if (len && (i & 1))
+			bench_other[i][len - 1] = 'A';
+
+		// Half of the needles are taken from the string, the others never match
+		int at = len > 8 ? (i * 7) % (len - 4) : 0;
+		if ((i & 2) && len > 8)
+			memcpy(bench_needle[i], &bench_str[i][at], 4);
+		else
+			memcpy(bench_needle[i], "0123", 4);
+		bench_needle[i][4] = 0;
+
+		bench_x[i] = 0.01f + 9.98f * i / BENCH_INPUTS;
+		bench_y[i] = 0.01f + 9.98f * ((i * 37) % BENCH_INPUTS) / BENCH_INPUTS;
+	}
+	ready = 1;
+}
+
+static int float_differs(float a, float b) {
+	if (isnan(a) || isnan(b))
+		return isnan(a) != isnan(b);
+	float diff = fabsf(a - b);
+	return diff > 1e-4f * fabsf(a) && diff > 1e-6f;
+}
+
+static int sign(int x) {
+	return (x > 0) - (x < 0);
+}
+
+// Runs the i-th input through func, returns its result folded into an int
+// (or, for floats, stores it in *f)
+static intptr_t bench_call(int kind, uintptr_t func, int i, float *f) {
+	switch (kind) {
+	case INTRINSIC_STRLEN:
+		return ((strlen_fn)func)(bench_str[i]);
+	case INTRINSIC_STRCMP:
+		return sign(((strcmp_fn)func)(bench_str[i], bench_other[i]));
+	case INTRINSIC_STRNCMP:
+		return sign(((strncmp_fn)func)(bench_str[i], bench_other[i], strlen(bench_str[i])));
+	case INTRINSIC_STRCHR:
+		return (intptr_t)((strchr_fn)func)(bench_str[i], bench_needle[i][0]);
+	case INTRINSIC_STRSTR:
+		return (intptr_t)((strstr_fn)func)(bench_str[i], bench_needle[i]);
+	case INTRINSIC_MEMCHR:
+		return (intptr_t)((memchr_fn)func)(bench_str[i], bench_needle[i][0], strlen(bench_str[i]));
+	case INTRINSIC_F_F:
+		*f = ((f_f_fn)func)(bench_x[i]);
+		return 0;
+	case INTRINSIC_F_FF:
+		*f = ((f_ff_fn)func)(bench_x[i], bench_y[i]);
+		return 0;
+	}
+	return 0;
+}
+
+/*
+ * intrinsics_bench: calls the routine found in the module and its
+ * replacement on the same inputs, once per input to compare their
+ * results, then the given number of times each to time them.
+*/
+int intrinsics_bench(const intrinsic *entry, uintptr_t orig, int calls, intrinsic_result *result) {
+	volatile intptr_t sink = 0;
+	float fo, fr;
+
+	bench_inputs();
+	result->disagreements = 0;
+	for (int i = 0; i < BENCH_INPUTS; i++) {
+		intptr_t ro = bench_call(entry->kind, orig, i, &fo);
+		intptr_t rr = bench_call(entry->kind, entry->func, i, &fr);
+		if (entry->kind == INTRINSIC_F_F || entry->kind == INTRINSIC_F_FF) {
+			if (float_differs(fo, fr))
+				result->disagreements++;
+		} else if (ro != rr) {
+			result->disagreements++;
+		}
+	}
+
+	uint64_t start = sceKernelGetProcessTimeWide();
+	for (int i = 0; i < calls; i++)
+		sink += bench_call(entry->kind, orig, i % BENCH_INPUTS, &fo);
+	result->orig_us = sceKernelGetProcessTimeWide() - start;
+
+	start = sceKernelGetProcessTimeWide();
+	for (int i = 0; i < calls; i++)
+		sink += bench_call(entry->kind, entry->func, i % BENCH_INPUTS, &fr);
+	result->repl_us = sceKernelGetProcessTimeWide() - start;
+	result->calls = calls;
+
+	return result->disagreements;
+}
+
+int intrinsics_apply(so_module *mod, const intrinsic *table, int num, const char *enable, int bench_calls, intrinsic_result *results) {
+	const char *names[MAX_INTRINSICS];
+	uintptr_t addrs[MAX_INTRINSICS];
+	int enabled[MAX_INTRINSICS];
+	int num_enabled = 0, pending = 0;
+
+	if (num > MAX_INTRINSICS)
+		num = MAX_INTRINSICS;
+	memset(results, 0, num * sizeof(intrinsic_result));
+	for (int i = 0; i < num; i++) {
+		if (is_enabled(enable, table[i].name)) {
+			enabled[num_enabled] = i;
+			names[num_enabled++] = table[i].name;
+		}
+	}
+	so_symbols_lookup(mod, names, addrs, num_enabled);
+
+	// A signature guards the routine found by name as well, in case the game
+	// has one with the same name doing something else
+	static signature sigs[MAX_INTRINSICS];
+	for (int n = 0; n < num_enabled; n++) {
+		const intrinsic *e = &table[enabled[n]];
+		intrinsic_result *r = &results[enabled[n]];
+		r->addr = addrs[n];
+		if (!e->signature)
+			continue;
+
+		if (parse_signature(e->signature, &sigs[n]) < 0) {
+			r->addr = 0;
+			r->rejected = 1;
+			sigs[n].len = 0;
+			continue;
+		}
+		if (r->addr) {
+			Elf32_Sym *sym = find_symbol(mod, r->addr);
+			if (!sym || !match_signature(mod, sym, &sigs[n])) {
+				r->addr = 0;
+				r->rejected = 1;
+				sigs[n].len = 0;
+			}
+		} else {
+			pending++;
+		}
+	}
+
+	// Then look for the missing ones among the functions of the module, in one pass
+	for (int i = 1; i < mod->num_dynsym && pending; i++) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx == SHN_UNDEF || ELF32_ST_TYPE(sym->st_info) != STT_FUNC)
+			continue;
+		for (int n = 0; n < num_enabled; n++) {
+			intrinsic_result *r = &results[enabled[n]];
+			if (r->addr || !table[enabled[n]].signature || !sigs[n].len)
+				continue;
+			if (match_signature(mod, sym, &sigs[n])) {
+				r->addr = mod->text_base + sym->st_value;
+				r->by_signature = 1;
+				pending--;
+				break;
+			}
+		}
+	}
+
+	so_hook_batch hooks;
+	hook_begin(&hooks);
+	int found = 0;
+	for (int n = 0; n < num_enabled; n++) {
+		const intrinsic *e = &table[enabled[n]];
+		intrinsic_result *r = &results[enabled[n]];
+		if (!r->addr)
+			continue;
+		if (bench_calls)
+			intrinsics_bench(e, r->addr, bench_calls, r);
+		hook_queue(&hooks, r->addr, e->func, NULL);
+		found++;
+	}
+	if (hook_commit(&hooks) < 0)
+		return -1;
+
+	return found;
+}
+
+int intrinsics_report(const char *path, const intrinsic *table, int num, const intrinsic_result *results) {
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return -1;
+
+	fprintf(f, "%-24s %10s %10s %12s %12s %8s %8s\n", "intrinsic", "address", "found by", "orig ns", "native ns", "speedup", "differ");
+	for (int i = 0; i < num; i++) {
+		const intrinsic_result *r = &results[i];
+		if (!r->addr) {
+			fprintf(f, "%-24s %10s%s\n", table[i].name, "-", r->rejected ? "  (signature differs)" : "");
+			continue;
+		}
+		fprintf(f, "%-24s 0x%08X %10s", table[i].name, (unsigned)r->addr, r->by_signature ? "signature" : "name");
+		if (r->calls)
+			fprintf(f, " %12.1f %12.1f %7.2fx %8d", r->orig_us * 1000.0 / r->calls, r->repl_us * 1000.0 / r->calls,
+				r->repl_us ? (double)r->orig_us / r->repl_us : 0.0, r->disagreements);
+		fprintf(f, "\n");
+	}
+	fclose(f);
+
+	return num;
+}
@@ -0,0 +1,42 @@
+#ifndef __INTRINSICS_H__
+#define __INTRINSICS_H__
+
+#include "so_util.h"
+
+// Prototype of a substituted routine, so that the benchmark can call both sides
+enum {
+  INTRINSIC_STRLEN,  // size_t (const char *)
+  INTRINSIC_STRCMP,  // int (const char *, const char *)
+  INTRINSIC_STRNCMP, // int (const void *, const void *, size_t), memcmp too
+  INTRINSIC_STRCHR,  // char *(const char *, int)
+  INTRINSIC_STRSTR,  // char *(const char *, const char *)
+  INTRINSIC_MEMCHR,  // void *(const void *, int, size_t)
+  INTRINSIC_F_F,     // float (float), over ]0, 10[
+  INTRINSIC_F_FF,    // float (float, float), over ]0, 10[
+};
+
+typedef struct {
+  const char *name;      // enable list key and the symbol looked up in the module
+  int kind;              // INTRINSIC_*
+  uintptr_t func;        // native replacement
+  const char *signature; // first bytes of the function in hex, "??" for any, NULL to match by name only
+} intrinsic;
+
+typedef struct {
+  uintptr_t addr;        // routine in the module, 0 if not found or not enabled
+  int by_signature;      // found through its signature rather than by name
+  int rejected;          // found by name but with another signature (or a bad one), left alone
+  uint32_t calls;        // benchmark calls made on each side, 0 if not benchmarked
+  uint64_t orig_us, repl_us;
+  int disagreements;     // calls whose results differ (floats beyond a relative 1e-4)
+} intrinsic_result;
+
+// Finds the enabled entries of the table in the module (enable is a space
+// separated list of names, or "all"), benchmarks them against their
+// replacement if bench_calls is not 0, then hooks them all in one batch.
+// Returns the number of routines substituted, < 0 if hooking failed.
+int intrinsics_apply(so_module *mod, const intrinsic *table, int num, const char *enable, int bench_calls, intrinsic_result *results);
+int intrinsics_bench(const intrinsic *entry, uintptr_t orig, int calls, intrinsic_result *result);
+int intrinsics_report(const char *path, const intrinsic *table, int num, const intrinsic_result *results);
+
+#endif
@@ -47,6 +47,13 @@
 #include "dialog.h"
 #include "so_util.h"
 #include "sha1.h"
+#include "prelink.h"
+#include "intrinsics.h"
+#include "deps.h"
+#include "snapshot.h"
+#include "tls.h"
+#include "probes.h"
+#include "profiler.h"
 #include "trophies.h"
 
 #ifdef DEBUG
@@ -55,6 +62,13 @@
 #define dlog
 #endif
 
+#if defined(SNAPSHOT) && defined(TRACE_IMPORTS)
+#error "A snapshot keeps the imports bound directly, it cannot be used along with TRACE_IMPORTS"
+#endif
+#if defined(SNAPSHOT_INIT) && defined(DEFER_INIT)
+#error "Constructors are skipped when restored from SNAPSHOT_INIT, the deferred ones would never run"
+#endif
+
 void sincos(double x, double *sin, double *cos) {
 	float s, c;
 	sincosf(x, &s, &c);
@@ -79,7 +93,30 @@ int _newlib_heap_size_user = MEMORY_NEWLIB_MB * 1024 * 1024;
 
 unsigned int _pthread_stack_default_user = 1 * 1024 * 1024;
 
-so_module cpp_mod, hrm_mod;
+so_module hrm_mod;
+static deps_graph modules;
+#ifdef SNAPSHOT
+static snapshot boot_snapshot;
+#endif
+
+static uint64_t boot_start, boot_last;
+
+static void boot_phase(const char *phase) {
+	uint64_t now = sceKernelGetProcessTimeWide();
+	printf("boot: %-28s %8llu us (at %llu us)\n", phase, now - boot_last, now - boot_start);
+	boot_last = now;
+}
+
+#ifdef DEFER_INIT
+static int deferred_inits = 0;
+
+static void *run_deferred_inits(void *arg) {
+	uint64_t start = sceKernelGetProcessTimeWide();
+	deps_initialize_deferred(&modules);
+	printf("%d deferred constructors ran in %llu us\n", deferred_inits, sceKernelGetProcessTimeWide() - start);
+	return NULL;
+}
+#endif
 
 void *__wrap_memcpy(void *dest, const void *src, size_t n) {
 	return sceClibMemcpy(dest, src, n);
@@ -371,6 +408,8 @@ int pthread_cond_timedwait_relative_np_fake(pthread_cond_t **cnd, pthread_mutex_
 	return 0;
 }
 
+// The thread gets its TLS blocks on its first access and gives them back on
+// exit through the pthread key holding them (see tls.c)
 int pthread_create_fake(pthread_t *thread, const void *unused, void *entry, void *arg) {
 	return pthread_create(thread, NULL, entry, arg);
 }
@@ -501,14 +540,11 @@ static so_default_dynlib gl_hook[] = {
 	{"glDetachShader", (uintptr_t)&ret0},
 	{"glClear", (uintptr_t)&ret0}, // Game likes to spam glClear on level loads on different fbos causing a skyrocket on sceGxm scenes count
 };
-static size_t gl_numhook = sizeof(gl_hook) / sizeof(*gl_hook);
 
 void *SDL_GL_GetProcAddress_fake(const char *symbol) {
-	for (size_t i = 0; i < gl_numhook; ++i) {
-		if (!strcmp(symbol, gl_hook[i].symbol)) {
-			return (void *)gl_hook[i].func;
-		}
-	}
+	int i = so_dynlib_lookup(gl_hook, sizeof(gl_hook), symbol);
+	if (i >= 0)
+		return (void *)so_dynlib_target(gl_hook, sizeof(gl_hook), i);
 	
 	void *r = vglGetProcAddress(symbol);
 	if (!r) {
@@ -661,6 +697,20 @@ SDL_Window * SDL_CreateWindow_fake(const char *title, int x, int y, int w, int h
 	return SDL_CreateWindow(title, 0, 0, SCREEN_W, SCREEN_H, flags);
 }
 
+static int first_frame = 1;
+
+void SDL_GL_SwapWindow_fake(SDL_Window *window) {
+	SDL_GL_SwapWindow(window);
+	if (first_frame) {
+		first_frame = 0;
+		boot_phase("first frame");
+#if defined(DEFER_INIT) && defined(DEFER_INIT_FRAME)
+		if (deferred_inits)
+			run_deferred_inits(NULL);
+#endif
+	}
+}
+
 SDL_Renderer *SDL_CreateRenderer_hook(SDL_Window *window, int index, Uint32 flags) {
 	SDL_Renderer *r = SDL_CreateRenderer(window, index, flags);
 	SDL_RenderSetLogicalSize(r, SCREEN_W, SCREEN_H);
@@ -683,6 +733,50 @@ int rename_hook(const char *old_filename, const char *new_filename) {
 	return rename(old_filename, new_filename);
 }
 
+#ifdef SNAPSHOT_INIT
+// Calls that leave state out of the heap (threads, pthread keys, kernel and GPU
+// objects, open files), none of which a snapshot can bring back. Counted by a stub
+// in front of the import, which leaves the arguments as they are
+int init_state_calls = 0;
+
+#define INIT_WATCH(func) \
+	__attribute__((naked)) void func##_watched(void) { \
+		asm volatile( \
+			"push {r0, r1}\n" \
+			"ldr r0, =init_state_calls\n" \
+			"ldr r1, [r0]\n" \
+			"adds r1, r1, #1\n" \
+			"str r1, [r0]\n" \
+			"pop {r0, r1}\n" \
+			"ldr ip, =" #func "\n" \
+			"bx ip\n" \
+			".ltorg\n" \
+		); \
+	}
+#define INIT_WATCHED(func) func##_watched
+
+INIT_WATCH(pthread_create_fake)
+INIT_WATCH(pthread_key_create)
+INIT_WATCH(pthread_setspecific)
+INIT_WATCH(fopen_hook)
+INIT_WATCH(opendir_fake)
+INIT_WATCH(SDL_Init)
+INIT_WATCH(SDL_InitSubSystem)
+INIT_WATCH(SDL_CreateThread)
+INIT_WATCH(SDL_CreateMutex)
+INIT_WATCH(SDL_CreateCond)
+INIT_WATCH(SDL_CreateSemaphore)
+INIT_WATCH(SDL_CreateWindow_fake)
+INIT_WATCH(SDL_CreateRenderer)
+INIT_WATCH(SDL_CreateTexture)
+INIT_WATCH(glGenTextures)
+INIT_WATCH(glGenBuffers)
+INIT_WATCH(glGenFramebuffers)
+INIT_WATCH(glGenRenderbuffers)
+#else
+#define INIT_WATCHED(func) func
+#endif
+
 static so_default_dynlib default_dynlib[] = {
 	{ "SDL_GetBasePath", (uintptr_t)&SDL_GetBasePath_hook },
 	{ "SDL_AndroidGetActivityClass", (uintptr_t)&ret0 },
@@ -696,9 +790,9 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_CondSignal", (uintptr_t)&SDL_CondSignal },
 	{ "SDL_CondWait", (uintptr_t)&SDL_CondWait },
 	{ "SDL_ConvertSurfaceFormat", (uintptr_t)&SDL_ConvertSurfaceFormat },
-	{ "SDL_CreateCond", (uintptr_t)&SDL_CreateCond },
-	{ "SDL_CreateMutex", (uintptr_t)&SDL_CreateMutex },
-	{ "SDL_CreateRenderer", (uintptr_t)&SDL_CreateRenderer },
+	{ "SDL_CreateCond", (uintptr_t)&INIT_WATCHED(SDL_CreateCond) },
+	{ "SDL_CreateMutex", (uintptr_t)&INIT_WATCHED(SDL_CreateMutex) },
+	{ "SDL_CreateRenderer", (uintptr_t)&INIT_WATCHED(SDL_CreateRenderer) },
 	{ "SDL_CreateRGBSurface", (uintptr_t)&SDL_CreateRGBSurface },
 	{ "SDL_iconv_string", (uintptr_t)&SDL_iconv_string},
 	{ "SDL_OpenURL", (uintptr_t)&SDL_OpenURL},
@@ -711,7 +805,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_DisableScreenSaver", (uintptr_t)&SDL_DisableScreenSaver},
 	{ "SDL_memset", (uintptr_t)&SDL_memset},
 	{ "SDL_RWseek", (uintptr_t)&SDL_RWseek},
-	{ "SDL_CreateSemaphore", (uintptr_t)&SDL_CreateSemaphore},
+	{ "SDL_CreateSemaphore", (uintptr_t)&INIT_WATCHED(SDL_CreateSemaphore)},
 	{ "SDL_SemWait", (uintptr_t)&SDL_SemWait},
 	{ "SDL_SemWaitTimeout", (uintptr_t)&SDL_SemWaitTimeout},
 	{ "SDL_SemPost", (uintptr_t)&SDL_SemPost},
@@ -721,10 +815,10 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_TLSSet", (uintptr_t)&SDL_TLSSet},
 	{ "sincos", (uintptr_t)&sincos},
 	{ "SDL_CreateRGBSurfaceFrom", (uintptr_t)&SDL_CreateRGBSurfaceFrom},
-	{ "SDL_CreateTexture", (uintptr_t)&SDL_CreateTexture },
+	{ "SDL_CreateTexture", (uintptr_t)&INIT_WATCHED(SDL_CreateTexture) },
 	{ "SDL_CreateTextureFromSurface", (uintptr_t)&SDL_CreateTextureFromSurface },
-	{ "SDL_CreateThread", (uintptr_t)&SDL_CreateThread },
-	{ "SDL_CreateWindow", (uintptr_t)&SDL_CreateWindow_fake },
+	{ "SDL_CreateThread", (uintptr_t)&INIT_WATCHED(SDL_CreateThread) },
+	{ "SDL_CreateWindow", (uintptr_t)&INIT_WATCHED(SDL_CreateWindow_fake) },
 	{ "SDL_Delay", (uintptr_t)&SDL_Delay },
 	{ "SDL_strlen", (uintptr_t)&SDL_strlen },
 	{ "SDL_DestroyMutex", (uintptr_t)&SDL_DestroyMutex },
@@ -751,8 +845,8 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_GL_GetCurrentContext", (uintptr_t)&SDL_GL_GetCurrentContext },
 	{ "SDL_GL_MakeCurrent", (uintptr_t)&SDL_GL_MakeCurrent },
 	{ "SDL_GL_SetAttribute", (uintptr_t)&SDL_GL_SetAttribute },
-	{ "SDL_Init", (uintptr_t)&SDL_Init },
-	{ "SDL_InitSubSystem", (uintptr_t)&SDL_InitSubSystem },
+	{ "SDL_Init", (uintptr_t)&INIT_WATCHED(SDL_Init) },
+	{ "SDL_InitSubSystem", (uintptr_t)&INIT_WATCHED(SDL_InitSubSystem) },
 	{ "SDL_IntersectRect", (uintptr_t)&SDL_IntersectRect },
 	{ "SDL_LockMutex", (uintptr_t)&SDL_LockMutex },
 	{ "SDL_LockSurface", (uintptr_t)&SDL_LockSurface },
@@ -839,7 +933,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_JoystickGetDeviceGUID", (uintptr_t)&SDL_JoystickGetDeviceGUID },
 	{ "SDL_GameControllerNameForIndex", (uintptr_t)&SDL_GameControllerNameForIndex },
 	{ "SDL_GetWindowFromID", (uintptr_t)&SDL_GetWindowFromID },
-	{ "SDL_GL_SwapWindow", (uintptr_t)&SDL_GL_SwapWindow },
+	{ "SDL_GL_SwapWindow", (uintptr_t)&SDL_GL_SwapWindow_fake },
 	{ "SDL_SetMainReady", (uintptr_t)&SDL_SetMainReady },
 	{ "SDL_NumAccelerometers", (uintptr_t)&ret0 },
 	{ "SDL_AndroidGetJNIEnv", (uintptr_t)&Android_JNI_GetEnv },
@@ -880,7 +974,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "SDL_GameControllerClose", (uintptr_t)&SDL_GameControllerClose },
 	{ "SDL_FreeCursor", (uintptr_t)&SDL_FreeCursor },
 	{ "SDL_CreateColorCursor", (uintptr_t)&SDL_CreateColorCursor },
-	{ "opendir", (uintptr_t)&opendir_fake },
+	{ "opendir", (uintptr_t)&INIT_WATCHED(opendir_fake) },
 	{ "readdir", (uintptr_t)&readdir_fake },
 	{ "closedir", (uintptr_t)&closedir_fake },
 	{ "g_SDL_BufferGeometry_w", (uintptr_t)&g_SDL_BufferGeometry_w },
@@ -907,6 +1001,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "__aeabi_memset4", (uintptr_t)&sceClibMemset2 },
 	{ "__aeabi_memset8", (uintptr_t)&sceClibMemset2 },
 	{ "__aeabi_atexit", (uintptr_t)&__aeabi_atexit },
+	{ "__aeabi_read_tp", (uintptr_t)&so_tls_read_tp },
 	{ "__android_log_print", (uintptr_t)&__android_log_print },
 	{ "__android_log_vprint", (uintptr_t)&__android_log_vprint },
 	{ "__android_log_write", (uintptr_t)&__android_log_write },
@@ -924,6 +1019,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "__sF", (uintptr_t)&__sF_fake },
 	{ "__stack_chk_fail", (uintptr_t)&__stack_chk_fail },
 	{ "__stack_chk_guard", (uintptr_t)&__stack_chk_guard_fake },
+	{ "__tls_get_addr", (uintptr_t)&so_tls_get_addr },
 	{ "_ctype_", (uintptr_t)&BIONIC_ctype_},
 	{ "_tolower_tab_", (uintptr_t)&BIONIC_tolower_tab_},
 	{ "_toupper_tab_", (uintptr_t)&BIONIC_toupper_tab_},
@@ -983,7 +1079,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "floorf", (uintptr_t)&floorf },
 	{ "fmod", (uintptr_t)&fmod },
 	{ "fmodf", (uintptr_t)&fmodf },
-	{ "fopen", (uintptr_t)&fopen_hook },
+	{ "fopen", (uintptr_t)&INIT_WATCHED(fopen_hook) },
 	{ "fprintf", (uintptr_t)&fprintf },
 	{ "fputc", (uintptr_t)&fputc },
 	// { "fputwc", (uintptr_t)&fputwc },
@@ -1025,7 +1121,6 @@ static so_default_dynlib default_dynlib[] = {
 	{ "iswcntrl", (uintptr_t)&iswcntrl },
 	{ "iswctype", (uintptr_t)&iswctype },
 	{ "iswdigit", (uintptr_t)&iswdigit },
-	{ "iswdigit", (uintptr_t)&iswdigit },
 	{ "iswlower", (uintptr_t)&iswlower },
 	{ "iswprint", (uintptr_t)&iswprint },
 	{ "iswpunct", (uintptr_t)&iswpunct },
@@ -1075,10 +1170,10 @@ static so_default_dynlib default_dynlib[] = {
 	{ "pthread_cond_destroy", (uintptr_t)&pthread_cond_destroy_fake},
 	{ "pthread_cond_timedwait", (uintptr_t)&pthread_cond_timedwait_fake},
 	{ "pthread_cond_timedwait_relative_np", (uintptr_t)&pthread_cond_timedwait_relative_np_fake}, // FIXME
-	{ "pthread_create", (uintptr_t)&pthread_create_fake },
+	{ "pthread_create", (uintptr_t)&INIT_WATCHED(pthread_create_fake) },
 	{ "pthread_getschedparam", (uintptr_t)&pthread_getschedparam },
 	{ "pthread_getspecific", (uintptr_t)&pthread_getspecific },
-	{ "pthread_key_create", (uintptr_t)&pthread_key_create },
+	{ "pthread_key_create", (uintptr_t)&INIT_WATCHED(pthread_key_create) },
 	{ "pthread_key_delete", (uintptr_t)&pthread_key_delete },
 	{ "pthread_mutex_destroy", (uintptr_t)&pthread_mutex_destroy_fake },
 	{ "pthread_mutex_init", (uintptr_t)&pthread_mutex_init_fake },
@@ -1091,9 +1186,8 @@ static so_default_dynlib default_dynlib[] = {
 	{ "pthread_once", (uintptr_t)&pthread_once_fake },
 	{ "pthread_self", (uintptr_t)&pthread_self },
 	{ "pthread_setname_np", (uintptr_t)&ret0 },
-	{ "pthread_getschedparam", (uintptr_t)&pthread_getschedparam },
 	{ "pthread_setschedparam", (uintptr_t)&pthread_setschedparam },
-	{ "pthread_setspecific", (uintptr_t)&pthread_setspecific },
+	{ "pthread_setspecific", (uintptr_t)&INIT_WATCHED(pthread_setspecific) },
 	{ "sched_get_priority_min", (uintptr_t)&ret0 },
 	{ "sched_get_priority_max", (uintptr_t)&ret99 },
 	{ "putc", (uintptr_t)&putc },
@@ -1120,7 +1214,6 @@ static so_default_dynlib default_dynlib[] = {
 	{ "sin", (uintptr_t)&sin },
 	{ "sinf", (uintptr_t)&sinf },
 	{ "sinh", (uintptr_t)&sinh },
-	//{ "sincos", (uintptr_t)&sincos },
 	{ "snprintf", (uintptr_t)&snprintf },
 	// { "socket", (uintptr_t)&socket },
 	{ "sprintf", (uintptr_t)&sprintf },
@@ -1197,7 +1290,7 @@ static so_default_dynlib default_dynlib[] = {
 	{ "glTexImage2D", (uintptr_t)&glTexImage2D },
 	{ "glDeleteTextures", (uintptr_t)&glDeleteTextures },
 	{ "glDepthFunc", (uintptr_t)&glDepthFunc },
-	{ "glGenTextures", (uintptr_t)&glGenTextures },
+	{ "glGenTextures", (uintptr_t)&INIT_WATCHED(glGenTextures) },
 	{ "glBindTexture", (uintptr_t)&glBindTexture },
 	{ "glTexParameteri", (uintptr_t)&glTexParameteri },
 	{ "glGetError", (uintptr_t)&glGetError },
@@ -1220,14 +1313,14 @@ static so_default_dynlib default_dynlib[] = {
 	{ "glBindRenderbuffer", (uintptr_t)&glBindRenderbuffer},
 	{ "glGetRenderbufferParameteriv", (uintptr_t)&ret0},
 	{ "glDeleteFramebuffers", (uintptr_t)&glDeleteFramebuffers},
-	{ "glGenFramebuffers", (uintptr_t)&glGenFramebuffers},
-	{ "glGenRenderbuffers", (uintptr_t)&glGenRenderbuffers},
+	{ "glGenFramebuffers", (uintptr_t)&INIT_WATCHED(glGenFramebuffers)},
+	{ "glGenRenderbuffers", (uintptr_t)&INIT_WATCHED(glGenRenderbuffers)},
 	{ "glFramebufferRenderbuffer", (uintptr_t)&glFramebufferRenderbuffer},
 	{ "glFramebufferTexture2D", (uintptr_t)&glFramebufferTexture2D},
 	{ "glRenderbufferStorage", (uintptr_t)&glRenderbufferStorage},
 	{ "glCheckFramebufferStatus", (uintptr_t)&glCheckFramebufferStatus},
 	{ "glDeleteBuffers", (uintptr_t)&glDeleteBuffers},
-	{ "glGenBuffers", (uintptr_t)&glGenBuffers},
+	{ "glGenBuffers", (uintptr_t)&INIT_WATCHED(glGenBuffers)},
 	{ "glBufferSubData", (uintptr_t)&glBufferSubData},
 	{ "glBufferData", (uintptr_t)&glBufferData},
 	{ "glLineWidth", (uintptr_t)&glLineWidth},
@@ -1274,7 +1367,6 @@ static so_default_dynlib default_dynlib[] = {
 	{ "glVertexPointer", (uintptr_t)&glVertexPointer },
 	{ "glTexCoordPointer", (uintptr_t)&glTexCoordPointer },
 	{ "glDrawElements", (uintptr_t)&glDrawElements },
-	{ "Android_JNI_GetEnv", (uintptr_t)&Android_JNI_GetEnv },
 	{ "IMG_Load", (uintptr_t)&IMG_Load_hook },
 	{ "IMG_LoadTexture", (uintptr_t)&IMG_LoadTexture_hook },
 	{ "IMG_LoadTexture_RW", (uintptr_t)&IMG_LoadTexture_RW },
@@ -1577,177 +1669,281 @@ void UnlockGooglePlayAchievement(char *ach) {
 	}
 }
 
-void patch_game(void) {
-	hook_addr(so_symbol(&hrm_mod, "_Z23GetCurrentPlatformClassv"), GetCurrentPlatformClass);
-	hook_addr(so_symbol(&hrm_mod, "_Z21SDL2SetContextVersioni"), SetContextVersion);
-	hook_addr(so_symbol(&hrm_mod, "_Z23GetSlowTrulyRandomValuev"), GetSlowTrulyRandomValue);
-	hook_addr(so_symbol(&hrm_mod, "_Z22PfmGetSystemLanguageIdv"), PfmGetSystemLanguageId);
-	hook_addr(so_symbol(&hrm_mod, "_Z27UnlockGooglePlayAchievementPKc"), UnlockGooglePlayAchievement);
-	ogl_hook = hook_addr(so_symbol(&hrm_mod, "ogl_LoadFunctions"), ogl_LoadFunctions);
-	
+typedef struct {
+	const char *symbol;
+	uintptr_t func;
+	so_hook *out;
+} game_hook;
+
+static game_hook game_hooks[] = {
+	{ "_Z23GetCurrentPlatformClassv", (uintptr_t)GetCurrentPlatformClass, NULL },
+	{ "_Z21SDL2SetContextVersioni", (uintptr_t)SetContextVersion, NULL },
+	{ "_Z23GetSlowTrulyRandomValuev", (uintptr_t)GetSlowTrulyRandomValue, NULL },
+	{ "_Z22PfmGetSystemLanguageIdv", (uintptr_t)PfmGetSystemLanguageId, NULL },
+	{ "_Z27UnlockGooglePlayAchievementPKc", (uintptr_t)UnlockGooglePlayAchievement, NULL },
+	{ "ogl_LoadFunctions", (uintptr_t)ogl_LoadFunctions, &ogl_hook },
+
 	// openAL
-	hook_addr(so_symbol(&hrm_mod, "alAuxiliaryEffectSlotf"), (uintptr_t)alAuxiliaryEffectSlotf);
-	hook_addr(so_symbol(&hrm_mod, "alAuxiliaryEffectSlotfv"), (uintptr_t)alAuxiliaryEffectSlotfv);
-	hook_addr(so_symbol(&hrm_mod, "alAuxiliaryEffectSloti"), (uintptr_t)alAuxiliaryEffectSloti);
-	hook_addr(so_symbol(&hrm_mod, "alAuxiliaryEffectSlotiv"), (uintptr_t)alAuxiliaryEffectSlotiv);
-	hook_addr(so_symbol(&hrm_mod, "alBuffer3f"), (uintptr_t)alBuffer3f);
-	hook_addr(so_symbol(&hrm_mod, "alBuffer3i"), (uintptr_t)alBuffer3i);
-	hook_addr(so_symbol(&hrm_mod, "alBufferData"), (uintptr_t)alBufferData);
-	hook_addr(so_symbol(&hrm_mod, "alBufferSamplesSOFT"), (uintptr_t)alBufferSamplesSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alBufferSubDataSOFT"), (uintptr_t)alBufferSubDataSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alBufferSubSamplesSOFT"), (uintptr_t)alBufferSubSamplesSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alBufferf"), (uintptr_t)alBufferf);
-	hook_addr(so_symbol(&hrm_mod, "alBufferfv"), (uintptr_t)alBufferfv);
-	hook_addr(so_symbol(&hrm_mod, "alBufferi"), (uintptr_t)alBufferi);
-	hook_addr(so_symbol(&hrm_mod, "alBufferiv"), (uintptr_t)alBufferiv);
-	hook_addr(so_symbol(&hrm_mod, "alDeferUpdatesSOFT"), (uintptr_t)alDeferUpdatesSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alDeleteAuxiliaryEffectSlots"), (uintptr_t)alDeleteAuxiliaryEffectSlots);
-	hook_addr(so_symbol(&hrm_mod, "alDeleteBuffers"), (uintptr_t)alDeleteBuffers);
-	hook_addr(so_symbol(&hrm_mod, "alDeleteEffects"), (uintptr_t)alDeleteEffects);
-	hook_addr(so_symbol(&hrm_mod, "alDeleteFilters"), (uintptr_t)alDeleteFilters);
-	hook_addr(so_symbol(&hrm_mod, "alDeleteSources"), (uintptr_t)alDeleteSources);
-	hook_addr(so_symbol(&hrm_mod, "alDisable"), (uintptr_t)alDisable);
-	hook_addr(so_symbol(&hrm_mod, "alDistanceModel"), (uintptr_t)alDistanceModel);
-	hook_addr(so_symbol(&hrm_mod, "alDopplerFactor"), (uintptr_t)alDopplerFactor);
-	hook_addr(so_symbol(&hrm_mod, "alDopplerVelocity"), (uintptr_t)alDopplerVelocity);
-	hook_addr(so_symbol(&hrm_mod, "alEffectf"), (uintptr_t)alEffectf);
-	hook_addr(so_symbol(&hrm_mod, "alEffectfv"), (uintptr_t)alEffectfv);
-	hook_addr(so_symbol(&hrm_mod, "alEffecti"), (uintptr_t)alEffecti);
-	hook_addr(so_symbol(&hrm_mod, "alEffectiv"), (uintptr_t)alEffectiv);
-	hook_addr(so_symbol(&hrm_mod, "alEnable"), (uintptr_t)alEnable);
-	hook_addr(so_symbol(&hrm_mod, "alFilterf"), (uintptr_t)alFilterf);
-	hook_addr(so_symbol(&hrm_mod, "alFilterfv"), (uintptr_t)alFilterfv);
-	hook_addr(so_symbol(&hrm_mod, "alFilteri"), (uintptr_t)alFilteri);
-	hook_addr(so_symbol(&hrm_mod, "alFilteriv"), (uintptr_t)alFilteriv);
-	hook_addr(so_symbol(&hrm_mod, "alGenBuffers"), (uintptr_t)alGenBuffers);
-	hook_addr(so_symbol(&hrm_mod, "alGenEffects"), (uintptr_t)alGenEffects);
-	hook_addr(so_symbol(&hrm_mod, "alGenFilters"), (uintptr_t)alGenFilters);
-	hook_addr(so_symbol(&hrm_mod, "alGenSources"), (uintptr_t)alGenSources);
-	hook_addr(so_symbol(&hrm_mod, "alGetAuxiliaryEffectSlotf"), (uintptr_t)alGetAuxiliaryEffectSlotf);
-	hook_addr(so_symbol(&hrm_mod, "alGetAuxiliaryEffectSlotfv"), (uintptr_t)alGetAuxiliaryEffectSlotfv);
-	hook_addr(so_symbol(&hrm_mod, "alGetAuxiliaryEffectSloti"), (uintptr_t)alGetAuxiliaryEffectSloti);
-	hook_addr(so_symbol(&hrm_mod, "alGetAuxiliaryEffectSlotiv"), (uintptr_t)alGetAuxiliaryEffectSlotiv);
-	hook_addr(so_symbol(&hrm_mod, "alGetBoolean"), (uintptr_t)alGetBoolean);
-	hook_addr(so_symbol(&hrm_mod, "alGetBooleanv"), (uintptr_t)alGetBooleanv);
-	hook_addr(so_symbol(&hrm_mod, "alGetBuffer3f"), (uintptr_t)alGetBuffer3f);
-	hook_addr(so_symbol(&hrm_mod, "alGetBuffer3i"), (uintptr_t)alGetBuffer3i);
-	hook_addr(so_symbol(&hrm_mod, "alGetBufferSamplesSOFT"), (uintptr_t)alGetBufferSamplesSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alGetBufferf"), (uintptr_t)alGetBufferf);
-	hook_addr(so_symbol(&hrm_mod, "alGetBufferfv"), (uintptr_t)alGetBufferfv);
-	hook_addr(so_symbol(&hrm_mod, "alGetBufferi"), (uintptr_t)alGetBufferi);
-	hook_addr(so_symbol(&hrm_mod, "alGetBufferiv"), (uintptr_t)alGetBufferiv);
-	hook_addr(so_symbol(&hrm_mod, "alGetDouble"), (uintptr_t)alGetDouble);
-	hook_addr(so_symbol(&hrm_mod, "alGetDoublev"), (uintptr_t)alGetDoublev);
-	hook_addr(so_symbol(&hrm_mod, "alGetEffectf"), (uintptr_t)alGetEffectf);
-	hook_addr(so_symbol(&hrm_mod, "alGetEffectfv"), (uintptr_t)alGetEffectfv);
-	hook_addr(so_symbol(&hrm_mod, "alGetEffecti"), (uintptr_t)alGetEffecti);
-	hook_addr(so_symbol(&hrm_mod, "alGetEffectiv"), (uintptr_t)alGetEffectiv);
-	hook_addr(so_symbol(&hrm_mod, "alGetEnumValue"), (uintptr_t)alGetEnumValue);
-	hook_addr(so_symbol(&hrm_mod, "alGetError"), (uintptr_t)alGetError);
-	hook_addr(so_symbol(&hrm_mod, "alGetFilterf"), (uintptr_t)alGetFilterf);
-	hook_addr(so_symbol(&hrm_mod, "alGetFilterfv"), (uintptr_t)alGetFilterfv);
-	hook_addr(so_symbol(&hrm_mod, "alGetFilteri"), (uintptr_t)alGetFilteri);
-	hook_addr(so_symbol(&hrm_mod, "alGetFilteriv"), (uintptr_t)alGetFilteriv);
-	hook_addr(so_symbol(&hrm_mod, "alGetFloat"), (uintptr_t)alGetFloat);
-	hook_addr(so_symbol(&hrm_mod, "alGetFloatv"), (uintptr_t)alGetFloatv);
-	hook_addr(so_symbol(&hrm_mod, "alGetInteger"), (uintptr_t)alGetInteger);
-	hook_addr(so_symbol(&hrm_mod, "alGetIntegerv"), (uintptr_t)alGetIntegerv);
-	hook_addr(so_symbol(&hrm_mod, "alGetListener3f"), (uintptr_t)alGetListener3f);
-	hook_addr(so_symbol(&hrm_mod, "alGetListener3i"), (uintptr_t)alGetListener3i);
-	hook_addr(so_symbol(&hrm_mod, "alGetListenerf"), (uintptr_t)alGetListenerf);
-	hook_addr(so_symbol(&hrm_mod, "alGetListenerfv"), (uintptr_t)alGetListenerfv);
-	hook_addr(so_symbol(&hrm_mod, "alGetListeneri"), (uintptr_t)alGetListeneri);
-	hook_addr(so_symbol(&hrm_mod, "alGetListeneriv"), (uintptr_t)alGetListeneriv);
-	hook_addr(so_symbol(&hrm_mod, "alGetProcAddress"), (uintptr_t)alGetProcAddress);
-	hook_addr(so_symbol(&hrm_mod, "alGetSource3dSOFT"), (uintptr_t)alGetSource3dSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alGetSource3f"), (uintptr_t)alGetSource3f);
-	hook_addr(so_symbol(&hrm_mod, "alGetSource3i"), (uintptr_t)alGetSource3i);
-	hook_addr(so_symbol(&hrm_mod, "alGetSource3i64SOFT"), (uintptr_t)alGetSource3i64SOFT);
-	hook_addr(so_symbol(&hrm_mod, "alGetSourcedSOFT"), (uintptr_t)alGetSourcedSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alGetSourcedvSOFT"), (uintptr_t)alGetSourcedvSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alGetSourcef"), (uintptr_t)alGetSourcef);
-	hook_addr(so_symbol(&hrm_mod, "alGetSourcefv"), (uintptr_t)alGetSourcefv);
-	hook_addr(so_symbol(&hrm_mod, "alGetSourcei"), (uintptr_t)alGetSourcei);
-	hook_addr(so_symbol(&hrm_mod, "alGetSourcei64SOFT"), (uintptr_t)alGetSourcei64SOFT);
-	hook_addr(so_symbol(&hrm_mod, "alGetSourcei64vSOFT"), (uintptr_t)alGetSourcei64vSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alGetSourceiv"), (uintptr_t)alGetSourceiv);
-	hook_addr(so_symbol(&hrm_mod, "alGetString"), (uintptr_t)alGetString);
-	hook_addr(so_symbol(&hrm_mod, "alIsAuxiliaryEffectSlot"), (uintptr_t)alIsAuxiliaryEffectSlot);
-	hook_addr(so_symbol(&hrm_mod, "alIsBuffer"), (uintptr_t)alIsBuffer);
-	hook_addr(so_symbol(&hrm_mod, "alIsBufferFormatSupportedSOFT"), (uintptr_t)alIsBufferFormatSupportedSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alIsEffect"), (uintptr_t)alIsEffect);
-	hook_addr(so_symbol(&hrm_mod, "alIsEnabled"), (uintptr_t)alIsEnabled);
-	hook_addr(so_symbol(&hrm_mod, "alIsExtensionPresent"), (uintptr_t)alIsExtensionPresent);
-	hook_addr(so_symbol(&hrm_mod, "alIsFilter"), (uintptr_t)alIsFilter);
-	hook_addr(so_symbol(&hrm_mod, "alIsSource"), (uintptr_t)alIsSource);
-	hook_addr(so_symbol(&hrm_mod, "alListener3f"), (uintptr_t)alListener3f);
-	hook_addr(so_symbol(&hrm_mod, "alListener3i"), (uintptr_t)alListener3i);
-	hook_addr(so_symbol(&hrm_mod, "alListenerf"), (uintptr_t)alListenerf);
-	hook_addr(so_symbol(&hrm_mod, "alListenerfv"), (uintptr_t)alListenerfv);
-	hook_addr(so_symbol(&hrm_mod, "alListeneri"), (uintptr_t)alListeneri);
-	hook_addr(so_symbol(&hrm_mod, "alListeneriv"), (uintptr_t)alListeneriv);
-	hook_addr(so_symbol(&hrm_mod, "alProcessUpdatesSOFT"), (uintptr_t)alProcessUpdatesSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alSetConfigMOB"), (uintptr_t)ret0);
-	hook_addr(so_symbol(&hrm_mod, "alSource3dSOFT"), (uintptr_t)alSource3dSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alSource3f"), (uintptr_t)alSource3f);
-	hook_addr(so_symbol(&hrm_mod, "alSource3i"), (uintptr_t)alSource3i);
-	hook_addr(so_symbol(&hrm_mod, "alSource3i64SOFT"), (uintptr_t)alSource3i64SOFT);
-	hook_addr(so_symbol(&hrm_mod, "alSourcePause"), (uintptr_t)alSourcePause);
-	hook_addr(so_symbol(&hrm_mod, "alSourcePausev"), (uintptr_t)alSourcePausev);
-	hook_addr(so_symbol(&hrm_mod, "alSourcePlay"), (uintptr_t)alSourcePlay);
-	hook_addr(so_symbol(&hrm_mod, "alSourcePlayv"), (uintptr_t)alSourcePlayv);
-	hook_addr(so_symbol(&hrm_mod, "alSourceQueueBuffers"), (uintptr_t)alSourceQueueBuffers);
-	hook_addr(so_symbol(&hrm_mod, "alSourceRewind"), (uintptr_t)alSourceRewind);
-	hook_addr(so_symbol(&hrm_mod, "alSourceRewindv"), (uintptr_t)alSourceRewindv);
-	hook_addr(so_symbol(&hrm_mod, "alSourceStop"), (uintptr_t)alSourceStop);
-	hook_addr(so_symbol(&hrm_mod, "alSourceStopv"), (uintptr_t)alSourceStopv);
-	hook_addr(so_symbol(&hrm_mod, "alSourceUnqueueBuffers"), (uintptr_t)alSourceUnqueueBuffers);
-	hook_addr(so_symbol(&hrm_mod, "alSourcedSOFT"), (uintptr_t)alSourcedSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alSourcedvSOFT"), (uintptr_t)alSourcedvSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alSourcef"), (uintptr_t)alSourcef);
-	hook_addr(so_symbol(&hrm_mod, "alSourcefv"), (uintptr_t)alSourcefv);
-	hook_addr(so_symbol(&hrm_mod, "alSourcei"), (uintptr_t)alSourcei);
-	hook_addr(so_symbol(&hrm_mod, "alSourcei64SOFT"), (uintptr_t)alSourcei64SOFT);
-	hook_addr(so_symbol(&hrm_mod, "alSourcei64vSOFT"), (uintptr_t)alSourcei64vSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alSourceiv"), (uintptr_t)alSourceiv);
-	hook_addr(so_symbol(&hrm_mod, "alSpeedOfSound"), (uintptr_t)alSpeedOfSound);
-	hook_addr(so_symbol(&hrm_mod, "alcCaptureCloseDevice"), (uintptr_t)alcCaptureCloseDevice);
-	hook_addr(so_symbol(&hrm_mod, "alcCaptureOpenDevice"), (uintptr_t)alcCaptureOpenDevice);
-	hook_addr(so_symbol(&hrm_mod, "alcCaptureSamples"), (uintptr_t)alcCaptureSamples);
-	hook_addr(so_symbol(&hrm_mod, "alcCaptureStart"), (uintptr_t)alcCaptureStart);
-	hook_addr(so_symbol(&hrm_mod, "alcCaptureStop"), (uintptr_t)alcCaptureStop);
-	hook_addr(so_symbol(&hrm_mod, "alcCloseDevice"), (uintptr_t)alcCloseDevice);
-	hook_addr(so_symbol(&hrm_mod, "alcCreateContext"), (uintptr_t)alcCreateContext);
-	hook_addr(so_symbol(&hrm_mod, "alcDestroyContext"), (uintptr_t)alcDestroyContext);
-	hook_addr(so_symbol(&hrm_mod, "alcDeviceEnableHrtfMOB"), (uintptr_t)ret0);
-	hook_addr(so_symbol(&hrm_mod, "alcGetContextsDevice"), (uintptr_t)alcGetContextsDevice);
-	hook_addr(so_symbol(&hrm_mod, "alcGetCurrentContext"), (uintptr_t)alcGetCurrentContext);
-	hook_addr(so_symbol(&hrm_mod, "alcGetEnumValue"), (uintptr_t)alcGetEnumValue);
-	hook_addr(so_symbol(&hrm_mod, "alcGetError"), (uintptr_t)alcGetError);
-	hook_addr(so_symbol(&hrm_mod, "alcGetIntegerv"), (uintptr_t)alcGetIntegerv);
-	hook_addr(so_symbol(&hrm_mod, "alcGetProcAddress"), (uintptr_t)alcGetProcAddress);
-	hook_addr(so_symbol(&hrm_mod, "alcGetString"), (uintptr_t)alcGetString);
-	hook_addr(so_symbol(&hrm_mod, "alcGetThreadContext"), (uintptr_t)alcGetThreadContext);
-	hook_addr(so_symbol(&hrm_mod, "alcIsExtensionPresent"), (uintptr_t)alcIsExtensionPresent);
-	hook_addr(so_symbol(&hrm_mod, "alcIsRenderFormatSupportedSOFT"), (uintptr_t)alcIsRenderFormatSupportedSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alcLoopbackOpenDeviceSOFT"), (uintptr_t)alcLoopbackOpenDeviceSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alcMakeContextCurrent"), (uintptr_t)alcMakeContextCurrent);
-	hook_addr(so_symbol(&hrm_mod, "alcOpenDevice"), (uintptr_t)alcOpenDevice);
-	hook_addr(so_symbol(&hrm_mod, "alcProcessContext"), (uintptr_t)alcProcessContext);
-	hook_addr(so_symbol(&hrm_mod, "alcRenderSamplesSOFT"), (uintptr_t)alcRenderSamplesSOFT);
-	hook_addr(so_symbol(&hrm_mod, "alcSetThreadContext"), (uintptr_t)alcSetThreadContext);
-	hook_addr(so_symbol(&hrm_mod, "alcSuspendContext"), (uintptr_t)alcSuspendContext);
-	hook_addr(so_symbol(&hrm_mod, "alBufferMarkNeedsFreed"), (uintptr_t)ret0);
-	hook_addr(so_symbol(&hrm_mod, "_Z22alBufferMarkNeedsFreedj"), (uintptr_t)ret0);
-	hook_addr(so_symbol(&hrm_mod, "_Z17alBufferDebugNamejPKc"), (uintptr_t)ret0);
+	{ "alAuxiliaryEffectSlotf", (uintptr_t)alAuxiliaryEffectSlotf, NULL },
+	{ "alAuxiliaryEffectSlotfv", (uintptr_t)alAuxiliaryEffectSlotfv, NULL },
+	{ "alAuxiliaryEffectSloti", (uintptr_t)alAuxiliaryEffectSloti, NULL },
+	{ "alAuxiliaryEffectSlotiv", (uintptr_t)alAuxiliaryEffectSlotiv, NULL },
+	{ "alBuffer3f", (uintptr_t)alBuffer3f, NULL },
+	{ "alBuffer3i", (uintptr_t)alBuffer3i, NULL },
+	{ "alBufferData", (uintptr_t)alBufferData, NULL },
+	{ "alBufferSamplesSOFT", (uintptr_t)alBufferSamplesSOFT, NULL },
+	{ "alBufferSubDataSOFT", (uintptr_t)alBufferSubDataSOFT, NULL },
+	{ "alBufferSubSamplesSOFT", (uintptr_t)alBufferSubSamplesSOFT, NULL },
+	{ "alBufferf", (uintptr_t)alBufferf, NULL },
+	{ "alBufferfv", (uintptr_t)alBufferfv, NULL },
+	{ "alBufferi", (uintptr_t)alBufferi, NULL },
+	{ "alBufferiv", (uintptr_t)alBufferiv, NULL },
+	{ "alDeferUpdatesSOFT", (uintptr_t)alDeferUpdatesSOFT, NULL },
+	{ "alDeleteAuxiliaryEffectSlots", (uintptr_t)alDeleteAuxiliaryEffectSlots, NULL },
+	{ "alDeleteBuffers", (uintptr_t)alDeleteBuffers, NULL },
+	{ "alDeleteEffects", (uintptr_t)alDeleteEffects, NULL },
+	{ "alDeleteFilters", (uintptr_t)alDeleteFilters, NULL },
+	{ "alDeleteSources", (uintptr_t)alDeleteSources, NULL },
+	{ "alDisable", (uintptr_t)alDisable, NULL },
+	{ "alDistanceModel", (uintptr_t)alDistanceModel, NULL },
+	{ "alDopplerFactor", (uintptr_t)alDopplerFactor, NULL },
+	{ "alDopplerVelocity", (uintptr_t)alDopplerVelocity, NULL },
+	{ "alEffectf", (uintptr_t)alEffectf, NULL },
+	{ "alEffectfv", (uintptr_t)alEffectfv, NULL },
+	{ "alEffecti", (uintptr_t)alEffecti, NULL },
+	{ "alEffectiv", (uintptr_t)alEffectiv, NULL },
+	{ "alEnable", (uintptr_t)alEnable, NULL },
+	{ "alFilterf", (uintptr_t)alFilterf, NULL },
+	{ "alFilterfv", (uintptr_t)alFilterfv, NULL },
+	{ "alFilteri", (uintptr_t)alFilteri, NULL },
+	{ "alFilteriv", (uintptr_t)alFilteriv, NULL },
+	{ "alGenBuffers", (uintptr_t)alGenBuffers, NULL },
+	{ "alGenEffects", (uintptr_t)alGenEffects, NULL },
+	{ "alGenFilters", (uintptr_t)alGenFilters, NULL },
+	{ "alGenSources", (uintptr_t)alGenSources, NULL },
+	{ "alGetAuxiliaryEffectSlotf", (uintptr_t)alGetAuxiliaryEffectSlotf, NULL },
+	{ "alGetAuxiliaryEffectSlotfv", (uintptr_t)alGetAuxiliaryEffectSlotfv, NULL },
+	{ "alGetAuxiliaryEffectSloti", (uintptr_t)alGetAuxiliaryEffectSloti, NULL },
+	{ "alGetAuxiliaryEffectSlotiv", (uintptr_t)alGetAuxiliaryEffectSlotiv, NULL },
+	{ "alGetBoolean", (uintptr_t)alGetBoolean, NULL },
+	{ "alGetBooleanv", (uintptr_t)alGetBooleanv, NULL },
+	{ "alGetBuffer3f", (uintptr_t)alGetBuffer3f, NULL },
+	{ "alGetBuffer3i", (uintptr_t)alGetBuffer3i, NULL },
+	{ "alGetBufferSamplesSOFT", (uintptr_t)alGetBufferSamplesSOFT, NULL },
+	{ "alGetBufferf", (uintptr_t)alGetBufferf, NULL },
+	{ "alGetBufferfv", (uintptr_t)alGetBufferfv, NULL },
+	{ "alGetBufferi", (uintptr_t)alGetBufferi, NULL },
+	{ "alGetBufferiv", (uintptr_t)alGetBufferiv, NULL },
+	{ "alGetDouble", (uintptr_t)alGetDouble, NULL },
+	{ "alGetDoublev", (uintptr_t)alGetDoublev, NULL },
+	{ "alGetEffectf", (uintptr_t)alGetEffectf, NULL },
+	{ "alGetEffectfv", (uintptr_t)alGetEffectfv, NULL },
+	{ "alGetEffecti", (uintptr_t)alGetEffecti, NULL },
+	{ "alGetEffectiv", (uintptr_t)alGetEffectiv, NULL },
+	{ "alGetEnumValue", (uintptr_t)alGetEnumValue, NULL },
+	{ "alGetError", (uintptr_t)alGetError, NULL },
+	{ "alGetFilterf", (uintptr_t)alGetFilterf, NULL },
+	{ "alGetFilterfv", (uintptr_t)alGetFilterfv, NULL },
+	{ "alGetFilteri", (uintptr_t)alGetFilteri, NULL },
+	{ "alGetFilteriv", (uintptr_t)alGetFilteriv, NULL },
+	{ "alGetFloat", (uintptr_t)alGetFloat, NULL },
+	{ "alGetFloatv", (uintptr_t)alGetFloatv, NULL },
+	{ "alGetInteger", (uintptr_t)alGetInteger, NULL },
+	{ "alGetIntegerv", (uintptr_t)alGetIntegerv, NULL },
+	{ "alGetListener3f", (uintptr_t)alGetListener3f, NULL },
+	{ "alGetListener3i", (uintptr_t)alGetListener3i, NULL },
+	{ "alGetListenerf", (uintptr_t)alGetListenerf, NULL },
+	{ "alGetListenerfv", (uintptr_t)alGetListenerfv, NULL },
+	{ "alGetListeneri", (uintptr_t)alGetListeneri, NULL },
+	{ "alGetListeneriv", (uintptr_t)alGetListeneriv, NULL },
+	{ "alGetProcAddress", (uintptr_t)alGetProcAddress, NULL },
+	{ "alGetSource3dSOFT", (uintptr_t)alGetSource3dSOFT, NULL },
+	{ "alGetSource3f", (uintptr_t)alGetSource3f, NULL },
+	{ "alGetSource3i", (uintptr_t)alGetSource3i, NULL },
+	{ "alGetSource3i64SOFT", (uintptr_t)alGetSource3i64SOFT, NULL },
+	{ "alGetSourcedSOFT", (uintptr_t)alGetSourcedSOFT, NULL },
+	{ "alGetSourcedvSOFT", (uintptr_t)alGetSourcedvSOFT, NULL },
+	{ "alGetSourcef", (uintptr_t)alGetSourcef, NULL },
+	{ "alGetSourcefv", (uintptr_t)alGetSourcefv, NULL },
+	{ "alGetSourcei", (uintptr_t)alGetSourcei, NULL },
+	{ "alGetSourcei64SOFT", (uintptr_t)alGetSourcei64SOFT, NULL },
+	{ "alGetSourcei64vSOFT", (uintptr_t)alGetSourcei64vSOFT, NULL },
+	{ "alGetSourceiv", (uintptr_t)alGetSourceiv, NULL },
+	{ "alGetString", (uintptr_t)alGetString, NULL },
+	{ "alIsAuxiliaryEffectSlot", (uintptr_t)alIsAuxiliaryEffectSlot, NULL },
+	{ "alIsBuffer", (uintptr_t)alIsBuffer, NULL },
+	{ "alIsBufferFormatSupportedSOFT", (uintptr_t)alIsBufferFormatSupportedSOFT, NULL },
+	{ "alIsEffect", (uintptr_t)alIsEffect, NULL },
+	{ "alIsEnabled", (uintptr_t)alIsEnabled, NULL },
+	{ "alIsExtensionPresent", (uintptr_t)alIsExtensionPresent, NULL },
+	{ "alIsFilter", (uintptr_t)alIsFilter, NULL },
+	{ "alIsSource", (uintptr_t)alIsSource, NULL },
+	{ "alListener3f", (uintptr_t)alListener3f, NULL },
+	{ "alListener3i", (uintptr_t)alListener3i, NULL },
+	{ "alListenerf", (uintptr_t)alListenerf, NULL },
+	{ "alListenerfv", (uintptr_t)alListenerfv, NULL },
+	{ "alListeneri", (uintptr_t)alListeneri, NULL },
+	{ "alListeneriv", (uintptr_t)alListeneriv, NULL },
+	{ "alProcessUpdatesSOFT", (uintptr_t)alProcessUpdatesSOFT, NULL },
+	{ "alSetConfigMOB", (uintptr_t)ret0, NULL },
+	{ "alSource3dSOFT", (uintptr_t)alSource3dSOFT, NULL },
+	{ "alSource3f", (uintptr_t)alSource3f, NULL },
+	{ "alSource3i", (uintptr_t)alSource3i, NULL },
+	{ "alSource3i64SOFT", (uintptr_t)alSource3i64SOFT, NULL },
+	{ "alSourcePause", (uintptr_t)alSourcePause, NULL },
+	{ "alSourcePausev", (uintptr_t)alSourcePausev, NULL },
+	{ "alSourcePlay", (uintptr_t)alSourcePlay, NULL },
+	{ "alSourcePlayv", (uintptr_t)alSourcePlayv, NULL },
+	{ "alSourceQueueBuffers", (uintptr_t)alSourceQueueBuffers, NULL },
+	{ "alSourceRewind", (uintptr_t)alSourceRewind, NULL },
+	{ "alSourceRewindv", (uintptr_t)alSourceRewindv, NULL },
+	{ "alSourceStop", (uintptr_t)alSourceStop, NULL },
+	{ "alSourceStopv", (uintptr_t)alSourceStopv, NULL },
+	{ "alSourceUnqueueBuffers", (uintptr_t)alSourceUnqueueBuffers, NULL },
+	{ "alSourcedSOFT", (uintptr_t)alSourcedSOFT, NULL },
+	{ "alSourcedvSOFT", (uintptr_t)alSourcedvSOFT, NULL },
+	{ "alSourcef", (uintptr_t)alSourcef, NULL },
+	{ "alSourcefv", (uintptr_t)alSourcefv, NULL },
+	{ "alSourcei", (uintptr_t)alSourcei, NULL },
+	{ "alSourcei64SOFT", (uintptr_t)alSourcei64SOFT, NULL },
+	{ "alSourcei64vSOFT", (uintptr_t)alSourcei64vSOFT, NULL },
+	{ "alSourceiv", (uintptr_t)alSourceiv, NULL },
+	{ "alSpeedOfSound", (uintptr_t)alSpeedOfSound, NULL },
+	{ "alcCaptureCloseDevice", (uintptr_t)alcCaptureCloseDevice, NULL },
+	{ "alcCaptureOpenDevice", (uintptr_t)alcCaptureOpenDevice, NULL },
+	{ "alcCaptureSamples", (uintptr_t)alcCaptureSamples, NULL },
+	{ "alcCaptureStart", (uintptr_t)alcCaptureStart, NULL },
+	{ "alcCaptureStop", (uintptr_t)alcCaptureStop, NULL },
+	{ "alcCloseDevice", (uintptr_t)alcCloseDevice, NULL },
+	{ "alcCreateContext", (uintptr_t)alcCreateContext, NULL },
+	{ "alcDestroyContext", (uintptr_t)alcDestroyContext, NULL },
+	{ "alcDeviceEnableHrtfMOB", (uintptr_t)ret0, NULL },
+	{ "alcGetContextsDevice", (uintptr_t)alcGetContextsDevice, NULL },
+	{ "alcGetCurrentContext", (uintptr_t)alcGetCurrentContext, NULL },
+	{ "alcGetEnumValue", (uintptr_t)alcGetEnumValue, NULL },
+	{ "alcGetError", (uintptr_t)alcGetError, NULL },
+	{ "alcGetIntegerv", (uintptr_t)alcGetIntegerv, NULL },
+	{ "alcGetProcAddress", (uintptr_t)alcGetProcAddress, NULL },
+	{ "alcGetString", (uintptr_t)alcGetString, NULL },
+	{ "alcGetThreadContext", (uintptr_t)alcGetThreadContext, NULL },
+	{ "alcIsExtensionPresent", (uintptr_t)alcIsExtensionPresent, NULL },
+	{ "alcIsRenderFormatSupportedSOFT", (uintptr_t)alcIsRenderFormatSupportedSOFT, NULL },
+	{ "alcLoopbackOpenDeviceSOFT", (uintptr_t)alcLoopbackOpenDeviceSOFT, NULL },
+	{ "alcMakeContextCurrent", (uintptr_t)alcMakeContextCurrent, NULL },
+	{ "alcOpenDevice", (uintptr_t)alcOpenDevice, NULL },
+	{ "alcProcessContext", (uintptr_t)alcProcessContext, NULL },
+	{ "alcRenderSamplesSOFT", (uintptr_t)alcRenderSamplesSOFT, NULL },
+	{ "alcSetThreadContext", (uintptr_t)alcSetThreadContext, NULL },
+	{ "alcSuspendContext", (uintptr_t)alcSuspendContext, NULL },
+	{ "alBufferMarkNeedsFreed", (uintptr_t)ret0, NULL },
+	{ "_Z22alBufferMarkNeedsFreedj", (uintptr_t)ret0, NULL },
+	{ "_Z17alBufferDebugNamejPKc", (uintptr_t)ret0, NULL },
+};
+
+#define NUM_GAME_HOOKS (sizeof(game_hooks) / sizeof(*game_hooks))
+
+#ifdef INTRINSICS
+// Routines the game may carry its own copy of, matched in its exports and
+// routed to native ones (only the ones listed in INTRINSICS are). The names
+// it imports instead already go through default_dynlib.
+static intrinsic intrinsics[] = {
+	{ "strlen", INTRINSIC_STRLEN, (uintptr_t)&strlen, NULL },
+	{ "strcmp", INTRINSIC_STRCMP, (uintptr_t)&sceClibStrcmp, NULL },
+	{ "strncmp", INTRINSIC_STRNCMP, (uintptr_t)&sceClibStrncmp, NULL },
+	{ "strchr", INTRINSIC_STRCHR, (uintptr_t)&strchr, NULL },
+	{ "strrchr", INTRINSIC_STRCHR, (uintptr_t)&sceClibStrrchr, NULL },
+	{ "strstr", INTRINSIC_STRSTR, (uintptr_t)&sceClibStrstr, NULL },
+	{ "memcmp", INTRINSIC_STRNCMP, (uintptr_t)&memcmp, NULL },
+	{ "memchr", INTRINSIC_MEMCHR, (uintptr_t)&sceClibMemchr, NULL },
+
+	// mathneon, less accurate than libm
+	{ "sinf", INTRINSIC_F_F, (uintptr_t)&sinf_neon, NULL },
+	{ "cosf", INTRINSIC_F_F, (uintptr_t)&cosf_neon, NULL },
+	{ "tanf", INTRINSIC_F_F, (uintptr_t)&tanf_neon, NULL },
+	{ "atanf", INTRINSIC_F_F, (uintptr_t)&atanf_neon, NULL },
+	{ "atan2f", INTRINSIC_F_FF, (uintptr_t)&atan2f_neon, NULL },
+	{ "expf", INTRINSIC_F_F, (uintptr_t)&expf_neon, NULL },
+	{ "logf", INTRINSIC_F_F, (uintptr_t)&logf_neon, NULL },
+	{ "log10f", INTRINSIC_F_F, (uintptr_t)&log10f_neon, NULL },
+	{ "powf", INTRINSIC_F_FF, (uintptr_t)&powf_neon, NULL },
+	{ "sqrtf", INTRINSIC_F_F, (uintptr_t)&sqrtf_neon, NULL },
+	{ "fmodf", INTRINSIC_F_FF, (uintptr_t)&fmodf_neon, NULL },
+};
+
+#define NUM_INTRINSICS (sizeof(intrinsics) / sizeof(*intrinsics))
+#endif
+
+void patch_game(void) {
+	const char *symbols[NUM_GAME_HOOKS];
+	uintptr_t addrs[NUM_GAME_HOOKS];
+	for (int i = 0; i < NUM_GAME_HOOKS; i++)
+		symbols[i] = game_hooks[i].symbol;
+	so_symbols_lookup(&hrm_mod, symbols, addrs, NUM_GAME_HOOKS);
+
+	so_hook_batch hooks;
+	hook_begin(&hooks);
+	for (int i = 0; i < NUM_GAME_HOOKS; i++)
+		hook_queue(&hooks, addrs[i], game_hooks[i].func, game_hooks[i].out);
+
+	if (hook_commit(&hooks) < 0)
+		fatal_error("Error could not install the game hooks.");
+
+#ifdef INTRINSICS
+	static intrinsic_result results[NUM_INTRINSICS];
+#ifdef INTRINSICS_BENCH
+	int bench_calls = INTRINSICS_BENCH;
+#else
+	int bench_calls = 0;
+#endif
+	int substituted = intrinsics_apply(&hrm_mod, intrinsics, NUM_INTRINSICS, INTRINSICS, bench_calls, results);
+	if (substituted < 0)
+		fatal_error("Error could not install the intrinsics.");
+	printf("%d intrinsics substituted\n", substituted);
+	for (int i = 0; i < NUM_INTRINSICS; i++)
+		if (results[i].rejected)
+			printf("Intrinsic %s left alone, its signature differs\n", intrinsics[i].name);
+	if (bench_calls)
+		intrinsics_report(DATA_PATH "/intrinsics.txt", intrinsics, NUM_INTRINSICS, results);
+#endif
+#ifdef PROBES
+	int probed = probes_install_file(&hrm_mod, DATA_PATH "/probes.txt", PROBES);
+	if (probed < 0)
+		fatal_error("Error could not install the probes.");
+	printf("%d probes installed\n", probed);
+#endif
 }
 
+#ifdef TRACE_IMPORTS
+static void report_imports(void) {
+	so_trace_report(DATA_PATH "/imports.txt");
+}
+#endif
+
+#ifdef PROBES
+static void report_probes(void) {
+	probes_report(DATA_PATH "/probes_report.txt");
+}
+#endif
+
+#ifdef PROFILER
+static void stop_profiler(void) {
+	profiler_stop(DATA_PATH);
+}
+#endif
+
 void *hrm_main(void *argv) {
 	char *args[1];
 	args[0] = DATA_PATH;
 	
 	int (* SDL_main)(int argc, char *args[]) = (void *) so_symbol(&hrm_mod, "SDL_main");
+#ifdef PROFILER
+	if (profiler_start(sceKernelGetThreadId(), PROFILER_INTERVAL_US) >= 0)
+		atexit(stop_profiler);
+#endif
 	SDL_main(1, args);
+#ifdef PROFILER
+	stop_profiler();
+#endif
 	
 	return NULL;
 }
@@ -1775,6 +1971,52 @@ int __wrap_sceTouchPeek(SceUInt32 port, SceTouchData *pData, SceUInt32 nBufs) {
 	return num;
 }
 
+// Binds a module, replaying its prelinked bindings when they are still valid:
+// the ones built in by host/bindgen first, then the ones cached by a previous boot
+void link_module(so_module *mod, const char *prelink_path) {
+	if (so_prelink_static(mod, default_dynlib, sizeof(default_dynlib)) < 0)
+		so_prelink_load(mod, prelink_path, default_dynlib, sizeof(default_dynlib));
+	mod->link_threads = LINK_THREADS;
+#ifdef LAZY_BINDING
+	int res = so_link_lazy(mod, default_dynlib, sizeof(default_dynlib), 0);
+#else
+	int res = so_link(mod, default_dynlib, sizeof(default_dynlib), 0);
+#endif
+	if (res < 0)
+		fatal_error("Error could not link %s.", mod->soname);
+	if (!mod->prelinked)
+		so_prelink_save(mod, prelink_path, default_dynlib, sizeof(default_dynlib));
+	so_link_report(mod);
+}
+
+#ifdef RECLAIM
+// Names so_symbol is still called with once booted, the other ones are looked up
+// in the modules themselves after so_reclaim
+static const char *runtime_symbols[] = {
+	"SDL_main",
+	"ogl_ext_OES_mapbuffer",
+};
+#endif
+
+// DATA_PATH/libfoo.so caches its bindings in DATA_PATH/libfoo.prelink
+static int link_dep(so_module *mod, const char *name, void *arg) {
+	char prelink_path[256];
+	const char *ext = strrchr(name, '.');
+	snprintf(prelink_path, sizeof(prelink_path), DATA_PATH "/%.*s.prelink", (int)(ext ? ext - name : strlen(name)), name);
+
+	printf("Linking %s\n", name);
+	link_module(mod, prelink_path);
+#ifdef SNAPSHOT
+	char path[256];
+	snprintf(path, sizeof(path), DATA_PATH "/%s", name);
+	snapshot_add(&boot_snapshot, mod, name, path);
+#endif
+	if (mod == &hrm_mod)
+		patch_game();
+
+	return 0;
+}
+
 int main(int argc, char *argv[]) {
 	// Play
 	btns[0].mask = SCE_CTRL_CROSS;
@@ -1820,26 +2062,106 @@ int main(int argc, char *argv[]) {
 	if (check_kubridge() < 0)
 		fatal_error("Error: kubridge.skprx is not installed.");
 
+	// The game and the modules it needs from DATA_PATH come back from the
+	// snapshot if there is a valid one, otherwise they are read on helper
+	// threads from here on and each one gets linked as soon as it is in
+	boot_start = boot_last = sceKernelGetProcessTimeWide();
+	if (deps_scan(&modules, DATA_PATH, "libHumanResourceMachine.so", &hrm_mod, LOAD_ADDRESS) < 0)
+		fatal_error("Error could not load %s.", DATA_PATH "/libHumanResourceMachine.so");
+#ifdef SNAPSHOT
+	int restored = snapshot_restore(SNAPSHOT_FILE, &modules, default_dynlib, sizeof(default_dynlib));
+#else
+	int restored = -1;
+#endif
+	if (restored < 0 && deps_start(&modules) < 0)
+		fatal_error("Error could not queue %d modules.", modules.num);
+
 	if (!file_exists("ur0:/data/libshacccg.suprx") && !file_exists("ur0:/data/external/libshacccg.suprx"))
 		fatal_error("Error: libshacccg.suprx is not installed.");
 	
-	printf("Loading libc++_shared\n");
-	if (so_file_load(&cpp_mod, DATA_PATH "/libc++_shared.so", LOAD_ADDRESS + 0x3000000) < 0)
-		fatal_error("Error could not load %s.", DATA_PATH "/libc++_shared.so");
-	so_relocate(&cpp_mod);
-	so_resolve(&cpp_mod, default_dynlib, sizeof(default_dynlib), 0);
-	so_flush_caches(&cpp_mod);
-	so_initialize(&cpp_mod);
-	
-	printf("Loading libHumanResourceMachine\n");
-	if (so_file_load(&hrm_mod, DATA_PATH "/libHumanResourceMachine.so", LOAD_ADDRESS) < 0)
-		fatal_error("Error could not load %s.", DATA_PATH "/libHumanResourceMachine.so");
-	so_relocate(&hrm_mod);
-	so_resolve(&hrm_mod, default_dynlib, sizeof(default_dynlib), 0);
-	
-	patch_game();
-	so_flush_caches(&hrm_mod);
-	so_initialize(&hrm_mod);
+	// Index the import tables once, this also reports duplicated entries
+	so_dynlib_prepare(default_dynlib, sizeof(default_dynlib));
+	so_dynlib_prepare(gl_hook, sizeof(gl_hook));
+#ifdef TRACE_IMPORTS
+	so_trace_imports(TRACE_IMPORTS);
+	atexit(report_imports);
+#endif
+#ifdef PROBES
+	atexit(report_probes);
+#endif
+
+	if (restored >= 0) {
+		// Mapped back as they were once linked, only the hooks are left to install
+		patch_game();
+		so_flush_caches(&hrm_mod);
+		boot_phase("modules restored and patched");
+	} else {
+#ifdef SNAPSHOT
+		snapshot_begin(&boot_snapshot, SNAPSHOT_FILE, modules.num, default_dynlib, sizeof(default_dynlib));
+#endif
+		int failed = deps_link(&modules, link_dep, NULL);
+		if (failed >= 0)
+			fatal_error("Error could not load %s.", modules.nodes[failed].path);
+		boot_phase("modules linked and patched");
+	}
+	for (int i = 0; i < modules.num; i++)
+		so_arena_report(modules.nodes[i].mod);
+
+	if (restored > 0) {
+		boot_phase("modules initialized already");
+	} else {
+#ifdef SNAPSHOT_INIT
+		struct mallinfo heap = mallinfo();
+		int state_calls = init_state_calls;
+#endif
+#ifdef DEFER_INIT
+		deferred_inits = deps_initialize(&modules, DEFER_INIT);
+#else
+		deps_initialize(&modules, NULL);
+#endif
+		boot_phase("modules initialized");
+#ifdef SNAPSHOT
+		if (restored < 0) {
+#ifdef SNAPSHOT_INIT
+			// Whatever the constructors allocated would not be there on the next boot
+			// and neither would the threads, files and objects they made
+			int allocated = mallinfo().uordblks - heap.uordblks;
+			int state_made = init_state_calls - state_calls;
+			if (allocated)
+				printf("Constructors allocated %d bytes, their data is not kept.\n", allocated);
+			else if (state_made)
+				printf("Constructors made %d threads, files or objects, their data is not kept.\n", state_made);
+			else
+				snapshot_add_init(&boot_snapshot);
+#endif
+			if (snapshot_end(&boot_snapshot) < 0)
+				printf("Could not write %s.\n", SNAPSHOT_FILE);
+			boot_phase("snapshot written");
+		}
+#endif
+	}
+	deps_report(&modules);
+	so_tls_report();
+#ifdef RECLAIM
+	size_t reclaimed = so_reclaim(runtime_symbols, sizeof(runtime_symbols) / sizeof(*runtime_symbols));
+	for (int i = 0; i < modules.num; i++)
+		so_reclaim_report(modules.nodes[i].mod);
+	printf("%u bytes of loader metadata reclaimed\n", (unsigned)reclaimed);
+	boot_phase("metadata reclaimed");
+#endif
+#if defined(DEFER_INIT) && !defined(DEFER_INIT_FRAME)
+	// Alongside the game from here on, past so_reclaim as they may bind lazily
+	if (deferred_inits) {
+		pthread_t init_thread;
+		pthread_attr_t init_attr;
+		pthread_attr_init(&init_attr);
+		pthread_attr_setstacksize(&init_attr, 0x100000);
+		if (pthread_create(&init_thread, &init_attr, run_deferred_inits, NULL) == 0)
+			pthread_detach(init_thread);
+		else
+			run_deferred_inits(NULL);
+	}
+#endif
 	
 	vglInitExtended(0, SCREEN_W, SCREEN_H, MEMORY_VITAGL_THRESHOLD_MB * 1024 * 1024, SCE_GXM_MULTISAMPLE_4X);
 	
@@ -0,0 +1,268 @@
+/* prelink.c -- persistent cache of the import bindings of a module
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "so_util.h"
+#include "prelink.h"
+#include "sha1.h"
+
+#define PRELINK_MAGIC "HRMPLNK"
+#define PRELINK_VERSION 1
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_providers;
+	uint32_t num_bindings;
+	uint32_t num_dynsym;
+	uint8_t module_hash[SO_HASH_SIZE];
+	uint8_t dynlib_hash[SO_HASH_SIZE];
+	char build[32];
+} prelink_header;
+
+// Any rebuild of the loader invalidates the cache
+static const char build_id[32] = __DATE__ " " __TIME__;
+
+void so_dynlib_hash(so_default_dynlib *default_dynlib, int size_default_dynlib, uint8_t *hash) {
+	SHA1_CTX ctx;
+	sha1_init(&ctx);
+	for (int i = 0; i < size_default_dynlib / sizeof(so_default_dynlib); i++)
+		sha1_update(&ctx, (const BYTE *)default_dynlib[i].symbol, strlen(default_dynlib[i].symbol) + 1);
+	sha1_final(&ctx, hash);
+}
+
+static int read_all(SceUID fd, void *buf, size_t size) {
+	return sceIoRead(fd, buf, size) == size ? 0 : -1;
+}
+
+// Checks bindings recorded for this module against it and against the modules
+// loaded now, then gives it a copy with the providers mapped to load positions
+int so_prelink_table_apply(so_module *mod, const prelink_table *table, so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	int position[PRELINK_MAX_PROVIDERS];
+	uint8_t dynlib_hash[SO_HASH_SIZE];
+
+	so_dynlib_hash(default_dynlib, size_default_dynlib, dynlib_hash);
+	if (table->num_dynsym != mod->num_dynsym ||
+		table->num_providers > PRELINK_MAX_PROVIDERS ||
+		table->num_bindings > mod->num_dynsym ||
+		memcmp(table->module_hash, mod->digest, SO_HASH_SIZE) != 0 ||
+		memcmp(table->dynlib_hash, dynlib_hash, SO_HASH_SIZE) != 0)
+		return -1;
+
+	// Every provider must still be loaded and unchanged
+	for (int i = 0; i < table->num_providers; i++) {
+		so_module *provider;
+		position[i] = -1;
+		for (int pos = 0; (provider = so_module_at(pos)); pos++) {
+			if (provider->soname && strncmp(provider->soname, table->providers[i].soname, sizeof(table->providers[i].soname)) == 0 &&
+				memcmp(provider->digest, table->providers[i].hash, SO_HASH_SIZE) == 0) {
+				position[i] = pos;
+				break;
+			}
+		}
+		if (position[i] == -1)
+			return -1;
+	}
+
+	so_binding *bindings = malloc(table->num_bindings * sizeof(so_binding));
+	if (!bindings)
+		return -1;
+	memcpy(bindings, table->bindings, table->num_bindings * sizeof(so_binding));
+
+	int num_default_dynlib = size_default_dynlib / sizeof(so_default_dynlib);
+	for (int i = 0; i < table->num_bindings; i++) {
+		so_binding *b = &bindings[i];
+		if (b->sym >= mod->num_dynsym)
+			goto err;
+		switch (b->kind) {
+		case SO_BIND_DYNLIB:
+			if (b->index >= num_default_dynlib)
+				goto err;
+			break;
+		case SO_BIND_LINK:
+			if (b->provider >= table->num_providers)
+				goto err;
+			b->provider = position[b->provider];
+			if (b->index >= so_module_at(b->provider)->num_dynsym)
+				goto err;
+			break;
+		case SO_BIND_NONE:
+			break;
+		default:
+			goto err;
+		}
+	}
+
+	free(mod->bindings);
+	mod->bindings = bindings;
+	mod->num_bindings = table->num_bindings;
+	mod->prelinked = 1;
+
+	return 0;
+
+err:
+	free(bindings);
+	return -1;
+}
+
+// The other way around: the bindings of a linked module, providers by soname and hash
+int so_prelink_table_build(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, prelink_table *table) {
+	int table_index[PRELINK_MAX_PROVIDERS];
+
+	memset(table, 0, sizeof(*table));
+	if (!mod->bindings)
+		return -1;
+
+	prelink_provider *providers = calloc(PRELINK_MAX_PROVIDERS, sizeof(prelink_provider));
+	so_binding *bindings = malloc(mod->num_bindings * sizeof(so_binding));
+	if (!providers || !bindings)
+		goto err;
+
+	for (int i = 0; i < PRELINK_MAX_PROVIDERS; i++)
+		table_index[i] = -1;
+	for (int i = 0; i < mod->num_bindings; i++) {
+		bindings[i] = mod->bindings[i];
+		if (bindings[i].kind != SO_BIND_LINK)
+			continue;
+
+		int pos = bindings[i].provider;
+		if (pos >= PRELINK_MAX_PROVIDERS)
+			goto err;
+		if (table_index[pos] == -1) {
+			if (table->num_providers == PRELINK_MAX_PROVIDERS)
+				goto err;
+			so_module *provider = so_module_at(pos);
+			strncpy(providers[table->num_providers].soname, provider->soname ? provider->soname : "", sizeof(providers[0].soname) - 1);
+			memcpy(providers[table->num_providers].hash, provider->digest, SO_HASH_SIZE);
+			table_index[pos] = table->num_providers++;
+		}
+		bindings[i].provider = table_index[pos];
+	}
+
+	table->soname = mod->soname;
+	memcpy(table->module_hash, mod->digest, SO_HASH_SIZE);
+	so_dynlib_hash(default_dynlib, size_default_dynlib, table->dynlib_hash);
+	table->num_dynsym = mod->num_dynsym;
+	table->providers = providers;
+	table->bindings = bindings;
+	table->num_bindings = mod->num_bindings;
+
+	return 0;
+
+err:
+	free(providers);
+	free(bindings);
+	memset(table, 0, sizeof(*table));
+	return -1;
+}
+
+void so_prelink_table_free(prelink_table *table) {
+	free((void *)table->providers);
+	free((void *)table->bindings);
+	memset(table, 0, sizeof(*table));
+}
+
+int so_prelink_static(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	mod->prelinked = 0;
+	if (!mod->soname)
+		return -1;
+
+	for (int i = 0; i < num_static_bindings; i++) {
+		if (strcmp(static_bindings[i].soname, mod->soname) == 0)
+			return so_prelink_table_apply(mod, &static_bindings[i], default_dynlib, size_default_dynlib);
+	}
+
+	return -1;
+}
+
+int so_prelink_load(so_module *mod, const char *path, so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	prelink_header hdr;
+	prelink_provider providers[PRELINK_MAX_PROVIDERS];
+	so_binding *bindings = NULL;
+	int res = -1;
+
+	mod->prelinked = 0;
+
+	SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+	if (fd < 0)
+		return fd;
+
+	if (read_all(fd, &hdr, sizeof(hdr)) < 0 ||
+		memcmp(hdr.magic, PRELINK_MAGIC, sizeof(PRELINK_MAGIC)) != 0 ||
+		hdr.version != PRELINK_VERSION ||
+		hdr.num_providers > PRELINK_MAX_PROVIDERS ||
+		hdr.num_bindings > mod->num_dynsym ||
+		memcmp(hdr.build, build_id, sizeof(build_id)) != 0)
+		goto err;
+
+	bindings = malloc(hdr.num_bindings * sizeof(so_binding));
+	if (!bindings ||
+		read_all(fd, providers, hdr.num_providers * sizeof(prelink_provider)) < 0 ||
+		read_all(fd, bindings, hdr.num_bindings * sizeof(so_binding)) < 0)
+		goto err;
+
+	prelink_table table;
+	table.soname = mod->soname;
+	memcpy(table.module_hash, hdr.module_hash, SO_HASH_SIZE);
+	memcpy(table.dynlib_hash, hdr.dynlib_hash, SO_HASH_SIZE);
+	table.num_dynsym = hdr.num_dynsym;
+	table.providers = providers;
+	table.num_providers = hdr.num_providers;
+	table.bindings = bindings;
+	table.num_bindings = hdr.num_bindings;
+	res = so_prelink_table_apply(mod, &table, default_dynlib, size_default_dynlib);
+
+err:
+	free(bindings);
+	sceIoClose(fd);
+	return res;
+}
+
+int so_prelink_save(so_module *mod, const char *path, so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	prelink_header hdr;
+	prelink_table table;
+
+	if (so_prelink_table_build(mod, default_dynlib, size_default_dynlib, &table) < 0)
+		return -1;
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PRELINK_MAGIC, sizeof(PRELINK_MAGIC));
+	hdr.version = PRELINK_VERSION;
+	hdr.num_providers = table.num_providers;
+	hdr.num_bindings = table.num_bindings;
+	hdr.num_dynsym = table.num_dynsym;
+	memcpy(hdr.module_hash, table.module_hash, SO_HASH_SIZE);
+	memcpy(hdr.dynlib_hash, table.dynlib_hash, SO_HASH_SIZE);
+	memcpy(hdr.build, build_id, sizeof(build_id));
+
+	SceUID fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+	if (fd < 0) {
+		so_prelink_table_free(&table);
+		return fd;
+	}
+
+	int res = 0;
+	if (sceIoWrite(fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+		sceIoWrite(fd, table.providers, hdr.num_providers * sizeof(prelink_provider)) != hdr.num_providers * sizeof(prelink_provider) ||
+		sceIoWrite(fd, table.bindings, hdr.num_bindings * sizeof(so_binding)) != hdr.num_bindings * sizeof(so_binding))
+		res = -1;
+
+	sceIoClose(fd);
+	so_prelink_table_free(&table);
+
+	// Never leave a truncated cache behind
+	if (res < 0)
+		sceIoRemove(path);
+
+	return res;
+}
@@ -0,0 +1,38 @@
+#ifndef __PRELINK_H__
+#define __PRELINK_H__
+
+#include "so_util.h"
+
+#define PRELINK_MAX_PROVIDERS 16
+
+typedef struct {
+  char soname[64];
+  uint8_t hash[SO_HASH_SIZE];
+} prelink_provider;
+
+// The bindings of one module, as saved in a .prelink file or compiled in by host/bindgen.
+// LINK bindings refer to their provider by index in providers.
+typedef struct {
+  const char *soname;
+  uint8_t module_hash[SO_HASH_SIZE]; // so_module digest
+  uint8_t dynlib_hash[SO_HASH_SIZE]; // so_dynlib_hash of default_dynlib
+  uint32_t num_dynsym;
+  const prelink_provider *providers;
+  uint32_t num_providers;
+  const so_binding *bindings;
+  uint32_t num_bindings;
+} prelink_table;
+
+// Generated tables, see static_bindings.c
+extern const prelink_table static_bindings[];
+extern const int num_static_bindings;
+
+void so_dynlib_hash(so_default_dynlib *default_dynlib, int size_default_dynlib, uint8_t *hash);
+int so_prelink_load(so_module *mod, const char *path, so_default_dynlib *default_dynlib, int size_default_dynlib);
+int so_prelink_save(so_module *mod, const char *path, so_default_dynlib *default_dynlib, int size_default_dynlib);
+int so_prelink_static(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib);
+int so_prelink_table_apply(so_module *mod, const prelink_table *table, so_default_dynlib *default_dynlib, int size_default_dynlib);
+int so_prelink_table_build(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, prelink_table *table);
+void so_prelink_table_free(prelink_table *table);
+
+#endif
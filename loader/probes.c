@@ -0,0 +1,216 @@
+/* probes.c -- entry/exit timing of chosen functions of the game
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+#include <kubridge.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dialog.h"
+#include "probes.h"
+
+#define PROBES_FILE_MAX 0x4000
+
+/*
+ * Each probed function gets its first instructions replaced by a jump to a
+ * timed call thunk in the arenas of its module, the one import tracing uses:
+ * the hook trampoline runs between so_shadow_enter and so_shadow_leave, which
+ * hands the figures to probes_account. Calls left by longjmp are dropped from
+ * the shadow stack, but an exception cannot be unwound through the thunk.
+ * Without PROBES none of this is reached.
+*/
+static probe probes[PROBES_MAX];
+static int num_probes = 0;
+
+static void probes_account(so_shadow_site *site, uint64_t time_us, uint64_t self_us, int depth) {
+	probe *p = (probe *)site;
+	__atomic_add_fetch(&p->returns, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&p->time_us, time_us, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&p->self_us, self_us, __ATOMIC_RELAXED);
+	if (depth)
+		__atomic_add_fetch(&p->nested, 1, __ATOMIC_RELAXED);
+
+	uint32_t depth_max = __atomic_load_n(&p->depth_max, __ATOMIC_RELAXED);
+	while (depth + 1 > depth_max && !__atomic_compare_exchange_n(&p->depth_max, &depth_max, depth + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	uint64_t min = __atomic_load_n(&p->min_us, __ATOMIC_RELAXED);
+	while (time_us < min && !__atomic_compare_exchange_n(&p->min_us, &min, time_us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+	uint64_t max = __atomic_load_n(&p->max_us, __ATOMIC_RELAXED);
+	while (time_us > max && !__atomic_compare_exchange_n(&p->max_us, &max, time_us, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+		;
+}
+
+static uintptr_t probes_thunk(so_module *mod, probe *p) {
+	uint32_t code[SO_SHADOW_THUNK_SIZE / 4];
+	so_shadow_code(&p->site, code);
+	return so_arena_write(mod, 0, code, sizeof(code));
+}
+
+// Next name of a list, NULL at its end
+static const char *probes_next(const char *s, size_t *len) {
+	for (;;) {
+		while (*s && isspace((unsigned char)*s))
+			s++;
+		if (*s != '#')
+			break;
+		while (*s && *s != '\n')
+			s++;
+	}
+	if (!*s)
+		return NULL;
+
+	const char *end = s;
+	while (*end && !isspace((unsigned char)*end) && *end != '#')
+		end++;
+	*len = end - s;
+	return s;
+}
+
+int probes_install(so_module *mod, const char *list) {
+	so_hook_batch hooks;
+	int first = num_probes, len_max = sizeof(probes[0].name) - 1;
+	size_t len;
+	hook_begin(&hooks);
+	for (const char *s = list; s && (s = probes_next(s, &len)); s += len) {
+		char name[sizeof(probes[0].name)];
+		if (len > len_max) {
+			printf("Probe name too long: %.*s\n", len_max, s);
+			continue;
+		}
+		memcpy(name, s, len);
+		name[len] = 0;
+
+		int dup = 0;
+		for (int i = 0; i < num_probes && !dup; i++)
+			dup = strcmp(probes[i].name, name) == 0;
+		if (dup)
+			continue;
+		if (num_probes == PROBES_MAX) {
+			printf("Too many probes, %s is one more than %d\n", name, PROBES_MAX);
+			break;
+		}
+
+		uintptr_t addr = so_symbol(mod, name);
+		if (!addr) {
+			printf("Probe not found: %s\n", name);
+			continue;
+		}
+
+		probe *p = &probes[num_probes];
+		memset(p, 0, sizeof(probe));
+		strcpy(p->name, name);
+		p->addr = addr;
+		p->site.leave = probes_account;
+		p->min_us = UINT64_MAX;
+		p->thunk = probes_thunk(mod, p);
+		if (!p->thunk) {
+			printf("Probe not installed, arenas are full: %s\n", name);
+			continue;
+		}
+		memcpy(p->orig, (void *)(addr & ~1), sizeof(p->orig));
+		hook_queue(&hooks, addr, p->thunk, &p->hook);
+		num_probes++;
+	}
+	if (hook_commit(&hooks) < 0) {
+		num_probes = first;
+		return -1;
+	}
+
+	// A prologue that cannot be moved leaves no way to run the function, put it back
+	int n = first;
+	for (int i = first; i < num_probes; i++) {
+		probe *p = &probes[i];
+		if (!p->hook.trampoline) {
+			printf("Probe not installed, prologue cannot be moved: %s\n", p->name);
+			kuKernelCpuUnrestrictedMemcpy((void *)(p->addr & ~1), p->orig, sizeof(p->orig));
+			kuKernelFlushCaches((void *)(p->addr & ~1), sizeof(p->orig));
+			continue;
+		}
+		p->site.target = p->hook.trampoline;
+		if (n != i) {
+			// Its thunk is only reached once the probe is in place, point it at the new slot
+			uint32_t literal = (uint32_t)(uintptr_t)&probes[n].site;
+			probes[n] = *p;
+			kuKernelCpuUnrestrictedMemcpy((void *)(p->thunk + SO_SHADOW_THUNK_SITE), &literal, sizeof(literal));
+			kuKernelFlushCaches((void *)(p->thunk + SO_SHADOW_THUNK_SITE), sizeof(literal));
+		}
+		n++;
+	}
+	num_probes = n;
+
+	return num_probes - first;
+}
+
+int probes_install_file(so_module *mod, const char *path, const char *fallback) {
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return fallback ? probes_install(mod, fallback) : 0;
+
+	char *list = malloc(PROBES_FILE_MAX + 1);
+	if (!list) {
+		fclose(f);
+		return -1;
+	}
+	size_t len = fread(list, 1, PROBES_FILE_MAX, f);
+	fclose(f);
+	if (len == PROBES_FILE_MAX)
+		printf("Probe list %s is cut at %d bytes\n", path, PROBES_FILE_MAX);
+	list[len] = 0;
+
+	int res = probes_install(mod, list);
+	free(list);
+	return res;
+}
+
+static int probes_cmp(const void *a, const void *b) {
+	const probe *pa = *(const probe **)a, *pb = *(const probe **)b;
+	if (pa->time_us != pb->time_us)
+		return pa->time_us < pb->time_us ? 1 : -1;
+	return pa->site.calls < pb->site.calls ? 1 : pa->site.calls > pb->site.calls ? -1 : 0;
+}
+
+// Writes the probes ranked by total time, returns how many were called
+int probes_report(const char *path) {
+	probe *ranked[PROBES_MAX];
+	int num = 0;
+	for (int i = 0; i < num_probes; i++)
+		if (probes[i].site.calls)
+			ranked[num++] = &probes[i];
+	qsort(ranked, num, sizeof(probe *), probes_cmp);
+
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return -1;
+	fprintf(f, "%10s %10s %12s %12s %10s %10s %10s %6s %10s  %s\n",
+		"calls", "returned", "total ms", "self ms", "avg us", "min us", "max us", "depth", "nested", "function");
+	for (int i = 0; i < num; i++) {
+		probe *p = ranked[i];
+		fprintf(f, "%10u %10u %12.3f %12.3f %10.3f %10llu %10llu %6u %10u  %s\n", p->site.calls, p->returns, p->time_us / 1000.0, p->self_us / 1000.0,
+			p->returns ? (double)p->time_us / p->returns : 0.0, p->returns ? (unsigned long long)p->min_us : 0ULL, (unsigned long long)p->max_us,
+			p->depth_max, p->nested, p->name);
+	}
+	for (int i = 0; i < num_probes; i++)
+		if (!probes[i].site.calls)
+			fprintf(f, "%10u %10u %12s %12s %10s %10s %10s %6s %10s  %s\n", 0, 0, "-", "-", "-", "-", "-", "-", "-", probes[i].name);
+	fclose(f);
+
+	return num;
+}
+
+const probe *probes_list(int *num) {
+	*num = num_probes;
+	return probes;
+}
+
+void probes_clear(void) {
+	num_probes = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef __PROBES_H__
+#define __PROBES_H__
+
+#include "so_util.h"
+
+#define PROBES_MAX 64
+
+typedef struct {
+  so_shadow_site site; // runs the hook trampoline, counts the calls
+  char name[SO_NAME_MAX * 2];
+  uintptr_t addr;
+  so_hook hook;
+  uintptr_t thunk;
+  uint8_t orig[12];    // what the hook overwrote, hook.orig_instr misses a Thumb alignment NOP
+  uint32_t returns;    // calls that came back, the times only cover these
+  uint32_t nested;     // calls made while another timed one was running
+  uint32_t depth_max;  // deepest it was entered at, 1 when never under another timed call
+  uint64_t time_us;    // from entry to exit, the timed calls it made included
+  uint64_t self_us;    // the same without them, probes and traced imports alike
+  uint64_t min_us, max_us;
+} probe;
+
+// Hooks every function of mod named in list (mangled names separated by
+// spaces or lines, # starts a comment), so that each call goes through a
+// timed call thunk (so_shadow_code). Returns how many got a probe, names not
+// found or whose prologue cannot be moved are reported and left alone.
+int probes_install(so_module *mod, const char *list);
+// The same with the list read from path, fallback when there is no such file
+int probes_install_file(so_module *mod, const char *path, const char *fallback);
+// Ranked by total time, returns how many were called
+int probes_report(const char *path);
+const probe *probes_list(int *num);
+// Forgets the probes and their figures, their modules are gone
+void probes_clear(void);
+
+#endif
@@ -0,0 +1,391 @@
+/* profiler.c -- PC sampling profiler for the loaded modules
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "so_util.h"
+#include "profiler.h"
+
+#define PROF_MAGIC "HRMPROF"
+#define PROF_VERSION 1
+#define PROF_MAX_MODULES 16
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_modules;
+	uint32_t num_samples;
+} prof_header;
+
+typedef struct {
+	char soname[64];
+	uint32_t text_base;
+	uint32_t text_size;
+} prof_module;
+
+typedef struct {
+	uint64_t key; // caller symbol << 32 | callee symbol
+	int count;
+} prof_edge;
+
+static int symbol_cmp(const void *a, const void *b) {
+	const prof_symbol *sa = (const prof_symbol *)a, *sb = (const prof_symbol *)b;
+	if (sa->start != sb->start)
+		return sa->start < sb->start ? -1 : 1;
+	return 0;
+}
+
+int prof_index_build(prof_index *index) {
+	int num = 0;
+	for (int pos = 0; so_module_at(pos); pos++) {
+		so_module *mod = so_module_at(pos);
+		for (int i = 1; i < mod->num_dynsym; i++)
+			if (mod->dynsym[i].st_shndx != SHN_UNDEF && ELF32_ST_TYPE(mod->dynsym[i].st_info) == STT_FUNC)
+				num++;
+	}
+
+	index->symbols = malloc((num + 1) * sizeof(prof_symbol));
+	index->num_symbols = 0;
+	if (!index->symbols)
+		return -1;
+
+	for (int pos = 0; so_module_at(pos); pos++) {
+		so_module *mod = so_module_at(pos);
+		int first = index->num_symbols;
+		for (int i = 1; i < mod->num_dynsym; i++) {
+			Elf32_Sym *sym = &mod->dynsym[i];
+			if (sym->st_shndx == SHN_UNDEF || ELF32_ST_TYPE(sym->st_info) != STT_FUNC)
+				continue;
+			prof_symbol *s = &index->symbols[index->num_symbols++];
+			s->start = mod->text_base + (sym->st_value & ~1);
+			s->end = s->start + sym->st_size;
+			s->name = mod->dynstr + sym->st_name;
+			s->mod = mod;
+		}
+
+		// Symbols without a size stretch up to the next one of their module
+		qsort(&index->symbols[first], index->num_symbols - first, sizeof(prof_symbol), symbol_cmp);
+		for (int i = first; i < index->num_symbols; i++) {
+			prof_symbol *s = &index->symbols[i];
+			if (s->end == s->start)
+				s->end = i + 1 < index->num_symbols ? index->symbols[i + 1].start : mod->text_base + mod->text_size;
+		}
+	}
+	qsort(index->symbols, index->num_symbols, sizeof(prof_symbol), symbol_cmp);
+
+	return 0;
+}
+
+void prof_index_free(prof_index *index) {
+	free(index->symbols);
+	index->symbols = NULL;
+	index->num_symbols = 0;
+}
+
+// Returns the symbol covering addr, or -1 if there is none
+int prof_symbolize(prof_index *index, uintptr_t addr) {
+	int lo = 0, hi = index->num_symbols - 1, found = -1;
+	while (lo <= hi) {
+		int mid = (lo + hi) / 2;
+		if (index->symbols[mid].start <= addr) {
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	// Nested or aliased symbols share a start, walk back to one that covers addr
+	while (found >= 0 && addr >= index->symbols[found].end) {
+		if (found == 0 || index->symbols[found - 1].start != index->symbols[found].start)
+			return -1;
+		found--;
+	}
+	return found;
+}
+
+int prof_samples_save(const char *path, prof_sample *samples, int num) {
+	prof_header hdr;
+	prof_module modules[PROF_MAX_MODULES];
+	int num_modules = 0;
+
+	memset(modules, 0, sizeof(modules));
+	for (so_module *mod; num_modules < PROF_MAX_MODULES && (mod = so_module_at(num_modules)); num_modules++) {
+		strncpy(modules[num_modules].soname, mod->soname ? mod->soname : "", sizeof(modules[num_modules].soname) - 1);
+		modules[num_modules].text_base = mod->text_base;
+		modules[num_modules].text_size = mod->text_size;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, PROF_MAGIC, sizeof(PROF_MAGIC));
+	hdr.version = PROF_VERSION;
+	hdr.num_modules = num_modules;
+	hdr.num_samples = num;
+
+	FILE *f = fopen(path, "wb");
+	if (!f)
+		return -1;
+	int res = 0;
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+		fwrite(modules, sizeof(prof_module), num_modules, f) != num_modules ||
+		fwrite(samples, sizeof(prof_sample), num, f) != num)
+		res = -1;
+	fclose(f);
+
+	return res;
+}
+
+static uint32_t prof_rebase(prof_module *modules, int num_modules, so_module **loaded, uint32_t addr) {
+	for (int i = 0; i < num_modules; i++) {
+		if (loaded[i] && addr >= modules[i].text_base && addr - modules[i].text_base < modules[i].text_size)
+			return addr - modules[i].text_base + loaded[i]->text_base;
+	}
+	return addr;
+}
+
+prof_sample *prof_samples_load(const char *path, int *num) {
+	prof_header hdr;
+	prof_module modules[PROF_MAX_MODULES];
+	so_module *loaded[PROF_MAX_MODULES];
+	prof_sample *samples = NULL;
+
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return NULL;
+
+	if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+		memcmp(hdr.magic, PROF_MAGIC, sizeof(PROF_MAGIC)) != 0 ||
+		hdr.version != PROF_VERSION ||
+		hdr.num_modules > PROF_MAX_MODULES ||
+		hdr.num_samples > PROFILER_MAX_SAMPLES ||
+		fread(modules, sizeof(prof_module), hdr.num_modules, f) != hdr.num_modules)
+		goto err;
+
+	for (int i = 0; i < hdr.num_modules; i++) {
+		loaded[i] = NULL;
+		for (int pos = 0; so_module_at(pos); pos++) {
+			so_module *mod = so_module_at(pos);
+			if (mod->soname && strncmp(mod->soname, modules[i].soname, sizeof(modules[i].soname)) == 0) {
+				loaded[i] = mod;
+				break;
+			}
+		}
+	}
+
+	samples = malloc(hdr.num_samples * sizeof(prof_sample));
+	if (!samples || fread(samples, sizeof(prof_sample), hdr.num_samples, f) != hdr.num_samples)
+		goto err;
+	fclose(f);
+
+	for (int i = 0; i < hdr.num_samples; i++) {
+		samples[i].pc = prof_rebase(modules, hdr.num_modules, loaded, samples[i].pc);
+		samples[i].lr = prof_rebase(modules, hdr.num_modules, loaded, samples[i].lr);
+	}
+	*num = hdr.num_samples;
+	return samples;
+
+err:
+	free(samples);
+	fclose(f);
+	return NULL;
+}
+
+static int edge_key_cmp(const void *a, const void *b) {
+	uint64_t ka = ((const prof_edge *)a)->key, kb = ((const prof_edge *)b)->key;
+	return ka < kb ? -1 : ka > kb;
+}
+
+static int edge_count_cmp(const void *a, const void *b) {
+	const prof_edge *ea = (const prof_edge *)a, *eb = (const prof_edge *)b;
+	if (ea->count != eb->count)
+		return eb->count - ea->count;
+	return edge_key_cmp(a, b);
+}
+
+static const char *prof_name(prof_index *index, int sym) {
+	return sym < 0 ? "[unknown]" : index->symbols[sym].name;
+}
+
+static const char *prof_module_name(prof_index *index, int sym) {
+	return sym < 0 || !index->symbols[sym].mod->soname ? "" : index->symbols[sym].mod->soname;
+}
+
+int prof_report(prof_index *index, prof_sample *samples, int num, const char *flat_path, const char *graph_path) {
+	// The last slot collects the samples outside of any known function
+	int *self = calloc(index->num_symbols + 1, sizeof(int));
+	prof_edge *order = malloc((index->num_symbols + 1) * sizeof(prof_edge));
+	prof_edge *edges = malloc((num + 1) * sizeof(prof_edge));
+	int res = -1;
+
+	if (!self || !order || !edges)
+		goto out;
+
+	for (int i = 0; i < num; i++) {
+		int callee = prof_symbolize(index, samples[i].pc);
+		int caller = prof_symbolize(index, samples[i].lr & ~1);
+		self[callee < 0 ? index->num_symbols : callee]++;
+		edges[i].key = (uint64_t)(uint32_t)caller << 32 | (uint32_t)callee;
+		edges[i].count = 1;
+	}
+
+	// Flat profile, busiest functions first
+	int num_order = 0;
+	for (int i = 0; i <= index->num_symbols; i++)
+		if (self[i])
+			order[num_order++] = (prof_edge){ .key = i, .count = self[i] };
+	qsort(order, num_order, sizeof(prof_edge), edge_count_cmp);
+
+	FILE *f = fopen(flat_path, "w");
+	if (!f)
+		goto out;
+	fprintf(f, "%d samples\n%10s %7s  %s\n", num, "self", "%", "function");
+	for (int i = 0; i < num_order; i++) {
+		int sym = order[i].key == index->num_symbols ? -1 : (int)order[i].key;
+		fprintf(f, "%10d %6.2f%%  %s %s\n", order[i].count, 100.0 * order[i].count / num, prof_name(index, sym), prof_module_name(index, sym));
+	}
+	fclose(f);
+
+	// Caller/callee pairs, as told by the LR of each sample
+	int num_edges = 0;
+	qsort(edges, num, sizeof(prof_edge), edge_key_cmp);
+	for (int i = 0; i < num; i++) {
+		if (num_edges && edges[num_edges - 1].key == edges[i].key)
+			edges[num_edges - 1].count++;
+		else
+			edges[num_edges++] = edges[i];
+	}
+	qsort(edges, num_edges, sizeof(prof_edge), edge_count_cmp);
+
+	f = fopen(graph_path, "w");
+	if (!f)
+		goto out;
+	fprintf(f, "%d samples\n%10s %7s  %s\n", num, "samples", "%", "caller -> callee");
+	for (int i = 0; i < num_edges; i++) {
+		int caller = (int32_t)(edges[i].key >> 32), callee = (int32_t)(uint32_t)edges[i].key;
+		fprintf(f, "%10d %6.2f%%  %s -> %s\n", edges[i].count, 100.0 * edges[i].count / num, prof_name(index, caller), prof_name(index, callee));
+	}
+	fclose(f);
+	res = 0;
+
+out:
+	free(self);
+	free(order);
+	free(edges);
+	return res;
+}
+
+#ifdef __arm__
+#define CHECK_SAMPLES 8
+
+// User context of a thread as sceKernelGetThreadContextForVM saves it, the
+// layout SceKernel keeps thread registers in
+typedef struct {
+	uint32_t r[13];
+	uint32_t sp, lr, pc;
+	uint32_t cpsr;
+	uint32_t unk;
+} prof_cpu_context;
+
+typedef struct {
+	uint64_t d[32];
+	uint32_t fpscr, fpexc;
+} prof_vfp_context;
+
+static SceUID sampler_thid = -1;
+static SceUID target_thid;
+static int sampler_interval;
+static volatile int sampler_running;
+static prof_sample *samples;
+static volatile int num_samples;
+
+static int sampler_capture(prof_cpu_context *cpu) {
+	prof_vfp_context vfp;
+	memset(cpu, 0, sizeof(prof_cpu_context));
+	return sceKernelGetThreadContextForVM(target_thid, (void *)cpu, (void *)&vfp);
+}
+
+static int sampler_thread(SceSize args, void *argp) {
+	prof_cpu_context cpu;
+	SceKernelThreadInfo info;
+
+	// A context not laid out as expected would shift every sample by a register,
+	// check that it holds a user mode CPSR and an SP within the thread's stack
+	memset(&info, 0, sizeof(info));
+	info.size = sizeof(info);
+	if (sceKernelGetThreadInfo(target_thid, &info) < 0) {
+		printf("Profiler could not get the stack of thread 0x%08X\n", target_thid);
+		return 0;
+	}
+	uintptr_t stack = (uintptr_t)info.stack;
+	for (int checked = 0; sampler_running && checked < CHECK_SAMPLES; ) {
+		sceKernelDelayThread(sampler_interval);
+		if (sampler_capture(&cpu) < 0)
+			continue;
+		if ((cpu.cpsr & 0x1f) != 0x10 || cpu.sp < stack || cpu.sp > stack + info.stackSize) {
+			printf("Profiler got a context of thread 0x%08X it cannot read (cpsr 0x%08X, sp 0x%08X), not sampling\n",
+				target_thid, (unsigned)cpu.cpsr, (unsigned)cpu.sp);
+			return 0;
+		}
+		checked++;
+	}
+
+	while (sampler_running && num_samples < PROFILER_MAX_SAMPLES) {
+		sceKernelDelayThread(sampler_interval);
+		if (sampler_capture(&cpu) < 0)
+			continue;
+		samples[num_samples].pc = cpu.pc;
+		samples[num_samples].lr = cpu.lr;
+		num_samples++;
+	}
+
+	return 0;
+}
+
+int profiler_start(SceUID thid, int interval_us) {
+	samples = malloc(PROFILER_MAX_SAMPLES * sizeof(prof_sample));
+	if (!samples)
+		return -1;
+
+	target_thid = thid;
+	sampler_interval = interval_us;
+	sampler_running = 1;
+	num_samples = 0;
+	sampler_thid = sceKernelCreateThread("profiler", sampler_thread, 0x10000100, 0x4000, 0, 0, NULL);
+	if (sampler_thid < 0)
+		return sampler_thid;
+
+	return sceKernelStartThread(sampler_thid, 0, NULL);
+}
+
+void profiler_stop(const char *dir) {
+	char flat_path[256], graph_path[256], samples_path[256];
+	prof_index index;
+
+	if (!sampler_running)
+		return;
+	sampler_running = 0;
+	sceKernelWaitThreadEnd(sampler_thid, NULL, NULL);
+	sceKernelDeleteThread(sampler_thid);
+
+	snprintf(samples_path, sizeof(samples_path), "%s/samples.prof", dir);
+	snprintf(flat_path, sizeof(flat_path), "%s/profile_flat.txt", dir);
+	snprintf(graph_path, sizeof(graph_path), "%s/profile_calls.txt", dir);
+	prof_samples_save(samples_path, samples, num_samples);
+	if (prof_index_build(&index) == 0) {
+		prof_report(&index, samples, num_samples, flat_path, graph_path);
+		prof_index_free(&index);
+	}
+
+	free(samples);
+	samples = NULL;
+}
+#endif
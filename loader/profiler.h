@@ -0,0 +1,42 @@
+#ifndef __PROFILER_H__
+#define __PROFILER_H__
+
+#include "so_util.h"
+
+#define PROFILER_MAX_SAMPLES (1 << 20)
+
+typedef struct {
+  uint32_t pc;
+  uint32_t lr;
+} prof_sample;
+
+typedef struct {
+  uintptr_t start, end;
+  const char *name;
+  so_module *mod;
+} prof_symbol;
+
+// Address to symbol map of every loaded module, sorted by start address
+typedef struct {
+  prof_symbol *symbols;
+  int num_symbols;
+} prof_index;
+
+int prof_index_build(prof_index *index);
+void prof_index_free(prof_index *index);
+int prof_symbolize(prof_index *index, uintptr_t addr);
+
+// Recorded samples keep the module layout they were taken with, loading
+// them rebases every address on the modules loaded now (matched by soname)
+int prof_samples_save(const char *path, prof_sample *samples, int num);
+prof_sample *prof_samples_load(const char *path, int *num);
+
+// Writes the flat (self samples per function) and caller/callee profiles
+int prof_report(prof_index *index, prof_sample *samples, int num, const char *flat_path, const char *graph_path);
+
+// Samples the PC/LR of a thread at the given rate until profiler_stop, which
+// writes samples.prof, profile_flat.txt and profile_calls.txt in dir
+int profiler_start(SceUID thid, int interval_us);
+void profiler_stop(const char *dir);
+
+#endif
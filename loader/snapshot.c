@@ -0,0 +1,384 @@
+/* snapshot.c -- linked (and initialized) modules kept across boots
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+#include <kubridge.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "snapshot.h"
+#include "prelink.h"
+#include "workers.h"
+#include "sha1.h"
+
+#define SNAPSHOT_MAGIC "HRMSNAP"
+#define SNAPSHOT_VERSION 4
+#define SNAPSHOT_CHUNK 0x10000 // blocks are read and summed in pieces of this size
+#define SNAPSHOT_READERS 2 // like the background loader, the memory card does not keep up with more
+
+// Bound imports point into the loader itself, any rebuild of it invalidates the snapshot
+static const char build_id[32] = __DATE__ " " __TIME__;
+
+// What the images hold of the loader: the functions imports were bound to and
+// the resolver lazy stubs call. build_id alone misses a rebuild leaving this
+// file alone, these move along with whatever code did change.
+static void snapshot_loader_hash(so_default_dynlib *default_dynlib, int size_default_dynlib, uint8_t *hash) {
+	SHA1_CTX ctx;
+	uint32_t addr = (uint32_t)(uintptr_t)&so_lazy_bind;
+	sha1_init(&ctx);
+	sha1_update(&ctx, (const BYTE *)build_id, sizeof(build_id));
+	sha1_update(&ctx, (const BYTE *)&addr, sizeof(addr));
+	for (int i = 0; i < size_default_dynlib / sizeof(so_default_dynlib); i++) {
+		addr = (uint32_t)default_dynlib[i].func;
+		sha1_update(&ctx, (const BYTE *)default_dynlib[i].symbol, strlen(default_dynlib[i].symbol) + 1);
+		sha1_update(&ctx, (const BYTE *)&addr, sizeof(addr));
+	}
+	sha1_final(&ctx, hash);
+}
+
+// Only meant to catch a damaged file: two FNV-1a lanes over words keep up with
+// the memory card where SHA1 over megabytes of image would not
+static uint64_t snapshot_sum(uint64_t sum, const void *data, size_t size) {
+	const uint32_t *words = (const uint32_t *)data;
+	uint32_t lo = (uint32_t)sum, hi = (uint32_t)(sum >> 32);
+	for (size_t i = 0; i < size / 4; i++) {
+		lo = (lo ^ words[i]) * 16777619u;
+		hi = (hi ^ words[i] ^ (lo >> 16)) * 0x01000193u + 0x9e3779b9u;
+	}
+	for (size_t i = size & ~3; i < size; i++)
+		lo = (lo ^ ((const uint8_t *)data)[i]) * 16777619u;
+	return (uint64_t)hi << 32 | lo;
+}
+
+// Each chunk is summed on its own, seeded with where it is in the file, so that
+// they can be read in any order: a block sums to the total of its chunks
+static uint64_t snapshot_chunks_sum(SceOff offset, const void *data, size_t size) {
+	uint64_t sum = 0;
+	for (size_t done = 0; done < size; done += SNAPSHOT_CHUNK) {
+		size_t len = size - done < SNAPSHOT_CHUNK ? size - done : SNAPSHOT_CHUNK;
+		sum += snapshot_sum(offset + done, (const uint8_t *)data + done, len);
+	}
+	return sum;
+}
+
+static int write_block(snapshot *snap, uint64_t *sum, uintptr_t addr, size_t size) {
+	if (sceIoWrite(snap->fd, (const void *)addr, size) != size)
+		return -1;
+	*sum += snapshot_chunks_sum(snap->offset, (const void *)addr, size);
+	snap->offset += size;
+	return 0;
+}
+
+static int write_data(snapshot *snap, so_layout *layout, uint64_t *sum) {
+	*sum = 0;
+	for (int i = 0; i < layout->n_data; i++) {
+		if (write_block(snap, sum, layout->data_block[i], layout->data_block_size[i]) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+// A chunk of a block to read back, executable ones are not writable from
+// usermode and go through a bounce buffer
+typedef struct {
+	SceOff offset;
+	uintptr_t addr;
+	uint32_t size;
+	uint8_t module;
+	uint8_t exec;
+	uint8_t data;
+} snapshot_job;
+
+typedef struct {
+	SceUID fd;
+	snapshot_job *jobs;
+	int num_jobs;
+	SceOff offset; // where the next block starts in the file
+	uint64_t image_sum[DEPS_MAX], data_sum[DEPS_MAX];
+	uint64_t read_us[DEPS_MAX];
+	char *bounce[SNAPSHOT_READERS]; // one per reader, taken by whichever is free
+	int bounce_busy[SNAPSHOT_READERS];
+	int failed;
+} snapshot_reader;
+
+// Queues a block in chunks, only counts them while there is no job array yet
+static void read_queue(snapshot_reader *r, int module, uintptr_t addr, size_t size, int exec, int data) {
+	for (size_t done = 0; done < size; done += SNAPSHOT_CHUNK) {
+		if (r->jobs) {
+			snapshot_job *job = &r->jobs[r->num_jobs];
+			job->offset = r->offset + done;
+			job->addr = addr + done;
+			job->size = size - done < SNAPSHOT_CHUNK ? size - done : SNAPSHOT_CHUNK;
+			job->module = module;
+			job->exec = exec;
+			job->data = data;
+		}
+		r->num_jobs++;
+	}
+	r->offset += size;
+}
+
+static void read_job(void *arg, int index) {
+	snapshot_reader *r = arg;
+	snapshot_job *job = &r->jobs[index];
+	if (__atomic_load_n(&r->failed, __ATOMIC_RELAXED))
+		return;
+
+	uint64_t start = sceKernelGetProcessTimeWide();
+	void *buf = (void *)job->addr;
+	int slot = 0;
+	if (job->exec) {
+		// No more jobs run at once than there are readers, one is always free
+		while (__atomic_exchange_n(&r->bounce_busy[slot], 1, __ATOMIC_ACQUIRE))
+			slot = (slot + 1) % SNAPSHOT_READERS;
+		buf = r->bounce[slot];
+	}
+	int ok = sceIoPread(r->fd, buf, job->size, job->offset) == job->size;
+	uint64_t sum = ok ? snapshot_sum(job->offset, buf, job->size) : 0;
+	if (job->exec) {
+		if (ok)
+			kuKernelCpuUnrestrictedMemcpy((void *)job->addr, buf, job->size);
+		__atomic_store_n(&r->bounce_busy[slot], 0, __ATOMIC_RELEASE);
+	}
+	if (!ok) {
+		__atomic_store_n(&r->failed, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	__atomic_add_fetch(job->data ? &r->data_sum[job->module] : &r->image_sum[job->module], sum, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&r->read_us[job->module], sceKernelGetProcessTimeWide() - start, __ATOMIC_RELAXED);
+}
+
+// Every block the restore needs, in file order: the images, then the data as
+// linked, or else the data as initialized past all of them
+static void read_queue_all(snapshot_reader *r, const snapshot_header *hdr, const snapshot_module *mods) {
+	r->num_jobs = 0;
+	r->offset = sizeof(snapshot_header) + hdr->num_modules * sizeof(snapshot_module);
+	for (int k = 0; k < hdr->num_modules; k++) {
+		const so_layout *layout = &mods[k].layout;
+		read_queue(r, k, layout->patch_base, layout->patch_head - layout->patch_base, 1, 0);
+		read_queue(r, k, layout->text_block, layout->text_block_size, 1, 0);
+		for (int i = 0; i < layout->n_data; i++) {
+			if (hdr->init)
+				r->offset += layout->data_block_size[i];
+			else
+				read_queue(r, k, layout->data_block[i], layout->data_block_size[i], 0, 1);
+		}
+	}
+	for (int k = 0; k < hdr->num_modules && hdr->init; k++) {
+		const so_layout *layout = &mods[k].layout;
+		for (int i = 0; i < layout->n_data; i++)
+			read_queue(r, k, layout->data_block[i], layout->data_block_size[i], 0, 1);
+	}
+}
+
+int snapshot_begin(snapshot *snap, const char *path, int num_modules, so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	memset(snap, 0, sizeof(snapshot));
+	snprintf(snap->path, sizeof(snap->path), "%s", path);
+	snap->fd = -1;
+	snap->failed = 1;
+	if (num_modules > DEPS_MAX)
+		return -1;
+
+	memcpy(snap->hdr.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	snap->hdr.version = SNAPSHOT_VERSION;
+	snap->hdr.num_modules = num_modules;
+	snap->offset = sizeof(snapshot_header) + num_modules * sizeof(snapshot_module);
+	so_dynlib_hash(default_dynlib, size_default_dynlib, snap->hdr.dynlib_hash);
+	snapshot_loader_hash(default_dynlib, size_default_dynlib, snap->hdr.loader_hash);
+	memcpy(snap->hdr.build, build_id, sizeof(build_id));
+
+	snap->fd = sceIoOpen(path, SCE_O_WRONLY | SCE_O_CREAT | SCE_O_TRUNC, 0777);
+	if (snap->fd < 0)
+		return snap->fd;
+
+	// The records are written once every module is in, the images go after them
+	if (sceIoWrite(snap->fd, &snap->hdr, sizeof(snapshot_header)) != sizeof(snapshot_header) ||
+		sceIoWrite(snap->fd, snap->mods, num_modules * sizeof(snapshot_module)) != num_modules * sizeof(snapshot_module)) {
+		snapshot_end(snap);
+		return -1;
+	}
+	snap->failed = 0;
+
+	return 0;
+}
+
+int snapshot_add(snapshot *snap, so_module *mod, const char *name, const char *path) {
+	SceIoStat st;
+	uint64_t sum = 0;
+
+	if (snap->failed || snap->num == snap->hdr.num_modules)
+		goto err;
+
+	snapshot_module *rec = &snap->mods[snap->num];
+	if (so_layout_get(mod, &rec->layout) < 0 || sceIoGetstat(path, &st) < 0)
+		goto err;
+	snprintf(rec->name, sizeof(rec->name), "%s", name);
+	rec->file_size = st.st_size;
+	rec->file_mtime = st.st_mtime;
+
+	so_layout *layout = &rec->layout;
+	if (write_block(snap, &sum, layout->patch_base, layout->patch_head - layout->patch_base) < 0 ||
+		write_block(snap, &sum, layout->text_block, layout->text_block_size) < 0)
+		goto err;
+	rec->image_sum = sum;
+	if (write_data(snap, layout, &rec->data_sum) < 0)
+		goto err;
+
+	snap->mod[snap->num++] = mod;
+	return 0;
+
+err:
+	snap->failed = 1;
+	return -1;
+}
+
+int snapshot_add_init(snapshot *snap) {
+	if (snap->failed || snap->num != snap->hdr.num_modules)
+		return -1;
+
+	// Only the data changes, the images of the linked modules stay as they are
+	for (int k = 0; k < snap->num; k++) {
+		if (write_data(snap, &snap->mods[k].layout, &snap->mods[k].init_sum) < 0) {
+			snap->failed = 1;
+			return -1;
+		}
+	}
+	snap->hdr.init = 1;
+
+	return 0;
+}
+
+int snapshot_end(snapshot *snap) {
+	if (snap->fd < 0)
+		return -1;
+
+	if (!snap->failed && snap->num == snap->hdr.num_modules) {
+		if (sceIoLseek(snap->fd, 0, SCE_SEEK_SET) != 0 ||
+			sceIoWrite(snap->fd, &snap->hdr, sizeof(snapshot_header)) != sizeof(snapshot_header) ||
+			sceIoWrite(snap->fd, snap->mods, snap->num * sizeof(snapshot_module)) != snap->num * sizeof(snapshot_module))
+			snap->failed = 1;
+	} else {
+		snap->failed = 1;
+	}
+	sceIoClose(snap->fd);
+	snap->fd = -1;
+
+	// Never leave an incomplete snapshot behind
+	if (snap->failed) {
+		sceIoRemove(snap->path);
+		return -1;
+	}
+
+	return 0;
+}
+
+// The snapshot must have been taken from the very files in the graph (as far
+// as their size and time tell), at the addresses they are placed at now
+static int snapshot_check(const snapshot_header *hdr, const snapshot_module *mods, deps_graph *graph, so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	uint8_t digest[SO_HASH_SIZE], loader[SO_HASH_SIZE];
+	SceIoStat st;
+
+	so_dynlib_hash(default_dynlib, size_default_dynlib, digest);
+	snapshot_loader_hash(default_dynlib, size_default_dynlib, loader);
+	if (memcmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0 ||
+		hdr->version != SNAPSHOT_VERSION ||
+		memcmp(hdr->build, build_id, sizeof(build_id)) != 0 ||
+		memcmp(hdr->dynlib_hash, digest, SO_HASH_SIZE) != 0 ||
+		memcmp(hdr->loader_hash, loader, SO_HASH_SIZE) != 0 ||
+		hdr->num_modules != graph->num)
+		return -1;
+
+	for (int k = 0; k < graph->num; k++) {
+		deps_node *node = &graph->nodes[graph->order[k]];
+		const snapshot_module *rec = &mods[k];
+		if (strncmp(rec->name, node->name, sizeof(rec->name)) != 0 ||
+			rec->layout.text_block != node->load_addr ||
+			sceIoGetstat(node->path, &st) < 0 ||
+			st.st_size != rec->file_size ||
+			memcmp(&st.st_mtime, &rec->file_mtime, sizeof(SceDateTime)) != 0)
+			return -1;
+	}
+
+	return 0;
+}
+
+int snapshot_restore(const char *path, deps_graph *graph, so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	snapshot_header hdr;
+	snapshot_module *mods = NULL;
+	snapshot_reader *reader = NULL;
+	int mapped = 0, res = -1;
+
+	SceUID fd = sceIoOpen(path, SCE_O_RDONLY, 0);
+	if (fd < 0)
+		return fd;
+
+	if (sceIoRead(fd, &hdr, sizeof(hdr)) != sizeof(hdr) || hdr.num_modules > DEPS_MAX)
+		goto out;
+	mods = malloc(hdr.num_modules * sizeof(snapshot_module));
+	reader = calloc(1, sizeof(snapshot_reader));
+	if (!mods || !reader ||
+		sceIoRead(fd, mods, hdr.num_modules * sizeof(snapshot_module)) != hdr.num_modules * sizeof(snapshot_module))
+		goto out;
+	if (snapshot_check(&hdr, mods, graph, default_dynlib, size_default_dynlib) < 0) {
+		printf("%s is out of date, loading the modules.\n", path);
+		goto out;
+	}
+
+	for (int k = 0; k < graph->num; k++) {
+		if (so_layout_map(graph->nodes[graph->order[k]].mod, &mods[k].layout) < 0)
+			goto out;
+		mapped++;
+	}
+
+	// The blocks come back in chunks on as many threads as the background loader
+	// reads modules with, summing and copying them overlaps the other reads
+	reader->fd = fd;
+	read_queue_all(reader, &hdr, mods);
+	reader->jobs = malloc((reader->num_jobs ? reader->num_jobs : 1) * sizeof(snapshot_job));
+	if (!reader->jobs)
+		goto out;
+	for (int i = 0; i < SNAPSHOT_READERS; i++)
+		if (!(reader->bounce[i] = malloc(SNAPSHOT_CHUNK)))
+			goto out;
+	read_queue_all(reader, &hdr, mods);
+	workers_run(SNAPSHOT_READERS, reader->num_jobs, read_job, reader);
+	if (reader->failed)
+		goto out;
+
+	for (int k = 0; k < graph->num; k++) {
+		if (reader->image_sum[k] != mods[k].image_sum || reader->data_sum[k] != (hdr.init ? mods[k].init_sum : mods[k].data_sum))
+			goto out;
+		graph->nodes[graph->order[k]].mod->load_us = reader->read_us[k];
+	}
+
+	// Every module checked out, they become visible in the order they were linked in
+	for (int k = 0; k < graph->num; k++)
+		so_layout_register(graph->nodes[graph->order[k]].mod, default_dynlib, size_default_dynlib);
+	res = hdr.init ? 1 : 0;
+
+out:
+	if (res < 0) {
+		if (mapped)
+			printf("%s is damaged, loading the modules.\n", path);
+		for (int k = mapped - 1; k >= 0; k--)
+			so_unload(graph->nodes[graph->order[k]].mod);
+	}
+	if (reader) {
+		for (int i = 0; i < SNAPSHOT_READERS; i++)
+			free(reader->bounce[i]);
+		free(reader->jobs);
+	}
+	free(reader);
+	free(mods);
+	sceIoClose(fd);
+
+	return res;
+}
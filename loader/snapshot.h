@@ -0,0 +1,55 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "deps.h"
+
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_modules;
+  uint32_t init;      // the data of every module as its constructors left it follows the images
+  uint8_t dynlib_hash[SO_HASH_SIZE];
+  uint8_t loader_hash[SO_HASH_SIZE]; // the loader addresses bound into the images
+  char build[32];
+} snapshot_header;
+
+// One module, its image follows: the used part of its patch arena, its text
+// block, then its data blocks
+typedef struct {
+  char name[SO_NAME_MAX];
+  SceOff file_size;
+  SceDateTime file_mtime;
+  so_layout layout;
+  // Totals of the sums of every chunk of the blocks, each seeded with its offset
+  uint64_t image_sum; // patch arena and text block
+  uint64_t data_sum;  // data blocks once linked
+  uint64_t init_sum;  // data blocks once initialized
+} snapshot_module;
+
+// A snapshot being written, module after module as they get linked
+typedef struct {
+  char path[256];
+  SceUID fd;
+  SceOff offset; // where the next block goes in the file, the chunk sums depend on it
+  int failed;
+  snapshot_header hdr;
+  snapshot_module mods[DEPS_MAX];
+  so_module *mod[DEPS_MAX];
+  int num;
+} snapshot;
+
+// Starts a snapshot of num_modules modules, bound against default_dynlib
+int snapshot_begin(snapshot *snap, const char *path, int num_modules, so_default_dynlib *default_dynlib, int size_default_dynlib);
+// Adds a module once linked, before anything gets hooked in it
+int snapshot_add(snapshot *snap, so_module *mod, const char *name, const char *path);
+// Adds the data of every module as it is now, once their constructors ran
+int snapshot_add_init(snapshot *snap);
+// Completes the snapshot, or removes it if any module could not be added
+int snapshot_end(snapshot *snap);
+// Maps the modules of the graph back from a snapshot and registers them, once
+// every one of them checked out against its file and its checksums. Returns 1 if
+// their constructors ran already, 0 if they still have to, < 0 if the modules
+// have to be loaded and linked.
+int snapshot_restore(const char *path, deps_graph *graph, so_default_dynlib *default_dynlib, int size_default_dynlib);
+
+#endif
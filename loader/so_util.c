@@ -9,6 +9,7 @@
 #include <vitasdk.h>
 #include <kubridge.h>
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -16,6 +17,9 @@
 #include "main.h"
 #include "dialog.h"
 #include "so_util.h"
+#include "sha1.h"
+#include "tls.h"
+#include "workers.h"
 
 #ifndef SCE_KERNEL_MEMBLOCK_TYPE_USER_RX
 #define SCE_KERNEL_MEMBLOCK_TYPE_USER_RX                 (0x0C20D050)
@@ -57,158 +61,681 @@ typedef struct ldst_enc {
 #define LDR_OFFS(RT, RN, IMM) ((ldst_enc){.bits = {.cond = 0b1110, .enc = 0b010, .p = 1, .u = (IMM >= 0), .b = 0, .w = 0, .bit20_1 = 1, .rn = RN, .rt = RT, .imm12 = (IMM >= 0) ? IMM : -IMM}})
 
 #define PATCH_SZ 0x10000 //64 KB-ish arenas
+#define SO_STREAM_CHUNK 0x10000 // bounce buffer for streaming .text
+#define MAX_DYNLIB_INDEX 4
+#define LINK_MIN_PARALLEL 4096 // smaller tables are not worth waking the workers for
+#define LINK_JOBS_PER_THREAD 4
+#define SHADOW_DEPTH 256 // timed calls running at once on a thread
+#define SO_LOAD_MAX 16
+#define SO_LOAD_THREADS 2 // modules read at once, the memory card does not keep up with more
 static so_module *head = NULL, *tail = NULL;
+static so_dynlib_index dynlib_index[MAX_DYNLIB_INDEX];
+
+// Modules handed to the background loaders, claimed in queue order
+typedef struct {
+	so_module *mod;
+	const char *filename;
+	uintptr_t load_addr;
+	int res;
+	int done;
+} so_load_item;
+
+static so_load_item load_queue[SO_LOAD_MAX];
+static int load_num = 0, load_next = 0, load_registered = 0, load_running = 0;
+static pthread_t load_thread[SO_LOAD_THREADS];
+static pthread_mutex_t load_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t load_cond = PTHREAD_COND_INITIALIZER;
+
+typedef struct {
+	so_shadow_site *site;
+	uintptr_t lr;       // the caller's, to return to
+	uintptr_t sp;       // the caller's when it made the call
+	uintptr_t ret;      // where the thunk gets back to once target returns
+	uint64_t start;
+	uint64_t child_us;  // spent in the timed calls made from this one
+} so_shadow_frame;
+
+typedef struct {
+	int depth;
+	so_shadow_frame frames[SHADOW_DEPTH];
+} so_shadow_stack;
+
+static int trace_mode = SO_TRACE_OFF;
+static pthread_key_t shadow_key;
+static pthread_once_t shadow_once = PTHREAD_ONCE_INIT;
+
+static int so_symbol_index(so_module *mod, const char *symbol);
+static void so_symtab_add(so_module *mod);
+static void so_symtab_rebuild(void);
+static int so_symtab_find(const char *symbol);
+static int so_symtab_index(so_module *mod, const char *symbol);
+static void so_resolve_needed(so_module *mod);
+static uintptr_t so_alloc_arena(so_module *so, uintptr_t range, uintptr_t dst, size_t sz);
+static so_dynlib_index *so_dynlib_get(so_default_dynlib *default_dynlib, int size_default_dynlib);
+
+#define HOOK_PATCH_MAX 10 // Thumb alignment NOP + LDR PC + target
+#define CACHE_LINE 32
+#define TRAMPOLINE_MAX 128
+#define RECLAIM_MIN 64 // smaller ranges are not worth an arena
+
+typedef struct {
+	uint8_t code[TRAMPOLINE_MAX];
+	size_t len;
+} trampoline_buf;
+
+static void emit16(trampoline_buf *t, uint16_t hw) {
+	memcpy(t->code + t->len, &hw, sizeof(hw));
+	t->len += sizeof(hw);
+}
 
-so_hook hook_thumb(uintptr_t addr, uintptr_t dst) {
-	so_hook h;
-	//printf("THUMB HOOK\n");
-	if (addr == 0)
-		return;
-	h.thumb_addr = addr;
-	addr &= ~1;
-	if (addr & 2) {
-		uint16_t nop = 0xbf00;
-		kuKernelCpuUnrestrictedMemcpy((void *)addr, &nop, sizeof(nop));
-		addr += 2;
-		//printf("THUMB UNALIGNED\n");
+static void emit32(trampoline_buf *t, uint32_t word) {
+	memcpy(t->code + t->len, &word, sizeof(word));
+	t->len += sizeof(word);
+}
+
+// Thumb literal loads below use Align(PC, 4), keep them on a word boundary
+static void thumb_align(trampoline_buf *t) {
+	if (t->len & 2)
+		emit16(t, 0xbf00); // NOP
+}
+
+static void thumb_load(trampoline_buf *t, int rd, uint32_t value, int deref) {
+	thumb_align(t);
+	emit16(t, 0xf8df); // LDR.W Rd, [PC, #4]
+	emit16(t, (rd << 12) | 4);
+	emit16(t, 0xe002); // B.N over the literal
+	emit16(t, 0xbf00);
+	emit32(t, value);
+	if (deref) {
+		emit16(t, 0xf8d0 | rd); // LDR.W Rd, [Rd]
+		emit16(t, rd << 12);
 	}
-	
-	h.addr = addr;
-	h.patch_instr[0] = 0xf000f8df; // LDR PC, [PC]
-	h.patch_instr[1] = dst;
-	kuKernelCpuUnrestrictedMemcpy(&h.orig_instr, (void *)addr, sizeof(h.orig_instr));
-	kuKernelCpuUnrestrictedMemcpy((void *)addr, h.patch_instr, sizeof(h.patch_instr));
+}
+
+static void thumb_jump(trampoline_buf *t, uint32_t target) {
+	thumb_align(t);
+	emit32(t, 0xf000f8df); // LDR.W PC, [PC]
+	emit32(t, target);
+}
+
+static void thumb_call(trampoline_buf *t, uint32_t target) {
+	thumb_align(t);
+	emit16(t, 0xf8df); // LDR.W IP, [PC, #4]
+	emit16(t, 0xc004);
+	emit16(t, 0x47e0); // BLX IP
+	emit16(t, 0xe001); // B.N over the literal
+	emit32(t, target);
+}
+
+static void arm_load(trampoline_buf *t, uint32_t cond, int rd, uint32_t value, int deref) {
+	emit32(t, cond | 0x059f0000 | (rd << 12)); // LDR<c> Rd, [PC]
+	emit32(t, 0xea000000);                     // B over the literal
+	emit32(t, value);
+	if (deref)
+		emit32(t, cond | 0x05900000 | (rd << 16) | (rd << 12)); // LDR<c> Rd, [Rd]
+}
+
+// Re-emits the ARM instruction found at at, returns -1 if it cannot be moved
+static int trampoline_arm(trampoline_buf *t, uintptr_t at, uint32_t insn) {
+	uint32_t cond = insn & 0xf0000000;
+	uint32_t pc = at + 8;
+
+	if (cond == 0xf0000000)
+		return -1;
+
+	if ((insn & 0x0e000000) == 0x0a000000) { // B, BL
+		uint32_t target = pc + ((int32_t)(insn << 8) >> 6);
+		if (insn & 0x01000000) {
+			if (cond != 0xe0000000)
+				return -1;
+			emit32(t, 0xe28fe004); // ADD LR, PC, #4
+			emit32(t, 0xe51ff004); // LDR PC, [PC, #-0x4]
+			emit32(t, target);
+		} else {
+			emit32(t, cond | 0x059ff000); // LDR<c> PC, [PC]
+			emit32(t, 0xea000000);        // B over the literal
+			emit32(t, target);
+		}
+		return 0;
+	}
+
+	int rn = (insn >> 16) & 0xf, rd = (insn >> 12) & 0xf, rm = insn & 0xf;
+
+	if ((insn & 0x0f7f0000) == 0x051f0000) { // LDR Rt, [PC, #imm]
+		if (rd == 15)
+			return -1;
+		uint32_t imm = insn & 0xfff;
+		arm_load(t, cond, rd, (insn & 0x00800000) ? pc + imm : pc - imm, 1);
+		return 0;
+	}
+
+	if ((insn & 0x0fef0000) == 0x028f0000 || (insn & 0x0fef0000) == 0x024f0000) { // ADR
+		if (rd == 15)
+			return -1;
+		uint32_t rot = ((insn >> 8) & 0xf) * 2, imm = insn & 0xff;
+		imm = rot ? (imm >> rot) | (imm << (32 - rot)) : imm;
+		arm_load(t, cond, rd, (insn & 0x00800000) ? pc + imm : pc - imm, 0);
+		return 0;
+	}
+
+	// Anything else naming PC is left alone, block transfers only matter if they load it
+	// and BX/BLX have their should-be-one fields set
+	if ((insn & 0x0fffffd0) == 0x012fff10) {
+		if (rm == 15)
+			return -1;
+	} else if ((insn & 0x0e000000) == 0x08000000) {
+		if (rn == 15 || ((insn & 0x00100000) && (insn & 0x8000)))
+			return -1;
+	} else if (rn == 15 || rd == 15 || rm == 15) {
+		return -1;
+	}
+
+	emit32(t, insn);
+	return 0;
+}
+
+// Re-emits the Thumb instruction found at at, returns its length or -1 if it cannot be moved
+static int trampoline_thumb(trampoline_buf *t, uintptr_t at, uint16_t hw1, uint16_t hw2) {
+	uint32_t pc = at + 4;
+
+	if ((hw1 & 0xf800) < 0xe800) {
+		if ((hw1 & 0xf800) == 0x4800) { // LDR Rt, [PC, #imm]
+			thumb_load(t, (hw1 >> 8) & 7, (pc & ~3) + (hw1 & 0xff) * 4, 1);
+		} else if ((hw1 & 0xf800) == 0xa000) { // ADR
+			thumb_load(t, (hw1 >> 8) & 7, (pc & ~3) + (hw1 & 0xff) * 4, 0);
+		} else if ((hw1 & 0xf800) == 0xe000) { // B
+			thumb_jump(t, (pc + ((int32_t)((uint32_t)hw1 << 21) >> 20)) | 1);
+		} else if ((hw1 & 0xf000) == 0xd000 || (hw1 & 0xf500) == 0xb100 || ((hw1 & 0xff00) == 0xbf00 && (hw1 & 0xf))) {
+			return -1; // B<c>, CBZ/CBNZ, IT
+		} else if ((hw1 & 0xfc00) == 0x4400 && (((hw1 >> 3) & 0xf) == 15 || ((hw1 & 0x80) >> 4 | (hw1 & 7)) == 15)) {
+			return -1; // high register ops on PC
+		} else {
+			emit16(t, hw1);
+		}
+		return 2;
+	}
+
+	if ((hw1 & 0xf800) == 0xf000 && (hw2 & 0x8000)) { // BL, BLX, B.W
+		uint32_t s = (hw1 >> 10) & 1;
+		uint32_t i1 = !(((hw2 >> 13) & 1) ^ s), i2 = !(((hw2 >> 11) & 1) ^ s);
+		uint32_t imm = (s << 24) | (i1 << 23) | (i2 << 22) | ((hw1 & 0x3ff) << 12) | ((hw2 & 0x7ff) << 1);
+		int32_t offset = (int32_t)(imm << 7) >> 7;
+		switch (hw2 & 0xd000) {
+		case 0xd000:
+			thumb_call(t, (pc + offset) | 1);
+			break;
+		case 0xc000:
+			thumb_call(t, ((pc & ~3) + offset) & ~3);
+			break;
+		case 0x9000:
+			thumb_jump(t, (pc + offset) | 1);
+			break;
+		default:
+			return -1;
+		}
+		return 4;
+	}
+
+	if ((hw1 & 0xff7f) == 0xf85f) { // LDR.W Rt, [PC, #imm]
+		int rt = hw2 >> 12;
+		if (rt == 15)
+			return -1;
+		uint32_t imm = hw2 & 0xfff;
+		thumb_load(t, rt, (hw1 & 0x80) ? (pc & ~3) + imm : (pc & ~3) - imm, 1);
+		return 4;
+	}
+
+	// ADR.W, TBB/TBH and any other access based on PC
+	if ((hw1 & 0xf) == 0xf || (hw2 >> 12) == 15)
+		return -1;
+
+	emit16(t, hw1);
+	emit16(t, hw2);
+	return 4;
+}
+
+static so_module *so_module_containing(uintptr_t addr) {
+	for (so_module *mod = head; mod; mod = mod->next)
+		if (addr >= mod->text_base && addr < mod->text_base + mod->text_size)
+			return mod;
+	return NULL;
+}
+
+/*
+ * trampoline: copies the instructions a hook at addr displaces into the patch
+ * arena of its module, fixing up the PC-relative ones, followed by a jump back
+ * past the patch. Calling it runs the original function. Returns 0 when some
+ * instruction cannot be moved, SO_CONTINUE then falls back to unpatching.
+*/
+static uintptr_t hook_trampoline(uintptr_t addr) {
+	so_module *mod = so_module_containing(addr & ~1);
+	trampoline_buf t;
+	uintptr_t entry, resume;
+
+	if (!mod)
+		return 0;
+
+	t.len = 0;
+	if (addr & 1) {
+		entry = addr & ~1;
+		size_t need = (entry & 2) ? HOOK_PATCH_MAX : 8;
+		size_t done = 0;
+		while (done < need) {
+			uint16_t hw[2];
+			memcpy(hw, (void *)(entry + done), sizeof(hw));
+			int len = trampoline_thumb(&t, entry + done, hw[0], hw[1]);
+			if (len < 0)
+				return 0;
+			done += len;
+		}
+		resume = entry + done;
+		thumb_jump(&t, resume | 1);
+	} else {
+		entry = addr;
+		for (int i = 0; i < 2; i++) {
+			if (trampoline_arm(&t, entry + i * 4, ((uint32_t *)entry)[i]) < 0)
+				return 0;
+		}
+		resume = entry + 8;
+		emit32(&t, 0xe51ff004); // LDR PC, [PC, #-0x4]
+		emit32(&t, resume);
+	}
+
+	uintptr_t tramp = so_arena_write(mod, 0, t.code, t.len);
+	if (!tramp)
+		return 0;
+
+	return tramp | (addr & 1);
+}
+
+// Builds the patch for a hook at addr, h->orig_instr is read straight from .text
+// and, if asked for, the prologue is moved into a trampoline.
+// The bytes to write go to patch, returns their length and where they go in *write_addr
+static size_t hook_prepare(so_hook *h, uintptr_t addr, uintptr_t dst, int trampoline, uintptr_t *write_addr, uint8_t *patch) {
+	size_t len = 0;
+
+	h->trampoline = trampoline ? hook_trampoline(addr) : 0;
+
+	if (addr & 1) {
+		h->thumb_addr = addr;
+		addr &= ~1;
+		*write_addr = addr;
+		if (addr & 2) {
+			uint16_t nop = 0xbf00;
+			memcpy(patch, &nop, sizeof(nop));
+			len += sizeof(nop);
+			addr += 2;
+		}
+		h->patch_instr[0] = 0xf000f8df; // LDR PC, [PC]
+	} else {
+		h->thumb_addr = 0;
+		*write_addr = addr;
+		h->patch_instr[0] = 0xe51ff004; // LDR PC, [PC, #-0x4]
+	}
+
+	h->addr = addr;
+	h->patch_instr[1] = dst;
+	memcpy(h->orig_instr, (void *)addr, sizeof(h->orig_instr));
+	memcpy(patch + len, h->patch_instr, sizeof(h->patch_instr));
+	return len + sizeof(h->patch_instr);
+}
+
+static so_hook hook_install(uintptr_t addr, uintptr_t dst) {
+	uint8_t patch[HOOK_PATCH_MAX];
+	uintptr_t write_addr;
+	so_hook h;
+
+	size_t len = hook_prepare(&h, addr, dst, 1, &write_addr, patch);
+	kuKernelCpuUnrestrictedMemcpy((void *)write_addr, patch, len);
 
 	return h;
 }
 
+so_hook hook_thumb(uintptr_t addr, uintptr_t dst) {
+	//printf("THUMB HOOK\n");
+	if (addr == 0)
+		return (so_hook){ 0 };
+	return hook_install(addr | 1, dst);
+}
+
 so_hook hook_arm(uintptr_t addr, uintptr_t dst) {
 	//printf("ARM HOOK\n");
 	if (addr == 0)
-		return;
-	uint32_t hook[2];
-	so_hook h;
-	h.thumb_addr = 0;
-	h.addr = addr;
-	h.patch_instr[0] = 0xe51ff004; // LDR PC, [PC, #-0x4]
-	h.patch_instr[1] = dst;
-	kuKernelCpuUnrestrictedMemcpy(&h.orig_instr, (void *)addr, sizeof(h.orig_instr));
-	kuKernelCpuUnrestrictedMemcpy((void *)addr, h.patch_instr, sizeof(h.patch_instr));
-
-	return h;
+		return (so_hook){ 0 };
+	return hook_install(addr & ~1, dst);
 }
 
 so_hook hook_addr(uintptr_t addr, uintptr_t dst) {
+	if (addr == 0)
+		return (so_hook){ 0 };
+	return hook_install(addr, dst);
+}
+
+void hook_begin(so_hook_batch *batch) {
+	batch->entries = NULL;
+	batch->num = 0;
+	batch->size = 0;
+}
+
+void hook_queue(so_hook_batch *batch, uintptr_t addr, uintptr_t dst, so_hook *out) {
 	if (addr == 0)
 		return;
-	if (addr & 1)
-		return hook_thumb(addr, dst);
-	else
-		return hook_arm(addr, dst);
+
+	if (batch->num == batch->size) {
+		int size = batch->size ? batch->size * 2 : 64;
+		so_hook_entry *entries = realloc(batch->entries, size * sizeof(so_hook_entry));
+		if (!entries)
+			fatal_error("Error could not queue hook at %p.", (void *)addr);
+		batch->entries = entries;
+		batch->size = size;
+	}
+
+	so_hook_entry *e = &batch->entries[batch->num];
+	e->addr = addr;
+	e->dst = dst;
+	e->out = out;
+	e->seq = batch->num++;
+}
+
+static int hook_entry_cmp(const void *a, const void *b) {
+	const so_hook_entry *ea = (const so_hook_entry *)a;
+	const so_hook_entry *eb = (const so_hook_entry *)b;
+	uintptr_t aa = ea->addr & ~1, ab = eb->addr & ~1;
+	if (aa != ab)
+		return aa < ab ? -1 : 1;
+	return ea->seq - eb->seq;
+}
+
+/*
+ * commit: installs every queued hook in address order, then flushes only the
+ * cache lines the patches touched. Nothing is written if two hooks overlap.
+ * Hooking the same address twice keeps the last one queued, as hook_addr would.
+*/
+int hook_commit(so_hook_batch *batch) {
+	so_hook_entry *entries = batch->entries;
+	int num = batch->num;
+	int res = 0;
+
+	qsort(entries, num, sizeof(so_hook_entry), hook_entry_cmp);
+
+	// Drop the hooks overridden by a later one on the same address, then make
+	// sure the remaining patches do not step on each other
+	int n = 0;
+	for (int i = 0; i < num; i++) {
+		if (n && (entries[n - 1].addr & ~1) == (entries[i].addr & ~1))
+			n--;
+		entries[n++] = entries[i];
+	}
+	for (int i = 1; i < n; i++) {
+		// Unaligned Thumb hooks take a NOP on top of the 8 bytes of the patch
+		uintptr_t prev_end = (entries[i - 1].addr & ~1) + ((entries[i - 1].addr & 3) == 3 ? HOOK_PATCH_MAX : 8);
+		if ((entries[i].addr & ~1) < prev_end) {
+			printf("Overlapping hooks at %p and %p\n", (void *)(entries[i - 1].addr & ~1), (void *)(entries[i].addr & ~1));
+			res = -1;
+			goto out;
+		}
+	}
+
+	uintptr_t flush_start = 0, flush_end = 0;
+	for (int i = 0; i < n; i++) {
+		uint8_t patch[HOOK_PATCH_MAX];
+		uintptr_t write_addr;
+		so_hook h;
+
+		size_t len = hook_prepare(&h, entries[i].addr, entries[i].dst, entries[i].out != NULL, &write_addr, patch);
+		kuKernelCpuUnrestrictedMemcpy((void *)write_addr, patch, len);
+		if (entries[i].out)
+			*entries[i].out = h;
+
+		// Neighbouring patches often share or follow a cache line, flush them together
+		uintptr_t line_start = write_addr & ~(CACHE_LINE - 1);
+		uintptr_t line_end = ALIGN_MEM(write_addr + len, CACHE_LINE);
+		if (flush_end && line_start <= flush_end) {
+			if (line_end > flush_end)
+				flush_end = line_end;
+		} else {
+			if (flush_end)
+				kuKernelFlushCaches((void *)flush_start, flush_end - flush_start);
+			flush_start = line_start;
+			flush_end = line_end;
+		}
+	}
+	if (flush_end)
+		kuKernelFlushCaches((void *)flush_start, flush_end - flush_start);
+	res = n;
+
+out:
+	free(entries);
+	hook_begin(batch);
+	return res;
 }
 
 void so_flush_caches(so_module *mod) {
 	kuKernelFlushCaches((void *)mod->text_base, mod->text_size);
 }
 
-int _so_load(so_module *mod, SceUID so_blockid, void *so_data, uintptr_t load_addr) {
-	int res = 0;
-	uintptr_t data_addr = 0;
-	
-	if (memcmp(so_data, ELFMAG, SELFMAG) != 0) {
-		res = -1;
-		goto err_free_so;
+static void so_hash_module(so_module *mod) {
+	// Hash what binding depends on rather than the whole file, this keeps it cheap
+	// enough to run on every boot while still catching any change to the imports,
+	// exports or relocations of the module
+	static const char *linked_sections[] = {
+		".dynamic", ".dynsym", ".dynstr", ".hash", ".gnu.hash", ".rel.dyn", ".rel.plt", ".relr.dyn"
+	};
+	SHA1_CTX ctx;
+
+	sha1_init(&ctx);
+	sha1_update(&ctx, (const BYTE *)mod->ehdr, sizeof(Elf32_Ehdr));
+	sha1_update(&ctx, (const BYTE *)mod->shdr, mod->ehdr->e_shnum * sizeof(Elf32_Shdr));
+	for (int i = 0; i < mod->ehdr->e_shnum; i++) {
+		const char *sh_name = mod->shstr + mod->shdr[i].sh_name;
+		for (int j = 0; j < sizeof(linked_sections) / sizeof(*linked_sections); j++) {
+			if (strcmp(sh_name, linked_sections[j]) == 0) {
+				sha1_update(&ctx, (const BYTE *)(mod->text_base + mod->shdr[i].sh_addr), mod->shdr[i].sh_size);
+				break;
+			}
+		}
 	}
+	sha1_final(&ctx, mod->digest);
+}
 
-	mod->ehdr = (Elf32_Ehdr *)so_data;
-	mod->phdr = (Elf32_Phdr *)((uintptr_t)so_data + mod->ehdr->e_phoff);
-	mod->shdr = (Elf32_Shdr *)((uintptr_t)so_data + mod->ehdr->e_shoff);
+static void so_free_segments(so_module *mod) {
+	while (mod->arenas) {
+		so_arena *next = mod->arenas->next;
+		if (mod->arenas->blockid >= 0)
+			sceKernelFreeMemBlock(mod->arenas->blockid);
+		free(mod->arenas);
+		mod->arenas = next;
+	}
+	for (int i = 0; i < mod->n_data; i++)
+		sceKernelFreeMemBlock(mod->data_blockid[i]);
+	if (mod->text_blockid > 0)
+		sceKernelFreeMemBlock(mod->text_blockid);
+	if (mod->patch_blockid > 0)
+		sceKernelFreeMemBlock(mod->patch_blockid);
+}
 
-	mod->shstr = (char *)((uintptr_t)so_data + mod->shdr[mod->ehdr->e_shstrndx].sh_offset);
+// Reserves the memory of a PT_LOAD segment and rebases its program header,
+// on return [*prog_data, *prog_data + *prog_size) is the block to fill
+static int so_alloc_segment(so_module *mod, Elf32_Phdr *phdr, uintptr_t load_addr, uintptr_t *data_addr, void **prog_data, size_t *prog_size) {
+	int res;
+
+	if ((phdr->p_flags & PF_X) == PF_X) {
+		// Allocate arena for code patches, trampolines, etc
+		// Sits exactly under the desired allocation space
+		mod->patch_size = ALIGN_MEM(PATCH_SZ, phdr->p_align);
+		SceKernelAllocMemBlockKernelOpt opt;
+		memset(&opt, 0, sizeof(SceKernelAllocMemBlockKernelOpt));
+		opt.size = sizeof(SceKernelAllocMemBlockKernelOpt);
+		opt.attr = 0x1;
+		opt.field_C = (SceUInt32)load_addr - mod->patch_size;
+		res = mod->patch_blockid = kuKernelAllocMemBlock("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, mod->patch_size, &opt);
+		if (res < 0)
+			return res;
+
+		sceKernelGetMemBlockBase(mod->patch_blockid, &mod->patch_base);
+		mod->patch_head = mod->patch_base;
+
+		*prog_size = ALIGN_MEM(phdr->p_memsz, phdr->p_align);
+		memset(&opt, 0, sizeof(SceKernelAllocMemBlockKernelOpt));
+		opt.size = sizeof(SceKernelAllocMemBlockKernelOpt);
+		opt.attr = 0x1;
+		opt.field_C = (SceUInt32)load_addr;
+		res = mod->text_blockid = kuKernelAllocMemBlock("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, *prog_size, &opt);
+		if (res < 0)
+			return res;
+
+		sceKernelGetMemBlockBase(mod->text_blockid, prog_data);
+
+		phdr->p_vaddr += (Elf32_Addr)(uintptr_t)*prog_data;
+
+		mod->text_base = phdr->p_vaddr;
+		mod->text_size = phdr->p_memsz;
+		mod->text_block_size = *prog_size;
+
+		// Use the .text segment padding as a code cave
+		// Word-align it to make it simpler for instruction arena allocation
+		mod->cave_size = ALIGN_MEM(*prog_size - phdr->p_memsz, 0x4);
+		mod->cave_base = mod->cave_head = (uintptr_t)*prog_data + phdr->p_memsz;
+		mod->cave_base = ALIGN_MEM(mod->cave_base, 0x4);
+		mod->cave_head = mod->cave_base;
+		printf("code cave: %u bytes (@0x%08X).\n", (unsigned)mod->cave_size, (unsigned)mod->cave_base);
+
+		*data_addr = (uintptr_t)*prog_data + *prog_size;
+	} else {
+		if (*data_addr == 0 || mod->n_data >= MAX_DATA_SEG)
+			return -1;
 
-	for (int i = 0; i < mod->ehdr->e_phnum; i++) {
-		if (mod->phdr[i].p_type == PT_LOAD) {
-			void *prog_data;
-			size_t prog_size;
+		*prog_size = ALIGN_MEM(phdr->p_memsz + phdr->p_vaddr - (*data_addr - mod->text_base), phdr->p_align);
 
-			if ((mod->phdr[i].p_flags & PF_X) == PF_X) {
-				// Allocate arena for code patches, trampolines, etc
-				// Sits exactly under the desired allocation space
-				mod->patch_size = ALIGN_MEM(PATCH_SZ, mod->phdr[i].p_align);
-				SceKernelAllocMemBlockKernelOpt opt;
-				memset(&opt, 0, sizeof(SceKernelAllocMemBlockKernelOpt));
-				opt.size = sizeof(SceKernelAllocMemBlockKernelOpt);
-				opt.attr = 0x1;
-				opt.field_C = (SceUInt32)load_addr - mod->patch_size;
-				res = mod->patch_blockid = kuKernelAllocMemBlock("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, mod->patch_size, &opt);
-				if (res < 0)
-					goto err_free_so;
-
-				sceKernelGetMemBlockBase(mod->patch_blockid, &mod->patch_base);
-				mod->patch_head = mod->patch_base;
-				
-				prog_size = ALIGN_MEM(mod->phdr[i].p_memsz, mod->phdr[i].p_align);
-				memset(&opt, 0, sizeof(SceKernelAllocMemBlockKernelOpt));
-				opt.size = sizeof(SceKernelAllocMemBlockKernelOpt);
-				opt.attr = 0x1;
-				opt.field_C = (SceUInt32)load_addr;
-				res = mod->text_blockid = kuKernelAllocMemBlock("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, prog_size, &opt);
-				if (res < 0)
-					goto err_free_so;
-
-				sceKernelGetMemBlockBase(mod->text_blockid, &prog_data);
-
-				mod->phdr[i].p_vaddr += (Elf32_Addr)prog_data;
-
-				mod->text_base = mod->phdr[i].p_vaddr;
-				mod->text_size = mod->phdr[i].p_memsz;
-		
-				// Use the .text segment padding as a code cave
-				// Word-align it to make it simpler for instruction arena allocation
-				mod->cave_size = ALIGN_MEM(prog_size - mod->phdr[i].p_memsz, 0x4);
-				mod->cave_base = mod->cave_head = prog_data + mod->phdr[i].p_memsz;
-				mod->cave_base = ALIGN_MEM(mod->cave_base, 0x4);
-				mod->cave_head = mod->cave_base;
-				printf("code cave: %d bytes (@0x%08X).\n", mod->cave_size, mod->cave_base);
-
-				data_addr = (uintptr_t)prog_data + prog_size;
-			} else {
-				if (data_addr == 0)
-					goto err_free_so;
+		SceKernelAllocMemBlockKernelOpt opt;
+		memset(&opt, 0, sizeof(SceKernelAllocMemBlockKernelOpt));
+		opt.size = sizeof(SceKernelAllocMemBlockKernelOpt);
+		opt.attr = 0x1;
+		opt.field_C = (SceUInt32)*data_addr;
+		res = mod->data_blockid[mod->n_data] = kuKernelAllocMemBlock("rw_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, *prog_size, &opt);
+		if (res < 0)
+			return res;
 
-				if (mod->n_data >= MAX_DATA_SEG)
-					goto err_free_data;
+		sceKernelGetMemBlockBase(mod->data_blockid[mod->n_data], prog_data);
+		*data_addr = (uintptr_t)*prog_data + *prog_size;
 
-				prog_size = ALIGN_MEM(mod->phdr[i].p_memsz + mod->phdr[i].p_vaddr - (data_addr - mod->text_base), mod->phdr[i].p_align);
+		phdr->p_vaddr += (Elf32_Addr)mod->text_base;
 
-				SceKernelAllocMemBlockKernelOpt opt;
-				memset(&opt, 0, sizeof(SceKernelAllocMemBlockKernelOpt));
-				opt.size = sizeof(SceKernelAllocMemBlockKernelOpt);
-				opt.attr = 0x1;
-				opt.field_C = (SceUInt32)data_addr;
-				res = mod->data_blockid[mod->n_data] = kuKernelAllocMemBlock("rw_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, prog_size, &opt);
-				if (res < 0)
-					goto err_free_text;
+		mod->data_base[mod->n_data] = phdr->p_vaddr;
+		mod->data_size[mod->n_data] = phdr->p_memsz;
+		mod->data_block_size[mod->n_data] = *prog_size;
+		mod->n_data++;
+	}
 
-				sceKernelGetMemBlockBase(mod->data_blockid[mod->n_data], &prog_data);
-				data_addr = (uintptr_t)prog_data + prog_size;
+	return 0;
+}
 
-				mod->phdr[i].p_vaddr += (Elf32_Addr)mod->text_base;
+#define APS2_GROUPED_BY_INFO 1
+#define APS2_GROUPED_BY_OFFSET_DELTA 2
+#define APS2_GROUPED_BY_ADDEND 4
+#define APS2_GROUP_HAS_ADDEND 8
+
+static int so_read_sleb128(const uint8_t **p, const uint8_t *end, int32_t *value) {
+	uint32_t result = 0;
+	int shift = 0;
+	uint8_t byte;
+
+	do {
+		if (*p >= end || shift >= 35)
+			return -1;
+		byte = *(*p)++;
+		result |= (uint32_t)(byte & 0x7f) << shift;
+		shift += 7;
+	} while (byte & 0x80);
+
+	if (shift < 32 && (byte & 0x40))
+		result |= ~0u << shift;
+	*value = (int32_t)result;
+	return 0;
+}
 
-				mod->data_base[mod->n_data] = mod->phdr[i].p_vaddr;
-				mod->data_size[mod->n_data] = mod->phdr[i].p_memsz;
-				mod->n_data++;
-			}
+/*
+ * Android packed relocations: "APS2" followed by SLEB128 numbers, the count
+ * and first offset, then groups of relocations that may share their r_info
+ * or the delta between their offsets. They are expanded once into a plain
+ * .rel.dyn so that every pass over the relocations works on them as is.
+*/
+static int so_unpack_rel(so_module *mod, const uint8_t *packed, size_t size) {
+	const uint8_t *p = packed + 4, *end = packed + size;
+	int32_t count, offset, group_size, flags, delta = 0, info = 0;
+
+	if (size < 4 || memcmp(packed, "APS2", 4) != 0)
+		return -1;
+	if (so_read_sleb128(&p, end, &count) < 0 || so_read_sleb128(&p, end, &offset) < 0 || count < 0)
+		return -1;
+	// Expanded, the table has to fit where a plain one would, in a 32 bit DT_RELSZ
+	if ((size_t)count > SIZE_MAX / sizeof(Elf32_Rel) || (uint64_t)count * sizeof(Elf32_Rel) > UINT32_MAX)
+		return -1;
+
+	Elf32_Rel *rels = malloc((size_t)count * sizeof(Elf32_Rel));
+	if (count && !rels)
+		return -1;
+
+	for (int n = 0; n < count; ) {
+		if (so_read_sleb128(&p, end, &group_size) < 0 || so_read_sleb128(&p, end, &flags) < 0 ||
+			group_size <= 0 || group_size > count - n || (flags & APS2_GROUP_HAS_ADDEND))
+			goto err;
+		if ((flags & APS2_GROUPED_BY_OFFSET_DELTA) && so_read_sleb128(&p, end, &delta) < 0)
+			goto err;
+		if ((flags & APS2_GROUPED_BY_INFO) && so_read_sleb128(&p, end, &info) < 0)
+			goto err;
+
+		for (int i = 0; i < group_size; i++, n++) {
+			int32_t d = delta;
+			if (!(flags & APS2_GROUPED_BY_OFFSET_DELTA) && so_read_sleb128(&p, end, &d) < 0)
+				goto err;
+			if (!(flags & APS2_GROUPED_BY_INFO) && so_read_sleb128(&p, end, &info) < 0)
+				goto err;
+			offset += d;
+			rels[n].r_offset = offset;
+			rels[n].r_info = info;
+		}
+	}
 
-			char *zero = malloc(prog_size - mod->phdr[i].p_filesz);
-			memset(zero, 0, prog_size - mod->phdr[i].p_filesz);
-			kuKernelCpuUnrestrictedMemcpy(prog_data + mod->phdr[i].p_filesz, zero, prog_size - mod->phdr[i].p_filesz);
-			free(zero);
+	mod->reldyn = rels;
+	mod->num_reldyn = count;
+	mod->reldyn_unpacked = 1;
+	return 0;
+
+err:
+	free(rels);
+	return -1;
+}
 
-			kuKernelCpuUnrestrictedMemcpy((void *)mod->phdr[i].p_vaddr, (void *)((uintptr_t)so_data + mod->phdr[i].p_offset), mod->phdr[i].p_filesz);
+// Applies RELR relative relocations: an even word is the address of one, an
+// odd one a bitmap of which of the 31 words after the last address have one
+static int so_apply_relr(so_module *mod) {
+	Elf32_Addr *where = NULL;
+	int count = 0;
+
+	for (int i = 0; i < mod->num_relr; i++) {
+		Elf32_Addr entry = mod->relr[i];
+		if ((entry & 1) == 0) {
+			where = (Elf32_Addr *)(mod->text_base + entry);
+			*where++ += mod->text_base;
+			count++;
+		} else {
+			Elf32_Addr *ptr = where;
+			for (uint32_t bitmap = entry >> 1; bitmap; bitmap >>= 1, ptr++) {
+				if (bitmap & 1) {
+					*ptr += mod->text_base;
+					count++;
+				}
+			}
+			where += 31;
 		}
 	}
 
+	return count;
+}
+
+// Locates the tables used for linking once every segment is in place
+static int so_parse_sections(so_module *mod) {
 	for (int i = 0; i < mod->ehdr->e_shnum; i++) {
 		char *sh_name = mod->shstr + mod->shdr[i].sh_name;
 		uintptr_t sh_addr = mod->text_base + mod->shdr[i].sh_addr;
@@ -221,7 +748,7 @@ int _so_load(so_module *mod, SceUID so_blockid, void *so_data, uintptr_t load_ad
 		} else if (strcmp(sh_name, ".dynsym") == 0) {
 			mod->dynsym = (Elf32_Sym *)sh_addr;
 			mod->num_dynsym = sh_size / sizeof(Elf32_Sym);
-		} else if (strcmp(sh_name, ".rel.dyn") == 0) {
+		} else if (strcmp(sh_name, ".rel.dyn") == 0 && mod->shdr[i].sh_type == SHT_REL) {
 			mod->reldyn = (Elf32_Rel *)sh_addr;
 			mod->num_reldyn = sh_size / sizeof(Elf32_Rel);
 		} else if (strcmp(sh_name, ".rel.plt") == 0) {
@@ -232,30 +759,75 @@ int _so_load(so_module *mod, SceUID so_blockid, void *so_data, uintptr_t load_ad
 			mod->num_init_array = sh_size / sizeof(void *);
 		} else if (strcmp(sh_name, ".hash") == 0) {
 			mod->hash = (void *)sh_addr;
+		} else if (strcmp(sh_name, ".gnu.hash") == 0) {
+			mod->gnu_hash = (void *)sh_addr;
 		}
 	}
 
+	// Drop hash tables we could not walk, lookups fall back to the next best one
+	if (mod->hash && mod->hash[0] == 0)
+		mod->hash = NULL;
+	if (mod->gnu_hash && (mod->gnu_hash[0] == 0 || mod->gnu_hash[2] == 0 || (mod->gnu_hash[2] & (mod->gnu_hash[2] - 1)) != 0))
+		mod->gnu_hash = NULL;
+
 	if (mod->dynamic == NULL ||
 		mod->dynstr == NULL ||
-		mod->dynsym == NULL ||
-		mod->reldyn == NULL ||
-		mod->relplt == NULL) {
-		res = -2;
-		goto err_free_data;
-	}
+		mod->dynsym == NULL)
+		return -2;
 
+	// Packed tables are only found through .dynamic, their sections have no fixed names
+	uintptr_t packed = 0;
+	size_t packed_size = 0, relr_size = 0;
 	for (int i = 0; i < mod->num_dynamic; i++) {
 		switch (mod->dynamic[i].d_tag) {
 		case DT_SONAME:
 			mod->soname = mod->dynstr + mod->dynamic[i].d_un.d_ptr;
 			break;
+		case DT_ANDROID_REL:
+			packed = mod->text_base + mod->dynamic[i].d_un.d_ptr;
+			break;
+		case DT_ANDROID_RELSZ:
+			packed_size = mod->dynamic[i].d_un.d_val;
+			break;
+		case DT_ANDROID_RELA:
+			return -2; // RELA has no place on ARM32
+		case DT_RELR:
+		case DT_ANDROID_RELR:
+			mod->relr = (Elf32_Addr *)(mod->text_base + mod->dynamic[i].d_un.d_ptr);
+			break;
+		case DT_RELRSZ:
+		case DT_ANDROID_RELRSZ:
+			relr_size = mod->dynamic[i].d_un.d_val;
+			break;
 		default:
 			break;
 		}
 	}
+	mod->num_relr = mod->relr ? relr_size / sizeof(Elf32_Addr) : 0;
 
-	sceKernelFreeMemBlock(so_blockid);
+	if (mod->relplt == NULL)
+		return -2;
+	if (packed && !mod->reldyn && so_unpack_rel(mod, (const uint8_t *)packed, packed_size) < 0)
+		return -2;
+	if (mod->reldyn == NULL && mod->relr == NULL)
+		return -2;
+
+	return 0;
+}
+
+// The PT_TLS segment lies within a PT_LOAD one, only its place is kept
+static void so_find_tls(so_module *mod) {
+	for (int i = 0; i < mod->ehdr->e_phnum; i++) {
+		if (mod->phdr[i].p_type == PT_TLS && mod->phdr[i].p_memsz) {
+			mod->tls_image = mod->text_base + mod->phdr[i].p_vaddr;
+			mod->tls_filesz = mod->phdr[i].p_filesz;
+			mod->tls_memsz = mod->phdr[i].p_memsz;
+			mod->tls_align = mod->phdr[i].p_align ? mod->phdr[i].p_align : 1;
+		}
+	}
+}
 
+static void so_register(so_module *mod) {
 	if (!head && !tail) {
 		head = mod;
 		tail = mod;
@@ -264,13 +836,58 @@ int _so_load(so_module *mod, SceUID so_blockid, void *so_data, uintptr_t load_ad
 		tail = mod;
 	}
 
+	so_tls_register(mod);
+	so_symtab_add(mod);
+}
+
+int _so_load(so_module *mod, SceUID so_blockid, void *so_data, uintptr_t load_addr) {
+	int res = 0;
+	uintptr_t data_addr = 0;
+	
+	if (memcmp(so_data, ELFMAG, SELFMAG) != 0) {
+		res = -1;
+		goto err_free_so;
+	}
+
+	mod->ehdr = (Elf32_Ehdr *)so_data;
+	mod->phdr = (Elf32_Phdr *)((uintptr_t)so_data + mod->ehdr->e_phoff);
+	mod->shdr = (Elf32_Shdr *)((uintptr_t)so_data + mod->ehdr->e_shoff);
+
+	mod->shstr = (char *)((uintptr_t)so_data + mod->shdr[mod->ehdr->e_shstrndx].sh_offset);
+
+	for (int i = 0; i < mod->ehdr->e_phnum; i++) {
+		if (mod->phdr[i].p_type == PT_LOAD) {
+			void *prog_data;
+			size_t prog_size;
+
+			res = so_alloc_segment(mod, &mod->phdr[i], load_addr, &data_addr, &prog_data, &prog_size);
+			if (res < 0)
+				goto err_free_segments;
+
+			char *zero = malloc(prog_size - mod->phdr[i].p_filesz);
+			memset(zero, 0, prog_size - mod->phdr[i].p_filesz);
+			kuKernelCpuUnrestrictedMemcpy(prog_data + mod->phdr[i].p_filesz, zero, prog_size - mod->phdr[i].p_filesz);
+			free(zero);
+
+			kuKernelCpuUnrestrictedMemcpy((void *)(uintptr_t)mod->phdr[i].p_vaddr, (void *)((uintptr_t)so_data + mod->phdr[i].p_offset), mod->phdr[i].p_filesz);
+		}
+	}
+
+	res = so_parse_sections(mod);
+	if (res < 0)
+		goto err_free_segments;
+	so_find_tls(mod);
+
+	so_hash_module(mod);
+
+	sceKernelFreeMemBlock(so_blockid);
+
+	so_register(mod);
+
 	return 0;
 
-err_free_data:
-	for (int i = 0; i < mod->n_data; i++)
-		sceKernelFreeMemBlock(mod->data_blockid[i]);
-err_free_text:
-	sceKernelFreeMemBlock(mod->text_blockid);
+err_free_segments:
+	so_free_segments(mod);
 err_free_so:
 	sceKernelFreeMemBlock(so_blockid);
 
@@ -293,7 +910,7 @@ int so_mem_load(so_module *mod, void *buffer, size_t so_size, uintptr_t load_add
 	return _so_load(mod, so_blockid, so_data, load_addr);
 }
 
-int so_file_load(so_module *mod, const char *filename, uintptr_t load_addr) {
+int so_file_load_whole(so_module *mod, const char *filename, uintptr_t load_addr) {
 	SceUID so_blockid;
 	void *so_data;
 
@@ -318,73 +935,914 @@ int so_file_load(so_module *mod, const char *filename, uintptr_t load_addr) {
 	return _so_load(mod, so_blockid, so_data, load_addr);
 }
 
-int so_relocate(so_module *mod) {
-	for (int i = 0; i < mod->num_reldyn + mod->num_relplt; i++) {
-		Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
-		Elf32_Sym *sym = &mod->dynsym[ELF32_R_SYM(rel->r_info)];
-		uintptr_t *ptr = (uintptr_t *)(mod->text_base + rel->r_offset);
+static int so_pread_all(SceUID fd, void *data, size_t size, SceOff offset) {
+	return sceIoPread(fd, data, size, offset) == size ? 0 : -1;
+}
 
-		int type = ELF32_R_TYPE(rel->r_info);
-		switch (type) {
-		case R_ARM_ABS32:
-			if (sym->st_shndx != SHN_UNDEF)
-				*ptr += mod->text_base + sym->st_value;
-			break;
-		case R_ARM_RELATIVE:
-			*ptr += mod->text_base;
-			break;
-		case R_ARM_GLOB_DAT:
-		case R_ARM_JUMP_SLOT:
-		{
-			if (sym->st_shndx != SHN_UNDEF)
-				*ptr = mod->text_base + sym->st_value;
-			break;
-		}
-		default:
-			fatal_error("Error unknown relocation type %x\n", type);
-			break;
-		}
+// Text is not writable from usermode, so it goes through a small bounce buffer
+static int so_stream_text(SceUID fd, Elf32_Phdr *phdr, void *prog_data, size_t prog_size, char *chunk) {
+	uintptr_t dst = phdr->p_vaddr;
+	uintptr_t end = (uintptr_t)prog_data + prog_size;
+
+	for (size_t done = 0; done < phdr->p_filesz; ) {
+		size_t len = phdr->p_filesz - done < SO_STREAM_CHUNK ? phdr->p_filesz - done : SO_STREAM_CHUNK;
+		if (so_pread_all(fd, chunk, len, phdr->p_offset + done) < 0)
+			return -1;
+		kuKernelCpuUnrestrictedMemcpy((void *)(dst + done), chunk, len);
+		done += len;
+	}
+
+	sceClibMemset(chunk, 0, SO_STREAM_CHUNK);
+	for (dst += phdr->p_filesz; dst < end; ) {
+		size_t len = end - dst < SO_STREAM_CHUNK ? end - dst : SO_STREAM_CHUNK;
+		kuKernelCpuUnrestrictedMemcpy((void *)dst, chunk, len);
+		dst += len;
 	}
 
 	return 0;
 }
 
-uintptr_t so_resolve_link(so_module *mod, const char *symbol) {
-	for (int i = 0; i < mod->num_dynamic; i++) {
-		switch (mod->dynamic[i].d_tag) {
-		case DT_NEEDED:
-		{
-			so_module *curr = head;
-			while (curr) {
-				if (curr != mod && strcmp(curr->soname, mod->dynstr + mod->dynamic[i].d_un.d_ptr) == 0) {
-					uintptr_t link = so_symbol(curr, symbol);
-					if (link)
-						return link;
-				}
-				curr = curr->next;
-			}
+static int so_stream_data(SceUID fd, Elf32_Phdr *phdr, void *prog_data, size_t prog_size) {
+	uintptr_t end = (uintptr_t)prog_data + prog_size;
 
-			break;
-		}
-		default:
-			break;
-		}
-	}
+	if (so_pread_all(fd, (void *)(uintptr_t)phdr->p_vaddr, phdr->p_filesz, phdr->p_offset) < 0)
+		return -1;
+	sceClibMemset((void *)(uintptr_t)(phdr->p_vaddr + phdr->p_filesz), 0, end - (phdr->p_vaddr + phdr->p_filesz));
 
 	return 0;
 }
 
-void reloc_err(uintptr_t got0)
-{
-	// Find to which module this missing symbol belongs
-	int found = 0;
-	so_module *curr = head;
-	while (curr && !found) {
-		for (int i = 0; i < curr->n_data; i++)
-			if ((got0 >= curr->data_base[i]) && (got0 <= (uintptr_t)(curr->data_base[i] + curr->data_size[i])))
-				found = 1;
-		
-		if (!found)
+// Reads a module in place without making it visible to symbol lookups, so it
+// can run on the background loader while other modules are being linked
+static int so_file_place(so_module *mod, const char *filename, uintptr_t load_addr) {
+	Elf32_Ehdr ehdr;
+	char *headers = NULL, *chunk = NULL;
+	int res = -1;
+	uintptr_t data_addr = 0;
+	uint64_t start = sceKernelGetProcessTimeWide();
+
+	memset(mod, 0, sizeof(so_module));
+
+	SceUID fd = sceIoOpen(filename, SCE_O_RDONLY, 0);
+	if (fd < 0)
+		return fd;
+
+	if (so_pread_all(fd, &ehdr, sizeof(ehdr), 0) < 0 || memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0)
+		goto err_close;
+
+	// Only the headers are read up front, they are dropped once the module is in place
+	size_t phdr_size = ehdr.e_phnum * sizeof(Elf32_Phdr);
+	size_t shdr_size = ehdr.e_shnum * sizeof(Elf32_Shdr);
+	headers = malloc(sizeof(Elf32_Ehdr) + phdr_size + shdr_size);
+	if (!headers)
+		goto err_close;
+
+	mod->ehdr = (Elf32_Ehdr *)headers;
+	mod->phdr = (Elf32_Phdr *)(headers + sizeof(Elf32_Ehdr));
+	mod->shdr = (Elf32_Shdr *)(headers + sizeof(Elf32_Ehdr) + phdr_size);
+	memcpy(mod->ehdr, &ehdr, sizeof(Elf32_Ehdr));
+	if (so_pread_all(fd, mod->phdr, phdr_size, ehdr.e_phoff) < 0 ||
+		so_pread_all(fd, mod->shdr, shdr_size, ehdr.e_shoff) < 0 ||
+		ehdr.e_shstrndx >= ehdr.e_shnum)
+		goto err_free_headers;
+
+	Elf32_Shdr *shstrtab = &mod->shdr[ehdr.e_shstrndx];
+	mod->shstr = malloc(shstrtab->sh_size);
+	if (!mod->shstr || so_pread_all(fd, mod->shstr, shstrtab->sh_size, shstrtab->sh_offset) < 0)
+		goto err_free_headers;
+
+	chunk = malloc(SO_STREAM_CHUNK);
+	if (!chunk)
+		goto err_free_headers;
+
+	for (int i = 0; i < ehdr.e_phnum; i++) {
+		if (mod->phdr[i].p_type == PT_LOAD) {
+			void *prog_data;
+			size_t prog_size;
+
+			res = so_alloc_segment(mod, &mod->phdr[i], load_addr, &data_addr, &prog_data, &prog_size);
+			if (res < 0)
+				goto err_free_segments;
+
+			if ((mod->phdr[i].p_flags & PF_X) == PF_X)
+				res = so_stream_text(fd, &mod->phdr[i], prog_data, prog_size, chunk);
+			else
+				res = so_stream_data(fd, &mod->phdr[i], prog_data, prog_size);
+			if (res < 0)
+				goto err_free_segments;
+		}
+	}
+
+	res = so_parse_sections(mod);
+	if (res < 0)
+		goto err_free_segments;
+	so_find_tls(mod);
+
+	so_hash_module(mod);
+
+	free(chunk);
+	free(mod->shstr);
+	free(headers);
+	sceIoClose(fd);
+	mod->ehdr = NULL;
+	mod->phdr = NULL;
+	mod->shdr = NULL;
+	mod->shstr = NULL;
+	mod->load_us = sceKernelGetProcessTimeWide() - start;
+
+	return 0;
+
+err_free_segments:
+	so_free_segments(mod);
+err_free_headers:
+	free(chunk);
+	free(mod->shstr);
+	free(headers);
+err_close:
+	sceIoClose(fd);
+	memset(mod, 0, sizeof(so_module));
+
+	return res;
+}
+
+int so_file_load(so_module *mod, const char *filename, uintptr_t load_addr) {
+	int res = so_file_place(mod, filename, load_addr);
+	if (res < 0)
+		return res;
+
+	so_register(mod);
+
+	return 0;
+}
+
+static void *so_load_thread(void *arg) {
+	pthread_mutex_lock(&load_lock);
+	while (load_next < load_num) {
+		so_load_item *item = &load_queue[load_next++];
+		pthread_mutex_unlock(&load_lock);
+		int res = so_file_place(item->mod, item->filename, item->load_addr);
+		pthread_mutex_lock(&load_lock);
+
+		item->res = res;
+		item->done = 1;
+		pthread_cond_broadcast(&load_cond);
+	}
+	pthread_mutex_unlock(&load_lock);
+
+	return NULL;
+}
+
+int so_load_queue(so_module *mod, const char *filename, uintptr_t load_addr) {
+	if (load_running || load_num >= SO_LOAD_MAX)
+		return -1;
+
+	so_load_item *item = &load_queue[load_num++];
+	item->mod = mod;
+	item->filename = filename;
+	item->load_addr = load_addr;
+	item->res = -1;
+	item->done = 0;
+
+	return 0;
+}
+
+void so_load_start(void) {
+	if (load_running || !load_num)
+		return;
+
+	load_registered = 0;
+	load_next = 0;
+	int threads = load_num < SO_LOAD_THREADS ? load_num : SO_LOAD_THREADS;
+	while (load_running < threads && pthread_create(&load_thread[load_running], NULL, so_load_thread, NULL) == 0)
+		load_running++;
+	if (!load_running)
+		printf("Could not start the module loader thread, loading in order.\n");
+}
+
+int so_load_wait(so_module *mod) {
+	int i;
+	for (i = 0; i < load_num && load_queue[i].mod != mod; i++);
+	if (i == load_num)
+		return -1;
+
+	uint64_t start = sceKernelGetProcessTimeWide();
+	if (load_running) {
+		pthread_mutex_lock(&load_lock);
+		for (int j = load_registered; j <= i; j++)
+			while (!load_queue[j].done)
+				pthread_cond_wait(&load_cond, &load_lock);
+		pthread_mutex_unlock(&load_lock);
+	} else {
+		for (int j = 0; j <= i; j++) {
+			if (!load_queue[j].done) {
+				load_queue[j].res = so_file_place(load_queue[j].mod, load_queue[j].filename, load_queue[j].load_addr);
+				load_queue[j].done = 1;
+			}
+		}
+	}
+	uint64_t waited = sceKernelGetProcessTimeWide() - start;
+
+	// Every module before this one is in place too and gets registered first,
+	// so that lookups keep the queue (dependency) order
+	for (; load_registered <= i; load_registered++) {
+		if (load_queue[load_registered].res >= 0)
+			so_register(load_queue[load_registered].mod);
+	}
+	if (load_queue[i].res >= 0)
+		mod->wait_us = waited;
+
+	int res = load_queue[i].res;
+	if (load_registered == load_num) {
+		for (int t = 0; t < load_running; t++)
+			pthread_join(load_thread[t], NULL);
+		load_running = 0;
+		load_num = 0;
+	}
+
+	return res;
+}
+
+// Reads the DT_NEEDED entries of a module from its file, without loading it,
+// and how much address space it takes from its load address up
+int so_file_needed(const char *filename, char needed[][SO_NAME_MAX], int max_needed, size_t *span) {
+	Elf32_Ehdr ehdr;
+	Elf32_Phdr *phdr = NULL;
+	Elf32_Dyn *dynamic = NULL;
+	int num = -1;
+
+	SceUID fd = sceIoOpen(filename, SCE_O_RDONLY, 0);
+	if (fd < 0)
+		return fd;
+
+	if (so_pread_all(fd, &ehdr, sizeof(ehdr), 0) < 0 || memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0)
+		goto out;
+	phdr = malloc(ehdr.e_phnum * sizeof(Elf32_Phdr));
+	if (!phdr || so_pread_all(fd, phdr, ehdr.e_phnum * sizeof(Elf32_Phdr), ehdr.e_phoff) < 0)
+		goto out;
+
+	Elf32_Phdr *dyn_phdr = NULL;
+	*span = 0;
+	for (int i = 0; i < ehdr.e_phnum; i++) {
+		if (phdr[i].p_type == PT_LOAD) {
+			size_t end = ALIGN_MEM(phdr[i].p_vaddr + phdr[i].p_memsz, phdr[i].p_align ? phdr[i].p_align : 1);
+			if (end > *span)
+				*span = end;
+		} else if (phdr[i].p_type == PT_DYNAMIC) {
+			dyn_phdr = &phdr[i];
+		}
+	}
+
+	num = 0;
+	if (!dyn_phdr)
+		goto out;
+	int num_dynamic = dyn_phdr->p_filesz / sizeof(Elf32_Dyn);
+	dynamic = malloc(dyn_phdr->p_filesz);
+	if (!dynamic || so_pread_all(fd, dynamic, num_dynamic * sizeof(Elf32_Dyn), dyn_phdr->p_offset) < 0) {
+		num = -1;
+		goto out;
+	}
+
+	Elf32_Addr strtab_addr = 0;
+	size_t strtab_size = 0;
+	for (int i = 0; i < num_dynamic && dynamic[i].d_tag != DT_NULL; i++) {
+		if (dynamic[i].d_tag == DT_STRTAB)
+			strtab_addr = dynamic[i].d_un.d_ptr;
+		else if (dynamic[i].d_tag == DT_STRSZ)
+			strtab_size = dynamic[i].d_un.d_val;
+	}
+
+	// The string table is addressed by where it gets loaded, find it in the file
+	SceOff strtab_off = -1;
+	for (int i = 0; i < ehdr.e_phnum; i++) {
+		if (phdr[i].p_type == PT_LOAD && strtab_addr >= phdr[i].p_vaddr && strtab_addr + strtab_size <= phdr[i].p_vaddr + phdr[i].p_filesz)
+			strtab_off = phdr[i].p_offset + (strtab_addr - phdr[i].p_vaddr);
+	}
+	if (strtab_off < 0) {
+		num = -1;
+		goto out;
+	}
+
+	// Only the names are read, the table itself is large
+	for (int i = 0; i < num_dynamic && dynamic[i].d_tag != DT_NULL; i++) {
+		if (dynamic[i].d_tag != DT_NEEDED || dynamic[i].d_un.d_val >= strtab_size)
+			continue;
+		if (num == max_needed) {
+			printf("%s: too many DT_NEEDED modules, ignoring the rest\n", filename);
+			break;
+		}
+		size_t len = strtab_size - dynamic[i].d_un.d_val < SO_NAME_MAX ? strtab_size - dynamic[i].d_un.d_val : SO_NAME_MAX;
+		if (so_pread_all(fd, needed[num], len, strtab_off + dynamic[i].d_un.d_val) < 0) {
+			num = -1;
+			goto out;
+		}
+		// A cut name would never match a file and leave the module to default_dynlib
+		if (!memchr(needed[num], 0, len)) {
+			printf("%s: DT_NEEDED name too long: %.*s...\n", filename, (int)len, needed[num]);
+			num = -1;
+			goto out;
+		}
+		num++;
+	}
+
+out:
+	free(dynamic);
+	free(phdr);
+	sceIoClose(fd);
+
+	return num;
+}
+
+#define SO_OFFSET(mod, ptr) ((ptr) ? (uint32_t)((uintptr_t)(ptr) - (mod)->text_base) : 0)
+#define SO_POINTER(layout, off) ((off) ? (void *)(uintptr_t)((layout)->text_base + (off)) : NULL)
+
+int so_layout_get(so_module *mod, so_layout *layout) {
+	// Extra arenas and trace thunks live in blocks placed wherever there was room
+	if (mod->arenas || trace_mode != SO_TRACE_OFF)
+		return -1;
+
+	void *block;
+	memset(layout, 0, sizeof(so_layout));
+	layout->patch_base = mod->patch_base;
+	layout->patch_size = mod->patch_size;
+	layout->patch_head = mod->patch_head;
+	sceKernelGetMemBlockBase(mod->text_blockid, &block);
+	layout->text_block = (uintptr_t)block;
+	layout->text_block_size = mod->text_block_size;
+	layout->text_base = mod->text_base;
+	layout->text_size = mod->text_size;
+	layout->cave_base = mod->cave_base;
+	layout->cave_size = mod->cave_size;
+	layout->cave_head = mod->cave_head;
+	layout->n_data = mod->n_data;
+	for (int i = 0; i < mod->n_data; i++) {
+		sceKernelGetMemBlockBase(mod->data_blockid[i], &block);
+		layout->data_block[i] = (uintptr_t)block;
+		layout->data_block_size[i] = mod->data_block_size[i];
+		layout->data_base[i] = mod->data_base[i];
+		layout->data_size[i] = mod->data_size[i];
+	}
+
+	layout->dynamic = SO_OFFSET(mod, mod->dynamic);
+	layout->dynstr = SO_OFFSET(mod, mod->dynstr);
+	layout->dynsym = SO_OFFSET(mod, mod->dynsym);
+	// A decoded APS2 table is on the heap, it is not needed once linked
+	layout->reldyn = mod->reldyn_unpacked ? 0 : SO_OFFSET(mod, mod->reldyn);
+	layout->relplt = SO_OFFSET(mod, mod->relplt);
+	layout->relr = SO_OFFSET(mod, mod->relr);
+	layout->init_array = SO_OFFSET(mod, mod->init_array);
+	layout->hash = SO_OFFSET(mod, mod->hash);
+	layout->gnu_hash = SO_OFFSET(mod, mod->gnu_hash);
+	layout->soname = SO_OFFSET(mod, mod->soname);
+	layout->num_dynamic = mod->num_dynamic;
+	layout->num_dynsym = mod->num_dynsym;
+	layout->num_reldyn = layout->reldyn ? mod->num_reldyn : 0;
+	layout->num_relplt = mod->num_relplt;
+	layout->num_relr = mod->num_relr;
+	layout->num_init_array = mod->num_init_array;
+	layout->lazy_stub = mod->lazy_stub;
+	layout->lazy_dynlib_only = mod->lazy_dynlib_only;
+	layout->tls_image = SO_OFFSET(mod, mod->tls_image);
+	layout->tls_filesz = mod->tls_filesz;
+	layout->tls_memsz = mod->tls_memsz;
+	layout->tls_align = mod->tls_align;
+	layout->tls_id = mod->tls_id;
+	layout->tls_offset = mod->tls_offset;
+	memcpy(layout->digest, mod->digest, SO_HASH_SIZE);
+	layout->link_stats = mod->link_stats;
+
+	return 0;
+}
+
+static SceUID so_layout_block(const char *name, SceUInt32 type, uintptr_t addr, size_t size) {
+	SceKernelAllocMemBlockKernelOpt opt;
+	void *base;
+
+	memset(&opt, 0, sizeof(SceKernelAllocMemBlockKernelOpt));
+	opt.size = sizeof(SceKernelAllocMemBlockKernelOpt);
+	opt.attr = 0x1;
+	opt.field_C = (SceUInt32)addr;
+	SceUID blockid = kuKernelAllocMemBlock(name, type, size, &opt);
+	if (blockid < 0)
+		return blockid;
+
+	sceKernelGetMemBlockBase(blockid, &base);
+	if ((uintptr_t)base != addr) {
+		sceKernelFreeMemBlock(blockid);
+		return -1;
+	}
+	return blockid;
+}
+
+int so_layout_map(so_module *mod, const so_layout *layout) {
+	memset(mod, 0, sizeof(so_module));
+	if (layout->n_data > MAX_DATA_SEG || !layout->dynamic || !layout->dynstr || !layout->dynsym)
+		return -1;
+
+	if ((mod->patch_blockid = so_layout_block("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, layout->patch_base, layout->patch_size)) < 0 ||
+		(mod->text_blockid = so_layout_block("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, layout->text_block, layout->text_block_size)) < 0)
+		goto err;
+	for (int i = 0; i < layout->n_data; i++) {
+		if ((mod->data_blockid[i] = so_layout_block("rw_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RW, layout->data_block[i], layout->data_block_size[i])) < 0)
+			goto err;
+		mod->n_data++;
+		mod->data_base[i] = layout->data_base[i];
+		mod->data_size[i] = layout->data_size[i];
+		mod->data_block_size[i] = layout->data_block_size[i];
+	}
+
+	mod->patch_base = layout->patch_base;
+	mod->patch_size = layout->patch_size;
+	mod->patch_head = layout->patch_head;
+	mod->text_base = layout->text_base;
+	mod->text_size = layout->text_size;
+	mod->text_block_size = layout->text_block_size;
+	mod->cave_base = layout->cave_base;
+	mod->cave_size = layout->cave_size;
+	mod->cave_head = layout->cave_head;
+
+	mod->dynamic = SO_POINTER(layout, layout->dynamic);
+	mod->dynstr = SO_POINTER(layout, layout->dynstr);
+	mod->dynsym = SO_POINTER(layout, layout->dynsym);
+	mod->reldyn = SO_POINTER(layout, layout->reldyn);
+	mod->relplt = SO_POINTER(layout, layout->relplt);
+	mod->relr = SO_POINTER(layout, layout->relr);
+	mod->init_array = SO_POINTER(layout, layout->init_array);
+	mod->hash = SO_POINTER(layout, layout->hash);
+	mod->gnu_hash = SO_POINTER(layout, layout->gnu_hash);
+	mod->soname = SO_POINTER(layout, layout->soname);
+	mod->num_dynamic = layout->num_dynamic;
+	mod->num_dynsym = layout->num_dynsym;
+	mod->num_reldyn = layout->num_reldyn;
+	mod->num_relplt = layout->num_relplt;
+	mod->num_relr = layout->num_relr;
+	mod->num_init_array = layout->num_init_array;
+	mod->lazy_stub = layout->lazy_stub;
+	mod->lazy_dynlib_only = layout->lazy_dynlib_only;
+	mod->tls_image = (uintptr_t)SO_POINTER(layout, layout->tls_image);
+	mod->tls_filesz = layout->tls_filesz;
+	mod->tls_memsz = layout->tls_memsz;
+	mod->tls_align = layout->tls_align;
+	mod->tls_id = layout->tls_id;
+	mod->tls_offset = layout->tls_offset;
+	memcpy(mod->digest, layout->digest, SO_HASH_SIZE);
+	mod->link_stats = layout->link_stats;
+
+	return 0;
+
+err:
+	so_free_segments(mod);
+	memset(mod, 0, sizeof(so_module));
+	return -1;
+}
+
+void so_layout_register(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	// The resolver stub carries the address of its so_module, which need not
+	// be where it was when the snapshot was taken
+	if (mod->lazy_stub) {
+		uint32_t literals[2] = { (uint32_t)(uintptr_t)mod, (uint32_t)(uintptr_t)&so_lazy_bind };
+		kuKernelCpuUnrestrictedMemcpy((void *)(mod->lazy_stub + 8 * sizeof(uint32_t)), literals, sizeof(literals));
+		mod->lazy_dynlib = default_dynlib;
+		mod->lazy_dynlib_size = size_default_dynlib;
+	}
+	kuKernelFlushCaches((void *)mod->patch_base, mod->patch_head - mod->patch_base);
+	so_flush_caches(mod);
+
+	so_register(mod);
+	so_resolve_needed(mod);
+}
+
+void so_unload(so_module *mod) {
+	so_module *prev = NULL, *curr = head;
+	while (curr && curr != mod) {
+		prev = curr;
+		curr = curr->next;
+	}
+
+	if (curr) {
+		if (prev)
+			prev->next = mod->next;
+		else
+			head = mod->next;
+		if (tail == mod)
+			tail = prev;
+	}
+
+	// Modules still loaded must not reach it through their dependencies
+	for (curr = head; curr; curr = curr->next) {
+		int n = 0;
+		for (int i = 0; i < curr->num_needed; i++)
+			if (curr->needed[i] != mod)
+				curr->needed[n++] = curr->needed[i];
+		curr->num_needed = n;
+	}
+
+	so_tls_unregister(mod);
+	so_free_segments(mod);
+	free(mod->bindings);
+	free(mod->init_stats);
+	if (mod->reldyn_unpacked)
+		free(mod->reldyn);
+
+	memset(mod, 0, sizeof(so_module));
+
+	so_symtab_rebuild();
+}
+
+int so_module_position(so_module *mod) {
+	int pos = 0;
+	for (so_module *curr = head; curr; curr = curr->next, pos++) {
+		if (curr == mod)
+			return pos;
+	}
+	return -1;
+}
+
+so_module *so_module_at(int position) {
+	so_module *curr = head;
+	while (curr && position--)
+		curr = curr->next;
+	return curr;
+}
+
+static inline int so_is_tls(int type) {
+	return type == R_ARM_TLS_DTPMOD32 || type == R_ARM_TLS_DTPOFF32 || type == R_ARM_TLS_TPOFF32;
+}
+
+// def is the module defining the variable, value its offset in def's block
+static void so_apply_tls(so_module *mod, Elf32_Addr *ptr, int type, so_module *def, uint32_t value) {
+	switch (type) {
+	case R_ARM_TLS_DTPMOD32:
+		*ptr = def->tls_id;
+		break;
+	case R_ARM_TLS_DTPOFF32:
+		*ptr += value;
+		break;
+	default:
+		if (!def->tls_offset)
+			fatal_error("Error %s reaches the TLS of %s from the thread pointer, it has no static block.\n", mod->soname, def->soname);
+		*ptr += def->tls_offset + value;
+		break;
+	}
+}
+
+int so_relocate(so_module *mod) {
+	so_apply_relr(mod);
+
+	for (int i = 0; i < mod->num_reldyn + mod->num_relplt; i++) {
+		Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
+		Elf32_Sym *sym = &mod->dynsym[ELF32_R_SYM(rel->r_info)];
+		Elf32_Addr *ptr = (Elf32_Addr *)(mod->text_base + rel->r_offset);
+
+		int type = ELF32_R_TYPE(rel->r_info);
+		switch (type) {
+		case R_ARM_ABS32:
+			if (sym->st_shndx != SHN_UNDEF)
+				*ptr += mod->text_base + sym->st_value;
+			break;
+		case R_ARM_RELATIVE:
+			*ptr += mod->text_base;
+			break;
+		case R_ARM_GLOB_DAT:
+		case R_ARM_JUMP_SLOT:
+		{
+			if (sym->st_shndx != SHN_UNDEF)
+				*ptr = mod->text_base + sym->st_value;
+			break;
+		}
+		case R_ARM_TLS_DTPMOD32:
+		case R_ARM_TLS_DTPOFF32:
+		case R_ARM_TLS_TPOFF32:
+			// No symbol stands for the module's own block
+			if (ELF32_R_SYM(rel->r_info) == 0 || sym->st_shndx != SHN_UNDEF)
+				so_apply_tls(mod, ptr, type, mod, sym->st_value);
+			break;
+		default:
+			fatal_error("Error unknown relocation type %x\n", type);
+			break;
+		}
+	}
+
+	return 0;
+}
+
+// Loader-wide table of the symbols exported by every loaded module, binding
+// across modules and runtime so_symbol calls take a single probe through it
+typedef struct {
+	const char *name;
+	uint32_t hash;
+	int32_t next; // next module exporting the same name, in load order
+	so_module *mod;
+	uint32_t index;
+} so_symtab_entry;
+
+static so_symtab_entry *symtab = NULL;
+static int symtab_num = 0, symtab_cap = 0, symtab_names = 0;
+static so_dynlib_slot *symtab_slots = NULL; // first entry for each name, -1 if the slot is empty
+static uint32_t symtab_mask = 0;
+static int symtab_generation = 1; // bumped whenever the set of interned modules changes
+static int symtab_compact = 0; // only the names kept by so_reclaim are left
+
+static uint32_t so_gnu_hash(const uint8_t *name) {
+	uint32_t h = 5381;
+	while (*name)
+		h = (h << 5) + h + *name++;
+	return h;
+}
+
+// Names often differ only in their last characters, spread them with a
+// Fibonacci multiply or they pile up in long runs of adjacent slots
+static inline uint32_t so_name_slot(uint32_t hash, uint32_t mask) {
+	uint32_t mixed = hash * 2654435761u;
+	return (mixed ^ (mixed >> 15)) & mask;
+}
+
+// Slot holding the given name, or the empty one it would go into
+static uint32_t so_symtab_slot(so_dynlib_slot *slots, uint32_t mask, const char *name, uint32_t hash) {
+	uint32_t slot = so_name_slot(hash, mask);
+	while (slots[slot].index != -1) {
+		if (slots[slot].hash == hash && strcmp(symtab[slots[slot].index].name, name) == 0)
+			break;
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+static int so_symtab_reserve(int num_entries, int num_names) {
+	if (num_entries > symtab_cap) {
+		int cap = symtab_cap ? symtab_cap : 1024;
+		while (cap < num_entries)
+			cap <<= 1;
+		so_symtab_entry *entries = realloc(symtab, cap * sizeof(so_symtab_entry));
+		if (!entries)
+			return -1;
+		symtab = entries;
+		symtab_cap = cap;
+	}
+
+	// Keep the load factor under 1/2
+	uint32_t size = symtab_mask ? symtab_mask + 1 : 2048;
+	while (size < num_names * 2)
+		size <<= 1;
+	if (symtab_slots && size == symtab_mask + 1)
+		return 0;
+
+	so_dynlib_slot *slots = malloc(size * sizeof(so_dynlib_slot));
+	if (!slots)
+		return -1;
+	memset(slots, 0xff, size * sizeof(so_dynlib_slot));
+	for (int i = 0; i < symtab_num; i++) {
+		uint32_t slot = so_symtab_slot(slots, size - 1, symtab[i].name, symtab[i].hash);
+		if (slots[slot].index == -1) {
+			slots[slot].hash = symtab[i].hash;
+			slots[slot].index = i;
+		}
+	}
+	free(symtab_slots);
+	symtab_slots = slots;
+	symtab_mask = size - 1;
+
+	return 0;
+}
+
+static void so_symtab_add(so_module *mod) {
+	// A compacted table only covers the modules it was built from, start over
+	if (symtab_compact) {
+		so_symtab_rebuild();
+		return;
+	}
+
+	// Symbols under symoffset are not reachable through .gnu.hash, leave them out as well
+	int first = mod->gnu_hash ? mod->gnu_hash[1] : 1;
+	int count = 0;
+	for (int i = first; i < mod->num_dynsym; i++)
+		if (mod->dynsym[i].st_shndx != SHN_UNDEF && mod->dynsym[i].st_info != SHN_UNDEF)
+			count++;
+
+	symtab_generation++;
+	mod->interned = 0;
+	if (so_symtab_reserve(symtab_num + count, symtab_names + count) < 0) {
+		printf("%s: could not intern %d symbols, falling back to per module lookups\n", mod->soname, count);
+		return;
+	}
+
+	for (int i = first; i < mod->num_dynsym; i++) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx == SHN_UNDEF || sym->st_info == SHN_UNDEF)
+			continue;
+
+		const char *name = mod->dynstr + sym->st_name;
+		uint32_t hash = so_gnu_hash((const uint8_t *)name);
+		uint32_t slot = so_symtab_slot(symtab_slots, symtab_mask, name, hash);
+		if (symtab_slots[slot].index == -1) {
+			symtab_slots[slot].hash = hash;
+			symtab_slots[slot].index = symtab_num;
+			symtab_names++;
+		} else {
+			// Chain it behind the modules loaded earlier, first definition within a module wins
+			int32_t e = symtab_slots[slot].index;
+			while (symtab[e].mod != mod && symtab[e].next != -1)
+				e = symtab[e].next;
+			if (symtab[e].mod == mod)
+				continue;
+			symtab[e].next = symtab_num;
+		}
+
+		so_symtab_entry *entry = &symtab[symtab_num++];
+		entry->name = name;
+		entry->hash = hash;
+		entry->next = -1;
+		entry->mod = mod;
+		entry->index = i;
+	}
+
+	mod->interned = 1;
+}
+
+static void so_symtab_rebuild(void) {
+	symtab_num = 0;
+	symtab_names = 0;
+	symtab_generation++;
+	symtab_compact = 0;
+
+	if (!head) {
+		free(symtab);
+		free(symtab_slots);
+		symtab = NULL;
+		symtab_slots = NULL;
+		symtab_cap = 0;
+		symtab_mask = 0;
+		return;
+	}
+
+	if (symtab_slots)
+		memset(symtab_slots, 0xff, (symtab_mask + 1) * sizeof(so_dynlib_slot));
+	for (so_module *curr = head; curr; curr = curr->next)
+		so_symtab_add(curr);
+}
+
+static int so_symtab_find(const char *symbol) {
+	if (!symtab_slots)
+		return -1;
+	return symtab_slots[so_symtab_slot(symtab_slots, symtab_mask, symbol, so_gnu_hash((const uint8_t *)symbol))].index;
+}
+
+static int so_symtab_index(so_module *mod, const char *symbol) {
+	if (!mod->interned && !symtab_compact)
+		return so_symbol_index(mod, symbol);
+
+	for (int e = so_symtab_find(symbol); e != -1; e = symtab[e].next)
+		if (symtab[e].mod == mod)
+			return symtab[e].index;
+
+	// Names left out of a compacted table are still in the module's own hash tables
+	return mod->interned ? -1 : so_symbol_index(mod, symbol);
+}
+
+// Replaces the table with one holding only the given names, each module
+// exporting them chained in load order as before. Every module is counted its
+// share of the entries dropped, returns the bytes freed or -1.
+static int so_symtab_compact(const char **symbols, int num) {
+	int count = 0;
+	for (int i = 0; i < num; i++)
+		for (int e = so_symtab_find(symbols[i]); e != -1; e = symtab[e].next)
+			count++;
+
+	uint32_t size = 16;
+	while (size < num * 2)
+		size <<= 1;
+	so_symtab_entry *entries = malloc((count ? count : 1) * sizeof(so_symtab_entry));
+	so_dynlib_slot *slots = malloc(size * sizeof(so_dynlib_slot));
+	if (!entries || !slots) {
+		free(entries);
+		free(slots);
+		return -1;
+	}
+	memset(slots, 0xff, size * sizeof(so_dynlib_slot));
+
+	int n = 0, names = 0;
+	for (int i = 0; i < num; i++) {
+		int e = so_symtab_find(symbols[i]);
+		if (e == -1)
+			continue;
+
+		uint32_t hash = symtab[e].hash;
+		uint32_t slot = so_name_slot(hash, size - 1);
+		while (slots[slot].index != -1) {
+			if (slots[slot].hash == hash && strcmp(entries[slots[slot].index].name, symbols[i]) == 0)
+				break;
+			slot = (slot + 1) & (size - 1);
+		}
+		if (slots[slot].index != -1)
+			continue;
+		slots[slot].hash = hash;
+		slots[slot].index = n;
+		names++;
+
+		for (; e != -1; e = symtab[e].next, n++) {
+			entries[n] = symtab[e];
+			entries[n].next = symtab[e].next == -1 ? -1 : n + 1;
+		}
+	}
+
+	for (int i = 0; i < symtab_num; i++)
+		symtab[i].mod->reclaim_stats.heap += sizeof(so_symtab_entry);
+	for (int i = 0; i < n; i++) {
+		entries[i].mod->reclaim_stats.heap -= sizeof(so_symtab_entry);
+		entries[i].mod->reclaim_stats.symbols++;
+	}
+	int freed = (symtab_cap - n) * sizeof(so_symtab_entry) + (symtab_slots ? symtab_mask + 1 - size : 0) * sizeof(so_dynlib_slot);
+
+	free(symtab);
+	free(symtab_slots);
+	symtab = entries;
+	symtab_num = n;
+	symtab_cap = count ? count : 1;
+	symtab_names = names;
+	symtab_slots = slots;
+	symtab_mask = size - 1;
+	symtab_compact = 1;
+	symtab_generation++;
+	for (so_module *curr = head; curr; curr = curr->next)
+		curr->interned = 0;
+
+	return freed;
+}
+
+// Resolves the DT_NEEDED entries of a module to loaded modules. Done once when it
+// is linked or mapped back: lazy binds read the list from game threads with no
+// lock, so nothing past that point may rewrite it
+static void so_resolve_needed(so_module *mod) {
+	mod->num_needed = 0;
+	for (int i = 0; i < mod->num_dynamic; i++) {
+		if (mod->dynamic[i].d_tag != DT_NEEDED)
+			continue;
+		for (so_module *curr = head; curr; curr = curr->next) {
+			if (curr != mod && curr->soname && strcmp(curr->soname, mod->dynstr + mod->dynamic[i].d_un.d_ptr) == 0) {
+				if (mod->num_needed == MAX_NEEDED) {
+					printf("%s: too many DT_NEEDED modules, ignoring %s\n", mod->soname, curr->soname);
+					continue;
+				}
+				mod->needed[mod->num_needed++] = curr;
+			}
+		}
+	}
+}
+
+static uintptr_t so_resolve_link_ex(so_module *mod, const char *symbol, so_module **provider, int *index) {
+	so_module *found = NULL;
+	int idx = -1;
+
+	int interned = 1;
+	for (int n = 0; n < mod->num_needed; n++)
+		interned &= mod->needed[n]->interned;
+
+	if (interned) {
+		// A single probe gives every module exporting the symbol,
+		// keep the one DT_NEEDED would have reached first
+		int best = mod->num_needed;
+		for (int e = so_symtab_find(symbol); e != -1; e = symtab[e].next) {
+			for (int n = 0; n < best; n++) {
+				if (mod->needed[n] == symtab[e].mod) {
+					best = n;
+					found = symtab[e].mod;
+					idx = symtab[e].index;
+					break;
+				}
+			}
+		}
+	} else {
+		for (int n = 0; n < mod->num_needed && !found; n++) {
+			idx = so_symbol_index(mod->needed[n], symbol);
+			if (idx != -1)
+				found = mod->needed[n];
+		}
+	}
+
+	if (!found)
+		return 0;
+
+	if (provider)
+		*provider = found;
+	if (index)
+		*index = idx;
+	return found->text_base + found->dynsym[idx].st_value;
+}
+
+uintptr_t so_resolve_link(so_module *mod, const char *symbol) {
+	return so_resolve_link_ex(mod, symbol, NULL, NULL);
+}
+
+void reloc_err(uintptr_t got0)
+{
+	// Find to which module this missing symbol belongs
+	int found = 0;
+	so_module *curr = head;
+	while (curr && !found) {
+		for (int i = 0; i < curr->n_data; i++)
+			if ((got0 >= curr->data_base[i]) && (got0 <= (uintptr_t)(curr->data_base[i] + curr->data_size[i])))
+				found = 1;
+		
+		if (!found)
 			curr = curr->next;
 	}
 
@@ -393,121 +1851,614 @@ void reloc_err(uintptr_t got0)
 		for (int i = 0; i < curr->num_reldyn + curr->num_relplt; i++) {
 			Elf32_Rel *rel = i < curr->num_reldyn ? &curr->reldyn[i] : &curr->relplt[i - curr->num_reldyn];
 			Elf32_Sym *sym = &curr->dynsym[ELF32_R_SYM(rel->r_info)];
-			uintptr_t *ptr = (uintptr_t *)(curr->text_base + rel->r_offset);
+			Elf32_Addr *ptr = (Elf32_Addr *)(curr->text_base + rel->r_offset);
+
+			int type = ELF32_R_TYPE(rel->r_info);
+			switch (type) {
+				case R_ARM_JUMP_SLOT:
+				{
+					if (got0 == (uintptr_t)ptr) {
+						fatal_error("Unknown symbol \"%s\" (%p).\n", curr->dynstr + sym->st_name, (void*)got0);
+					}
+					break;
+				}
+			}
+		}
+	}
+
+	// Ooops, this shouldn't have happened.
+	fatal_error("Unknown symbol \"???\" (%p).\n", (void*)got0);
+}
+
+#ifdef __arm__
+__attribute__((naked)) void plt0_stub()
+{
+	register uintptr_t got0 asm("r12");
+	reloc_err(got0);
+}
+#else
+void plt0_stub()
+{
+	reloc_err(0);
+}
+#endif
+
+int so_resolve(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only) {
+	so_resolve_needed(mod);
+
+	for (int i = 0; i < mod->num_reldyn + mod->num_relplt; i++) {
+		Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
+		Elf32_Sym *sym = &mod->dynsym[ELF32_R_SYM(rel->r_info)];
+		Elf32_Addr *ptr = (Elf32_Addr *)(mod->text_base + rel->r_offset);
+
+		int type = ELF32_R_TYPE(rel->r_info);
+		switch (type) {
+		case R_ARM_ABS32:
+		case R_ARM_GLOB_DAT:
+		case R_ARM_JUMP_SLOT:
+		{
+			if (sym->st_shndx == SHN_UNDEF) {
+				int resolved = 0;
+				if (!default_dynlib_only) {
+					uintptr_t link = so_resolve_link(mod, mod->dynstr + sym->st_name);
+					if (link) {
+						// debugPrintf("Resolved from dependencies: %s\n", mod->dynstr + sym->st_name);
+						if (type == R_ARM_ABS32)
+							*ptr += link;
+						else
+							*ptr = link;
+						resolved = 1;
+					}
+				}
+
+				int j = so_dynlib_lookup(default_dynlib, size_default_dynlib, mod->dynstr + sym->st_name);
+				if (j >= 0) {
+					*ptr = so_dynlib_target(default_dynlib, size_default_dynlib, j);
+					resolved = 1;
+				}
+
+				if (!resolved) {
+					if (type == R_ARM_JUMP_SLOT) {
+						printf("Unresolved import: %s\n", mod->dynstr + sym->st_name);
+						*ptr = (uintptr_t)&plt0_stub;
+					}
+					else {
+						//printf("Unresolved import: %s\n", mod->dynstr + sym->st_name);
+					}
+				}
+			}
+
+			break;
+		}
+		case R_ARM_TLS_DTPMOD32:
+		case R_ARM_TLS_DTPOFF32:
+		case R_ARM_TLS_TPOFF32:
+		{
+			// Only modules have TLS blocks, default_dynlib has no say
+			so_module *def;
+			int index;
+			if (ELF32_R_SYM(rel->r_info) != 0 && sym->st_shndx == SHN_UNDEF && !default_dynlib_only &&
+				so_resolve_link_ex(mod, mod->dynstr + sym->st_name, &def, &index))
+				so_apply_tls(mod, ptr, type, def, def->dynsym[index].st_value);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+int so_resolve_with_dummy(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only) {
+	for (int i = 0; i < mod->num_reldyn + mod->num_relplt; i++) {
+		Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
+		Elf32_Sym *sym = &mod->dynsym[ELF32_R_SYM(rel->r_info)];
+		Elf32_Addr *ptr = (Elf32_Addr *)(mod->text_base + rel->r_offset);
+
+		int type = ELF32_R_TYPE(rel->r_info);
+		switch (type) {
+		case R_ARM_ABS32:
+		case R_ARM_GLOB_DAT:
+		case R_ARM_JUMP_SLOT:
+		{
+			if (sym->st_shndx == SHN_UNDEF) {
+				if (so_dynlib_lookup(default_dynlib, size_default_dynlib, mod->dynstr + sym->st_name) >= 0)
+					*ptr = (Elf32_Addr)(uintptr_t)&ret0;
+			}
+
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * lazy_stub: resolver trampoline lazy JUMP_SLOTs point to. The PLT entry
+ * jumps to it with ip holding the GOT slot (ldr pc, [ip, #n]!), the stub
+ * saves the argument registers, lets so_lazy_bind resolve and patch the
+ * slot, then tail jumps into the target with the registers restored.
+*/
+static uintptr_t so_lazy_stub(so_module *mod) {
+	if (mod->lazy_stub)
+		return mod->lazy_stub;
+
+	uint32_t stub[] = {
+		0xe92d500f, // PUSH {R0-R3, IP, LR}
+		0xe1a0100c, // MOV R1, IP          ; GOT slot
+		0xe59f0010, // LDR R0, [PC, #16]   ; mod
+		0xe59fc010, // LDR IP, [PC, #16]   ; so_lazy_bind
+		0xe12fff3c, // BLX IP
+		0xe58d0010, // STR R0, [SP, #16]   ; target replaces the saved IP
+		0xe8bd500f, // POP {R0-R3, IP, LR}
+		0xe12fff1c, // BX IP
+		(uint32_t)(uintptr_t)mod,
+		(uint32_t)(uintptr_t)&so_lazy_bind,
+	};
+
+	uintptr_t addr = so_arena_write(mod, 0, stub, sizeof(stub));
+	if (!addr)
+		return 0;
+	mod->lazy_stub = addr;
+
+	return addr;
+}
+
+uintptr_t so_lazy_bind(so_module *mod, uintptr_t slot) {
+	// PLT slots are usually laid out in .rel.plt order, try the matching entry first
+	Elf32_Rel *rel = NULL;
+	int guess = (slot - mod->text_base - (mod->num_relplt ? mod->relplt[0].r_offset : 0)) / sizeof(uint32_t);
+	if (guess >= 0 && guess < mod->num_relplt && mod->text_base + mod->relplt[guess].r_offset == slot) {
+		rel = &mod->relplt[guess];
+	} else {
+		for (int i = 0; i < mod->num_relplt && !rel; i++) {
+			if (mod->text_base + mod->relplt[i].r_offset == slot)
+				rel = &mod->relplt[i];
+		}
+	}
+	if (!rel)
+		reloc_err(slot);
+
+	const char *name = mod->dynstr + mod->dynsym[ELF32_R_SYM(rel->r_info)].st_name;
+	uintptr_t target = 0;
+	int index = so_dynlib_lookup(mod->lazy_dynlib, mod->lazy_dynlib_size, name);
+	if (index >= 0)
+		target = mod->lazy_dynlib[index].func;
+	else if (!mod->lazy_dynlib_only)
+		target = so_resolve_link(mod, name);
+	if (!target)
+		reloc_err(slot);
+
+	// Several threads may race on the first call, count the slot only once
+	if (__sync_bool_compare_and_swap((Elf32_Addr *)slot, (Elf32_Addr)mod->lazy_stub, (Elf32_Addr)target))
+		__sync_fetch_and_add(&mod->link_stats.lazy_bound, 1);
+
+	return target;
+}
+
+typedef struct {
+	so_module *mod;
+	uintptr_t *sym_value;
+	so_binding *sym_bind;
+	int num_jobs;
+	so_link_stats *stats; // one per job
+} so_link_ctx;
+
+// Writes the slots of one share of the relocation table, imports are bound already
+static void so_link_apply(void *arg, int job) {
+	so_link_ctx *ctx = (so_link_ctx *)arg;
+	so_module *mod = ctx->mod;
+	so_link_stats *stats = &ctx->stats[job];
+	int num_rel = mod->num_reldyn + mod->num_relplt;
+	int begin = (int)((int64_t)num_rel * job / ctx->num_jobs);
+	int end = (int)((int64_t)num_rel * (job + 1) / ctx->num_jobs);
+
+	for (int i = begin; i < end; i++) {
+		Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
+		Elf32_Addr *ptr = (Elf32_Addr *)(mod->text_base + rel->r_offset);
+		int type = ELF32_R_TYPE(rel->r_info);
+
+		if (type == R_ARM_RELATIVE) {
+			*ptr += mod->text_base;
+			stats->relative++;
+			continue;
+		}
+
+		int sym_idx = ELF32_R_SYM(rel->r_info);
+		Elf32_Sym *sym = &mod->dynsym[sym_idx];
+		if (so_is_tls(type)) {
+			stats->tls++;
+			if (sym_idx == 0 || sym->st_shndx != SHN_UNDEF) {
+				so_apply_tls(mod, ptr, type, mod, sym->st_value);
+				continue;
+			}
+			stats->imports++;
+			if (ctx->sym_bind[sym_idx].kind == SO_BIND_LINK) {
+				so_module *def = so_module_at(ctx->sym_bind[sym_idx].provider);
+				so_apply_tls(mod, ptr, type, def, def->dynsym[ctx->sym_bind[sym_idx].index].st_value);
+				stats->from_link++;
+			} else {
+				stats->unresolved++;
+			}
+			continue;
+		}
+
+		switch (type) {
+		case R_ARM_ABS32:
+			stats->abs32++;
+			break;
+		case R_ARM_GLOB_DAT:
+			stats->glob_dat++;
+			break;
+		default:
+			stats->jump_slot++;
+			break;
+		}
+
+		if (sym->st_shndx != SHN_UNDEF) {
+			if (type == R_ARM_ABS32)
+				*ptr += mod->text_base + sym->st_value;
+			else
+				*ptr = mod->text_base + sym->st_value;
+			continue;
+		}
+
+		stats->imports++;
+		switch (ctx->sym_bind[sym_idx].kind) {
+		case SO_BIND_DYNLIB:
+			*ptr = ctx->sym_value[sym_idx];
+			stats->from_dynlib++;
+			break;
+		case SO_BIND_LINK:
+			if (type == R_ARM_ABS32)
+				*ptr += ctx->sym_value[sym_idx];
+			else
+				*ptr = ctx->sym_value[sym_idx];
+			stats->from_link++;
+			break;
+		case SO_BIND_PENDING:
+			// Only lazy JUMP_SLOTs are left pending
+			*ptr = mod->lazy_stub;
+			stats->lazy++;
+			break;
+		default:
+			if (type == R_ARM_JUMP_SLOT)
+				*ptr = (uintptr_t)&plt0_stub;
+			stats->unresolved++;
+			break;
+		}
+	}
+}
+
+/*
+ * link: relocates and binds a module in a single pass over its relocations,
+ * every GOT slot is written once. Imports are looked up once per symbol and
+ * the result is reused by all the relocations referencing it. If the module
+ * carries prelinked bindings (see prelink.c) no lookup by name is done at all,
+ * otherwise the bindings found are recorded so that they can be persisted.
+ * In lazy mode, JUMP_SLOTs whose symbol is not known yet are bound by
+ * so_lazy_bind on their first call instead. With mod->link_threads > 1 the
+ * slots are written by a pool of workers once every import is bound.
+*/
+static int so_link_ex(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only, int lazy) {
+	so_link_stats *stats = &mod->link_stats;
+	uint64_t start = sceKernelGetProcessTimeWide();
+
+	// Traced imports get their thunks at link time, so_lazy_bind runs on game
+	// threads and must not allocate them
+	if (trace_mode != SO_TRACE_OFF)
+		lazy = 0;
+
+	if (lazy) {
+		if (!so_lazy_stub(mod))
+			return -1;
+		mod->lazy_dynlib = default_dynlib;
+		mod->lazy_dynlib_size = size_default_dynlib;
+		mod->lazy_dynlib_only = default_dynlib_only;
+	}
+
+	so_resolve_needed(mod);
+	memset(stats, 0, sizeof(so_link_stats));
+	uintptr_t *sym_value = malloc(mod->num_dynsym * sizeof(uintptr_t));
+	so_binding *sym_bind = calloc(mod->num_dynsym, sizeof(so_binding));
+	if (!sym_value || !sym_bind) {
+		free(sym_value);
+		free(sym_bind);
+		return -1;
+	}
+
+	if (mod->prelinked) {
+		for (int i = 0; i < mod->num_bindings; i++) {
+			so_binding *b = &mod->bindings[i];
+			so_module *provider;
+			switch (b->kind) {
+			case SO_BIND_DYNLIB:
+				sym_value[b->sym] = so_dynlib_target(default_dynlib, size_default_dynlib, b->index);
+				break;
+			case SO_BIND_LINK:
+				provider = so_module_at(b->provider);
+				sym_value[b->sym] = provider->text_base + provider->dynsym[b->index].st_value;
+				break;
+			default:
+				break;
+			}
+			sym_bind[b->sym] = *b;
+		}
+	}
+
+	// Bind the imports first, in relocation order and on this thread only, so that
+	// lookups and diagnostics come out exactly as they would in a single pass
+	int num_rel = mod->num_reldyn + mod->num_relplt;
+	for (int i = 0; i < num_rel; i++) {
+		Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
+		int type = ELF32_R_TYPE(rel->r_info);
+
+		if (type == R_ARM_RELATIVE)
+			continue;
+
+		int tls = so_is_tls(type);
+		if (type != R_ARM_ABS32 && type != R_ARM_GLOB_DAT && type != R_ARM_JUMP_SLOT && !tls)
+			fatal_error("Error unknown relocation type %x\n", type);
+
+		int sym_idx = ELF32_R_SYM(rel->r_info);
+		Elf32_Sym *sym = &mod->dynsym[sym_idx];
+		if (sym->st_shndx != SHN_UNDEF || (tls && sym_idx == 0))
+			continue;
+
+		so_binding *b = &sym_bind[sym_idx];
+		if (lazy && type == R_ARM_JUMP_SLOT && b->kind == SO_BIND_PENDING)
+			continue;
+
+		if (b->kind == SO_BIND_PENDING) {
+			// default_dynlib entries take precedence over the dependencies
+			const char *name = mod->dynstr + sym->st_name;
+			so_module *provider;
+			int index;
+			b->sym = sym_idx;
+			if (!tls && (index = so_dynlib_lookup(default_dynlib, size_default_dynlib, name)) >= 0) {
+				sym_value[sym_idx] = so_dynlib_target(default_dynlib, size_default_dynlib, index);
+				b->kind = SO_BIND_DYNLIB;
+				b->index = index;
+			} else if (!default_dynlib_only && (sym_value[sym_idx] = so_resolve_link_ex(mod, name, &provider, &index))) {
+				b->kind = SO_BIND_LINK;
+				b->provider = so_module_position(provider);
+				b->index = index;
+			} else {
+				b->kind = SO_BIND_NONE;
+			}
+		}
+
+		if (b->kind == SO_BIND_NONE && type == R_ARM_JUMP_SLOT)
+			printf("Unresolved import: %s\n", mod->dynstr + sym->st_name);
+		else if (b->kind != SO_BIND_LINK && type == R_ARM_TLS_DTPMOD32)
+			printf("Unresolved TLS import: %s\n", mod->dynstr + sym->st_name);
+	}
+
+	// Then write every slot, every relocation is independent by now so the
+	// table can be split across worker threads
+	so_link_ctx ctx;
+	ctx.mod = mod;
+	ctx.sym_value = sym_value;
+	ctx.sym_bind = sym_bind;
+	ctx.num_jobs = 1;
+	ctx.stats = NULL;
+	if (mod->link_threads > 1 && num_rel >= LINK_MIN_PARALLEL) {
+		ctx.num_jobs = mod->link_threads * LINK_JOBS_PER_THREAD;
+		ctx.stats = calloc(ctx.num_jobs, sizeof(so_link_stats));
+	}
+
+	if (ctx.stats) {
+		workers_run(mod->link_threads, ctx.num_jobs, so_link_apply, &ctx);
+		for (int i = 0; i < ctx.num_jobs; i++) {
+			so_link_stats *job = &ctx.stats[i];
+			stats->relative += job->relative;
+			stats->abs32 += job->abs32;
+			stats->glob_dat += job->glob_dat;
+			stats->jump_slot += job->jump_slot;
+			stats->imports += job->imports;
+			stats->from_dynlib += job->from_dynlib;
+			stats->from_link += job->from_link;
+			stats->unresolved += job->unresolved;
+			stats->lazy += job->lazy;
+			stats->tls += job->tls;
+		}
+		free(ctx.stats);
+	} else {
+		ctx.num_jobs = 1;
+		ctx.stats = stats;
+		so_link_apply(&ctx, 0);
+	}
+	stats->relative += so_apply_relr(mod);
 
-			int type = ELF32_R_TYPE(rel->r_info);
-			switch (type) {
-				case R_ARM_JUMP_SLOT:
-				{
-					if (got0 == (uintptr_t)ptr) {
-						fatal_error("Unknown symbol \"%s\" (%p).\n", curr->dynstr + sym->st_name, (void*)got0);
-					}
-					break;
-				}
+	if (!mod->prelinked) {
+		int num = 0;
+		for (int i = 0; i < mod->num_dynsym; i++) {
+			if (sym_bind[i].kind != SO_BIND_PENDING)
+				num++;
+		}
+
+		free(mod->bindings);
+		mod->num_bindings = 0;
+		mod->bindings = malloc(num * sizeof(so_binding));
+		if (mod->bindings) {
+			for (int i = 0; i < mod->num_dynsym; i++) {
+				if (sym_bind[i].kind != SO_BIND_PENDING)
+					mod->bindings[mod->num_bindings++] = sym_bind[i];
 			}
 		}
 	}
 
-	// Ooops, this shouldn't have happened.
-	fatal_error("Unknown symbol \"???\" (%p).\n", (void*)got0);
-}
+	free(sym_value);
+	free(sym_bind);
 
-__attribute__((naked)) void plt0_stub()
-{
-	register uintptr_t got0 asm("r12");
-	reloc_err(got0);
+	stats->time_us = sceKernelGetProcessTimeWide() - start;
+	return 0;
 }
 
-int so_resolve(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only) {
-	for (int i = 0; i < mod->num_reldyn + mod->num_relplt; i++) {
-		Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
-		Elf32_Sym *sym = &mod->dynsym[ELF32_R_SYM(rel->r_info)];
-		uintptr_t *ptr = (uintptr_t *)(mod->text_base + rel->r_offset);
+int so_link(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only) {
+	return so_link_ex(mod, default_dynlib, size_default_dynlib, default_dynlib_only, 0);
+}
 
-		int type = ELF32_R_TYPE(rel->r_info);
-		switch (type) {
-		case R_ARM_ABS32:
-		case R_ARM_GLOB_DAT:
-		case R_ARM_JUMP_SLOT:
-		{
-			if (sym->st_shndx == SHN_UNDEF) {
-				int resolved = 0;
-				if (!default_dynlib_only) {
-					uintptr_t link = so_resolve_link(mod, mod->dynstr + sym->st_name);
-					if (link) {
-						// debugPrintf("Resolved from dependencies: %s\n", mod->dynstr + sym->st_name);
-						if (type == R_ARM_ABS32)
-							*ptr += link;
-						else
-							*ptr = link;
-						resolved = 1;
-					}
-				}
+int so_link_lazy(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only) {
+	return so_link_ex(mod, default_dynlib, size_default_dynlib, default_dynlib_only, 1);
+}
 
-				for (int j = 0; j < size_default_dynlib / sizeof(so_default_dynlib); j++) {
-					if (strcmp(mod->dynstr + sym->st_name, default_dynlib[j].symbol) == 0) {
-						*ptr = default_dynlib[j].func;
-						resolved = 1;
-						break;
-					}
-				}
+void so_link_report(so_module *mod) {
+	so_link_stats *stats = &mod->link_stats;
+	printf("%s: %slinked in %llu us, %d relative, %d abs32, %d glob_dat, %d jump_slot, %d tls (%d imports: %d dynlib, %d linked, %d unresolved, %d lazy, %d bound since)\n",
+		mod->soname ? mod->soname : "???", mod->prelinked ? "pre" : "", (unsigned long long)stats->time_us, stats->relative, stats->abs32, stats->glob_dat, stats->jump_slot, stats->tls,
+		stats->imports, stats->from_dynlib, stats->from_link, stats->unresolved, stats->lazy, stats->lazy_bound);
+}
 
-				if (!resolved) {
-					if (type == R_ARM_JUMP_SLOT) {
-						printf("Unresolved import: %s\n", mod->dynstr + sym->st_name);
-						*ptr = (uintptr_t)&plt0_stub;
-					}
-					else {
-						//printf("Unresolved import: %s\n", mod->dynstr + sym->st_name);
-					}
-				}
-			}
+// Exported function addr falls into, or the closest one before it; NULL if
+// there is none or addr is not in the module
+const char *so_function_at(so_module *mod, uintptr_t addr, uintptr_t *offset) {
+	if (addr < mod->text_base || addr >= mod->text_base + mod->text_size)
+		return NULL;
 
-			break;
-		}
-		default:
-			break;
-		}
+	// Thumb functions have bit 0 set, in their symbols as in pointers to them
+	uintptr_t target = (addr - mod->text_base) & ~1;
+	int best = -1;
+	for (int i = 1; i < mod->num_dynsym; i++) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx == SHN_UNDEF || ELF32_ST_TYPE(sym->st_info) != STT_FUNC || (sym->st_value & ~1) > target)
+			continue;
+		if (best == -1 || (sym->st_value & ~1) > (mod->dynsym[best].st_value & ~1))
+			best = i;
 	}
+	if (best == -1)
+		return NULL;
+
+	if (offset)
+		*offset = target - (mod->dynsym[best].st_value & ~1);
+	return mod->dynstr + mod->dynsym[best].st_name;
+}
+
+// Static constructors are local symbols, they go by the export before them
+void so_init_name(so_module *mod, int index, char *buf, size_t size) {
+	uintptr_t func = (uintptr_t)mod->init_array[index], offset;
+	const char *name = so_function_at(mod, func, &offset);
+	if (name && offset)
+		snprintf(buf, size, "%s+0x%x", name, (unsigned)offset);
+	else if (name)
+		snprintf(buf, size, "%s", name);
+	else
+		snprintf(buf, size, "0x%08X", (unsigned)func);
+}
 
+// Either the whole name or the symbol it starts with, for all the constructors after it
+static int so_init_listed(const char *list, const char *name) {
+	const char *plus = strchr(name, '+');
+	size_t len = strlen(name), base = plus ? plus - name : len;
+
+	for (const char *p = list; *p; ) {
+		while (*p == ' ')
+			p++;
+		const char *end = p;
+		while (*end && *end != ' ')
+			end++;
+		if ((end - p == len || end - p == base) && strncmp(p, name, end - p) == 0)
+			return 1;
+		p = end;
+	}
 	return 0;
 }
 
-int so_resolve_with_dummy(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only) {
-	for (int i = 0; i < mod->num_reldyn + mod->num_relplt; i++) {
-		Elf32_Rel *rel = i < mod->num_reldyn ? &mod->reldyn[i] : &mod->relplt[i - mod->num_reldyn];
-		Elf32_Sym *sym = &mod->dynsym[ELF32_R_SYM(rel->r_info)];
-		uintptr_t *ptr = (uintptr_t *)(mod->text_base + rel->r_offset);
+static void so_init_run(so_module *mod, int index) {
+	uint64_t start = sceKernelGetProcessTimeWide();
+	mod->init_array[index]();
+	mod->init_stats[index].time_us = sceKernelGetProcessTimeWide() - start;
+	mod->init_stats[index].state = SO_INIT_DONE;
+}
 
-		int type = ELF32_R_TYPE(rel->r_info);
-		switch (type) {
-		case R_ARM_ABS32:
-		case R_ARM_GLOB_DAT:
-		case R_ARM_JUMP_SLOT:
-		{
-			if (sym->st_shndx == SHN_UNDEF) {
-				for (int j = 0; j < size_default_dynlib / sizeof(so_default_dynlib); j++) {
-					if (strcmp(mod->dynstr + sym->st_name, default_dynlib[j].symbol) == 0) {
-						*ptr = &ret0;
-						break;
-					}
-				}
-			}
+int so_initialize_defer(so_module *mod, const char *deferred) {
+	char name[SO_NAME_MAX * 2];
+	int num = 0;
+
+	free(mod->init_stats);
+	mod->init_stats = calloc(mod->num_init_array ? mod->num_init_array : 1, sizeof(so_init_stats));
+	if (!mod->init_stats) {
+		// Nowhere to time them or to keep them for later, run them as they are
+		for (int i = 0; i < mod->num_init_array; i++) {
+			if (mod->init_array[i])
+				mod->init_array[i]();
+		}
+		return 0;
+	}
 
-			break;
+	for (int i = 0; i < mod->num_init_array; i++) {
+		if (!mod->init_array[i]) {
+			mod->init_stats[i].state = SO_INIT_DONE;
+			continue;
 		}
-		default:
-			break;
+		if (deferred) {
+			so_init_name(mod, i, name, sizeof(name));
+			if (so_init_listed(deferred, name)) {
+				mod->init_stats[i].state = SO_INIT_DEFERRED;
+				mod->init_stats[i].deferred = 1;
+				num++;
+				continue;
+			}
 		}
+		so_init_run(mod, i);
 	}
 
-	return 0;
+	return num;
 }
 
 void so_initialize(so_module *mod) {
+	so_initialize_defer(mod, NULL);
+}
+
+// The constructors left by so_initialize_defer, in their order
+void so_initialize_deferred(so_module *mod) {
+	for (int i = 0; i < mod->num_init_array && mod->init_stats; i++) {
+		if (mod->init_stats[i].state == SO_INIT_DEFERRED)
+			so_init_run(mod, i);
+	}
+}
+
+// The slowest constructors first, so that they can be told apart from the rest
+void so_init_report(so_module *mod, int max) {
+	char name[SO_NAME_MAX * 2];
+	int shown[16];
+	int num = 0;
+
+	if (!mod->init_stats)
+		return;
+	if (max > 16)
+		max = 16;
+
+	uint64_t total = 0;
+	int deferred = 0;
 	for (int i = 0; i < mod->num_init_array; i++) {
-		if (mod->init_array[i])
-			mod->init_array[i]();
+		total += mod->init_stats[i].time_us;
+		deferred += mod->init_stats[i].deferred;
+	}
+	printf("%s: %d constructors, %llu us, %d deferred\n", mod->soname ? mod->soname : "?", mod->num_init_array, (unsigned long long)total, deferred);
+
+	while (num < max) {
+		int best = -1;
+		for (int i = 0; i < mod->num_init_array; i++) {
+			int taken = 0;
+			for (int n = 0; n < num; n++)
+				taken |= shown[n] == i;
+			if (!taken && mod->init_array[i] && (best == -1 || mod->init_stats[i].time_us > mod->init_stats[best].time_us))
+				best = i;
+		}
+		if (best == -1)
+			break;
+		shown[num++] = best;
+
+		so_init_name(mod, best, name, sizeof(name));
+		if (mod->init_stats[best].state == SO_INIT_DEFERRED)
+			printf("  #%d %s: deferred, not run yet\n", best, name);
+		else
+			printf("  #%d %s: %llu us%s\n", best, name, (unsigned long long)mod->init_stats[best].time_us, mod->init_stats[best].deferred ? " (deferred)" : "");
 	}
 }
 
@@ -522,8 +2473,338 @@ uint32_t so_hash(const uint8_t *name) {
 	return h;
 }
 
+static so_dynlib_index *so_dynlib_get(so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	int num = size_default_dynlib / sizeof(so_default_dynlib);
+	for (int i = 0; i < MAX_DYNLIB_INDEX; i++) {
+		if (dynlib_index[i].table == default_dynlib && dynlib_index[i].num == num)
+			return &dynlib_index[i];
+	}
+	return NULL;
+}
+
+/*
+ * Timed calls: a thunk written by so_shadow_code hands its site, the caller's
+ * LR and SP to so_shadow_enter, runs the site's target and comes back to
+ * so_shadow_leave for the LR. Frames are kept on a per thread shadow stack so
+ * that arguments passed on the stack stay in place. A call left without
+ * returning, by longjmp or unwinding, leaves its frame behind: it is dropped
+ * as soon as a call made from as far up the stack comes in or returns.
+*/
+static void so_shadow_key_init(void) {
+	pthread_key_create(&shadow_key, free);
+}
+
+void so_shadow_code(so_shadow_site *site, uint32_t *code) {
+	const uint32_t thunk[] = {
+		0xe92d500f, // PUSH {R0-R3, IP, LR}
+		0xe59f003c, // LDR R0, [PC, #60]  ; site
+		0xe1a0100e, // MOV R1, LR
+		0xe28d2018, // ADD R2, SP, #24    ; caller's SP
+		0xe28f3014, // ADD R3, PC, #20    ; return below
+		0xe59fc030, // LDR IP, [PC, #48]  ; so_shadow_enter
+		0xe12fff3c, // BLX IP
+		0xe58d0010, // STR R0, [SP, #16]  ; target, popped into IP
+		0xe8bd500f, // POP {R0-R3, IP, LR}
+		0xe28fe000, // ADD LR, PC, #0     ; return below
+		0xe12fff1c, // BX IP
+		0xe92d000f, // PUSH {R0-R3}
+		0xe28d0010, // ADD R0, SP, #16    ; caller's SP
+		0xe59fc014, // LDR IP, [PC, #20]  ; so_shadow_leave
+		0xe12fff3c, // BLX IP
+		0xe1a0c000, // MOV IP, R0         ; caller's LR
+		0xe8bd000f, // POP {R0-R3}
+		0xe12fff1c, // BX IP
+		(uint32_t)(uintptr_t)site,
+		(uint32_t)(uintptr_t)&so_shadow_enter,
+		(uint32_t)(uintptr_t)&so_shadow_leave,
+	};
+	memcpy(code, thunk, SO_SHADOW_THUNK_SIZE);
+}
+
+uintptr_t so_shadow_enter(so_shadow_site *site, uintptr_t lr, uintptr_t sp, uintptr_t ret) {
+	pthread_once(&shadow_once, so_shadow_key_init);
+	so_shadow_stack *stack = (so_shadow_stack *)pthread_getspecific(shadow_key);
+	if (!stack) {
+		stack = calloc(1, sizeof(so_shadow_stack));
+		if (!stack)
+			fatal_error("Error could not allocate the timed call stack.");
+		pthread_setspecific(shadow_key, stack);
+	}
+
+	// Frames from as far up the stack were left without returning, but for one
+	// whose function tail called this one: it then returns into that thunk
+	while (stack->depth) {
+		so_shadow_frame *top = &stack->frames[stack->depth - 1];
+		if (top->sp > sp || (top->sp == sp && top->ret == lr))
+			break;
+		stack->depth--;
+	}
+	if (stack->depth == SHADOW_DEPTH)
+		fatal_error("Error timed call stack overflow.");
+
+	__atomic_add_fetch(&site->calls, 1, __ATOMIC_RELAXED);
+	so_shadow_frame *frame = &stack->frames[stack->depth++];
+	frame->site = site;
+	frame->lr = lr;
+	frame->sp = sp;
+	frame->ret = ret;
+	frame->child_us = 0;
+	frame->start = sceKernelGetProcessTimeWide();
+	return site->target;
+}
+
+uintptr_t so_shadow_leave(uintptr_t sp) {
+	uint64_t now = sceKernelGetProcessTimeWide();
+	so_shadow_stack *stack = (so_shadow_stack *)pthread_getspecific(shadow_key);
+	while (stack && stack->depth && stack->frames[stack->depth - 1].sp < sp)
+		stack->depth--;
+	if (!stack || !stack->depth)
+		fatal_error("Error timed call returned with no frame left.");
+
+	so_shadow_frame *frame = &stack->frames[--stack->depth];
+	uint64_t time_us = now - frame->start;
+	if (stack->depth)
+		stack->frames[stack->depth - 1].child_us += time_us;
+	if (frame->site->leave)
+		frame->site->leave(frame->site, time_us, time_us - frame->child_us, stack->depth);
+	return frame->lr;
+}
+
+/*
+ * Import tracing: with so_trace_imports on, default_dynlib imports are bound
+ * through a thunk that counts the calls and, in SO_TRACE_TIME mode, a timed
+ * call thunk recording the time spent until the import returns. Imports that
+ * do not return, or return twice, are bound directly: the unwinder cannot walk
+ * past a thunk and setjmp would keep its return address.
+*/
+static const char *trace_untraced[] = {
+	"abort", "exit", "_exit", "_Exit", "pthread_exit", "__assert2", "__stack_chk_fail",
+	"setjmp", "_setjmp", "sigsetjmp", "longjmp", "_longjmp", "siglongjmp",
+	"__cxa_throw", "__cxa_rethrow", "__cxa_end_cleanup", "__cxa_pure_virtual",
+	"_Unwind_RaiseException", "_Unwind_Resume", "_Unwind_Resume_or_Rethrow",
+};
+
+void so_trace_imports(int mode) {
+	trace_mode = mode;
+}
+
+static void so_trace_leave(so_shadow_site *site, uint64_t time_us, uint64_t self_us, int depth) {
+	__atomic_add_fetch(&((so_trace_import *)site)->time_us, time_us, __ATOMIC_RELAXED);
+}
+
+static uintptr_t so_trace_thunk(so_dynlib_index *idx, int index) {
+	if (!idx->trace) {
+		idx->trace = calloc(idx->num, sizeof(so_trace_import));
+		size_t size = ALIGN_MEM(idx->num * SO_SHADOW_THUNK_SIZE, 0x1000);
+		idx->trace_blockid = kuKernelAllocMemBlock("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, size, NULL);
+		if (!idx->trace || idx->trace_blockid < 0)
+			fatal_error("Error could not allocate the import trace thunks.");
+		sceKernelGetMemBlockBase(idx->trace_blockid, &idx->trace_base);
+	}
+
+	so_trace_import *imp = &idx->trace[index];
+	if (imp->thunk)
+		return imp->thunk;
+
+	imp->symbol = idx->table[index].symbol;
+	imp->site.target = idx->table[index].func;
+	uintptr_t thunk = idx->trace_base + index * SO_SHADOW_THUNK_SIZE;
+	if (trace_mode == SO_TRACE_TIME) {
+		uint32_t code[SO_SHADOW_THUNK_SIZE / 4];
+		imp->site.leave = so_trace_leave;
+		so_shadow_code(&imp->site, code);
+		kuKernelCpuUnrestrictedMemcpy((void *)thunk, code, sizeof(code));
+		kuKernelFlushCaches((void *)thunk, sizeof(code));
+	} else {
+		uint32_t code[] = {
+			0xe92d0007, // PUSH {R0-R2}
+			0xe59f0018, // LDR R0, [PC, #24]  ; &calls
+			0xe1901f9f, // LDREX R1, [R0]
+			0xe2811001, // ADD R1, R1, #1
+			0xe1802f91, // STREX R2, R1, [R0]
+			0xe3520000, // CMP R2, #0
+			0x1afffffa, // BNE LDREX
+			0xe8bd0007, // POP {R0-R2}
+			0xe59ff000, // LDR PC, [PC]       ; func
+			(uint32_t)(uintptr_t)&imp->site.calls,
+			(uint32_t)imp->site.target,
+		};
+		kuKernelCpuUnrestrictedMemcpy((void *)thunk, code, sizeof(code));
+		kuKernelFlushCaches((void *)thunk, sizeof(code));
+	}
+	imp->thunk = thunk;
+
+	return thunk;
+}
+
+// What an import bound to default_dynlib[index] should point at
+uintptr_t so_dynlib_target(so_default_dynlib *default_dynlib, int size_default_dynlib, int index) {
+	so_dynlib_index *idx;
+	if (trace_mode == SO_TRACE_OFF || !(idx = so_dynlib_get(default_dynlib, size_default_dynlib)))
+		return default_dynlib[index].func;
+	for (int i = 0; i < sizeof(trace_untraced) / sizeof(*trace_untraced); i++)
+		if (strcmp(default_dynlib[index].symbol, trace_untraced[i]) == 0)
+			return default_dynlib[index].func;
+	return so_trace_thunk(idx, index);
+}
+
+// The trace entry of default_dynlib[index], NULL while it is bound directly
+so_trace_import *so_trace_get(so_default_dynlib *default_dynlib, int size_default_dynlib, int index) {
+	so_dynlib_index *idx = so_dynlib_get(default_dynlib, size_default_dynlib);
+	if (!idx || !idx->trace || !idx->trace[index].thunk)
+		return NULL;
+	return &idx->trace[index];
+}
+
+static int so_trace_cmp(const void *a, const void *b) {
+	const so_trace_import *ia = *(const so_trace_import **)a, *ib = *(const so_trace_import **)b;
+	if (ia->site.calls != ib->site.calls)
+		return ia->site.calls < ib->site.calls ? 1 : -1;
+	return ia->time_us < ib->time_us ? 1 : ia->time_us > ib->time_us ? -1 : 0;
+}
+
+// Writes the traced imports ranked by calls, returns how many were called
+int so_trace_report(const char *path) {
+	int num = 0, total = 0;
+	for (int i = 0; i < MAX_DYNLIB_INDEX; i++)
+		if (dynlib_index[i].trace)
+			total += dynlib_index[i].num;
+
+	so_trace_import **ranked = malloc((total + 1) * sizeof(so_trace_import *));
+	if (!ranked)
+		return -1;
+	for (int i = 0; i < MAX_DYNLIB_INDEX; i++) {
+		for (int j = 0; dynlib_index[i].trace && j < dynlib_index[i].num; j++)
+			if (dynlib_index[i].trace[j].site.calls)
+				ranked[num++] = &dynlib_index[i].trace[j];
+	}
+	qsort(ranked, num, sizeof(so_trace_import *), so_trace_cmp);
+
+	FILE *f = fopen(path, "w");
+	if (!f) {
+		free(ranked);
+		return -1;
+	}
+	fprintf(f, "%12s %12s %10s  %s\n", "calls", "total ms", "avg us", "import");
+	for (int i = 0; i < num; i++) {
+		so_trace_import *imp = ranked[i];
+		fprintf(f, "%12u %12.3f %10.3f  %s\n", imp->site.calls, imp->time_us / 1000.0, (double)imp->time_us / imp->site.calls, imp->symbol);
+	}
+	fclose(f);
+	free(ranked);
+
+	return num;
+}
+
+/*
+ * dynlib_prepare: builds the open addressing hash index used to look up
+ * imports in a default_dynlib table. Returns the number of duplicated
+ * entries found (only the first one of each is kept) or < 0 on error.
+*/
+int so_dynlib_prepare(so_default_dynlib *default_dynlib, int size_default_dynlib) {
+	int num = size_default_dynlib / sizeof(so_default_dynlib);
+	if (so_dynlib_get(default_dynlib, size_default_dynlib))
+		return 0;
+
+	so_dynlib_index *idx = NULL;
+	for (int i = 0; i < MAX_DYNLIB_INDEX && !idx; i++) {
+		if (!dynlib_index[i].table)
+			idx = &dynlib_index[i];
+	}
+	if (!idx)
+		return -1;
+
+	uint32_t cap = 16;
+	while (cap < num * 2)
+		cap <<= 1;
+	so_dynlib_slot *slots = malloc(cap * sizeof(so_dynlib_slot));
+	if (!slots)
+		return -1;
+	for (uint32_t i = 0; i < cap; i++)
+		slots[i].index = -1;
+
+	int dups = 0;
+	for (int i = 0; i < num; i++) {
+		uint32_t hash = so_hash((const uint8_t *)default_dynlib[i].symbol);
+		uint32_t slot = hash & (cap - 1);
+		while (slots[slot].index != -1) {
+			if (slots[slot].hash == hash && strcmp(default_dynlib[slots[slot].index].symbol, default_dynlib[i].symbol) == 0)
+				break;
+			slot = (slot + 1) & (cap - 1);
+		}
+
+		if (slots[slot].index != -1) {
+			printf("Duplicate import: %s (entries %d and %d)\n", default_dynlib[i].symbol, slots[slot].index, i);
+			dups++;
+			continue;
+		}
+
+		slots[slot].hash = hash;
+		slots[slot].index = i;
+	}
+
+	idx->slots = slots;
+	idx->mask = cap - 1;
+	idx->num = num;
+	idx->table = default_dynlib;
+
+	return dups;
+}
+
+int so_dynlib_lookup(so_default_dynlib *default_dynlib, int size_default_dynlib, const char *symbol) {
+	so_dynlib_index *idx = so_dynlib_get(default_dynlib, size_default_dynlib);
+	if (!idx) {
+		if (so_dynlib_prepare(default_dynlib, size_default_dynlib) < 0) {
+			// Out of index slots, fall back to a plain scan
+			for (int i = 0; i < size_default_dynlib / sizeof(so_default_dynlib); i++) {
+				if (strcmp(default_dynlib[i].symbol, symbol) == 0)
+					return i;
+			}
+			return -1;
+		}
+		idx = so_dynlib_get(default_dynlib, size_default_dynlib);
+	}
+
+	uint32_t hash = so_hash((const uint8_t *)symbol);
+	for (uint32_t slot = hash & idx->mask; idx->slots[slot].index != -1; slot = (slot + 1) & idx->mask) {
+		if (idx->slots[slot].hash == hash && strcmp(default_dynlib[idx->slots[slot].index].symbol, symbol) == 0)
+			return idx->slots[slot].index;
+	}
+
+	return -1;
+}
+
 static int so_symbol_index(so_module *mod, const char *symbol)
 {
+	// .gnu.hash first: its Bloom filter rejects most misses before touching a chain
+	if (mod->gnu_hash) {
+		uint32_t nbucket = mod->gnu_hash[0];
+		uint32_t symoffset = mod->gnu_hash[1];
+		uint32_t bloom_size = mod->gnu_hash[2];
+		uint32_t bloom_shift = mod->gnu_hash[3];
+		uint32_t *bloom = &mod->gnu_hash[4];
+		uint32_t *bucket = &bloom[bloom_size];
+		uint32_t *chain = &bucket[nbucket];
+
+		uint32_t hash = so_gnu_hash((const uint8_t *)symbol);
+		uint32_t word = bloom[(hash / 32) & (bloom_size - 1)];
+		uint32_t mask = (1u << (hash % 32)) | (1u << ((hash >> bloom_shift) % 32));
+		if ((word & mask) != mask)
+			return -1;
+
+		uint32_t i = bucket[hash % nbucket];
+		if (i < symoffset)
+			return -1;
+		for (;; i++) {
+			uint32_t chain_hash = chain[i - symoffset];
+			if ((chain_hash | 1) == (hash | 1) && mod->dynsym[i].st_shndx != SHN_UNDEF &&
+				strcmp(mod->dynstr + mod->dynsym[i].st_name, symbol) == 0)
+				return i;
+			if (chain_hash & 1)
+				return -1;
+		}
+	}
+
 	if (mod->hash) {
 		uint32_t hash = so_hash((const uint8_t *)symbol);
 		uint32_t nbucket = mod->hash[0];
@@ -535,6 +2816,7 @@ static int so_symbol_index(so_module *mod, const char *symbol)
 			if (mod->dynsym[i].st_info != SHN_UNDEF && strcmp(mod->dynstr + mod->dynsym[i].st_name, symbol) == 0)
 				return i;
 		}
+		return -1;
 	}
 
 	for (int i = 0; i < mod->num_dynsym; i++) {
@@ -547,32 +2829,248 @@ static int so_symbol_index(so_module *mod, const char *symbol)
 	return -1;
 }
 
+// Distance between an allocation and the address it has to be reachable from
+static uintptr_t so_arena_distance(uintptr_t addr, uintptr_t dst) {
+	return addr > dst ? addr - dst : dst - addr;
+}
+
+static uintptr_t so_arena_take(so_module *so, uintptr_t *head, uintptr_t base, size_t size, uintptr_t range, uintptr_t dst, size_t sz) {
+	if (sz > size - (*head - base))
+		return (uintptr_t)NULL;
+	if (range && (so_arena_distance(*head, dst) > range || so_arena_distance(*head + sz, dst) > range))
+		return (uintptr_t)NULL;
+
+	*head += sz;
+	return *head - sz;
+}
+
+// Adds a block to the module's arenas, placed right under the lowest one so
+// that it stays within branch range of .text for as long as possible
+static so_arena *so_arena_grow(so_module *so, size_t sz) {
+	so_arena *arena = calloc(1, sizeof(so_arena));
+	if (!arena)
+		return NULL;
+
+	uintptr_t floor = so->patch_base;
+	for (so_arena *a = so->arenas; a; a = a->next)
+		if (a->base < floor)
+			floor = a->base;
+
+	arena->size = ALIGN_MEM(sz > PATCH_SZ ? sz : PATCH_SZ, PATCH_SZ);
+	arena->blockid = -1;
+	if (floor > arena->size) {
+		SceKernelAllocMemBlockKernelOpt opt;
+		memset(&opt, 0, sizeof(SceKernelAllocMemBlockKernelOpt));
+		opt.size = sizeof(SceKernelAllocMemBlockKernelOpt);
+		opt.attr = 0x1;
+		opt.field_C = (SceUInt32)(floor - arena->size);
+		arena->blockid = kuKernelAllocMemBlock("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, arena->size, &opt);
+	}
+	if (arena->blockid < 0)
+		arena->blockid = kuKernelAllocMemBlock("rx_block", SCE_KERNEL_MEMBLOCK_TYPE_USER_RX, arena->size, NULL);
+	if (arena->blockid < 0) {
+		free(arena);
+		return NULL;
+	}
+
+	sceKernelGetMemBlockBase(arena->blockid, &arena->base);
+	arena->head = arena->base;
+	arena->next = so->arenas;
+	so->arenas = arena;
+	so->arena_stats.extra_blocks++;
+	so->arena_stats.extra_size += arena->size;
+
+	return arena;
+}
+
 /*
- * alloc_arena: allocates space on either patch or cave arenas, 
+ * alloc_arena: allocates space on the patch arena, the cave or the extra
+ * blocks, in that order, adding a block when none of them has room
  * range: maximum range from allocation to dst (ignored if NULL)
  * dst: destination address
 */
 static uintptr_t so_alloc_arena(so_module *so, uintptr_t range, uintptr_t dst, size_t sz) {
-	// Is address in range?
-	#define inrange(lsr, gtr, range) \
-		(((uintptr_t)(range) == (uintptr_t)NULL) || ((uintptr_t)(range) >= ((uintptr_t)(gtr) - (uintptr_t)(lsr))))
-	// Space left on block
-	#define blkavail(type) (so->type##_size - (so->type##_head - so->type##_base))
-	
+	uintptr_t addr;
+
 	// keep allocations 4-byte aligned for simplicity
 	sz = ALIGN_MEM(sz, 4);
+	so->arena_stats.allocs++;
+
+	if ((addr = so_arena_take(so, &so->patch_head, so->patch_base, so->patch_size, range, dst, sz)) ||
+		(addr = so_arena_take(so, &so->cave_head, so->cave_base, so->cave_size, range, dst, sz)))
+		return addr;
 
-	if (sz <= (blkavail(patch)) && inrange(so->patch_base, dst, range)) {
-		so->patch_head += sz;
-		return (so->patch_head - sz);
-	} else if (sz <= (blkavail(cave)) && inrange(dst, so->cave_base, range)) {
-		so->cave_head += sz;
-		return (so->cave_head - sz);
+	for (so_arena *a = so->arenas; a; a = a->next) {
+		if ((addr = so_arena_take(so, &a->head, a->base, a->size, range, dst, sz)))
+			return addr;
 	}
 
+	so_arena *a = so_arena_grow(so, sz);
+	if (a && (addr = so_arena_take(so, &a->head, a->base, a->size, range, dst, sz)))
+		return addr;
+
+	so->arena_stats.failures++;
 	return (uintptr_t)NULL;
 }
 
+// Returns where to branch from "from" to reach "to": "to" itself when it is in
+// B range, else a veneer (LDR PC) placed in range that jumps there
+uintptr_t so_arena_branch(so_module *mod, uintptr_t from, uintptr_t to) {
+	if (so_arena_distance(B_OFFSET(from), to) <= B_RANGE)
+		return to;
+
+	uint32_t veneer[] = {
+		0xe51ff004, // LDR PC, [PC, #-0x4]
+		(uint32_t)to,
+	};
+	uintptr_t addr = so_alloc_arena(mod, B_RANGE, B_OFFSET(from), sizeof(veneer));
+	if (!addr)
+		return (uintptr_t)NULL;
+
+	kuKernelCpuUnrestrictedMemcpy((void *)addr, veneer, sizeof(veneer));
+	kuKernelFlushCaches((void *)addr, sizeof(veneer));
+	mod->arena_stats.veneers++;
+
+	return addr;
+}
+
+// Copies code into the arenas, within B range of near unless it is 0
+uintptr_t so_arena_write(so_module *mod, uintptr_t near, const void *code, size_t size) {
+	uintptr_t addr = so_alloc_arena(mod, near ? B_RANGE : (uintptr_t)NULL, near ? B_OFFSET(near) : 0, size);
+	if (!addr)
+		return (uintptr_t)NULL;
+
+	kuKernelCpuUnrestrictedMemcpy((void *)addr, code, size);
+	kuKernelFlushCaches((void *)addr, size);
+
+	return addr;
+}
+
+void so_arena_report(so_module *mod) {
+	so_arena_stats *st = &mod->arena_stats;
+	size_t extra_used = 0, reclaimed_used = 0;
+	for (so_arena *a = mod->arenas; a; a = a->next) {
+		if (a->blockid >= 0)
+			extra_used += a->head - a->base;
+		else
+			reclaimed_used += a->head - a->base;
+	}
+
+	printf("%s arenas: patch %u/%u, cave %u/%u, %d extra blocks %u/%u, reclaimed %u/%u, %d veneers (%d allocations, %d failed)\n",
+		mod->soname ? mod->soname : "?",
+		(unsigned)(mod->patch_head - mod->patch_base), (unsigned)mod->patch_size,
+		(unsigned)(mod->cave_head - mod->cave_base), (unsigned)mod->cave_size,
+		st->extra_blocks, (unsigned)extra_used, (unsigned)st->extra_size,
+		(unsigned)reclaimed_used, (unsigned)mod->reclaim_stats.arena,
+		st->veneers, st->allocs, st->failures);
+}
+
+// Hands [start, start + size) of the module's executable block to the arena
+// allocator, once nothing reads it anymore
+static size_t so_reclaim_range(so_module *mod, uintptr_t start, size_t size) {
+	uintptr_t base = ALIGN_MEM(start, 4);
+	uintptr_t end = (start + size) & ~3;
+	if (base < mod->text_base || end > mod->text_base + mod->text_size || end < base + RECLAIM_MIN)
+		return 0;
+
+	so_arena *arena = calloc(1, sizeof(so_arena));
+	if (!arena)
+		return 0;
+	arena->blockid = -1;
+	arena->base = arena->head = base;
+	arena->size = end - base;
+	arena->next = mod->arenas;
+	mod->arenas = arena;
+
+	return arena->size;
+}
+
+// Returns the bytes recovered, its share of the symbol table aside
+static size_t so_reclaim_module(so_module *mod) {
+	so_reclaim_stats *st = &mod->reclaim_stats;
+	size_t heap = mod->num_bindings * sizeof(so_binding);
+	free(mod->bindings);
+	mod->bindings = NULL;
+	mod->num_bindings = 0;
+
+	// .rel.dyn (or its packed form) and .relr.dyn were done with once linked;
+	// .rel.plt stays for lazy binding and for naming unresolved imports
+	uintptr_t ranges[2][2] = { { 0 } };
+	int num = 0;
+	if (mod->reldyn_unpacked) {
+		heap += mod->num_reldyn * sizeof(Elf32_Rel);
+		free(mod->reldyn);
+		for (int i = 0; i < mod->num_dynamic; i++) {
+			if (mod->dynamic[i].d_tag == DT_ANDROID_REL)
+				ranges[num][0] = mod->text_base + mod->dynamic[i].d_un.d_ptr;
+			else if (mod->dynamic[i].d_tag == DT_ANDROID_RELSZ)
+				ranges[num][1] = mod->dynamic[i].d_un.d_val;
+		}
+		num++;
+	} else if (mod->reldyn) {
+		ranges[num][0] = (uintptr_t)mod->reldyn;
+		ranges[num++][1] = mod->num_reldyn * sizeof(Elf32_Rel);
+	}
+	if (mod->relr) {
+		ranges[num][0] = (uintptr_t)mod->relr;
+		ranges[num++][1] = mod->num_relr * sizeof(Elf32_Addr);
+	}
+	mod->reldyn = NULL;
+	mod->num_reldyn = 0;
+	mod->reldyn_unpacked = 0;
+	mod->relr = NULL;
+	mod->num_relr = 0;
+
+	// Adjacent tables make a single range
+	if (num == 2 && ranges[0][0] + ranges[0][1] == ranges[1][0]) {
+		ranges[0][1] += ranges[1][1];
+		num = 1;
+	} else if (num == 2 && ranges[1][0] + ranges[1][1] == ranges[0][0]) {
+		ranges[0][0] = ranges[1][0];
+		ranges[0][1] += ranges[1][1];
+		num = 1;
+	}
+	size_t arena = 0;
+	for (int i = 0; i < num; i++)
+		arena += so_reclaim_range(mod, ranges[i][0], ranges[i][1]);
+
+	st->heap += heap;
+	st->arena += arena;
+	mod->reclaimed = 1;
+	return heap + arena;
+}
+
+/*
+ * reclaim: drops what only binding needed once every module is linked. The
+ * loader-wide symbol table gives way to a compact index of the names so_symbol
+ * is still going to be called with, other names are looked up in each module
+ * on their own. Bindings and decoded relocations are freed and the relocation
+ * tables in the executable blocks become arena space: memblocks cannot be
+ * shrunk, so that is where hooks and trampolines go from then on instead of
+ * extra blocks. Returns the bytes recovered across modules.
+*/
+size_t so_reclaim(const char **symbols, int num) {
+	int freed = symtab_compact ? 0 : so_symtab_compact(symbols, num);
+	if (freed < 0) {
+		printf("Could not compact the symbol table, it is kept whole\n");
+		freed = 0;
+	}
+
+	size_t total = freed;
+	for (so_module *curr = head; curr; curr = curr->next) {
+		if (!curr->reclaimed)
+			total += so_reclaim_module(curr);
+	}
+
+	return total;
+}
+
+void so_reclaim_report(so_module *mod) {
+	so_reclaim_stats *st = &mod->reclaim_stats;
+	printf("%s: reclaimed %u bytes of heap, %u bytes of code space (%d exports kept in the symbol index)\n",
+		mod->soname ? mod->soname : "?", (unsigned)st->heap, (unsigned)st->arena, st->symbols);
+}
+
 static void trampoline_ldm(so_module *mod, uint32_t *dst) {
 	uint32_t trampoline[1];
 	uint32_t funct[20] = {0xFAFAFAFA};
@@ -582,7 +3080,7 @@ static void trampoline_ldm(so_module *mod, uint32_t *dst) {
 	int baseReg = ((*dst) >> 16) & 0xF;
 	int bitMask = (*dst) & 0xFFFF;
 
-	uint32_t stored = NULL;
+	uint32_t stored = 0;
 	for (int i = 0; i < 16; i++) {
 		if (bitMask & (1 << i)) {
 			// If the register we're reading the offset from is the same as the one we're writing,
@@ -601,30 +3099,114 @@ static void trampoline_ldm(so_module *mod, uint32_t *dst) {
 	}
 
 	*ptr++ = 0xe51ff004; // LDR PC, [PC, -0x4] ; jmp to [dst+0x4]
-	*ptr++ = dst+1; // .dword <...>	; [dst+0x4]
+	*ptr++ = (uint32_t)(uintptr_t)(dst+1); // .dword <...>	; [dst+0x4]
 
 	size_t trampoline_sz =	((uintptr_t)ptr - (uintptr_t)&funct[0]);
-	uintptr_t patch_addr = so_alloc_arena(mod, B_RANGE, B_OFFSET(dst), trampoline_sz);
+	uintptr_t patch_addr = so_alloc_arena(mod, B_RANGE, B_OFFSET((uintptr_t)dst), trampoline_sz);
+	uintptr_t branch_addr = patch_addr;
 
+	// Out of room near the code, place it anywhere and reach it through a veneer
 	if (!patch_addr) {
+		patch_addr = so_alloc_arena(mod, 0, 0, trampoline_sz);
+		branch_addr = patch_addr ? so_arena_branch(mod, (uintptr_t)dst, patch_addr) : (uintptr_t)NULL;
+	}
+	if (!branch_addr) {
 		fatal_error("Failed to patch LDMIA at 0x%08X, unable to allocate space.\n", dst);
 	}
 	
 	// Create sign extended relative address rel_addr
-	trampoline[0] = B(dst, patch_addr).raw;
+	trampoline[0] = B(dst, branch_addr).raw;
 
 	kuKernelCpuUnrestrictedMemcpy((void*)patch_addr, funct, trampoline_sz);
 	kuKernelCpuUnrestrictedMemcpy(dst, trampoline, sizeof(trampoline));
 }
 
 uintptr_t so_symbol(so_module *mod, const char *symbol) {
-	int index = so_symbol_index(mod, symbol);
+	int index = so_symtab_index(mod, symbol);
 	if (index == -1)
-		return NULL;
+		return 0;
 
 	return mod->text_base + mod->dynsym[index].st_value;
 }
 
+/*
+ * symbols_lookup: resolves a list of exports at once, out[i] is 0 for the
+ * missing ones. Returns how many were found.
+ * Interned and hashed modules take one probe per name already, the others
+ * get a single pass over .dynsym against a temporary set of the names
+ * instead of one full scan per name.
+*/
+int so_symbols_lookup(so_module *mod, const char **symbols, uintptr_t *out, int num) {
+	so_dynlib_slot *slots = NULL;
+	int32_t *first = NULL; // entry each name resolves like, for duplicates
+	uint32_t cap = 16;
+	int found = 0;
+
+	if (!mod->interned && !mod->gnu_hash && !mod->hash) {
+		while (cap < num * 2)
+			cap <<= 1;
+		slots = malloc(cap * sizeof(so_dynlib_slot));
+		first = malloc(num * sizeof(int32_t));
+	}
+	if (!slots || !first) {
+		free(slots);
+		free(first);
+		for (int i = 0; i < num; i++) {
+			out[i] = so_symbol(mod, symbols[i]);
+			if (out[i])
+				found++;
+		}
+		return found;
+	}
+	memset(slots, 0xff, cap * sizeof(so_dynlib_slot));
+
+	int pending = 0;
+	for (int i = 0; i < num; i++) {
+		uint32_t hash = so_gnu_hash((const uint8_t *)symbols[i]);
+		uint32_t slot = so_name_slot(hash, cap - 1);
+		while (slots[slot].index != -1) {
+			if (slots[slot].hash == hash && strcmp(symbols[slots[slot].index], symbols[i]) == 0)
+				break;
+			slot = (slot + 1) & (cap - 1);
+		}
+		if (slots[slot].index == -1) {
+			slots[slot].hash = hash;
+			slots[slot].index = i;
+			pending++;
+		}
+		first[i] = slots[slot].index;
+		out[i] = 0;
+	}
+
+	// First definition wins, as with so_symbol
+	for (int i = 0; i < mod->num_dynsym && pending; i++) {
+		Elf32_Sym *sym = &mod->dynsym[i];
+		if (sym->st_shndx == SHN_UNDEF || sym->st_info == SHN_UNDEF)
+			continue;
+
+		const char *name = mod->dynstr + sym->st_name;
+		uint32_t hash = so_gnu_hash((const uint8_t *)name);
+		for (uint32_t slot = so_name_slot(hash, cap - 1); slots[slot].index != -1; slot = (slot + 1) & (cap - 1)) {
+			int32_t n = slots[slot].index;
+			if (slots[slot].hash == hash && !out[n] && strcmp(symbols[n], name) == 0) {
+				out[n] = mod->text_base + sym->st_value;
+				pending--;
+				break;
+			}
+		}
+	}
+
+	for (int i = 0; i < num; i++) {
+		out[i] = out[first[i]];
+		if (out[i])
+			found++;
+	}
+
+	free(slots);
+	free(first);
+	return found;
+}
+
 void so_symbol_fix_ldmia(so_module *mod, const char *symbol) {
 	// This is meant to work around crashes due to unaligned accesses (SIGBUS :/) due to certain
 	// kernels not having the fault trap enabled, e.g. certain RK3326 Odroid Go Advance clone distros.
@@ -632,7 +3214,7 @@ void so_symbol_fix_ldmia(so_module *mod, const char *symbol) {
 	// Known to trigger on GM:S's "_Z11Shader_LoadPhjS_" - if it starts happening on other places,
 	// might be worth enabling it globally.
 	
-	int idx = so_symbol_index(mod, symbol);
+	int idx = so_symtab_index(mod, symbol);
 	if (idx == -1)
 		return;
 
@@ -643,7 +3225,7 @@ void so_symbol_fix_ldmia(so_module *mod, const char *symbol) {
 		//Is this an LDMIA instruction with a R0-R12 base register?
 		if (((inst & 0xFFF00000) == 0xE8900000) && (((inst >> 16) & 0xF) < 13) ) {
 			debugPrintf("Found possibly misaligned LDMIA on 0x%08X, trying to fix it... (instr: 0x%08X, to 0x%08X)\n", addr, *(uint32_t*)addr, mod->patch_head);
-			trampoline_ldm(mod, addr);
+			trampoline_ldm(mod, (uint32_t *)addr);
 		}
 	}
 }
@@ -5,21 +5,104 @@
 
 #define ALIGN_MEM(x, align) (((x) + ((align) - 1)) & ~((align) - 1))
 #define MAX_DATA_SEG 4
+#define MAX_NEEDED 16
+#define SO_HASH_SIZE 20 // SHA1
+#define SO_NAME_MAX 64
+
+enum {
+  SO_BIND_PENDING,
+  SO_BIND_DYNLIB,
+  SO_BIND_LINK,
+  SO_BIND_NONE,
+};
 
 typedef struct {
 	uintptr_t addr;
 	uintptr_t thumb_addr;
 	uint32_t orig_instr[2];
 	uint32_t patch_instr[2];
+	uintptr_t trampoline; // runs the original function, 0 if its prologue could not be moved
 } so_hook;
 
+typedef struct {
+  uintptr_t addr;
+  uintptr_t dst;
+  so_hook *out; // receives the installed hook and its trampoline, may be NULL
+  int seq;      // queue order, the last hook on an address wins
+} so_hook_entry;
+
+typedef struct {
+  so_hook_entry *entries;
+  int num;
+  int size;
+} so_hook_batch;
+
+typedef struct {
+  int relative, abs32, glob_dat, jump_slot;
+  int imports, from_dynlib, from_link, unresolved;
+  int lazy;          // JUMP_SLOTs left pointing at the resolver stub
+  int lazy_bound;    // of those, how many were called and bound since
+  int tls;           // R_ARM_TLS_* slots, counted apart from the above
+  uint64_t time_us;
+} so_link_stats;
+
+typedef struct {
+  char *symbol;
+  uintptr_t func;
+} so_default_dynlib;
+
+// Extra RX block added once the patch arena and the code cave are full, or a
+// range of the module's own block given back by so_reclaim (blockid < 0)
+typedef struct so_arena {
+  struct so_arena *next;
+  SceUID blockid;
+  uintptr_t base, head;
+  size_t size;
+} so_arena;
+
+typedef struct {
+  int allocs, failures;
+  int extra_blocks;
+  size_t extra_size;
+  int veneers;       // LDR PC islands for branches beyond B range
+} so_arena_stats;
+
+enum {
+  SO_INIT_PENDING,
+  SO_INIT_DEFERRED,  // left for so_initialize_deferred
+  SO_INIT_DONE,
+};
+
+typedef struct {
+  uint64_t time_us;
+  int state;         // SO_INIT_*
+  int deferred;      // runs after the others, whether it did already or not
+} so_init_stats;
+
+typedef struct {
+  size_t heap;       // bindings, decoded relocations and the module's share of the symbol table
+  size_t arena;      // relocation tables in the executable block, now arena space
+  int symbols;       // exports left in the compact symbol index
+} so_reclaim_stats;
+
+typedef struct {
+  uint32_t sym;      // dynsym index of the import
+  uint8_t kind;      // SO_BIND_*
+  uint8_t provider;  // load order position of the module providing it (SO_BIND_LINK)
+  uint16_t reserved;
+  uint32_t index;    // default_dynlib entry (SO_BIND_DYNLIB) or provider dynsym index (SO_BIND_LINK)
+} so_binding;
+
 typedef struct so_module {
   struct so_module *next;
 
   SceUID patch_blockid, text_blockid, data_blockid[MAX_DATA_SEG];
   uintptr_t patch_base, patch_head, cave_base, cave_head, text_base, data_base[MAX_DATA_SEG];
   size_t patch_size, cave_size, text_size, data_size[MAX_DATA_SEG];
+  size_t text_block_size, data_block_size[MAX_DATA_SEG]; // as allocated, the segments sit inside
   int n_data;
+  so_arena *arenas;
+  so_arena_stats arena_stats;
 
   Elf32_Ehdr *ehdr;
   Elf32_Phdr *phdr;
@@ -29,46 +112,191 @@ typedef struct so_module {
   Elf32_Sym *dynsym;
   Elf32_Rel *reldyn;
   Elf32_Rel *relplt;
+  Elf32_Addr *relr; // relative relocations as RELR address/bitmap words
 
   int (** init_array)(void);
   uint32_t *hash;
+  uint32_t *gnu_hash;
 
   int num_dynamic;
   int num_dynsym;
   int num_reldyn;
   int num_relplt;
+  int num_relr;
+  int reldyn_unpacked; // reldyn was decoded from an APS2 table and is heap allocated
   int num_init_array;
 
   char *soname;
   char *shstr;
   char *dynstr;
+
+  // PT_TLS segment, the image new threads get their block from (see tls.c)
+  uintptr_t tls_image;
+  size_t tls_filesz, tls_memsz, tls_align;
+  int tls_id;        // what R_ARM_TLS_DTPMOD32 writes, 0 for no TLS
+  size_t tls_offset; // of its static block from the thread pointer, 0 for none
+
+  uint8_t digest[SO_HASH_SIZE]; // covers the headers and every table used for binding
+  so_binding *bindings;
+  int num_bindings;
+  int prelinked;
+
+  // Loaded modules behind the DT_NEEDED entries, in lookup order
+  struct so_module *needed[MAX_NEEDED];
+  int num_needed;
+  int interned; // exports are in the loader-wide symbol table
+
+  int link_threads; // threads so_link splits the relocations across, 0 or 1 for none
+
+  so_init_stats *init_stats; // one per init_array entry, once so_initialize got to them
+
+  uint64_t load_us; // reading the file and placing the segments
+  uint64_t wait_us; // how long so_load_wait blocked on it, the rest overlapped other work
+
+  // Lazy binding: JUMP_SLOTs go through lazy_stub until first called
+  uintptr_t lazy_stub;
+  so_default_dynlib *lazy_dynlib;
+  int lazy_dynlib_size;
+  int lazy_dynlib_only;
+
+  so_link_stats link_stats;
+
+  int reclaimed;     // only what runs it is left, see so_reclaim
+  so_reclaim_stats reclaim_stats;
 } so_module;
 
+// Where a linked module is mapped and where its tables are in it, as a snapshot
+// keeps it: addresses are absolute, tables are offsets from text_base (0 for none)
 typedef struct {
-  char *symbol;
-  uintptr_t func;
-} so_default_dynlib;
+  uint32_t patch_base, patch_size, patch_head;
+  uint32_t text_block, text_block_size, text_base, text_size;
+  uint32_t cave_base, cave_size, cave_head;
+  uint32_t n_data;
+  uint32_t data_block[MAX_DATA_SEG], data_block_size[MAX_DATA_SEG];
+  uint32_t data_base[MAX_DATA_SEG], data_size[MAX_DATA_SEG];
+  uint32_t dynamic, dynstr, dynsym, reldyn, relplt, relr, init_array, hash, gnu_hash, soname;
+  uint32_t num_dynamic, num_dynsym, num_reldyn, num_relplt, num_relr, num_init_array;
+  uint32_t lazy_stub;      // its literals point into the loader and are written again
+  uint32_t lazy_dynlib_only;
+  uint32_t tls_image, tls_filesz, tls_memsz, tls_align;
+  uint32_t tls_id, tls_offset; // baked into the relocated slots, the module gets them back
+  uint8_t digest[SO_HASH_SIZE];
+  so_link_stats link_stats;
+} so_layout;
+
+typedef struct {
+  uint32_t hash;
+  int32_t index; // entry in the dynlib table, -1 if the slot is empty
+} so_dynlib_slot;
+
+enum {
+  SO_TRACE_OFF,
+  SO_TRACE_CALLS,
+  SO_TRACE_TIME,
+};
+
+#define SO_SHADOW_THUNK_SIZE 84
+#define SO_SHADOW_THUNK_SITE 72 // offset of the literal holding the site
+
+// A call timed through a thunk written by so_shadow_code, which keeps the
+// caller's return address on a per thread shadow stack while target runs
+typedef struct so_shadow_site {
+  uintptr_t target;
+  uint32_t calls;
+  // Accounts a call once it returned, depth is how many timed calls are still running around it
+  void (*leave)(struct so_shadow_site *site, uint64_t time_us, uint64_t self_us, int depth);
+} so_shadow_site;
+
+typedef struct {
+  so_shadow_site site; // target is the import, calls are counted in both modes
+  const char *symbol;
+  uintptr_t thunk;     // what importers are bound to instead of the import
+  uint64_t time_us;    // SO_TRACE_TIME only, includes the imports it calls in turn
+} so_trace_import;
+
+typedef struct {
+  so_default_dynlib *table;
+  int num;
+  uint32_t mask;
+  so_dynlib_slot *slots;
+  so_trace_import *trace; // one per entry once tracing binds any of them
+  SceUID trace_blockid;
+  uintptr_t trace_base;
+} so_dynlib_index;
 
 so_hook hook_thumb(uintptr_t addr, uintptr_t dst);
 so_hook hook_arm(uintptr_t addr, uintptr_t dst);
 so_hook hook_addr(uintptr_t addr, uintptr_t dst);
+void hook_begin(so_hook_batch *batch);
+void hook_queue(so_hook_batch *batch, uintptr_t addr, uintptr_t dst, so_hook *out);
+int hook_commit(so_hook_batch *batch);
 
 void so_flush_caches(so_module *mod);
+uintptr_t so_arena_write(so_module *mod, uintptr_t near, const void *code, size_t size);
+uintptr_t so_arena_branch(so_module *mod, uintptr_t from, uintptr_t to);
+void so_arena_report(so_module *mod);
 int so_file_load(so_module *mod, const char *filename, uintptr_t load_addr);
+// Background loading: queued modules are read in order on helper threads once
+// started, so_load_wait registers a module (and those queued before it) when ready
+int so_load_queue(so_module *mod, const char *filename, uintptr_t load_addr);
+void so_load_start(void);
+int so_load_wait(so_module *mod);
+int so_file_needed(const char *filename, char needed[][SO_NAME_MAX], int max_needed, size_t *span);
+// Mapping a module back as it was once linked: so_layout_map allocates its
+// blocks at the same addresses for the caller to fill, so_layout_register
+// then makes it visible to lookups
+int so_layout_get(so_module *mod, so_layout *layout);
+int so_layout_map(so_module *mod, const so_layout *layout);
+void so_layout_register(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib);
+int so_file_load_whole(so_module *mod, const char *filename, uintptr_t load_addr);
 int so_mem_load(so_module *mod, void * buffer, size_t so_size, uintptr_t load_addr);
+void so_unload(so_module *mod);
+int so_module_position(so_module *mod);
+so_module *so_module_at(int position);
 int so_relocate(so_module *mod);
 int so_resolve(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only);
+int so_link(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only);
+int so_link_lazy(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only);
+uintptr_t so_lazy_bind(so_module *mod, uintptr_t slot);
+uintptr_t so_resolve_link(so_module *mod, const char *symbol);
+void so_link_report(so_module *mod);
 int so_resolve_with_dummy(so_module *mod, so_default_dynlib *default_dynlib, int size_default_dynlib, int default_dynlib_only);
+int so_dynlib_prepare(so_default_dynlib *default_dynlib, int size_default_dynlib);
+int so_dynlib_lookup(so_default_dynlib *default_dynlib, int size_default_dynlib, const char *symbol);
+uintptr_t so_dynlib_target(so_default_dynlib *default_dynlib, int size_default_dynlib, int index);
+void so_trace_imports(int mode);
+so_trace_import *so_trace_get(so_default_dynlib *default_dynlib, int size_default_dynlib, int index);
+int so_trace_report(const char *path);
+// Fills code (SO_SHADOW_THUNK_SIZE bytes) with a thunk timing calls to site,
+// enter and leave are what it calls with the caller's LR and SP
+void so_shadow_code(so_shadow_site *site, uint32_t *code);
+uintptr_t so_shadow_enter(so_shadow_site *site, uintptr_t lr, uintptr_t sp, uintptr_t ret);
+uintptr_t so_shadow_leave(uintptr_t sp);
 void so_symbol_fix_ldmia(so_module *mod, const char *symbol);
 void so_initialize(so_module *mod);
+// Runs every constructor but the ones named in deferred (as so_init_name
+// names them, or just by their symbol), returns how many were left
+int so_initialize_defer(so_module *mod, const char *deferred);
+void so_initialize_deferred(so_module *mod);
+void so_init_name(so_module *mod, int index, char *buf, size_t size);
+void so_init_report(so_module *mod, int max);
+const char *so_function_at(so_module *mod, uintptr_t addr, uintptr_t *offset);
 uintptr_t so_symbol(so_module *mod, const char *symbol);
+int so_symbols_lookup(so_module *mod, const char **symbols, uintptr_t *out, int num);
+size_t so_reclaim(const char **symbols, int num);
+void so_reclaim_report(so_module *mod);
 
 #define SO_CONTINUE(type, h, ...) ({ \
-  kuKernelCpuUnrestrictedMemcpy((void *)h.addr, h.orig_instr, sizeof(h.orig_instr)); \
-  kuKernelFlushCaches((void *)h.addr, sizeof(h.orig_instr)); \
-  type r = h.thumb_addr ? ((type(*)())h.thumb_addr)(__VA_ARGS__) : ((type(*)())h.addr)(__VA_ARGS__); \
-  kuKernelCpuUnrestrictedMemcpy((void *)h.addr, h.patch_instr, sizeof(h.patch_instr)); \
-  kuKernelFlushCaches((void *)h.addr, sizeof(h.patch_instr)); \
+  type r; \
+  if (h.trampoline) { \
+    r = ((type(*)())h.trampoline)(__VA_ARGS__); \
+  } else { \
+    kuKernelCpuUnrestrictedMemcpy((void *)h.addr, h.orig_instr, sizeof(h.orig_instr)); \
+    kuKernelFlushCaches((void *)h.addr, sizeof(h.orig_instr)); \
+    r = h.thumb_addr ? ((type(*)())h.thumb_addr)(__VA_ARGS__) : ((type(*)())h.addr)(__VA_ARGS__); \
+    kuKernelCpuUnrestrictedMemcpy((void *)h.addr, h.patch_instr, sizeof(h.patch_instr)); \
+    kuKernelFlushCaches((void *)h.addr, sizeof(h.patch_instr)); \
+  } \
   r; \
 })
 
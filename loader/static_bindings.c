@@ -0,0 +1,21 @@
+/* static_bindings.c -- import bindings resolved offline
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+/*
+ * Overwritten by host/bindgen for a given set of modules:
+ *   ./build-host/bindgen -o loader/static_bindings.c libc++_shared.so libHumanResourceMachine.so
+ * Tables only apply to the exact modules and default_dynlib they were made
+ * with, anything else links by name as usual.
+*/
+
+#include <vitasdk.h>
+
+#include "prelink.h"
+
+const prelink_table static_bindings[] = { { 0 } };
+const int num_static_bindings = 0;
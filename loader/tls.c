@@ -0,0 +1,265 @@
+/* tls.c -- thread local storage of the loaded modules
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <vitasdk.h>
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dialog.h"
+#include "tls.h"
+
+/*
+ * Each thread gets a single allocation on its first TLS access: the table of
+ * its blocks by module id, then the thread pointer, then the static blocks at
+ * the offsets TPOFF32 relocations were given (ARM variant 1, the first one
+ * after the 8 byte TCB). Blocks are filled from the module's PT_TLS image the
+ * first time the thread asks for them, modules without a static offset get a
+ * heap block of their own. Ids and offsets are handed out again once their
+ * module is gone, tls_gen tells a thread its block belongs to a previous owner.
+*/
+typedef struct {
+	uint32_t generation;                 // tls_generation the blocks were checked against
+	uintptr_t block[TLS_MODULES + 1];    // by module id, 0 until the thread uses it
+	uint32_t gen[TLS_MODULES + 1];       // tls_gen of the module the block was set up for
+	void *dynamic[TLS_MODULES + 1];      // heap blocks, to be freed along with the thread
+	void *raw;                           // as allocated, the rest is aligned in it
+	uint32_t tcb[2] __attribute__((aligned(TLS_ALIGN_MAX)));
+	uint8_t area[TLS_STATIC_SIZE];
+} so_tls_thread;
+
+static pthread_once_t tls_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tls_key;
+static volatile int tls_ready = 0;
+static pthread_mutex_t tls_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static so_module *tls_mods[TLS_MODULES + 1];
+static uint32_t tls_gen[TLS_MODULES + 1];
+static volatile uint32_t tls_generation = 1; // bumped whenever a module comes or goes
+static so_tls_stats tls_stats;
+
+static void so_tls_thread_free(void *arg) {
+	so_tls_thread *t = (so_tls_thread *)arg;
+	for (int id = 1; id <= TLS_MODULES; id++)
+		free(t->dynamic[id]);
+	free(t->raw);
+}
+
+static void so_tls_key_init(void) {
+	pthread_key_create(&tls_key, so_tls_thread_free);
+	tls_ready = 1;
+}
+
+// First offset from the thread pointer a block of the module fits at, 0 if none
+static size_t so_tls_static_fit(so_module *mod) {
+	if (mod->tls_align > TLS_ALIGN_MAX)
+		return 0;
+
+	size_t offset = ALIGN_MEM(sizeof(((so_tls_thread *)0)->tcb), mod->tls_align);
+	for (int id = 1; id <= TLS_MODULES; id++) {
+		so_module *other = tls_mods[id];
+		if (!other || !other->tls_offset)
+			continue;
+		if (offset < other->tls_offset + other->tls_memsz && other->tls_offset < offset + mod->tls_memsz) {
+			offset = ALIGN_MEM(other->tls_offset + other->tls_memsz, mod->tls_align);
+			id = 0;
+		}
+	}
+
+	return offset + mod->tls_memsz <= sizeof(((so_tls_thread *)0)->tcb) + TLS_STATIC_SIZE ? offset : 0;
+}
+
+static int so_tls_static_free(so_module *mod) {
+	for (int id = 1; id <= TLS_MODULES; id++) {
+		so_module *other = tls_mods[id];
+		if (other && other->tls_offset && mod->tls_offset < other->tls_offset + other->tls_memsz &&
+			other->tls_offset < mod->tls_offset + mod->tls_memsz)
+			return 0;
+	}
+	return 1;
+}
+
+void so_tls_register(so_module *mod) {
+	if (!mod->tls_memsz)
+		return;
+
+	pthread_mutex_lock(&tls_lock);
+	if (mod->tls_id) {
+		if (mod->tls_id > TLS_MODULES || tls_mods[mod->tls_id] || (mod->tls_offset && !so_tls_static_free(mod)))
+			fatal_error("Error TLS module id %d of %s is taken.", mod->tls_id, mod->soname);
+	} else {
+		for (int id = 1; id <= TLS_MODULES && !mod->tls_id; id++) {
+			if (!tls_mods[id])
+				mod->tls_id = id;
+		}
+		if (!mod->tls_id)
+			fatal_error("Error too many modules with TLS, %s is one more than %d.", mod->soname, TLS_MODULES);
+		mod->tls_offset = so_tls_static_fit(mod);
+	}
+
+	tls_mods[mod->tls_id] = mod;
+	tls_gen[mod->tls_id]++;
+	tls_stats.modules++;
+	if (mod->tls_offset && mod->tls_offset + mod->tls_memsz > tls_stats.static_used)
+		tls_stats.static_used = mod->tls_offset + mod->tls_memsz;
+	__atomic_add_fetch(&tls_generation, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&tls_lock);
+}
+
+void so_tls_unregister(so_module *mod) {
+	if (!mod->tls_id)
+		return;
+
+	pthread_mutex_lock(&tls_lock);
+	if (tls_mods[mod->tls_id] != mod) {
+		pthread_mutex_unlock(&tls_lock);
+		return;
+	}
+	tls_mods[mod->tls_id] = NULL;
+	tls_gen[mod->tls_id]++;
+	tls_stats.modules--;
+	tls_stats.static_used = 0;
+	for (int id = 1; id <= TLS_MODULES; id++) {
+		so_module *other = tls_mods[id];
+		if (other && other->tls_offset && other->tls_offset + other->tls_memsz > tls_stats.static_used)
+			tls_stats.static_used = other->tls_offset + other->tls_memsz;
+	}
+	__atomic_add_fetch(&tls_generation, 1, __ATOMIC_RELEASE);
+	pthread_mutex_unlock(&tls_lock);
+}
+
+// The calling thread's blocks, with the ones of modules gone since dropped
+static so_tls_thread *so_tls_thread_get(void) {
+	pthread_once(&tls_once, so_tls_key_init);
+
+	so_tls_thread *t = (so_tls_thread *)pthread_getspecific(tls_key);
+	if (!t) {
+		void *raw = malloc(sizeof(so_tls_thread) + TLS_ALIGN_MAX);
+		if (!raw)
+			fatal_error("Error could not allocate the TLS blocks of a thread.");
+		t = (so_tls_thread *)ALIGN_MEM((uintptr_t)raw, TLS_ALIGN_MAX);
+		memset(t, 0, offsetof(so_tls_thread, tcb));
+		t->raw = raw;
+		pthread_setspecific(tls_key, t);
+		__atomic_add_fetch(&tls_stats.threads, 1, __ATOMIC_RELAXED);
+	}
+
+	uint32_t generation = __atomic_load_n(&tls_generation, __ATOMIC_ACQUIRE);
+	if (t->generation != generation) {
+		pthread_mutex_lock(&tls_lock);
+		for (int id = 1; id <= TLS_MODULES; id++) {
+			if (t->block[id] && t->gen[id] != tls_gen[id]) {
+				free(t->dynamic[id]);
+				t->dynamic[id] = NULL;
+				t->block[id] = 0;
+			}
+		}
+		t->generation = generation;
+		pthread_mutex_unlock(&tls_lock);
+	}
+
+	return t;
+}
+
+static uintptr_t so_tls_block(so_tls_thread *t, uint32_t id) {
+	if (id == 0 || id > TLS_MODULES)
+		fatal_error("Error TLS access to module id %u, it was never resolved.", id);
+	if (t->block[id])
+		return t->block[id];
+
+	pthread_mutex_lock(&tls_lock);
+	so_module *mod = tls_mods[id];
+	if (!mod)
+		fatal_error("Error TLS access to module id %u, it is not loaded.", id);
+
+	uintptr_t block;
+	if (mod->tls_offset) {
+		block = (uintptr_t)t->tcb + mod->tls_offset;
+	} else {
+		t->dynamic[id] = malloc(mod->tls_memsz + mod->tls_align);
+		if (!t->dynamic[id])
+			fatal_error("Error could not allocate the TLS block of %s.", mod->soname);
+		block = ALIGN_MEM((uintptr_t)t->dynamic[id], mod->tls_align);
+	}
+	memcpy((void *)block, (void *)mod->tls_image, mod->tls_filesz);
+	memset((void *)(block + mod->tls_filesz), 0, mod->tls_memsz - mod->tls_filesz);
+	t->gen[id] = tls_gen[id];
+	t->block[id] = block;
+	pthread_mutex_unlock(&tls_lock);
+
+	__atomic_add_fetch(&tls_stats.blocks, 1, __ATOMIC_RELAXED);
+	return block;
+}
+
+// Hot path: one key lookup and the block the thread already has
+void *so_tls_get_addr(so_tls_index *ti) {
+	so_tls_thread *t;
+	if (tls_ready && (t = (so_tls_thread *)pthread_getspecific(tls_key)) &&
+		t->generation == tls_generation && ti->module - 1 < TLS_MODULES && t->block[ti->module])
+		return (void *)(t->block[ti->module] + ti->offset);
+
+	return (void *)(so_tls_block(so_tls_thread_get(), ti->module) + ti->offset);
+}
+
+// Code reaching its variables from the thread pointer may touch any static
+// block without asking first, they are all set up before it gets it
+uintptr_t so_tls_thread_pointer(void) {
+	so_tls_thread *t;
+	if (tls_ready && (t = (so_tls_thread *)pthread_getspecific(tls_key)) && t->generation == tls_generation && t->block[0])
+		return (uintptr_t)t->tcb;
+
+	t = so_tls_thread_get();
+	for (int id = 1; id <= TLS_MODULES; id++) {
+		so_module *mod = tls_mods[id];
+		if (mod && mod->tls_offset)
+			so_tls_block(t, id);
+	}
+	t->block[0] = (uintptr_t)t->tcb; // static blocks are all in
+	return (uintptr_t)t->tcb;
+}
+
+#ifdef __arm__
+// Callers only expect r0 to change, and the first call of a thread runs C code
+// that may use any VFP register, so these are kept as well
+__attribute__((naked)) void so_tls_read_tp(void) {
+	asm volatile(
+		"push {r1-r4, ip, lr}\n"
+		"vpush {d0-d7}\n"
+		"vpush {d16-d31}\n"
+		"vmrs r4, fpscr\n"
+		"bl so_tls_thread_pointer\n"
+		"vmsr fpscr, r4\n"
+		"vpop {d16-d31}\n"
+		"vpop {d0-d7}\n"
+		"pop {r1-r4, ip, pc}\n"
+	);
+}
+#else
+void so_tls_read_tp(void) {
+	so_tls_thread_pointer();
+}
+#endif
+
+void so_tls_stats_get(so_tls_stats *stats) {
+	pthread_mutex_lock(&tls_lock);
+	*stats = tls_stats;
+	pthread_mutex_unlock(&tls_lock);
+}
+
+void so_tls_report(void) {
+	so_tls_stats stats;
+	so_tls_stats_get(&stats);
+	if (!stats.modules)
+		return;
+
+	printf("TLS: %d modules, %u of %u static bytes, %d threads, %d blocks set up\n",
+		stats.modules, (unsigned)stats.static_used, (unsigned)(sizeof(((so_tls_thread *)0)->tcb) + TLS_STATIC_SIZE), stats.threads, stats.blocks);
+}
@@ -0,0 +1,37 @@
+#ifndef __TLS_H__
+#define __TLS_H__
+
+#include "so_util.h"
+
+#define TLS_MODULES 16          // modules with a PT_TLS segment loaded at once, ids are 1 based
+#define TLS_STATIC_SIZE 0x2000  // static blocks per thread, what TPOFF32 relocations can reach
+#define TLS_ALIGN_MAX 64        // blocks aligned past this only get a dynamic one
+
+// What a __tls_get_addr call is given, a GOT pair filled by R_ARM_TLS_DTPMOD32
+// and R_ARM_TLS_DTPOFF32
+typedef struct {
+  uint32_t module;
+  uint32_t offset;
+} so_tls_index;
+
+typedef struct {
+  int modules;
+  size_t static_used;
+  int threads;       // threads that touched TLS so far
+  int blocks;        // module blocks set up across them
+} so_tls_stats;
+
+// Gives a module with a PT_TLS segment its id and, as long as there is room,
+// a static offset from the thread pointer. A module mapped back from a
+// snapshot gets the ones it had, its relocations carry them already.
+void so_tls_register(so_module *mod);
+void so_tls_unregister(so_module *mod);
+// Per thread blocks are set up on first use, in whatever thread it happens
+void *so_tls_get_addr(so_tls_index *ti);
+uintptr_t so_tls_thread_pointer(void);
+// __aeabi_read_tp for code built with -mtp=soft, only r0 is clobbered
+void so_tls_read_tp(void);
+void so_tls_stats_get(so_tls_stats *stats);
+void so_tls_report(void);
+
+#endif
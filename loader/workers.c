@@ -0,0 +1,83 @@
+/* workers.c -- small pool of threads used to split up loader work
+ *
+ * Copyright (C) 2022 Rinnegatamante
+ *
+ * This software may be modified and distributed under the terms
+ * of the MIT license.	See the LICENSE file for details.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "workers.h"
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static int num_helpers = 0;    // threads spawned so far, they are kept around for later runs
+static int active_helpers = 0; // how many of them take part in the current run
+static void (*job_fn)(void *arg, int job);
+static void *job_arg;
+static int next_job = 0, num_jobs = 0, jobs_done = 0;
+
+static void *worker_thread(void *id) {
+	pthread_mutex_lock(&lock);
+	for (;;) {
+		while (next_job >= num_jobs || (int)(intptr_t)id >= active_helpers)
+			pthread_cond_wait(&work_cond, &lock);
+
+		int job = next_job++;
+		pthread_mutex_unlock(&lock);
+		job_fn(job_arg, job);
+		pthread_mutex_lock(&lock);
+
+		if (++jobs_done == num_jobs)
+			pthread_cond_signal(&done_cond);
+	}
+
+	return NULL;
+}
+
+int workers_run(int num_threads, int jobs, void (*fn)(void *arg, int job), void *arg) {
+	if (num_threads > MAX_WORKERS)
+		num_threads = MAX_WORKERS;
+
+	pthread_mutex_lock(&lock);
+
+	while (num_helpers < num_threads - 1) {
+		pthread_t t;
+		if (pthread_create(&t, NULL, worker_thread, (void *)(intptr_t)num_helpers) != 0)
+			break;
+		pthread_detach(t);
+		num_helpers++;
+	}
+
+	job_fn = fn;
+	job_arg = arg;
+	next_job = 0;
+	jobs_done = 0;
+	num_jobs = jobs;
+	active_helpers = num_threads - 1 < num_helpers ? num_threads - 1 : num_helpers;
+	pthread_cond_broadcast(&work_cond);
+
+	// The caller works through the queue as well
+	while (next_job < num_jobs) {
+		int job = next_job++;
+		pthread_mutex_unlock(&lock);
+		fn(arg, job);
+		pthread_mutex_lock(&lock);
+		jobs_done++;
+	}
+
+	while (jobs_done < num_jobs)
+		pthread_cond_wait(&done_cond, &lock);
+
+	int threads = active_helpers + 1;
+	num_jobs = 0;
+	next_job = 0;
+	active_helpers = 0;
+	pthread_mutex_unlock(&lock);
+
+	return threads;
+}
@@ -0,0 +1,10 @@
+#ifndef __WORKERS_H__
+#define __WORKERS_H__
+
+#define MAX_WORKERS 8
+
+// Runs fn(arg, 0) .. fn(arg, num_jobs - 1) on up to num_threads threads,
+// the calling one included, and returns once all of them are done
+int workers_run(int num_threads, int num_jobs, void (*fn)(void *arg, int job), void *arg);
+
+#endif